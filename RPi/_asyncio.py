@@ -0,0 +1,113 @@
+# Copyright (c) 2013 Ben Croston
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+# of the Software, and to permit persons to whom the Software is furnished to do
+# so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+"""asyncio support behind GPIO.edge() and GPIO.events(), Python 3.5 and later.
+setup.py leaves this module out of Python 2 installs.
+
+The event stream of the extension (GPIO.event_fd() / GPIO.read_events()) is
+watched with loop.add_reader(), so events reach coroutines on the event loop
+thread without any extra threads.
+"""
+
+import asyncio
+from RPi import GPIO
+
+_readers = {}
+
+# only called from coroutines, get_event_loop() is deprecated there
+_running_loop = getattr(asyncio, 'get_running_loop', asyncio.get_event_loop)   # 3.7 and later
+
+
+class _Reader(object):
+    """Reads the event stream on one event loop and hands events to the waiters"""
+
+    def __init__(self, loop):
+        self.loop = loop
+        self.fd = GPIO.event_fd()
+        self.waiters = {}   # channel, or None for all channels -> list of functions taking an event
+        loop.add_reader(self.fd, self.read)
+
+    def read(self):
+        events = GPIO.read_events(256)
+        while events:
+            for ev in events:
+                for key in (ev[0], None):
+                    for waiter in list(self.waiters.get(key, ())):
+                        waiter(ev)
+            events = GPIO.read_events(256)
+
+    def add(self, channel, waiter):
+        self.waiters.setdefault(channel, []).append(waiter)
+
+    def remove(self, channel, waiter):
+        self.waiters[channel].remove(waiter)
+        if not self.waiters[channel]:
+            del self.waiters[channel]
+
+
+def _reader():
+    loop = _running_loop()
+    reader = _readers.get(loop)
+    if reader is None or reader.fd != GPIO.event_fd():
+        if reader is not None:
+            loop.remove_reader(reader.fd)
+        reader = _readers[loop] = _Reader(loop)
+    return reader
+
+
+async def edge(channel, timeout=None):
+    reader = _reader()
+    future = reader.loop.create_future()
+
+    def waiter(ev):
+        if not future.done():
+            future.set_result(ev)
+
+    reader.add(channel, waiter)
+    try:
+        return await asyncio.wait_for(future, timeout)
+    except asyncio.TimeoutError:
+        return None
+    finally:
+        reader.remove(channel, waiter)
+
+
+class events(object):
+    """Asynchronous iterator of the events of a channel, or of all channels for None"""
+
+    def __init__(self, channel=None):
+        self.channel = channel
+        self.reader = None
+        self.queue = None
+
+    def __aiter__(self):
+        if self.reader is None:
+            self.reader = _reader()
+            self.queue = asyncio.Queue()    # made on the running loop
+            self.reader.add(self.channel, self.queue.put_nowait)
+        return self
+
+    async def __anext__(self):
+        return await self.queue.get()
+
+    def close(self):
+        if self.reader is not None:
+            self.reader.remove(self.channel, self.queue.put_nowait)
+            self.reader = None
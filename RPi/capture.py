@@ -0,0 +1,93 @@
+# Copyright (c) 2013 Ben Croston
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+# of the Software, and to permit persons to whom the Software is furnished to do
+# so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+"""Helpers for the logic analyser captures returned by GPIO.sampler_data().
+
+A capture holds one 32 bit word of the levels of GPIO 0-31 per sample, or with
+SAMPLER_RLE a (samples since the entry before, levels) pair per change.
+GPIO.sampler_save_vcd() writes a value change dump, to_sigrok() a sigrok
+session file that PulseView and sigrok-cli open directly.
+"""
+
+import struct
+import zipfile
+
+SAMPLER_RLE = 1
+CHUNK = 1 << 22     # bytes per sample file in a sigrok session
+
+def runs(capture):
+    """Yields (levels, samples) for each run of unchanged levels in a capture"""
+    entries = memoryview(capture).tolist()
+    if capture.encoding == SAMPLER_RLE:
+        position = 0
+        for i, (delta, levels) in enumerate(entries):
+            if i > 0:
+                yield previous, delta
+            position += delta
+            previous = levels
+        if entries:
+            yield previous, capture.span - position
+    else:
+        count = 0
+        for levels in entries:
+            if count and levels != previous:
+                yield previous, count
+                count = 0
+            previous = levels
+            count += 1
+        if count:
+            yield previous, count
+
+def transitions(capture):
+    """Yields (sample, levels) for the first sample and every change of the levels"""
+    sample = 0
+    for levels, count in runs(capture):
+        yield sample, levels
+        sample += count
+
+def samplerate(rate):
+    for divisor, unit in ((1000000, 'MHz'), (1000, 'kHz')):
+        if rate % divisor == 0:
+            return '%d %s'%(rate // divisor, unit)
+    return '%d Hz'%rate
+
+def to_sigrok(capture, path):
+    """Writes a capture to a sigrok session file (.sr) with probes gpio0 to gpio31"""
+    with zipfile.ZipFile(path, 'w', zipfile.ZIP_DEFLATED) as sr:
+        sr.writestr('version', '2')
+        metadata = ['[global]', 'sigrok version=0.5.1', '', '[device 1]', 'capturefile=logic-1',
+                    'total probes=32', 'samplerate=%s'%samplerate(capture.rate), 'total analog=0', 'unitsize=4']
+        metadata += ['probe%d=gpio%d'%(gpio + 1, gpio) for gpio in range(32)]
+        sr.writestr('metadata', '\n'.join(metadata) + '\n')
+
+        chunk = bytearray()
+        chunks = 0
+        for levels, count in runs(capture):
+            word = struct.pack('<I', levels)
+            while count:
+                n = min(count, (CHUNK - len(chunk)) // 4)
+                chunk += word * n
+                count -= n
+                if len(chunk) >= CHUNK:
+                    chunks += 1
+                    sr.writestr('logic-1-%d'%chunks, bytes(chunk))
+                    chunk = bytearray()
+        if chunk or chunks == 0:
+            sr.writestr('logic-1-%d'%(chunks + 1), bytes(chunk))
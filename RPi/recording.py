@@ -0,0 +1,85 @@
+# Copyright (c) 2013 Ben Croston
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of
+# this software and associated documentation files (the "Software"), to deal in
+# the Software without restriction, including without limitation the rights to
+# use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+# of the Software, and to permit persons to whom the Software is furnished to do
+# so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+"""Reader for the edge recordings written by GPIO.record_start().
+
+A recording is a set of segment files <path>.000000, <path>.000001, ... each
+holding a 64 byte header and fixed size records, see source/event_record.h.
+Segments deleted by rotation are skipped.
+
+Convert a recording to CSV with:
+    python -m RPi.recording <path> [output.csv]
+"""
+
+import os
+import struct
+import sys
+
+MAGIC = b'RPIGPIOR'
+VERSION = 1
+HEADER = struct.Struct('=8sIIQQQ24x')
+RECORD = struct.Struct('=QIBBH')
+
+def segments(path):
+    """Returns the segment file names of a recording, in order"""
+    directory, base = os.path.split(path)
+    found = []
+    for name in os.listdir(directory or '.'):
+        if name.startswith(base + '.') and name[len(base) + 1:].isdigit():
+            found.append((int(name[len(base) + 1:]), os.path.join(directory, name)))
+    return [name for sequence, name in sorted(found)]
+
+def read(path):
+    """Yields (gpio, level, timestamp, count) for each recorded edge, timestamps in us"""
+    for name in segments(path):
+        with open(name, 'rb') as f:
+            data = f.read()
+        if len(data) < HEADER.size:
+            continue
+        magic, version, record_size, sequence, capacity, count = HEADER.unpack_from(data)
+        if magic != MAGIC or version != VERSION or record_size != RECORD.size:
+            raise ValueError('%s is not a recording segment'%name)
+        for i in range(min(count, (len(data) - HEADER.size) // RECORD.size)):
+            timestamp, n, gpio, level, reserved = RECORD.unpack_from(data, HEADER.size + i * RECORD.size)
+            yield gpio, level, timestamp, n
+
+def to_csv(path, out):
+    """Writes a recording to the file object out as CSV"""
+    out.write('timestamp,gpio,level,count\n')
+    for gpio, level, timestamp, count in read(path):
+        out.write('%d,%d,%d,%d\n'%(timestamp, gpio, level, count))
+
+def main(argv=None):
+    argv = sys.argv[1:] if argv is None else argv
+    if len(argv) not in (1, 2):
+        sys.stderr.write('usage: python -m RPi.recording <path> [output.csv]\n')
+        return 2
+    if not segments(argv[0]):
+        sys.stderr.write('no recording found at %s\n'%argv[0])
+        return 1
+    if len(argv) == 2:
+        with open(argv[1], 'w') as out:
+            to_csv(argv[0], out)
+    else:
+        to_csv(argv[0], sys.stdout)
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -48,6 +48,37 @@ Constants in the module table
 @field RISING Event edge-type detection, see event functions
 @field FALLING Event edge-type detection, see event functions
 @field BOTH Event edge-type detection, see event functions
+@field SYNTH_FIXED Synthetic edge schedule, see `simulate_events`
+@field SYNTH_BURST Synthetic edge schedule, see `simulate_events`
+@field SYNTH_POISSON Synthetic edge schedule, see `simulate_events`
+@field SYNTH_SQUARE Synthetic edge schedule, see `simulate_events`
+@field DROP_OLDEST Callback queue overflow policy, see `set_callback_executor`
+@field DROP_NEWEST Callback queue overflow policy, see `set_callback_executor`
+@field COALESCE Callback queue overflow policy, see `set_callback_executor`
+@field SAMPLER_IDLE Logic analyser state, see `sampler_state`
+@field SAMPLER_ARMED Logic analyser state, see `sampler_state`
+@field SAMPLER_TRIGGERED Logic analyser state, see `sampler_state`
+@field SAMPLER_DONE Logic analyser state, see `sampler_state`
+@field SAMPLER_RAW Logic analyser encoding, see `sampler_start`
+@field SAMPLER_RLE Logic analyser encoding, see `sampler_start`
+@field DECODE_DATA Decoded frame type, see `decode_uart`
+@field DECODE_START Decoded frame type, see `decode_i2c`
+@field DECODE_STOP Decoded frame type, see `decode_i2c`
+@field DECODE_ADDRESS Decoded frame type, see `decode_i2c`
+@field DECODE_RESET Decoded frame type, see `decode_onewire`
+@field DECODE_PARITY_ERROR Decoded frame flag, see `decode_uart`
+@field DECODE_FRAMING_ERROR Decoded frame flag, see `decode_uart`
+@field DECODE_NACK Decoded frame flag, see `decode_i2c`
+@field DECODE_INCOMPLETE Decoded frame flag, the capture ended or chip select rose within the frame
+@field DECODE_PRESENCE Decoded frame flag, see `decode_onewire`
+@field THREAD_POLL Edge detection thread, see `set_thread_config`
+@field THREAD_PWM Software PWM threads, see `set_thread_config`
+@field THREAD_EXECUTOR Callback executor threads, see `set_thread_config`
+@field THREAD_SERVICE Timed output, waveform and timer threads, see `set_thread_config`
+@field THREAD_ALL All threads of the module, see `set_thread_config`
+@field SCHED_OTHER Scheduling policy, see `set_thread_config`
+@field SCHED_FIFO Scheduling policy, see `set_thread_config`
+@field SCHED_RR Scheduling policy, see `set_thread_config`
 @table constants
 */
 
@@ -56,10 +87,15 @@ Constants in the module table
 #define LUA_EVENT_CONST_OFFSET 30
 // Name for PWM objects metatable
 #define PWM_MT_NAME "RPI-GPIO PWM MT"
+#define RECORDING_MT_NAME "RPI-GPIO RECORDING MT"
+#define WAVEFORM_MT_NAME "RPI-GPIO WAVEFORM MT"
+#define TIMER_MT_NAME "RPI-GPIO TIMER MT"
+#define PIN_MT_NAME "RPI-GPIO PIN MT"
 // Name for callback table
 #define RPI_CBT_NAME "RPI-GPIO CBT"
 
 
+#include <pthread.h>
 #include <errno.h>
 #include <string.h>
 
@@ -71,10 +107,28 @@ Constants in the module table
 
 #include "c_gpio.h"
 #include "event_gpio.h"
+#include "event_synth.h"
+#include "event_filter.h"
+#include "event_queue.h"
+#include "event_burst.h"
+#include "event_wait.h"
+#include "event_count.h"
+#include "event_measure.h"
+#include "event_reflex.h"
+#include "event_pattern.h"
+#include "event_stats.h"
+#include "trace.h"
+#include "event_record.h"
+#include "event_replay.h"
+#include "event_timer.h"
+#include "rt_thread.h"
+#include "sampler.h"
+#include "decode.h"
+#include "output_sched.h"
+#include "waveform.h"
 #include "cpuinfo.h"
 #include "common.h"
 #include "soft_pwm.h"
-#include "sys/time.h"
 #include "stdlib.h"
 
 typedef struct
@@ -88,20 +142,26 @@ typedef struct
 {
     unsigned int gpio;
     int cb_ref;
+    int burst;              // deliver the burst fields of ev as well
+   int pattern;            // ev is a pattern entry or exit
+   int timer;              // ev is a timer tick
+   int timestamped;        // deliver the timestamp, level, edge, sequence and count of ev as well
+    struct gpio_event ev;
 } dss_data;
 
 struct lua_callback
 {
    unsigned int gpio;
    int cb_ref;  // int value, key in the table named RPI_CB_NAME in registry
-   unsigned long long lastcall;
-   unsigned int bouncetime;
+   int timestamped;
    struct lua_callback *next;
 };
 
 // start of linked list with callbacks
 // TODO: static; hence lib can be used from only 1 Lua state!!!!!
 static struct lua_callback *lua_callbacks = NULL;
+// the executor threads walk the list while Lua adds and removes callbacks
+static pthread_mutex_t lua_callback_lock = PTHREAD_MUTEX_INITIALIZER;
 static void* lua_dss_utilid = NULL;
 
 int gpio_mode = MODE_UNKNOWN;
@@ -187,6 +247,33 @@ static int lua_setwarnings(lua_State *L)
    return 0;
 }
   
+// gets an optional numeric field from the table at index, or the default if absent
+static lua_Number lua_get_opt_field(lua_State* L, int index, const char* name, lua_Number def)
+{
+   lua_Number value = def;
+
+   lua_getfield(L, index, name);
+   if (!lua_isnil(L, -1))
+   {
+      if (!lua_isnumber(L, -1))
+         return (lua_Number)luaL_error(L, "Field '%s' must be a number", name);
+      value = lua_tonumber(L, -1);
+   }
+   lua_pop(L, 1);
+   return value;
+}
+
+// gets an optional boolean field from the table at index, false if absent
+static int lua_get_opt_bool(lua_State* L, int index, const char* name)
+{
+   int value;
+
+   lua_getfield(L, index, name);
+   value = lua_toboolean(L, -1);
+   lua_pop(L, 1);
+   return value;
+}
+
 // check a HIGH/LOW value on the position, using Lua boolean check
 // as True, but ALSO accepts 0 as false
 // ALso checks number of parameters
@@ -348,12 +435,14 @@ void dss_cancel(void* utilid)
 // removes all callbacks for the given gpio number
 void remove_lua_callbacks(lua_State* L, unsigned int gpio)
 {
-   struct lua_callback *cb = lua_callbacks;
+   struct lua_callback *cb;
    struct lua_callback *temp;
    struct lua_callback *prev = NULL;
 
    lua_getfield(L, LUA_REGISTRYINDEX, RPI_CBT_NAME);
    // remove all lua callbacks for gpio
+   pthread_mutex_lock(&lua_callback_lock);
+   cb = lua_callbacks;
    while (cb != NULL)
    {
       if (cb->gpio == gpio)
@@ -371,9 +460,44 @@ void remove_lua_callbacks(lua_State* L, unsigned int gpio)
          cb = cb->next;
       }
    }   
+   pthread_mutex_unlock(&lua_callback_lock);
    lua_pop(L, 1);
 }
 
+// a waveform, its steps are played from the Lua string they were given in, without copying
+typedef struct
+{
+   struct waveform w;
+   int steps_ref;   // registry reference keeping the string alive
+} WaveformObject;
+
+// waveforms handed to the player, registry references keep them alive until it is done with them
+static WaveformObject *in_player[3] = {NULL, NULL, NULL};
+static int in_player_ref[3] = {LUA_NOREF, LUA_NOREF, LUA_NOREF};
+
+static void lua_waveform_reap(lua_State* L)
+{
+   int i;
+
+   for (i = 0; i < 3; i++)
+   {
+      if (in_player[i] != NULL && !wave_in_use(&in_player[i]->w))
+      {
+         luaL_unref(L, LUA_REGISTRYINDEX, in_player_ref[i]);
+         in_player[i] = NULL;
+         in_player_ref[i] = LUA_NOREF;
+      }
+   }
+}
+
+typedef struct
+{
+   int id;   // -1 once cancelled
+} TimerObject;
+
+// the running timers by id
+static TimerObject *timer_objects[TIMER_MAX];
+
 /***
 Cleans up the modules' running operations. It will set all pins configured before to input.
 @function cleanup
@@ -385,6 +509,18 @@ static int lua_cleanup(lua_State* L)
 
     // clean up any /sys/class exports
     event_cleanup();
+    lua_waveform_reap(L);
+    for (i=0; i<PATTERN_MAX; i++)
+      remove_lua_callbacks(L, PATTERN_GPIO + i);
+    for (i=0; i<TIMER_MAX; i++)
+    {
+      remove_lua_callbacks(L, TIMER_GPIO + i);
+      if (timer_objects[i] != NULL)
+      {
+         timer_objects[i]->id = -1;
+         timer_objects[i] = NULL;
+      }
+    }
 
     // set everything back to input
     for (i=0; i<54; i++)
@@ -616,58 +752,118 @@ static int dss_decode(lua_State *L, void* TheData, void* utilid)
       if (!lua_isfunction(L, -1) && gpio_warnings)
          fprintf(stderr, "Event received, but callback was not found!\n");
       lua_remove(L, -2);                                  // drop the callback table
-      lua_pushinteger(L, (int)(chan_from_gpio(pData->gpio)));  // add the channel nr
-      result = 2;  // 1 = lua CB function, 2 = channel
+      if (pData->timer)
+      {
+         lua_pushnumber(L, (lua_Number)pData->ev.timestamp);
+         result = 2;  // 2 = timestamp the tick was due
+      }
+      else if (pData->pattern)
+      {
+         lua_pushinteger(L, (int)(pData->gpio - PATTERN_GPIO));
+         lua_pushboolean(L, pData->ev.level);
+         lua_pushnumber(L, (lua_Number)pData->ev.timestamp);
+         result = 4;  // 2 = pattern id, 3 = matched, 4 = timestamp
+      }
+      else
+      {
+         lua_pushinteger(L, (int)(chan_from_gpio(pData->gpio)));  // add the channel nr
+         result = 2;  // 1 = lua CB function, 2 = channel
+         if (pData->timestamped)
+         {
+            lua_pushnumber(L, (lua_Number)pData->ev.timestamp);
+            lua_pushboolean(L, pData->ev.level);
+            lua_pushinteger(L, (pData->ev.level ? RISING_EDGE : FALLING_EDGE) + LUA_EVENT_CONST_OFFSET);
+            lua_pushnumber(L, pData->ev.seq);
+            lua_pushnumber(L, pData->ev.count);
+            result = 7;  // 3 = timestamp, 4 = level, 5 = edge, 6 = sequence number, 7 = count
+         }
+         else if (pData->burst)
+         {
+            lua_pushnumber(L, pData->ev.count);
+            lua_pushnumber(L, (lua_Number)pData->ev.first);
+            lua_pushnumber(L, (lua_Number)pData->ev.timestamp);
+            lua_pushinteger(L, pData->ev.level);
+            result = 6;  // 3 = count, 4 = first, 5 = last, 6 = level
+         }
+      }
    }
    free(pData);
    return result;
 }
 
-// callback function execution
-static void run_lua_callbacks(unsigned int gpio)
+// callback function execution, switch bounce is handled by the event filter
+static void run_lua_callbacks(struct gpio_event *ev)
 {
-   struct lua_callback *cb = lua_callbacks;
-   struct timeval tv_timenow;
-   unsigned long long timenow;
+   struct lua_callback *cb;
+   int timer = ev->gpio >= TIMER_GPIO;
+   int pattern = !timer && ev->gpio >= PATTERN_GPIO;
+   int burst = !pattern && !timer && event_burst_enabled(ev->gpio);
    dss_data *pData;
 
+   pthread_mutex_lock(&lua_callback_lock);
+   cb = lua_callbacks;
    while (cb != NULL)
    {
-      if (cb->gpio == gpio)
+      if (cb->gpio == ev->gpio)
       {
-         gettimeofday(&tv_timenow, NULL);
-         timenow = tv_timenow.tv_sec*1E6 + tv_timenow.tv_usec;
-         if (cb->bouncetime == 0 || timenow - cb->lastcall > cb->bouncetime*1000 || cb->lastcall == 0 || cb->lastcall > timenow) {
-            if (lua_dss_utilid != NULL)
+         if (lua_dss_utilid != NULL)
+         {
+            // create a copy of the data
+            pData = malloc(sizeof(dss_data));
+            if (pData != NULL)
             {
-               // create a copy of the data
-               pData = malloc(sizeof(dss_data));
-               if (pData != NULL)
-               {
-                  pData->cb_ref = cb->cb_ref;
-                  pData->gpio = gpio;
-                  DSS_deliver(lua_dss_utilid, &dss_decode, NULL, pData);
-               }
-               else
-               {
-                  // TODO malloc failed, stay silent or some error?
-               }
+               pData->cb_ref = cb->cb_ref;
+               pData->gpio = ev->gpio;
+               pData->burst = burst;
+               pData->pattern = pattern;
+               pData->timer = timer;
+               pData->timestamped = cb->timestamped;
+               pData->ev = *ev;
+               DSS_deliver(lua_dss_utilid, &dss_decode, NULL, pData);
             }
             else
             {
-               // TODO we can't deliver, stay silent? or some error?
+               // TODO malloc failed, stay silent or some error?
             }
          }
-         cb->lastcall = timenow;
+         else
+         {
+            // TODO we can't deliver, stay silent? or some error?
+         }
       }
       cb = cb->next;
    }
+   pthread_mutex_unlock(&lua_callback_lock);
+}
+
+// sets the switch bounce lockout of the event filter for a gpio, bouncetime in ms
+static void set_bouncetime(unsigned int gpio, unsigned int bouncetime)
+{
+   struct event_filter filter;
+
+   get_event_filter(gpio, &filter);
+   filter.lockout = bouncetime * 1000;
+   set_event_filter(gpio, &filter);
+}
+
+// sets burst coalescing and counting for a gpio from the burstwindow, burstcount and counting fields of an options table
+static void set_burst(lua_State* L, unsigned int gpio, int idx)
+{
+   struct event_burst burst = {0, 0};
+
+   if (idx != 0)
+   {
+      burst.window = (unsigned int)lua_get_opt_field(L, idx, "burstwindow", 0);
+      burst.count = (unsigned int)lua_get_opt_field(L, idx, "burstcount", 0);
+      set_event_counting(gpio, lua_get_opt_bool(L, idx, "counting"));
+   }
+   set_event_burst(gpio, &burst);
 }
 
-void add_lua_callback(lua_State* L, unsigned int gpio, unsigned int bouncetime, int cb_index)  //NOTE: params will not be checked!
+void add_lua_callback(lua_State* L, unsigned int gpio, int cb_index, int timestamped)  //NOTE: params will not be checked!
 {
    struct lua_callback *new_lua_cb;
-   struct lua_callback *cb = lua_callbacks;
+   struct lua_callback *cb;
 
    if (lua_dss_utilid == NULL)  // check if DarkSideSync is available
    {
@@ -686,17 +882,19 @@ void add_lua_callback(lua_State* L, unsigned int gpio, unsigned int bouncetime,
    lua_pushvalue(L, cb_index);                         // copy callback to top of stack
    new_lua_cb->cb_ref = luaL_ref(L, -2);               // store it and get its unique index
    new_lua_cb->gpio = gpio;
-   new_lua_cb->lastcall = 0;
-   new_lua_cb->bouncetime = bouncetime;
+   new_lua_cb->timestamped = timestamped;
    new_lua_cb->next = NULL;
+   pthread_mutex_lock(&lua_callback_lock);
    if (lua_callbacks == NULL) {
       lua_callbacks = new_lua_cb;
    } else {
       // add to end of list
+      cb = lua_callbacks;
       while (cb->next != NULL)
          cb = cb->next;
       cb->next = new_lua_cb;
    }
+   pthread_mutex_unlock(&lua_callback_lock);
    add_edge_callback(gpio, run_lua_callbacks);
    lua_pop(L, 1);   
 }
@@ -712,7 +910,10 @@ Adds an event callback function. Using this function requires the helper library
 @function add_event_callback
 @param channel channel/pin for which to call the callback (see `setmode`)
 @param callback Callback function to call (a single parameter, the channel number, will be passed to the callback)
-@param bouncetime (optional) minimum time between two callbacks in milliseconds (intermediate events will be ignored)
+@param bouncetime (optional) minimum time between two events in milliseconds (intermediate events will be ignored), applies to all events of the channel
+@param timestamped (optional) `true` to pass the channel, the timestamp of the edge in microseconds (monotonic clock),
+the level (boolean), the edge (`RISING` or `FALLING`), the sequence number of the event on the channel (gaps are lost
+events) and the number of edges it stands for to the callback
 */
 static int lua_add_event_callback(lua_State* L)
 {
@@ -721,7 +922,7 @@ static int lua_add_event_callback(lua_State* L)
 
    luaL_checktype(L, 2, LUA_TFUNCTION);
 
-   if (lua_gettop(L) > 2) 
+   if (lua_gettop(L) > 2 && !lua_isnil(L, 3))
    {
       bouncetime = (unsigned int)luaL_checkint(L, 3);
       if (bouncetime < 0 || bouncetime > 60000)
@@ -735,7 +936,12 @@ static int lua_add_event_callback(lua_State* L)
    if (!gpio_event_added(gpio))
       return luaL_error(L, "Add event detection using add_event_detect first before adding a callback");
 
-   add_lua_callback(L, gpio, (unsigned int)bouncetime, 2);
+   if (event_counting(gpio))
+      return luaL_error(L, "Events of this GPIO channel are counted, callbacks can not be added");
+
+   add_lua_callback(L, gpio, 2, lua_toboolean(L, 4));
+   if (bouncetime > 0)
+      set_bouncetime(gpio, bouncetime);
    return 0;
 }
 
@@ -745,7 +951,16 @@ Adds event detection for a pin. Using this function with a callback (which is op
 @param channel channel/pin to detect events for (see `setmode`)
 @param edge What type of edge to catch events for. Either `RISING`, `FALLING` or `BOTH`.
 @param callback (optional) Callback function to call on the event (a single parameter, the channel number, will be passed to the callback). More can be added using `add_event_callback`.
-@param bouncetime (optional) minimum time between two callbacks in milliseconds (intermediate events will be ignored)
+@param bouncetime (optional) minimum time between two events in milliseconds (intermediate events will be ignored)
+@param options (optional) table with additional filter settings, fields (all optional);
+`stabletime` (time in microseconds the new level must hold before an edge is accepted),
+`minpulse` (pulses shorter than this time in microseconds are ignored, both of their edges; other edges are delayed by it),
+`burstwindow` (coalesce edges into one callback per window of this many microseconds),
+`burstcount` (coalesce edges into one callback per this many edges). With a burst setting the callback receives
+the channel, the number of edges, the timestamps of the first and last edge in microseconds and the final level.
+`counting` (`true` to only count the edges, see `count`; no callback can be used),
+`timestamped` (`true` to pass the callback the timestamp, level, edge, sequence number and count of the event, see
+`add_event_callback`; takes precedence over the burst fields)
 */
 static int lua_add_event_detect(lua_State* L)
 {
@@ -753,6 +968,7 @@ static int lua_add_event_detect(lua_State* L)
    int edge = luaL_checkint(L, 2);
    int result;
    unsigned int bouncetime = 0;
+   struct event_filter filter = {0, 0, 0};
 
    if (lua_gettop(L) > 2) 
    {
@@ -767,6 +983,15 @@ static int lua_add_event_detect(lua_State* L)
          luaL_error(L, "Bouncetime must be a value from 0 to 60000");
    }
 
+   if (lua_gettop(L) > 4 && !lua_isnil(L, 5))
+   {
+      luaL_checktype(L, 5, LUA_TTABLE);
+      filter.stable = (unsigned int)lua_get_opt_field(L, 5, "stabletime", 0);
+      filter.min_pulse = (unsigned int)lua_get_opt_field(L, 5, "minpulse", 0);
+      if (lua_get_opt_bool(L, 5, "counting") && lua_gettop(L) > 2 && !lua_isnil(L, 3))
+         return luaL_error(L, "A callback can not be used with counting");
+   }
+
    // check channel is set up as an input
    if (gpio_direction[gpio] != INPUT)
       return luaL_error(L, "You must setup() the GPIO channel as an input first");
@@ -786,12 +1011,121 @@ static int lua_add_event_detect(lua_State* L)
       }
    }
 
-   if (!lua_isnil(L, 3))
-      add_lua_callback(L, gpio, bouncetime, 3);
+   filter.lockout = bouncetime * 1000;
+   set_event_filter(gpio, &filter);
+   set_burst(L, gpio, (lua_gettop(L) > 4 && !lua_isnil(L, 5)) ? 5 : 0);
+
+   if (lua_gettop(L) > 2 && !lua_isnil(L, 3))
+      add_lua_callback(L, gpio, 3, lua_gettop(L) > 4 && !lua_isnil(L, 5) && lua_get_opt_bool(L, 5, "timestamped"));
+
+   return 0;
+}
+
+/***
+Adds event detection for a pin, fed by a synthetic edge generator instead of the pin itself. Useful for
+load testing callbacks without a signal source. Remove it again using `remove_event_detect`.
+@function simulate_events
+@param channel channel/pin to generate events for (see `setmode`)
+@param edge What type of edge to catch events for. Either `RISING`, `FALLING` or `BOTH`.
+@param schedule (optional) table with the edge schedule, fields (all optional);
+`schedule` (`SYNTH_FIXED` (default), `SYNTH_BURST`, `SYNTH_POISSON` or `SYNTH_SQUARE`),
+`interval` (time between edges in microseconds, default 1000, the mean time for `SYNTH_POISSON` and half period for `SYNTH_SQUARE`),
+`burst` (edges per burst for `SYNTH_BURST`), `gap` (idle time between bursts in microseconds for `SYNTH_BURST`),
+`jitter` (maximum edge displacement in microseconds for `SYNTH_SQUARE`), `count` (number of edges to generate, default 0 for unlimited),
+`stabletime`, `minpulse`, `burstwindow`, `burstcount`, `counting` and `timestamped` (filter, burst, counting and
+callback settings, see `add_event_detect`)
+@param callback (optional) Callback function to call on the event, see `add_event_detect`
+@param bouncetime (optional) minimum time between two events in milliseconds (intermediate events will be ignored)
+*/
+static int lua_simulate_events(lua_State* L)
+{
+   unsigned int gpio = lua_get_gpio_number(L, luaL_checkint(L, 1));
+   int edge = luaL_checkint(L, 2);
+   int result;
+   unsigned int bouncetime = 0;
+   struct synth_schedule sched = {SYNTH_FIXED, 1000, 1, 0, 0, 0};
+   struct event_filter filter = {0, 0, 0};
+
+   if (lua_gettop(L) > 2 && !lua_isnil(L, 3))
+   {
+      luaL_checktype(L, 3, LUA_TTABLE);
+      sched.type = (int)lua_get_opt_field(L, 3, "schedule", SYNTH_FIXED);
+      sched.interval = (unsigned int)lua_get_opt_field(L, 3, "interval", 1000);
+      sched.burst = (unsigned int)lua_get_opt_field(L, 3, "burst", 1);
+      sched.gap = (unsigned int)lua_get_opt_field(L, 3, "gap", 0);
+      sched.jitter = (unsigned int)lua_get_opt_field(L, 3, "jitter", 0);
+      sched.count = (unsigned long long)lua_get_opt_field(L, 3, "count", 0);
+      filter.stable = (unsigned int)lua_get_opt_field(L, 3, "stabletime", 0);
+      filter.min_pulse = (unsigned int)lua_get_opt_field(L, 3, "minpulse", 0);
+      if (lua_get_opt_bool(L, 3, "counting") && lua_gettop(L) > 3 && !lua_isnil(L, 4))
+         return luaL_error(L, "A callback can not be used with counting");
+   }
+
+   if (lua_gettop(L) > 3 && !lua_isnil(L, 4))
+      luaL_checktype(L, 4, LUA_TFUNCTION);
+
+   if (lua_gettop(L) > 4)
+   {
+      bouncetime = (unsigned int)luaL_checkint(L, 5);
+      if (bouncetime > 60000)
+         luaL_error(L, "Bouncetime must be a value from 0 to 60000");
+   }
+
+   // check channel is set up as an input
+   if (gpio_direction[gpio] != INPUT)
+      return luaL_error(L, "You must setup() the GPIO channel as an input first");
+
+   // is edge valid value
+   edge -= LUA_EVENT_CONST_OFFSET;
+   if (edge != RISING_EDGE && edge != FALLING_EDGE && edge != BOTH_EDGE)
+      return luaL_error(L, "The edge must be set to RISING, FALLING or BOTH");
+
+   if (sched.type < SYNTH_FIXED || sched.type > SYNTH_SQUARE)
+      return luaL_error(L, "The schedule must be set to SYNTH_FIXED, SYNTH_BURST, SYNTH_POISSON or SYNTH_SQUARE");
+
+   if (sched.interval == 0)
+      return luaL_error(L, "interval must be greater than 0");
+
+   if ((result = synth_start(gpio, edge, &sched)) != 0)   // starts a thread
+   {
+      if (result == 1)
+      {
+         return luaL_error(L, "Edge detection already enabled for this GPIO channel");
+      } else {
+         return luaL_error(L, "Failed to start simulated events");
+      }
+   }
+
+   filter.lockout = bouncetime * 1000;
+   set_event_filter(gpio, &filter);
+   set_burst(L, gpio, (lua_gettop(L) > 2 && !lua_isnil(L, 3)) ? 3 : 0);
+
+   if (lua_gettop(L) > 3 && !lua_isnil(L, 4))
+      add_lua_callback(L, gpio, 4, lua_gettop(L) > 2 && !lua_isnil(L, 3) && lua_get_opt_bool(L, 3, "timestamped"));
 
    return 0;
 }
 
+/***
+Reads the statistics of the synthetic edge generator of a pin (see `simulate_events`).
+@function simulated_stats
+@param channel channel/pin to report (see `setmode`)
+@return number of edges generated
+@return number of edges dropped because the poll thread could not keep up
+*/
+static int lua_simulated_stats(lua_State* L)
+{
+   unsigned int gpio = lua_get_gpio_number(L, luaL_checkint(L, 1));
+   unsigned long long generated, dropped;
+
+   if (synth_stats(gpio, &generated, &dropped) != 0)
+      return luaL_error(L, "No simulated events running for this GPIO channel");
+
+   lua_pushnumber(L, (lua_Number)generated);
+   lua_pushnumber(L, (lua_Number)dropped);
+   return 2;
+}
+
 /***
 Removes event detection for a pin.
 @function remove_event_detect
@@ -807,135 +1141,2011 @@ int lua_remove_event_detect(lua_State* L)
 }
 
 /***
-Reads events detected (non-blocking). Pins must first be configured using `add_event_detect`, events will be queued, 
-so `event_detected` will not miss events.
-@function event_detected
-@param channel channel/pin to check for events (see `setmode`)
-@return boolean, `true` if an event was detected, `false` otherwise
+Reads the number of edges rejected by the switch bounce and glitch filter of a pin (see `add_event_detect`).
+@function rejected_events
+@param channel channel/pin to report (see `setmode`)
+@return number of rejected edges
 */
-static int lua_event_detected(lua_State* L)
+static int lua_rejected_events(lua_State* L)
 {
    unsigned int gpio = lua_get_gpio_number(L, luaL_checkint(L, 1));
 
-   if (event_detected(gpio))
-      lua_pushboolean(L, 1);
-   else
-      lua_pushboolean(L, 0);
+   lua_pushnumber(L, (lua_Number)event_filter_rejected(gpio));
    return 1;
 }
 
 /***
-Wait for an event (blocking).
-@function wait_for_edge
-@param channel channel/pin to check for events (see `setmode`)
-@param edge What type of edge to wait for. Either `RISING`, `FALLING` or `BOTH`.
+Sets how event callbacks are handed over from the edge detection thread. Detected edges are queued and picked up
+by executor threads, so a slow callback does not hold up edge detection. Lua callbacks are always delivered
+through darksidesync, the executor only decouples the delivery.
+@function set_callback_executor
+@param threads (optional) number of executor threads (default 1), 0 hands the events over on the edge detection thread
+@param queue_size (optional) number of events that can wait for an executor thread (default 1024)
+@param overflow (optional) what to do when the queue is full; `DROP_OLDEST` (default), `DROP_NEWEST` or `COALESCE`
 */
-static int lua_wait_for_edge(lua_State* L)
+static int lua_set_callback_executor(lua_State* L)
 {
-   unsigned int gpio = lua_get_gpio_number(L, luaL_checkint(L, 1));
-   int edge = luaL_checkint(L, 2);
+   int threads = luaL_optint(L, 1, EXECUTOR_THREADS);
+   int queue_size = luaL_optint(L, 2, QUEUE_SIZE);
+   int overflow = luaL_optint(L, 3, QUEUE_DROP_OLDEST);
    int result;
-   char error[30];
 
-   // check channel is setup as an input
-   if (gpio_direction[gpio] != INPUT)
-      return luaL_error(L, "You must setup() the GPIO channel as an input first");
+   if (threads < 0)
+      return luaL_error(L, "threads must be 0 or greater");
+   if (queue_size < 1)
+      return luaL_error(L, "queue_size must be greater than 0");
+   if (overflow != QUEUE_DROP_OLDEST && overflow != QUEUE_DROP_NEWEST && overflow != QUEUE_COALESCE)
+      return luaL_error(L, "overflow must be set to DROP_OLDEST, DROP_NEWEST or COALESCE");
+
+   result = set_executor(threads, queue_size, overflow);
+   if (result == 1)
+      return luaL_error(L, "Out of memory");
+   else if (result == 2)
+      return luaL_error(L, "Failed to start the callback executor threads");
+   return 0;
+}
 
-   // is edge a valid value?
-   edge -= LUA_EVENT_CONST_OFFSET;
-   if (edge != RISING_EDGE && edge != FALLING_EDGE && edge != BOTH_EDGE)
-      return luaL_error(L, "The edge must be set to RISING, FALLING or BOTH");
+/***
+Returns the statistics of the callback queue.
+@function callback_queue_stats
+@return table with fields `queued`, `dropped`, `coalesced`, `high_water` and `size`
+*/
+static int lua_callback_queue_stats(lua_State* L)
+{
+   struct queue_stats stats;
 
-   result = blocking_wait_for_edge(gpio, edge);
+   get_queue_stats(&stats);
+   lua_newtable(L);
+   lua_pushnumber(L, (lua_Number)stats.queued);
+   lua_setfield(L, -2, "queued");
+   lua_pushnumber(L, (lua_Number)stats.dropped);
+   lua_setfield(L, -2, "dropped");
+   lua_pushnumber(L, (lua_Number)stats.coalesced);
+   lua_setfield(L, -2, "coalesced");
+   lua_pushnumber(L, stats.high_water);
+   lua_setfield(L, -2, "high_water");
+   lua_pushnumber(L, stats.size);
+   lua_setfield(L, -2, "size");
+   return 1;
+}
 
-   if (result == 0) {
-      return 0;
-   } else if (result == 2) {
-      return luaL_error(L, "Edge detection events already enabled for this GPIO channel");
-   } else {
-      sprintf(error, "Error #%d waiting for edge", result);
-      return luaL_error(L, error);
-   }
+// gets the gpio of a counting channel/pin, raises an error otherwise
+static unsigned int lua_get_counting_gpio(lua_State* L, int channel)
+{
+   unsigned int gpio = lua_get_gpio_number(L, channel);
+
+   if (!event_counting(gpio))
+      luaL_error(L, "Add event detection with the counting option first");
+   return gpio;
 }
 
-static const struct luaL_Reg gpio_lib[] = {
-  { "setup", lua_setup_channel},
-  { "cleanup", lua_cleanup},
-  { "input", lua_input_gpio},
-  { "output", lua_output_gpio},
-  { "setmode", lua_setmode},  
-  { "gpio_function", lua_gpio_function},
-  { "setwarnings", lua_setwarnings},
-  
-  // interrupts and events
-  { "wait_for_edge", lua_wait_for_edge},
-  { "event_detected", lua_event_detected},
-  { "add_event_detect", lua_add_event_detect},
-  { "remove_event_detect", lua_remove_event_detect},
-  { "add_event_callback", lua_add_event_callback},
-  
-  // PWM
-  { "newPWM", lua_pwm_init},
-  { "start", lua_pwm_start},
-  { "ChangeFrequency", lua_pwm_ChangeFrequency},
-  { "ChangeDutyCycle", lua_pwm_ChangeDutyCycle},
-  { "stop", lua_pwm_stop},
+/***
+Reads the number of edges counted on a pin set up with the `counting` option of `add_event_detect`.
+@function count
+@param channel channel/pin to read (see `setmode`)
+@return number of edges
+*/
+static int lua_count(lua_State* L)
+{
+   unsigned int gpio = lua_get_counting_gpio(L, luaL_checkint(L, 1));
 
-  {NULL, NULL}
-};
-  
+   lua_pushnumber(L, (lua_Number)event_count(gpio));
+   return 1;
+}
 
-int luaopen_GPIO (lua_State *L){
-  
-  
-  int i, result;
+/***
+Reads the number of edges counted on a pin and sets the counter back to 0 in one step.
+@function count_and_reset
+@param channel channel/pin to read (see `setmode`)
+@return number of edges
+*/
+static int lua_count_and_reset(lua_State* L)
+{
+   unsigned int gpio = lua_get_counting_gpio(L, luaL_checkint(L, 1));
 
-  for (i=0; i<54; i++)
-      gpio_direction[i] = -1;
+   lua_pushnumber(L, (lua_Number)event_count_reset(gpio));
+   return 1;
+}
 
-   result = setup();
-   if (result == SETUP_DEVMEM_FAIL)
+/***
+Reads the edge counts of several pins.
+@function counts
+@param channels table (list) of channels/pins to read (see `setmode`)
+@param reset (optional) `true` to set the counters back to 0 in the same step
+@return table (list) with the number of edges of each pin
+*/
+static int lua_counts(lua_State* L)
+{
+   unsigned int gpios[54];
+   int reset = lua_toboolean(L, 2);
+   int n, i;
+
+   luaL_checktype(L, 1, LUA_TTABLE);
+   n = lua_objlen(L, 1);
+   if (n > 54)
+      return luaL_error(L, "channels must hold at most 54 channels");
+
+   // check all channels before reading, so a reset is all or nothing
+   for (i = 0; i < n; i++)
    {
-      return luaL_error(L, "GPIO module has no access to /dev/mem.  Try running as root!");
-   } else if (result == SETUP_MALLOC_FAIL) {
-      return luaL_error(L, "No memory!");
-   } else if (result == SETUP_MMAP_FAIL) {
-      return luaL_error(L,  "Mmap of GPIO registers failed");
-   } 
+      lua_rawgeti(L, 1, i + 1);
+      gpios[i] = lua_get_counting_gpio(L, luaL_checkint(L, -1));
+      lua_pop(L, 1);
+   }
 
-  //Metatable for PWM objects
-  luaL_newmetatable(L, PWM_MT_NAME);
-  lua_pushcfunction(L, lua_pwm_dealloc);
-  lua_setfield(L, -2, "__gc");
-  lua_newtable(L);  // __index table
-  lua_pushcfunction(L, lua_pwm_start);
-  lua_setfield(L, -2, "start");
-  lua_pushcfunction(L, lua_pwm_ChangeFrequency);
-  lua_setfield(L, -2, "ChangeFrequency");
-  lua_pushcfunction(L, lua_pwm_ChangeDutyCycle);
-  lua_setfield(L, -2, "ChangeDutyCycle");
-  lua_pushcfunction(L, lua_pwm_stop);
-  lua_setfield(L, -2, "stop");
-  lua_setfield(L, -2, "__index");
-  lua_pop(L, 1);
+   lua_createtable(L, n, 0);
+   for (i = 0; i < n; i++)
+   {
+      lua_pushnumber(L, (lua_Number)(reset ? event_count_reset(gpios[i]) : event_count(gpios[i])));
+      lua_rawseti(L, -2, i + 1);
+   }
+   return 1;
+}
 
-  //luaL_newlib(L, gpio_lib);
-  luaL_register(L, "GPIO", gpio_lib);
-  
-  lua_pushboolean(L, 1);
-  lua_setfield(L, -2, "HIGH");
+// sets a field of the table on top of the stack
+static void lua_set_number_field(lua_State* L, const char* name, lua_Number value)
+{
+   lua_pushnumber(L, value);
+   lua_setfield(L, -2, name);
+}
 
-  lua_pushboolean(L, 0);
-  lua_setfield(L, -2, "LOW");
+/***
+Reads the input capture statistics of a pin with event detection: the period, high time, duty cycle and frequency
+of the signal, measured in C from the edge timestamps. Both edges are used, whatever edge type was set up.
+@function measure
+@param channel channel/pin to read (see `setmode`)
+@param reset (optional) `true` to start the statistics over after reading them
+@return table with fields `period`, `period_min`, `period_max`, `period_avg`, `high`, `high_min`, `high_max`,
+`high_avg` (times in microseconds, `_avg` is a moving average), `duty`, `duty_avg` (0 to 1), `frequency`,
+`frequency_avg` (in Hz), `periods` (number of full periods seen) and `last_edge` (timestamp in microseconds)
+*/
+static int lua_measure(lua_State* L)
+{
+   unsigned int gpio = lua_get_gpio_number(L, luaL_checkint(L, 1));
+   struct measure_result m;
 
-  lua_pushnumber(L, OUTPUT);
-  lua_setfield(L, -2, "OUT");
+   if (!gpio_event_added(gpio))
+      return luaL_error(L, "Add event detection using add_event_detect first");
 
-  lua_pushnumber(L, INPUT);
-  lua_setfield(L, -2, "IN");
-  
-  lua_pushnumber(L, PWM);
-  lua_setfield(L, -2, "PWM");
+   read_measure(gpio, &m);
+   if (lua_toboolean(L, 2))
+      reset_measure(gpio);
+
+   lua_newtable(L);
+   lua_set_number_field(L, "period", m.period.last);
+   lua_set_number_field(L, "period_min", m.period.min);
+   lua_set_number_field(L, "period_max", m.period.max);
+   lua_set_number_field(L, "period_avg", m.period.avg);
+   lua_set_number_field(L, "high", m.high.last);
+   lua_set_number_field(L, "high_min", m.high.min);
+   lua_set_number_field(L, "high_max", m.high.max);
+   lua_set_number_field(L, "high_avg", m.high.avg);
+   lua_set_number_field(L, "duty", m.duty);
+   lua_set_number_field(L, "duty_avg", m.duty_avg);
+   lua_set_number_field(L, "frequency", m.period.last ? 1000000.0 / m.period.last : 0.0);
+   lua_set_number_field(L, "frequency_avg", m.period.avg > 0.0 ? 1000000.0 / m.period.avg : 0.0);
+   lua_set_number_field(L, "periods", (lua_Number)m.periods);
+   lua_set_number_field(L, "last_edge", (lua_Number)m.last_edge);
+   return 1;
+}
+
+// turns an optional list field of output channels into a gpio bit mask
+static unsigned long long lua_get_output_mask(lua_State* L, int index, const char* name)
+{
+   unsigned long long mask = 0;
+   unsigned int gpio;
+   int n, i;
+
+   lua_getfield(L, index, name);
+   if (!lua_isnil(L, -1))
+   {
+      if (!lua_istable(L, -1))
+         return (unsigned long long)luaL_error(L, "Field '%s' must be a table of channels", name);
+      n = lua_objlen(L, -1);
+      for (i = 0; i < n; i++)
+      {
+         lua_rawgeti(L, -1, i + 1);
+         gpio = lua_get_gpio_number(L, luaL_checkint(L, -1));
+         lua_pop(L, 1);
+         if (gpio_direction[gpio] != OUTPUT)
+            return (unsigned long long)luaL_error(L, "The GPIO channel has not been set up as an OUTPUT");
+         mask |= 1ULL << gpio;
+      }
+   }
+   lua_pop(L, 1);
+   return mask;
+}
+
+/***
+Adds a reflex rule: an edge on an input pin drives outputs straight from the edge detection thread,
+without a round trip through Lua.
+@function add_reflex
+@param channel input channel/pin with event detection (see `setmode`)
+@param edge What type of edge the rule acts on. Either `RISING`, `FALLING` or `BOTH`, whatever edge type the
+channel's event detection was set up for.
+@param options table with the optional fields `set`, `clear` and `toggle` (tables of output channels to set `HIGH`,
+set `LOW` or invert), `pwm` (table with fields `channel`, `frequency` and `dutycycle` of a software PWM to start),
+`delay` (microseconds from the edge to the action, edges while an action is pending are ignored) and `oneshot`
+(`true` to remove the rule once it has acted)
+@return id of the rule, rules are removed with the event detection of their input
+*/
+static int lua_add_reflex(lua_State* L)
+{
+   unsigned int gpio = lua_get_gpio_number(L, luaL_checkint(L, 1));
+   int edge = luaL_checkint(L, 2);
+   struct reflex_rule rule;
+   int id;
+
+   if (!gpio_event_added(gpio))
+      return luaL_error(L, "Add event detection using add_event_detect first");
+
+   // is edge a valid value?
+   edge -= LUA_EVENT_CONST_OFFSET;
+   if (edge != RISING_EDGE && edge != FALLING_EDGE && edge != BOTH_EDGE)
+      return luaL_error(L, "The edge must be set to RISING, FALLING or BOTH");
+
+   luaL_checktype(L, 3, LUA_TTABLE);
+   rule.gpio = gpio;
+   rule.edge = edge;
+   rule.set = lua_get_output_mask(L, 3, "set");
+   rule.clear = lua_get_output_mask(L, 3, "clear");
+   rule.toggle = lua_get_output_mask(L, 3, "toggle");
+   rule.delay = (unsigned int)lua_get_opt_field(L, 3, "delay", 0);
+   rule.oneshot = lua_get_opt_bool(L, 3, "oneshot");
+   rule.pwm_gpio = -1;
+
+   lua_getfield(L, 3, "pwm");
+   if (!lua_isnil(L, -1))
+   {
+      luaL_checktype(L, -1, LUA_TTABLE);
+      rule.pwm_gpio = lua_get_gpio_number(L, (int)lua_get_opt_field(L, -1, "channel", -1));
+      if (gpio_direction[rule.pwm_gpio] != OUTPUT)
+         return luaL_error(L, "The PWM channel has not been set up as an OUTPUT");
+      rule.frequency = (float)lua_get_opt_field(L, -1, "frequency", 0);
+      rule.dutycycle = (float)lua_get_opt_field(L, -1, "dutycycle", 0);
+      if (rule.frequency <= 0.0 || rule.dutycycle < 0.0 || rule.dutycycle > 100.0)
+         return luaL_error(L, "pwm needs a frequency > 0.0 and a dutycycle from 0.0 to 100.0");
+   }
+   lua_pop(L, 1);
+
+   if ((id = add_reflex(&rule)) < 0)
+      return luaL_error(L, "Too many reflex rules");
+   lua_pushinteger(L, id);
+   return 1;
+}
+
+/***
+Removes a reflex rule.
+@function remove_reflex
+@param id the id returned by `add_reflex`
+*/
+static int lua_remove_reflex(lua_State* L)
+{
+   if (remove_reflex(luaL_checkint(L, 1)))
+      return luaL_error(L, "No reflex rule with this id");
+   return 0;
+}
+
+// turns an optional list field of set up channels into a gpio bit mask, adding the inputs to *inputs
+static unsigned long long lua_get_pattern_mask(lua_State* L, int index, const char* name, unsigned long long *inputs)
+{
+   unsigned long long mask = 0;
+   unsigned int gpio;
+   int n, i;
+
+   lua_getfield(L, index, name);
+   if (!lua_isnil(L, -1))
+   {
+      if (!lua_istable(L, -1))
+         return (unsigned long long)luaL_error(L, "Field '%s' must be a table of channels", name);
+      n = lua_objlen(L, -1);
+      for (i = 0; i < n; i++)
+      {
+         lua_rawgeti(L, -1, i + 1);
+         gpio = lua_get_gpio_number(L, luaL_checkint(L, -1));
+         lua_pop(L, 1);
+         if (gpio_direction[gpio] != INPUT && gpio_direction[gpio] != OUTPUT)
+            return (unsigned long long)luaL_error(L, "You must setup() the GPIO channel first");
+         mask |= 1ULL << gpio;
+         if (gpio_direction[gpio] == INPUT)
+            *inputs |= 1ULL << gpio;
+      }
+   }
+   lua_pop(L, 1);
+   return mask;
+}
+
+/***
+Adds a trigger on the levels of several pins. The pattern is checked in C against one snapshot of all levels
+on every edge, so there is no race between reading the pins one by one. Both edges are used, whatever edge type was
+set up. Input pins without event detection get it added.
+Using a callback requires the helper library `darksidesync` (async callback support).
+@function add_pattern
+@param pattern table with the optional fields `high` and `low` (tables of channels/pins that must be `HIGH` or `LOW`)
+and `poll` (also check every this many microseconds, for changes on outputs or pins without edges)
+@param callback (optional) function called with the pattern id, `true` or `false` for a match and the timestamp in
+microseconds, when the levels start or stop matching
+@return id of the pattern
+*/
+static int lua_add_pattern(lua_State* L)
+{
+   unsigned long long high, low, inputs = 0;
+   unsigned int gpio, poll;
+   int callback, id;
+
+   luaL_checktype(L, 1, LUA_TTABLE);
+   callback = !lua_isnoneornil(L, 2);
+   if (callback)
+      luaL_checktype(L, 2, LUA_TFUNCTION);
+
+   high = lua_get_pattern_mask(L, 1, "high", &inputs);
+   low = lua_get_pattern_mask(L, 1, "low", &inputs);
+   poll = (unsigned int)lua_get_opt_field(L, 1, "poll", 0);
+   if (high & low)
+      return luaL_error(L, "A channel can not be in both high and low");
+   if (inputs == 0)
+      return luaL_error(L, "The pattern must hold at least one input channel");
+
+   // the pattern is checked on the edges of its inputs
+   for (gpio = 0; gpio < 54; gpio++)
+      if ((inputs & (1ULL << gpio)) && add_wait_edge_detect(gpio) != 0)
+         return luaL_error(L, "Failed to add edge detection");
+
+   if ((id = add_pattern(high | low, high, poll, callback)) < 0)
+      return luaL_error(L, "Too many patterns");
+   if (callback)
+      add_lua_callback(L, PATTERN_GPIO + id, 2, 0);
+   lua_pushinteger(L, id);
+   return 1;
+}
+
+/***
+Reads the state of a pattern.
+@function pattern_state
+@param id the id returned by `add_pattern`
+@return `true` if the levels matched at the last check, `false` otherwise
+@return number of times the levels started to match
+@return number of times the levels stopped matching
+*/
+static int lua_pattern_state(lua_State* L)
+{
+   struct pattern_state state;
+
+   if (get_pattern_state(luaL_checkint(L, 1), &state))
+      return luaL_error(L, "No pattern with this id");
+   lua_pushboolean(L, state.matched);
+   lua_pushnumber(L, (lua_Number)state.entries);
+   lua_pushnumber(L, (lua_Number)state.exits);
+   return 3;
+}
+
+/***
+Removes a pattern.
+@function remove_pattern
+@param id the id returned by `add_pattern`
+*/
+static int lua_remove_pattern(lua_State* L)
+{
+   int id = luaL_checkint(L, 1);
+
+   if (remove_pattern(id))
+      return luaL_error(L, "No pattern with this id");
+   remove_lua_callbacks(L, PATTERN_GPIO + id);
+   return 0;
+}
+
+// pushes a histogram as a list table
+static void lua_push_histogram(lua_State* L, unsigned long long *buckets)
+{
+   int i;
+
+   lua_createtable(L, STATS_BUCKETS, 0);
+   for (i = 0; i < STATS_BUCKETS; i++)
+   {
+      lua_pushnumber(L, (lua_Number)buckets[i]);
+      lua_rawseti(L, -2, i + 1);
+   }
+}
+
+// pushes the stats table of a gpio
+static void lua_push_stats(lua_State* L, unsigned int gpio)
+{
+   struct event_stats s;
+
+   read_stats(gpio, &s);
+   lua_newtable(L);
+   lua_set_number_field(L, "seen", (lua_Number)s.seen);
+   lua_set_number_field(L, "bounced", (lua_Number)s.bounced);
+   lua_set_number_field(L, "dropped", (lua_Number)s.dropped);
+   lua_set_number_field(L, "delivered", (lua_Number)s.delivered);
+   lua_push_histogram(L, s.latency);
+   lua_setfield(L, -2, "latency");
+   lua_push_histogram(L, s.duration);
+   lua_setfield(L, -2, "duration");
+}
+
+/***
+Reads the event telemetry of a pin, kept in C for every edge: counters of edges seen, rejected by the switch bounce
+and glitch filter, dropped by a full callback queue and delivered to callbacks, and log2 histograms of the time from
+the edge to the callbacks and of the time spent in them.
+@function stats
+@param channel (optional) channel/pin to read (see `setmode`)
+@return table with fields `seen`, `bounced`, `dropped`, `delivered`, `latency` and `duration`. The histograms are lists
+of counts, item 1 for 0 microseconds and item n for 2^(n-2) to 2^(n-1) - 1 microseconds, the last item holding anything
+longer. Without a channel, a table of these tables indexed by channel, for all pins with event detection.
+*/
+static int lua_stats(lua_State* L)
+{
+   unsigned int gpio;
+   struct event_stats s;
+
+   if (!lua_isnoneornil(L, 1))
+   {
+      lua_push_stats(L, lua_get_gpio_number(L, luaL_checkint(L, 1)));
+      return 1;
+   }
+
+   lua_newtable(L);
+   for (gpio = 0; gpio < 54; gpio++)
+   {
+      read_stats(gpio, &s);
+      if ((!gpio_event_added(gpio) && s.seen == 0) || (int)chan_from_gpio(gpio) == -1)
+         continue;
+      lua_push_stats(L, gpio);
+      lua_rawseti(L, -2, chan_from_gpio(gpio));
+   }
+   return 1;
+}
+
+/***
+Sets the event telemetry counters back to 0.
+@function reset_stats
+@param channel (optional) channel/pin to reset (see `setmode`), all pins if absent
+*/
+static int lua_reset_stats(lua_State* L)
+{
+   unsigned int gpio;
+
+   if (!lua_isnoneornil(L, 1))
+   {
+      reset_stats(lua_get_gpio_number(L, luaL_checkint(L, 1)));
+      return 0;
+   }
+   for (gpio = 0; gpio < 54; gpio++)
+      reset_stats(gpio);
+   return 0;
+}
+
+/***
+Starts recording a trace of output writes, captured edges, callbacks and PWM sleeps. The records of an earlier trace are dropped.
+@function trace_start
+*/
+static int lua_trace_start(lua_State* L)
+{
+   trace_start();
+   return 0;
+}
+
+/***
+Stops recording the trace.
+@function trace_stop
+*/
+static int lua_trace_stop(lua_State* L)
+{
+   trace_stop();
+   return 0;
+}
+
+/***
+Stops recording and writes the trace as Chrome trace JSON, for chrome://tracing or Perfetto.
+@function trace_dump
+@param path name of the file to write
+*/
+static int lua_trace_dump(lua_State* L)
+{
+   const char *path = luaL_checkstring(L, 1);
+
+   if (trace_dump(path) != 0)
+      return luaL_error(L, "Cannot write trace to %s: %s", path, strerror(errno));
+   return 0;
+}
+
+/***
+Records every captured edge from the edge detection thread into memory mapped segment files
+`path.000000`, `path.000001`, ... Read them back with `recording`, or convert them to CSV with
+`python -m RPi.recording path`. The segment files of an earlier recording to the same path are deleted.
+@function record_start
+@param path base name of the segment files
+@param options (optional) table with the optional fields `channels` (table of channels/pins to record, all pins with
+event detection if absent), `segment_records` (records per segment file, default 65536 of 16 bytes each) and
+`segments` (number of segment files to keep, older ones are deleted; 0, the default, keeps all)
+*/
+static int lua_record_start(lua_State* L)
+{
+   const char *path = luaL_checkstring(L, 1);
+   unsigned long long gpios = ~0ULL;
+   unsigned int segment_records = RECORD_SEGMENT, segments = 0;
+   int n, i, result;
+
+   if (lua_istable(L, 2))
+   {
+      segment_records = (unsigned int)lua_get_opt_field(L, 2, "segment_records", RECORD_SEGMENT);
+      segments = (unsigned int)lua_get_opt_field(L, 2, "segments", 0);
+      lua_getfield(L, 2, "channels");
+      if (lua_istable(L, -1))
+      {
+         gpios = 0;
+         n = lua_objlen(L, -1);
+         for (i = 0; i < n; i++)
+         {
+            lua_rawgeti(L, -1, i + 1);
+            gpios |= 1ULL << lua_get_gpio_number(L, luaL_checkint(L, -1));
+            lua_pop(L, 1);
+         }
+      }
+      lua_pop(L, 1);
+   }
+
+   result = record_start(path, gpios, segment_records, segments);
+   if (result == 1)
+      return luaL_error(L, "Already recording, use record_stop first");
+   else if (result == 2)
+      return luaL_error(L, "Cannot write recording %s: %s", path, strerror(errno));
+   return 0;
+}
+
+/***
+Stops recording edges.
+@function record_stop
+*/
+static int lua_record_stop(lua_State* L)
+{
+   record_stop();
+   return 0;
+}
+
+/***
+Reads the recorder statistics.
+@function record_stats
+@return table with fields `records` (records written), `segments` (segments started) and `failed` (records lost
+because a segment file could not be made)
+*/
+static int lua_record_stats(lua_State* L)
+{
+   struct record_stats stats;
+
+   get_record_stats(&stats);
+   lua_newtable(L);
+   lua_set_number_field(L, "records", (lua_Number)stats.records);
+   lua_set_number_field(L, "segments", (lua_Number)stats.segments);
+   lua_set_number_field(L, "failed", (lua_Number)stats.failed);
+   return 1;
+}
+
+// iterator over a recording, the reader is in the userdata upvalue
+static int lua_recording_next(lua_State* L)
+{
+   struct record_reader **reader = luaL_checkudata(L, lua_upvalueindex(1), RECORDING_MT_NAME);
+   struct gpio_event ev;
+
+   if (*reader == NULL || !record_next(*reader, &ev))
+      return 0;
+   lua_pushinteger(L, ev.gpio);
+   lua_pushinteger(L, ev.level);
+   lua_pushnumber(L, (lua_Number)ev.timestamp);
+   lua_pushnumber(L, ev.count);
+   return 4;
+}
+
+static int lua_recording_close(lua_State* L)
+{
+   struct record_reader **reader = luaL_checkudata(L, 1, RECORDING_MT_NAME);
+
+   if (*reader != NULL)
+      record_close(*reader);
+   *reader = NULL;
+   return 0;
+}
+
+/***
+Reads a recording made with `record_start`.
+@function recording
+@param path base name of the segment files
+@return iterator for a generic for, giving the gpio (BCM number), level, timestamp in microseconds and edge count
+of each recorded edge, e.g. `for gpio, level, timestamp in GPIO.recording(path) do ... end`
+*/
+static int lua_recording(lua_State* L)
+{
+   const char *path = luaL_checkstring(L, 1);
+   struct record_reader **reader = lua_newuserdata(L, sizeof(struct record_reader *));
+
+   *reader = NULL;
+   lua_getfield(L, LUA_REGISTRYINDEX, RECORDING_MT_NAME);
+   lua_setmetatable(L, -2);
+   if ((*reader = record_open(path)) == NULL)
+      return luaL_error(L, "No recording found at %s", path);
+   lua_pushcclosure(L, lua_recording_next, 1);
+   return 1;
+}
+
+/***
+Replays a recording made with `record_start` through edge detection, the filters and the callbacks as if the edges
+happened now. Edge detection stays enabled on the replayed pins until `replay_stop`.
+@function replay_events
+@param path base name of the recording
+@param edge (optional) `GPIO.RISING`, `GPIO.FALLING` or `GPIO.BOTH` (default)
+@param options (optional) table with the optional fields `speed` (1 replays with the recorded timing, the default,
+2 twice as fast, 0 as fast as possible), `channels` (table of channels/pins to replay, all pins in the recording
+if absent) and `timestamped` (see `add_event_detect`)
+@param callback (optional) function called for the events of every replayed pin, see `add_event_callback`
+@param bouncetime (optional) switch bounce timeout in ms, see `add_event_detect`
+*/
+static int lua_replay_events(lua_State* L)
+{
+   const char *path = luaL_checkstring(L, 1);
+   int edge = luaL_optint(L, 2, BOTH_EDGE + LUA_EVENT_CONST_OFFSET);
+   unsigned long long gpios = ~0ULL;
+   unsigned int gpio, bouncetime = 0;
+   double speed = 1.0;
+   struct event_filter filter = {0, 0, 0};
+   int n, i, result, timestamped = 0;
+
+   if (lua_istable(L, 3))
+   {
+      speed = (double)lua_get_opt_field(L, 3, "speed", 1.0);
+      timestamped = lua_get_opt_bool(L, 3, "timestamped");
+      lua_getfield(L, 3, "channels");
+      if (lua_istable(L, -1))
+      {
+         gpios = 0;
+         n = lua_objlen(L, -1);
+         for (i = 0; i < n; i++)
+         {
+            lua_rawgeti(L, -1, i + 1);
+            gpios |= 1ULL << lua_get_gpio_number(L, luaL_checkint(L, -1));
+            lua_pop(L, 1);
+         }
+      }
+      lua_pop(L, 1);
+   }
+
+   if (lua_gettop(L) > 3 && !lua_isnil(L, 4))
+      luaL_checktype(L, 4, LUA_TFUNCTION);
+
+   if (lua_gettop(L) > 4)
+   {
+      bouncetime = (unsigned int)luaL_checkint(L, 5);
+      if (bouncetime > 60000)
+         luaL_error(L, "Bouncetime must be a value from 0 to 60000");
+   }
+
+   // is edge valid value
+   edge -= LUA_EVENT_CONST_OFFSET;
+   if (edge != RISING_EDGE && edge != FALLING_EDGE && edge != BOTH_EDGE)
+      return luaL_error(L, "The edge must be set to RISING, FALLING or BOTH");
+
+   if (speed < 0.0)
+      return luaL_error(L, "speed must be 0 (as fast as possible) or greater");
+
+   result = replay_open(path, &gpios, edge, speed);
+   if (result == 1)
+      return luaL_error(L, "Already replaying, use replay_stop first");
+   else if (result == 2)
+      return luaL_error(L, "No recording found at %s", path);
+   else if (result == 3)
+      return luaL_error(L, "Edge detection already enabled for a replayed GPIO channel");
+   else if (result != 0)
+      return luaL_error(L, "Failed to start the replay");
+
+   // filters and callbacks are in place before the first edge is replayed
+   filter.lockout = bouncetime * 1000;
+   for (gpio = 0; gpio < 54; gpio++)
+   {
+      if (!((gpios >> gpio) & 1))
+         continue;
+      set_event_filter(gpio, &filter);
+      if (lua_gettop(L) > 3 && !lua_isnil(L, 4))
+         add_lua_callback(L, gpio, 4, timestamped);
+   }
+
+   if (replay_run() != 0)
+      return luaL_error(L, "Failed to start the replay");
+   return 0;
+}
+
+/***
+Stops a replay and removes edge detection from the replayed pins.
+@function replay_stop
+*/
+static int lua_replay_stop(lua_State* L)
+{
+   unsigned long long gpios = replay_stop();
+   unsigned int gpio;
+
+   for (gpio = 0; gpio < 54; gpio++)
+      if ((gpios >> gpio) & 1)
+         remove_lua_callbacks(L, gpio);
+   return 0;
+}
+
+/***
+Reads the replay statistics.
+@function replay_stats
+@return table with fields `replayed` (edges replayed), `elapsed` (time in microseconds the replay took so far or in
+total) and `running` (boolean)
+*/
+static int lua_replay_stats(lua_State* L)
+{
+   struct replay_stats stats;
+
+   get_replay_stats(&stats);
+   lua_newtable(L);
+   lua_set_number_field(L, "replayed", (lua_Number)stats.replayed);
+   lua_set_number_field(L, "elapsed", (lua_Number)stats.elapsed);
+   lua_pushboolean(L, stats.running);
+   lua_setfield(L, -2, "running");
+   return 1;
+}
+
+// turns a table of channels at index into a mask of GPIO 0-31, the channels need not be set up as they are only sampled
+static unsigned int lua_sample_mask(lua_State* L, int index)
+{
+   unsigned int mask = 0, gpio;
+   int n, i;
+
+   n = lua_objlen(L, index);
+   for (i = 0; i < n; i++)
+   {
+      lua_rawgeti(L, index, i + 1);
+      gpio = lua_get_gpio_number(L, luaL_checkint(L, -1));
+      lua_pop(L, 1);
+      if (gpio >= 32)
+         return (unsigned int)luaL_error(L, "Only GPIO 0-31 are sampled");
+      mask |= 1U << gpio;
+   }
+   return mask;
+}
+
+/***
+Starts the logic analyser, sampling the levels of GPIO 0-31 in one register read at a fixed rate into a ring buffer.
+With a trigger the capture ends by itself when it is full, without one the ring keeps the latest samples until
+`sampler_stop`.
+@function sampler_start
+@param rate samples per second, up to 1000000 (the sampling thread busy waits between samples)
+@param samples size of the capture in samples
+@param options (optional) table with the optional fields `high` and `low` (tables of channels/pins that must be
+`HIGH` or `LOW` for the trigger), `pretrigger` (samples kept from before the trigger), `cpu` (core to pin the
+sampling thread to, e.g. one kept free with isolcpus) and `encoding` (`SAMPLER_RAW`, the default, stores every sample,
+`SAMPLER_RLE` only the changes as pairs of samples since the change before and levels, with `samples` and
+`pretrigger` counting those pairs)
+*/
+static int lua_sampler_start(lua_State* L)
+{
+   unsigned int rate = (unsigned int)luaL_checkint(L, 1);
+   unsigned int samples = (unsigned int)luaL_checkint(L, 2);
+   unsigned int high = 0, low = 0, pretrigger = 0;
+   int triggered = 0, cpu = -1, encoding = SAMPLER_RAW, result;
+
+   if (lua_istable(L, 3))
+   {
+      lua_getfield(L, 3, "high");
+      if (lua_istable(L, -1))
+         high = lua_sample_mask(L, lua_gettop(L));
+      lua_getfield(L, 3, "low");
+      if (lua_istable(L, -1))
+         low = lua_sample_mask(L, lua_gettop(L));
+      triggered = !lua_isnil(L, -1) || !lua_isnil(L, -2);
+      lua_pop(L, 2);
+      pretrigger = (unsigned int)lua_get_opt_field(L, 3, "pretrigger", 0);
+      cpu = (int)lua_get_opt_field(L, 3, "cpu", -1);
+      encoding = (int)lua_get_opt_field(L, 3, "encoding", SAMPLER_RAW);
+   }
+
+   if (encoding != SAMPLER_RAW && encoding != SAMPLER_RLE)
+      return luaL_error(L, "encoding must be SAMPLER_RAW or SAMPLER_RLE");
+   if (high & low)
+      return luaL_error(L, "A channel can not be in both high and low");
+   if (rate == 0 || rate > SAMPLER_MAX_RATE)
+      return luaL_error(L, "rate must be from 1 to %d samples per second", SAMPLER_MAX_RATE);
+   if (samples == 0)
+      return luaL_error(L, "samples must be greater than 0");
+   if (pretrigger >= samples)
+      return luaL_error(L, "pretrigger must be less than samples");
+
+   result = sampler_start(rate, samples, encoding, triggered, high | low, high, pretrigger, cpu);
+   if (result == 1)
+      return luaL_error(L, "Already sampling, use sampler_stop first");
+   else if (result != 0)
+      return luaL_error(L, "Failed to start the sampler");
+   return 0;
+}
+
+/***
+Stops the logic analyser, the samples taken so far are kept.
+@function sampler_stop
+*/
+static int lua_sampler_stop(lua_State* L)
+{
+   sampler_stop();
+   return 0;
+}
+
+/***
+Reads the logic analyser state.
+@function sampler_state
+@return table with fields `state` (`SAMPLER_IDLE`, `SAMPLER_ARMED`, `SAMPLER_TRIGGERED` or `SAMPLER_DONE`), `taken`
+(samples taken) and `missed` (sample times missed)
+*/
+static int lua_sampler_state(lua_State* L)
+{
+   struct sampler_status status;
+
+   get_sampler_status(&status);
+   lua_newtable(L);
+   lua_set_number_field(L, "state", status.state);
+   lua_set_number_field(L, "taken", (lua_Number)status.taken);
+   lua_set_number_field(L, "missed", (lua_Number)status.missed);
+   return 1;
+}
+
+/***
+Reads the last logic analyser capture.
+@function sampler_data
+@return string of the samples, oldest first, 4 bytes each in native byte order with bit n the level of GPIO n,
+or `nil` while sampling; e.g. `string.unpack("I4", data, 4 * i + 1)` in Lua 5.3. With `SAMPLER_RLE` each entry is
+two such words, the samples since the entry before and the levels
+@return index (0 based) of the trigger sample (entry), or `nil` if the capture did not trigger
+@return samples per second
+@return samples from the first one captured to the last
+*/
+static int lua_sampler_data(lua_State* L)
+{
+   struct sample_block *block;
+
+   if ((block = sampler_take()) == NULL)
+      return 0;
+   lua_pushlstring(L, (const char *)block->samples,
+                   (size_t)block->length * (block->encoding == SAMPLER_RLE ? 2 : 1) * sizeof(unsigned int));
+   if (block->trigger < 0)
+      lua_pushnil(L);
+   else
+      lua_pushnumber(L, (lua_Number)block->trigger);
+   lua_pushnumber(L, block->rate);
+   lua_pushnumber(L, (lua_Number)block->span);
+   sampler_release(block);
+   return 4;
+}
+
+/***
+Writes the last logic analyser capture to a value change dump file, for GTKWave or sigrok.
+@function sampler_save_vcd
+@param path file to write
+@param channels (optional) table of channels/pins to include (GPIO 0-31 only), the pins set up if absent
+*/
+static int lua_sampler_save_vcd(lua_State* L)
+{
+   const char *path = luaL_checkstring(L, 1);
+   unsigned int gpio, gpios = 0;
+   struct sample_block *block;
+   int result;
+
+   if (lua_istable(L, 2))
+   {
+      gpios = lua_sample_mask(L, 2);
+   } else {
+      // the pins set up, or all of them if none are
+      for (gpio = 0; gpio < 32; gpio++)
+         if (gpio_direction[gpio] != -1)
+            gpios |= 1U << gpio;
+      if (gpios == 0)
+         gpios = 0xffffffffU;
+   }
+
+   if ((block = sampler_take()) == NULL)
+      return luaL_error(L, "No capture to save, use sampler_start and wait for it to finish");
+   result = sampler_write_vcd(block, path, gpios);
+   sampler_release(block);
+   if (result != 0)
+      return luaL_error(L, "Cannot write %s: %s", path, strerror(errno));
+   return 0;
+}
+
+// turns the channel at index into a GPIO 0-31 for the decoders
+static unsigned int lua_sample_gpio(lua_State* L, int index)
+{
+   unsigned int gpio = lua_get_gpio_number(L, luaL_checkint(L, index));
+
+   if (gpio >= 32)
+      return (unsigned int)luaL_error(L, "Only GPIO 0-31 are sampled");
+   return gpio;
+}
+
+// the transitions of the gpios in the last capture if the argument at index 1 is nil, else in the recording at that path
+static void lua_decode_source(lua_State* L, unsigned int gpios, struct transitions *tr)
+{
+   struct sample_block *block;
+   const char *path;
+   int result;
+
+   if (lua_isnoneornil(L, 1))
+   {
+      if ((block = sampler_take()) == NULL)
+         luaL_error(L, "No capture to decode, use sampler_start and wait for it to finish");
+      result = decode_block(block, gpios, tr);
+      sampler_release(block);
+   } else {
+      path = luaL_checkstring(L, 1);
+      if ((result = decode_recording(path, gpios, tr)) == 1)
+         luaL_error(L, "Cannot read recording %s: %s", path, strerror(errno));
+   }
+   if (result != 0)
+      luaL_error(L, "Out of memory");
+}
+
+// pushes decoded frames as a table of tables, frees the frames
+static int lua_decode_result(lua_State* L, struct decode_frames *out, int result)
+{
+   unsigned int i;
+
+   if (result != 0)
+   {
+      free_frames(out);
+      return luaL_error(L, "Out of memory");
+   }
+   lua_createtable(L, out->count, 0);
+   for (i = 0; i < out->count; i++)
+   {
+      lua_createtable(L, 0, 6);
+      lua_set_number_field(L, "start", (lua_Number)out->frames[i].start);
+      lua_set_number_field(L, "finish", (lua_Number)out->frames[i].end);
+      lua_set_number_field(L, "type", out->frames[i].type);
+      lua_set_number_field(L, "value", out->frames[i].value);
+      lua_set_number_field(L, "value2", out->frames[i].value2);
+      lua_set_number_field(L, "flags", out->frames[i].flags);
+      lua_rawseti(L, -2, i + 1);
+   }
+   free_frames(out);
+   return 1;
+}
+
+/***
+Decodes serial characters from a capture. Returns a table of frames, each a table with `start` and `finish` in
+microseconds, `type` (`DECODE_DATA`), `value` and `flags` (`DECODE_PARITY_ERROR`, `DECODE_FRAMING_ERROR` and
+`DECODE_INCOMPLETE`).
+@function decode_uart
+@param capture `nil` for the last logic analyser capture, or the path of a recording
+@param channel channel/pin of the TX or RX line (idle high)
+@param baud bits per second
+@param options (optional) table with fields `bits` (5 to 9, default 8), `parity` (`"N"` default, `"E"` or `"O"`)
+and `stopbits` (1 default or 2)
+*/
+static int lua_decode_uart(lua_State* L)
+{
+   struct uart_config cfg;
+   struct transitions tr;
+   struct decode_frames out;
+   const char *parity = "N";
+   int result;
+
+   cfg.gpio = lua_sample_gpio(L, 2);
+   cfg.baud = (unsigned int)luaL_checkint(L, 3);
+   cfg.bits = 8;
+   cfg.stopbits = 1;
+   if (lua_istable(L, 4))
+   {
+      cfg.bits = (unsigned int)lua_get_opt_field(L, 4, "bits", 8);
+      cfg.stopbits = (unsigned int)lua_get_opt_field(L, 4, "stopbits", 1);
+      lua_getfield(L, 4, "parity");
+      if (!lua_isnil(L, -1))
+         parity = luaL_checkstring(L, -1);
+      lua_pop(L, 1);
+   }
+   if (cfg.baud == 0)
+      return luaL_error(L, "baud must be greater than 0");
+   if (cfg.bits < 5 || cfg.bits > 9 || cfg.stopbits < 1 || cfg.stopbits > 2)
+      return luaL_error(L, "bits must be from 5 to 9 and stopbits 1 or 2");
+   if (strcmp(parity, "N") != 0 && strcmp(parity, "E") != 0 && strcmp(parity, "O") != 0)
+      return luaL_error(L, "parity must be \"N\", \"E\" or \"O\"");
+   cfg.parity = parity[0];
+
+   lua_decode_source(L, 1U << cfg.gpio, &tr);
+   if (tr.rate < cfg.baud * 2)
+   {
+      free_transitions(&tr);
+      return luaL_error(L, "The capture must be sampled at least twice per bit");
+   }
+   result = decode_uart(&tr, &cfg, &out);
+   free_transitions(&tr);
+   return lua_decode_result(L, &out, result);
+}
+
+// the optional channel in field name of the table at index as a GPIO 0-31, -1 if absent
+static int lua_opt_sample_gpio(lua_State* L, int index, const char *name)
+{
+   int gpio = -1;
+
+   lua_getfield(L, index, name);
+   if (!lua_isnil(L, -1))
+      gpio = (int)lua_sample_gpio(L, lua_gettop(L));
+   lua_pop(L, 1);
+   return gpio;
+}
+
+/***
+Decodes SPI words from a capture. Returns a table of frames, each a table with `start` and `finish` in microseconds,
+`type` (`DECODE_DATA`), `value` (MOSI), `value2` (MISO) and `flags` (`DECODE_INCOMPLETE`).
+@function decode_spi
+@param capture `nil` for the last logic analyser capture, or the path of a recording
+@param clk channel/pin of the clock
+@param options (optional) table with fields `mosi`, `miso` and `cs` (channels, the active low chip select limiting
+words to while it is low), `mode` (0 to 3, default 0), `bits` (1 to 32, default 8) and `lsb_first` (default false)
+*/
+static int lua_decode_spi(lua_State* L)
+{
+   struct spi_config cfg;
+   struct transitions tr;
+   struct decode_frames out;
+   unsigned int gpios;
+   int result;
+
+   cfg.clk = lua_sample_gpio(L, 2);
+   cfg.mosi = cfg.miso = cfg.cs = -1;
+   cfg.mode = 0;
+   cfg.bits = 8;
+   cfg.lsb_first = 0;
+   if (lua_istable(L, 3))
+   {
+      cfg.mosi = lua_opt_sample_gpio(L, 3, "mosi");
+      cfg.miso = lua_opt_sample_gpio(L, 3, "miso");
+      cfg.cs = lua_opt_sample_gpio(L, 3, "cs");
+      cfg.mode = (int)lua_get_opt_field(L, 3, "mode", 0);
+      cfg.bits = (unsigned int)lua_get_opt_field(L, 3, "bits", 8);
+      lua_getfield(L, 3, "lsb_first");
+      cfg.lsb_first = lua_toboolean(L, -1);
+      lua_pop(L, 1);
+   }
+   if (cfg.mode < 0 || cfg.mode > 3)
+      return luaL_error(L, "mode must be from 0 to 3");
+   if (cfg.bits < 1 || cfg.bits > 32)
+      return luaL_error(L, "bits must be from 1 to 32");
+
+   gpios = 1U << cfg.clk;
+   if (cfg.mosi >= 0)
+      gpios |= 1U << cfg.mosi;
+   if (cfg.miso >= 0)
+      gpios |= 1U << cfg.miso;
+   if (cfg.cs >= 0)
+      gpios |= 1U << cfg.cs;
+   lua_decode_source(L, gpios, &tr);
+   result = decode_spi(&tr, &cfg, &out);
+   free_transitions(&tr);
+   return lua_decode_result(L, &out, result);
+}
+
+/***
+Decodes I2C transfers from a capture. Returns a table of frames, each a table with `start` and `finish` in
+microseconds, `type` (`DECODE_START`, `DECODE_ADDRESS` with the address byte and read bit in `value`, `DECODE_DATA`
+or `DECODE_STOP`), `value` and `flags` (`DECODE_NACK` and `DECODE_INCOMPLETE`).
+@function decode_i2c
+@param capture `nil` for the last logic analyser capture, or the path of a recording
+@param scl channel/pin of the clock
+@param sda channel/pin of the data
+*/
+static int lua_decode_i2c(lua_State* L)
+{
+   struct transitions tr;
+   struct decode_frames out;
+   unsigned int scl = lua_sample_gpio(L, 2);
+   unsigned int sda = lua_sample_gpio(L, 3);
+   int result;
+
+   lua_decode_source(L, (1U << scl) | (1U << sda), &tr);
+   result = decode_i2c(&tr, scl, sda, &out);
+   free_transitions(&tr);
+   return lua_decode_result(L, &out, result);
+}
+
+/***
+Decodes 1-Wire bytes at standard speed from a capture. Returns a table of frames, each a table with `start` and
+`finish` in microseconds, `type` (`DECODE_RESET`, with `DECODE_PRESENCE` in `flags` when a device answered, or
+`DECODE_DATA`) and `value`.
+@function decode_onewire
+@param capture `nil` for the last logic analyser capture, or the path of a recording
+@param channel channel/pin of the bus
+*/
+static int lua_decode_onewire(lua_State* L)
+{
+   struct transitions tr;
+   struct decode_frames out;
+   unsigned int gpio = lua_sample_gpio(L, 2);
+   int result;
+
+   lua_decode_source(L, 1U << gpio, &tr);
+   result = decode_onewire(&tr, gpio, &out);
+   free_transitions(&tr);
+   return lua_decode_result(L, &out, result);
+}
+
+/***
+Returns the current time in microseconds, on the clock of the event timestamps and `output_at`.
+@function timestamp
+@return time in microseconds
+*/
+static int lua_timestamp(lua_State* L)
+{
+   lua_pushnumber(L, (lua_Number)event_timestamp());
+   return 1;
+}
+
+/***
+Queues a change of outputs for an absolute time, made from a separate thread that spins the last 100 microseconds.
+Changes for the same time are made in the order queued, see `output_at_stats` for how late they were.
+@function output_at
+@param t time in microseconds (see `timestamp`), a time already past is made at once
+@param channel channel/pin set up as an output, or a table of them
+@param value truthy for `HIGH` (see `output`), or a table with a value for each channel
+*/
+static int lua_output_at(lua_State* L)
+{
+   unsigned long long t = (unsigned long long)luaL_checknumber(L, 1);
+   unsigned long long set = 0, clear = 0;
+   unsigned int gpio;
+   int n = 1, i, value, result;
+
+   if (lua_istable(L, 2))
+      n = lua_objlen(L, 2);
+   if (lua_istable(L, 3) && (int)lua_objlen(L, 3) != n)
+      return luaL_error(L, "values must have one value for each channel");
+
+   for (i = 0; i < n; i++)
+   {
+      if (lua_istable(L, 2))
+      {
+         lua_rawgeti(L, 2, i + 1);
+         gpio = lua_get_gpio_number(L, luaL_checkint(L, -1));
+         lua_pop(L, 1);
+      } else {
+         gpio = lua_get_gpio_number(L, luaL_checkint(L, 2));
+      }
+      if (lua_istable(L, 3))
+      {
+         lua_rawgeti(L, 3, i + 1);
+         value = lua_get_high_low(L, lua_gettop(L));
+         lua_pop(L, 1);
+      } else {
+         value = lua_get_high_low(L, 3);
+      }
+      if (gpio_direction[gpio] != OUTPUT)
+         return luaL_error(L, "The GPIO channel has not been set up as an OUTPUT");
+      if (value)
+         set |= 1ULL << gpio;
+      else
+         clear |= 1ULL << gpio;
+   }
+
+   result = output_at(t, set, clear);
+   if (result == 1)
+      return luaL_error(L, "Too many timed outputs queued");
+   else if (result != 0)
+      return luaL_error(L, "Failed to start the output thread");
+   return 0;
+}
+
+/***
+Drops the timed outputs not made yet.
+@function output_at_cancel
+@return number of changes dropped
+*/
+static int lua_output_at_cancel(lua_State* L)
+{
+   lua_pushnumber(L, output_sched_cancel());
+   return 1;
+}
+
+/***
+Returns the state of the timed outputs.
+@function output_at_stats
+@return table with fields `scheduled`, `executed`, `pending` (changes) and `late_last`, `late_avg` and `late_max`
+(lateness of the changes made in microseconds)
+*/
+static int lua_output_at_stats(lua_State* L)
+{
+   struct output_sched_stats stats;
+
+   get_output_sched_stats(&stats);
+   lua_newtable(L);
+   lua_set_number_field(L, "scheduled", (lua_Number)stats.scheduled);
+   lua_set_number_field(L, "executed", (lua_Number)stats.executed);
+   lua_set_number_field(L, "pending", stats.pending);
+   lua_set_number_field(L, "late_last", stats.late_last);
+   lua_set_number_field(L, "late_avg", stats.late_avg);
+   lua_set_number_field(L, "late_max", stats.late_max);
+   return 1;
+}
+
+/***
+Creates a waveform, a pattern of outputs played from a real time thread at absolute deadlines.
+The steps are used without copying and the pins they change must be set up as outputs when the waveform is made.
+@function newWaveform
+@param steps string of native unsigned 32 bit (set mask, clear mask, hold in ns) triplets for GPIO 0-31, e.g. from
+`string.pack("I4I4I4", set, clear, hold)` in Lua 5.3
+@return Waveform object with methods `play` and `queue` and fields `steps` and `duration` (ns for one pass)
+*/
+static int lua_waveform_init(lua_State* L)
+{
+   size_t len;
+   const char *steps = luaL_checklstring(L, 1, &len);
+   unsigned int gpio, outputs = 0;
+   WaveformObject *self;
+   int result;
+
+   if (len == 0 || len % (WAVE_STEP_WORDS * sizeof(unsigned int)) != 0 || ((size_t)steps % sizeof(unsigned int)) != 0)
+      return luaL_error(L, "steps must be a string of unsigned 32 bit (set, clear, hold) triplets");
+
+   for (gpio = 0; gpio < 32; gpio++)
+      if (gpio_direction[gpio] == OUTPUT)
+         outputs |= 1U << gpio;
+
+   self = lua_newuserdata(L, sizeof(WaveformObject));
+   self->steps_ref = LUA_NOREF;
+   self->w.offsets = NULL;
+   lua_getfield(L, LUA_REGISTRYINDEX, WAVEFORM_MT_NAME);
+   lua_setmetatable(L, -2);
+
+   result = wave_compile(&self->w, (const unsigned int *)steps, len / (WAVE_STEP_WORDS * sizeof(unsigned int)), outputs);
+   if (result == 1)
+      return luaL_error(L, "Every step must hold for at least 1ns");
+   else if (result == 2)
+      return luaL_error(L, "The steps change GPIO channels not set up as an OUTPUT");
+   else if (result == 3)
+      return luaL_error(L, "A step can not both set and clear a GPIO");
+   else if (result != 0)
+      return luaL_error(L, "Out of memory");
+
+   lua_pushvalue(L, 1);
+   self->steps_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+   return 1;
+}
+
+static int lua_waveform_start(lua_State* L, int queue)
+{
+   WaveformObject *self = luaL_checkudata(L, 1, WAVEFORM_MT_NAME);
+   unsigned int repeat = (unsigned int)luaL_optint(L, 2, 1);
+   int i, result;
+
+   result = wave_play(&self->w, repeat, queue);
+   if (result == 1)
+      return luaL_error(L, "A waveform is queued already");
+   else if (result != 0)
+      return luaL_error(L, "Failed to start the waveform thread");
+
+   lua_waveform_reap(L);
+   for (i = 0; i < 3; i++)
+   {
+      if (in_player[i] == NULL)
+      {
+         lua_pushvalue(L, 1);
+         in_player_ref[i] = luaL_ref(L, LUA_REGISTRYINDEX);
+         in_player[i] = self;
+         break;
+      }
+   }
+   lua_settop(L, 1); // only return object itself
+   return 1;
+}
+
+/***
+Plays the waveform at once, replacing any playing or queued.
+@function play
+@param self Waveform object to operate on
+@param repeat (optional) times to play it, 0 until stopped or followed by a queued waveform (default 1)
+@return Waveform object
+*/
+static int lua_waveform_play(lua_State* L)
+{
+   return lua_waveform_start(L, 0);
+}
+
+/***
+Plays the waveform right after the one playing, ending a repeating one at the end of its pass, or at once if none is.
+@function queue
+@param self Waveform object to operate on
+@param repeat (optional) times to play it, 0 until stopped or followed by a queued waveform (default 1)
+@return Waveform object
+*/
+static int lua_waveform_queue(lua_State* L)
+{
+   return lua_waveform_start(L, 1);
+}
+
+// field access, methods or steps and duration
+static int lua_waveform_index(lua_State* L)
+{
+   WaveformObject *self = luaL_checkudata(L, 1, WAVEFORM_MT_NAME);
+   const char *key = luaL_checkstring(L, 2);
+
+   if (strcmp(key, "steps") == 0)
+      lua_pushnumber(L, self->w.count);
+   else if (strcmp(key, "duration") == 0)
+      lua_pushnumber(L, (lua_Number)self->w.duration);
+   else if (strcmp(key, "play") == 0)
+      lua_pushcfunction(L, lua_waveform_play);
+   else if (strcmp(key, "queue") == 0)
+      lua_pushcfunction(L, lua_waveform_queue);
+   else
+      lua_pushnil(L);
+   return 1;
+}
+
+// deallocation method, the player holds a reference while it uses the steps
+static int lua_waveform_dealloc(lua_State* L)
+{
+   WaveformObject *self = luaL_checkudata(L, 1, WAVEFORM_MT_NAME);
+
+   // when the state is closed the references of the player go too
+   if (wave_in_use(&self->w))
+      wave_stop();
+   wave_free(&self->w);
+   luaL_unref(L, LUA_REGISTRYINDEX, self->steps_ref);
+   self->steps_ref = LUA_NOREF;
+   return 0;
+}
+
+/***
+Stops the waveform playing and drops any queued, the outputs keep their last levels.
+@function wave_stop
+*/
+static int lua_wave_stop(lua_State* L)
+{
+   wave_stop();
+   lua_waveform_reap(L);
+   return 0;
+}
+
+/***
+Returns the state of the waveform player.
+@function wave_status
+@return table with fields `playing` and `queued` (booleans), `steps` and `loops` (steps made and passes played to the
+end) and `late_max` (worst lateness of a step in microseconds)
+*/
+static int lua_wave_status(lua_State* L)
+{
+   struct wave_status status;
+
+   get_wave_status(&status);
+   lua_waveform_reap(L);
+   lua_newtable(L);
+   lua_pushboolean(L, status.playing);
+   lua_setfield(L, -2, "playing");
+   lua_pushboolean(L, status.queued);
+   lua_setfield(L, -2, "queued");
+   lua_set_number_field(L, "steps", (lua_Number)status.steps);
+   lua_set_number_field(L, "loops", (lua_Number)status.loops);
+   lua_set_number_field(L, "late_max", status.late_max);
+   return 1;
+}
+
+/***
+Sets the scheduling and cores of the module's threads, applied at once to those running and to those started later.
+Real time priority needs root or CAP_SYS_NICE. The environment variable `RPI_GPIO_RT` configures the threads as the
+module loads, e.g. `poll=fifo:80@3 pwm=rr:60@2-3 prefault=65536 mlock`, invalid entries are ignored.
+@function set_thread_config
+@param threads `THREAD_POLL` (edge detection), `THREAD_PWM` (software PWM), `THREAD_EXECUTOR` (callbacks),
+`THREAD_SERVICE` (timed outputs, waveforms and timers), the sum of several of them, or `THREAD_ALL`
+@param policy `SCHED_OTHER`, `SCHED_FIFO` or `SCHED_RR`
+@param priority (optional) 1-99 for `SCHED_FIFO` and `SCHED_RR`, 0 for `SCHED_OTHER` (default)
+@param cpus (optional) table of the cores the threads may run on, e.g. isolated ones (default the cores the process
+started with)
+@return `true`, or `false` when the system refused the settings for a running thread, see `thread_config`
+*/
+static int lua_set_thread_config(lua_State* L)
+{
+   struct rt_config cfg;
+   int threads = luaL_checkint(L, 1);
+   int cls, core, i, n, refused = 0;
+
+   cfg.policy = luaL_checkint(L, 2);
+   cfg.priority = luaL_optint(L, 3, 0);
+   if (threads <= 0 || threads >= (1 << RT_CLASSES))
+      return luaL_error(L, "threads must be THREAD_POLL, THREAD_PWM, THREAD_EXECUTOR, THREAD_SERVICE or a sum of them");
+
+   cfg.cpus = 0;
+   if (!lua_isnoneornil(L, 4))
+   {
+      luaL_checktype(L, 4, LUA_TTABLE);
+      n = lua_objlen(L, 4);
+      for (i = 0; i < n; i++)
+      {
+         lua_rawgeti(L, 4, i + 1);
+         core = luaL_checkint(L, -1);
+         lua_pop(L, 1);
+         if (core < 0 || core > 63)
+            return luaL_error(L, "cores must be 0-63");
+         cfg.cpus |= 1ULL << core;
+      }
+   }
+
+   for (cls = 0; cls < RT_CLASSES; cls++)
+   {
+      if (!(threads & (1 << cls)))
+         continue;
+      n = rt_set_config(cls, &cfg);
+      if (n == 2)
+         return luaL_error(L, "policy must be SCHED_OTHER with priority 0, or SCHED_FIFO or SCHED_RR with priority 1-99");
+      refused |= n;
+   }
+   lua_pushboolean(L, !refused);
+   return 1;
+}
+
+/***
+Locks all current and future memory of the process so it is never paged out.
+Needs root, CAP_IPC_LOCK or a large enough RLIMIT_MEMLOCK.
+@function lock_memory
+@param enable (optional) `false` unlocks the memory (default `true`)
+@param prefault (optional) bytes of stack each thread of the module touches as it starts (default 0)
+*/
+static int lua_lock_memory(lua_State* L)
+{
+   int enable = lua_isnoneornil(L, 1) || lua_toboolean(L, 1);
+   int result = rt_lock_memory(enable, (unsigned int)luaL_optnumber(L, 2, 0));
+
+   if (result == 1)
+      return luaL_error(L, "Failed to lock memory, needs root, CAP_IPC_LOCK or a larger RLIMIT_MEMLOCK");
+   else if (result == 2)
+      return luaL_error(L, "prefault must be at most %d bytes", RT_PREFAULT_MAX);
+   return 0;
+}
+
+// pushes the table thread_config reports for a class of threads
+static void lua_push_thread_status(lua_State* L, int cls)
+{
+   struct rt_status status;
+   int i, k = 0;
+
+   rt_get_status(cls, &status);
+   lua_newtable(L);
+   lua_set_number_field(L, "policy", status.effective.policy);
+   lua_set_number_field(L, "priority", status.effective.priority);
+   lua_set_number_field(L, "threads", status.threads);
+   lua_set_number_field(L, "failed", (lua_Number)status.failed);
+   lua_newtable(L);
+   for (i = 0; i < 64; i++)
+   {
+      if (status.effective.cpus & (1ULL << i))
+      {
+         lua_pushnumber(L, i);
+         lua_rawseti(L, -2, ++k);
+      }
+   }
+   lua_setfield(L, -2, "cpus");
+}
+
+/***
+Returns what the module's threads run with.
+@function thread_config
+@return table with fields `poll`, `pwm`, `executor` and `service`, tables with the fields `policy`, `priority` and
+`cpus` of a running thread (as configured when none runs), `threads` (number running) and `failed` (settings the system
+refused), and fields `memory_locked` (boolean) and `prefault` (bytes), see `lock_memory`
+*/
+static int lua_thread_config(lua_State* L)
+{
+   unsigned int prefault;
+   int locked;
+
+   rt_get_memory(&locked, &prefault);
+   lua_newtable(L);
+   lua_push_thread_status(L, RT_POLL);
+   lua_setfield(L, -2, "poll");
+   lua_push_thread_status(L, RT_PWM);
+   lua_setfield(L, -2, "pwm");
+   lua_push_thread_status(L, RT_EXECUTOR);
+   lua_setfield(L, -2, "executor");
+   lua_push_thread_status(L, RT_SERVICE);
+   lua_setfield(L, -2, "service");
+   lua_pushboolean(L, locked);
+   lua_setfield(L, -2, "memory_locked");
+   lua_set_number_field(L, "prefault", prefault);
+   return 1;
+}
+
+/***
+Creates a timer, ticking at a fixed rate from absolute deadlines on one thread shared by all timers, until `cancel`
+or the timer is collected. Ticks the thread is a period or more late for are skipped and counted as overruns.
+@function newTimer
+@param period time between ticks in microseconds, the first tick is a period from now
+@param callback (optional) function called with the timestamp the tick was due in microseconds, may be `nil`
+@param options (optional) table with the optional fields `toggle` (table of output channels/pins inverted on each
+tick in C) and `samples` (size of a ring of the levels of GPIO 0-31 read on each tick in C, see `samples`)
+@return Timer object with methods `cancel`, `stats` and `samples`
+*/
+static int lua_timer_init(lua_State* L)
+{
+   struct timer_config cfg;
+   TimerObject *self;
+   int id;
+
+   cfg.period = (unsigned long long)luaL_checknumber(L, 1);
+   if (cfg.period == 0)
+      return luaL_error(L, "period must be greater than 0");
+   if (!lua_isnoneornil(L, 2))
+      luaL_checktype(L, 2, LUA_TFUNCTION);
+   cfg.callback = !lua_isnoneornil(L, 2);
+   cfg.toggle = 0;
+   cfg.samples = 0;
+   if (lua_istable(L, 3))
+   {
+      cfg.toggle = lua_get_output_mask(L, 3, "toggle");
+      cfg.samples = (unsigned int)lua_get_opt_field(L, 3, "samples", 0);
+   }
+
+   self = lua_newuserdata(L, sizeof(TimerObject));
+   self->id = -1;
+   lua_getfield(L, LUA_REGISTRYINDEX, TIMER_MT_NAME);
+   lua_setmetatable(L, -2);
+
+   if ((id = add_timer(&cfg)) == -1)
+      return luaL_error(L, "Too many timers");
+   else if (id == -2)
+      return luaL_error(L, "Out of memory");
+   else if (id < 0)
+      return luaL_error(L, "Failed to start the timer thread");
+   self->id = id;
+   timer_objects[id] = self;
+   if (cfg.callback)
+      add_lua_callback(L, TIMER_GPIO + id, 2, 0);
+   return 1;
+}
+
+/***
+Stops the timer.
+@function cancel
+@param self Timer object to operate on
+*/
+static int lua_timer_cancel(lua_State* L)
+{
+   TimerObject *self = luaL_checkudata(L, 1, TIMER_MT_NAME);
+
+   if (self->id >= 0)
+   {
+      timer_objects[self->id] = NULL;
+      remove_timer(self->id);
+      remove_lua_callbacks(L, TIMER_GPIO + self->id);
+      self->id = -1;
+   }
+   return 0;
+}
+
+/***
+Returns the statistics of the timer.
+@function stats
+@param self Timer object to operate on
+@return table with fields `ticks`, `overruns` (ticks skipped because the timer thread was a period or more late),
+`dropped` (samples overwritten before they were read) and `late_last`, `late_avg` and `late_max` (lateness of the
+ticks in microseconds)
+*/
+static int lua_timer_stats(lua_State* L)
+{
+   TimerObject *self = luaL_checkudata(L, 1, TIMER_MT_NAME);
+   struct timer_stats stats;
+
+   if (self->id < 0 || get_timer_stats(self->id, &stats) != 0)
+      return luaL_error(L, "The timer has been cancelled");
+   lua_newtable(L);
+   lua_set_number_field(L, "ticks", (lua_Number)stats.ticks);
+   lua_set_number_field(L, "overruns", (lua_Number)stats.overruns);
+   lua_set_number_field(L, "dropped", (lua_Number)stats.dropped);
+   lua_set_number_field(L, "late_last", stats.late_last);
+   lua_set_number_field(L, "late_avg", stats.late_avg);
+   lua_set_number_field(L, "late_max", stats.late_max);
+   return 1;
+}
+
+/***
+Returns and removes the samples taken so far, oldest first.
+@function samples
+@param self Timer object to operate on
+@return table of tables with fields `timestamp` (microseconds) and `levels` (bit n is GPIO n)
+*/
+static int lua_timer_samples(lua_State* L)
+{
+   TimerObject *self = luaL_checkudata(L, 1, TIMER_MT_NAME);
+   struct timer_sample buf[256];
+   unsigned int n, i;
+   int k = 0;
+
+   if (self->id < 0)
+      return luaL_error(L, "The timer has been cancelled");
+   lua_newtable(L);
+   while ((n = timer_samples(self->id, buf, 256)) > 0)
+   {
+      for (i = 0; i < n; i++)
+      {
+         lua_createtable(L, 0, 2);
+         lua_set_number_field(L, "timestamp", (lua_Number)buf[i].timestamp);
+         lua_set_number_field(L, "levels", buf[i].levels);
+         lua_rawseti(L, -2, ++k);
+      }
+   }
+   return 1;
+}
+
+typedef struct
+{
+   struct gpio_pin pin;   // resolved once, the methods take no arguments to check
+} PinObject;
+
+/***
+Creates a pin object, a channel resolved once to its GPIO number and register bits, for tight loops. Set the
+channel up with `setup` first.
+@function newPin
+@param channel channel/pin (see `setmode`)
+@return Pin object with methods `high`, `low`, `toggle`, `write` and `read`
+*/
+static int lua_pin_init(lua_State* L)
+{
+   unsigned int gpio = lua_get_gpio_number(L, luaL_checkint(L, 1));
+   PinObject *self;
+
+   self = lua_newuserdata(L, sizeof(PinObject));
+   resolve_pin(gpio, &self->pin);
+   lua_getfield(L, LUA_REGISTRYINDEX, PIN_MT_NAME);
+   lua_setmetatable(L, -2);
+   return 1;
+}
+
+static PinObject *lua_check_output_pin(lua_State* L)
+{
+   PinObject *self = luaL_checkudata(L, 1, PIN_MT_NAME);
+
+   if (gpio_direction[self->pin.gpio] != OUTPUT)
+      luaL_error(L, "The GPIO channel has not been set up as an OUTPUT");
+   return self;
+}
+
+/***
+Sets the output `HIGH`.
+@function high
+@param self Pin object to operate on
+*/
+static int lua_pin_high(lua_State* L)
+{
+   output_pin(&lua_check_output_pin(L)->pin, HIGH);
+   return 0;
+}
+
+/***
+Sets the output `LOW`.
+@function low
+@param self Pin object to operate on
+*/
+static int lua_pin_low(lua_State* L)
+{
+   output_pin(&lua_check_output_pin(L)->pin, LOW);
+   return 0;
+}
+
+/***
+Inverts the output.
+@function toggle
+@param self Pin object to operate on
+@return the new level, `true` for `HIGH`
+*/
+static int lua_pin_toggle(lua_State* L)
+{
+   lua_pushboolean(L, toggle_pin(&lua_check_output_pin(L)->pin));
+   return 1;
+}
+
+/***
+Sets the output.
+@function write
+@param self Pin object to operate on
+@param value truthy for `HIGH`, falsy (or numeric 0) for `LOW`, as in `output`
+*/
+static int lua_pin_write(lua_State* L)
+{
+   PinObject *self = lua_check_output_pin(L);
+
+   output_pin(&self->pin, lua_get_high_low(L, 2));
+   return 0;
+}
+
+/***
+Reads the level of the pin, for outputs the current output value.
+@function read
+@param self Pin object to operate on
+@return Boolean `true` for a `HIGH` value, or `false` for a `LOW` value
+*/
+static int lua_pin_read(lua_State* L)
+{
+   PinObject *self = luaL_checkudata(L, 1, PIN_MT_NAME);
+
+   // check channel is set up as an input or output
+   if (gpio_direction[self->pin.gpio] != INPUT && gpio_direction[self->pin.gpio] != OUTPUT)
+      return luaL_error(L, "You must setup() the GPIO channel first");
+   lua_pushboolean(L, input_pin(&self->pin));
+   return 1;
+}
+
+/***
+Reads events detected (non-blocking). Pins must first be configured using `add_event_detect`, events will be queued, 
+so `event_detected` will not miss events.
+@function event_detected
+@param channel channel/pin to check for events (see `setmode`)
+@return boolean, `true` if an event was detected, `false` otherwise
+*/
+static int lua_event_detected(lua_State* L)
+{
+   unsigned int gpio = lua_get_gpio_number(L, luaL_checkint(L, 1));
+
+   if (event_detected(gpio))
+      lua_pushboolean(L, 1);
+   else
+      lua_pushboolean(L, 0);
+   return 1;
+}
+
+/***
+Wait for an event (blocking).
+@function wait_for_edge
+@param channel channel/pin to check for events (see `setmode`)
+@param edge What type of edge to wait for. Either `RISING`, `FALLING` or `BOTH`.
+*/
+static int lua_wait_for_edge(lua_State* L)
+{
+   unsigned int gpio = lua_get_gpio_number(L, luaL_checkint(L, 1));
+   int edge = luaL_checkint(L, 2);
+   int result;
+   char error[30];
+
+   // check channel is setup as an input
+   if (gpio_direction[gpio] != INPUT)
+      return luaL_error(L, "You must setup() the GPIO channel as an input first");
+
+   // is edge a valid value?
+   edge -= LUA_EVENT_CONST_OFFSET;
+   if (edge != RISING_EDGE && edge != FALLING_EDGE && edge != BOTH_EDGE)
+      return luaL_error(L, "The edge must be set to RISING, FALLING or BOTH");
+
+   result = blocking_wait_for_edge(gpio, edge);
+
+   if (result == 0) {
+      return 0;
+   } else if (result == 2) {
+      return luaL_error(L, "Edge detection events already enabled for this GPIO channel");
+   } else {
+      sprintf(error, "Error #%d waiting for edge", result);
+      return luaL_error(L, error);
+   }
+}
+
+/***
+Wait for an event on any of several pins (blocking). Pins without event detection get it added, and keep it
+so the next call is quick, until `add_event_detect`, `remove_event_detect` or `cleanup` is used on them.
+Pins with event detection report the edges they were set up for.
+@function wait_for_any
+@param channels table (list) of channels/pins to wait for (see `setmode`)
+@param edge What type of edge to wait for. Either `RISING`, `FALLING` or `BOTH`.
+@param timeout (optional) timeout in milliseconds, -1 (default) waits forever
+@return channel/pin of the first edge, or `nil` on timeout
+@return timestamp of the edge in microseconds (CLOCK_MONOTONIC)
+*/
+static int lua_wait_for_any(lua_State* L)
+{
+   unsigned int gpios[54];
+   int edge = luaL_checkint(L, 2);
+   int timeout = luaL_optint(L, 3, -1);
+   int n, i, result;
+   struct gpio_event ev;
+
+   luaL_checktype(L, 1, LUA_TTABLE);
+   n = lua_objlen(L, 1);
+   if (n < 1 || n > 54)
+      return luaL_error(L, "channels must hold 1 to 54 channels");
+   for (i = 0; i < n; i++)
+   {
+      lua_rawgeti(L, 1, i + 1);
+      gpios[i] = lua_get_gpio_number(L, luaL_checkint(L, -1));
+      lua_pop(L, 1);
+
+      // check channel is setup as an input
+      if (gpio_direction[gpios[i]] != INPUT)
+         return luaL_error(L, "You must setup() the GPIO channel as an input first");
+   }
+
+   // is edge a valid value?
+   edge -= LUA_EVENT_CONST_OFFSET;
+   if (edge != RISING_EDGE && edge != FALLING_EDGE && edge != BOTH_EDGE)
+      return luaL_error(L, "The edge must be set to RISING, FALLING or BOTH");
+
+   result = wait_for_any(gpios, n, edge, timeout, &ev);
+
+   if (result == 1)
+   {
+      lua_pushnil(L);
+      return 1;
+   } else if (result == 2) {
+      return luaL_error(L, "Failed to add edge detection");
+   }
+   lua_pushinteger(L, chan_from_gpio(ev.gpio));
+   lua_pushnumber(L, (lua_Number)ev.timestamp);
+   return 2;
+}
+
+static const struct luaL_Reg gpio_lib[] = {
+  { "setup", lua_setup_channel},
+  { "cleanup", lua_cleanup},
+  { "input", lua_input_gpio},
+  { "output", lua_output_gpio},
+  { "setmode", lua_setmode},  
+  { "gpio_function", lua_gpio_function},
+  { "setwarnings", lua_setwarnings},
+  
+  // interrupts and events
+  { "wait_for_edge", lua_wait_for_edge},
+  { "wait_for_any", lua_wait_for_any},
+  { "count", lua_count},
+  { "count_and_reset", lua_count_and_reset},
+  { "counts", lua_counts},
+  { "measure", lua_measure},
+  { "add_reflex", lua_add_reflex},
+  { "remove_reflex", lua_remove_reflex},
+  { "add_pattern", lua_add_pattern},
+  { "pattern_state", lua_pattern_state},
+  { "remove_pattern", lua_remove_pattern},
+  { "stats", lua_stats},
+  { "reset_stats", lua_reset_stats},
+  { "trace_start", lua_trace_start},
+  { "trace_stop", lua_trace_stop},
+  { "trace_dump", lua_trace_dump},
+  { "record_start", lua_record_start},
+  { "record_stop", lua_record_stop},
+  { "record_stats", lua_record_stats},
+  { "recording", lua_recording},
+  { "replay_events", lua_replay_events},
+  { "replay_stop", lua_replay_stop},
+  { "replay_stats", lua_replay_stats},
+  { "sampler_start", lua_sampler_start},
+  { "sampler_stop", lua_sampler_stop},
+  { "sampler_state", lua_sampler_state},
+  { "sampler_data", lua_sampler_data},
+  { "sampler_save_vcd", lua_sampler_save_vcd},
+  { "decode_uart", lua_decode_uart},
+  { "decode_spi", lua_decode_spi},
+  { "decode_i2c", lua_decode_i2c},
+  { "decode_onewire", lua_decode_onewire},
+  { "timestamp", lua_timestamp},
+  { "output_at", lua_output_at},
+  { "output_at_cancel", lua_output_at_cancel},
+  { "output_at_stats", lua_output_at_stats},
+  { "event_detected", lua_event_detected},
+  { "add_event_detect", lua_add_event_detect},
+  { "remove_event_detect", lua_remove_event_detect},
+  { "add_event_callback", lua_add_event_callback},
+  { "simulate_events", lua_simulate_events},
+  { "simulated_stats", lua_simulated_stats},
+  { "rejected_events", lua_rejected_events},
+  { "set_callback_executor", lua_set_callback_executor},
+  { "callback_queue_stats", lua_callback_queue_stats},
+  
+  // PWM
+  { "newPWM", lua_pwm_init},
+  { "newWaveform", lua_waveform_init},
+  { "newTimer", lua_timer_init},
+  { "newPin", lua_pin_init},
+  { "wave_stop", lua_wave_stop},
+  { "wave_status", lua_wave_status},
+  { "set_thread_config", lua_set_thread_config},
+  { "lock_memory", lua_lock_memory},
+  { "thread_config", lua_thread_config},
+  { "start", lua_pwm_start},
+  { "ChangeFrequency", lua_pwm_ChangeFrequency},
+  { "ChangeDutyCycle", lua_pwm_ChangeDutyCycle},
+  { "stop", lua_pwm_stop},
+
+  {NULL, NULL}
+};
+  
+
+int luaopen_GPIO (lua_State *L){
+  
+  
+  int i, result;
+
+  for (i=0; i<54; i++)
+      gpio_direction[i] = -1;
+
+   result = setup();
+   if (result == SETUP_DEVMEM_FAIL)
+   {
+      return luaL_error(L, "GPIO module has no access to /dev/mem.  Try running as root!");
+   } else if (result == SETUP_MALLOC_FAIL) {
+      return luaL_error(L, "No memory!");
+   } else if (result == SETUP_MMAP_FAIL) {
+      return luaL_error(L,  "Mmap of GPIO registers failed");
+   } 
+
+   // real time settings of the module's threads from the environment
+   rt_config_from_env();
+
+  //Metatable for PWM objects
+  luaL_newmetatable(L, PWM_MT_NAME);
+  lua_pushcfunction(L, lua_pwm_dealloc);
+  lua_setfield(L, -2, "__gc");
+  lua_newtable(L);  // __index table
+  lua_pushcfunction(L, lua_pwm_start);
+  lua_setfield(L, -2, "start");
+  lua_pushcfunction(L, lua_pwm_ChangeFrequency);
+  lua_setfield(L, -2, "ChangeFrequency");
+  lua_pushcfunction(L, lua_pwm_ChangeDutyCycle);
+  lua_setfield(L, -2, "ChangeDutyCycle");
+  lua_pushcfunction(L, lua_pwm_stop);
+  lua_setfield(L, -2, "stop");
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+
+  //Metatable for waveforms
+  luaL_newmetatable(L, WAVEFORM_MT_NAME);
+  lua_pushcfunction(L, lua_waveform_dealloc);
+  lua_setfield(L, -2, "__gc");
+  lua_pushcfunction(L, lua_waveform_index);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+
+  //Metatable for timers
+  luaL_newmetatable(L, TIMER_MT_NAME);
+  lua_pushcfunction(L, lua_timer_cancel);
+  lua_setfield(L, -2, "__gc");
+  lua_newtable(L);  // __index table
+  lua_pushcfunction(L, lua_timer_cancel);
+  lua_setfield(L, -2, "cancel");
+  lua_pushcfunction(L, lua_timer_stats);
+  lua_setfield(L, -2, "stats");
+  lua_pushcfunction(L, lua_timer_samples);
+  lua_setfield(L, -2, "samples");
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+
+  //Metatable for pins
+  luaL_newmetatable(L, PIN_MT_NAME);
+  lua_newtable(L);  // __index table
+  lua_pushcfunction(L, lua_pin_high);
+  lua_setfield(L, -2, "high");
+  lua_pushcfunction(L, lua_pin_low);
+  lua_setfield(L, -2, "low");
+  lua_pushcfunction(L, lua_pin_toggle);
+  lua_setfield(L, -2, "toggle");
+  lua_pushcfunction(L, lua_pin_write);
+  lua_setfield(L, -2, "write");
+  lua_pushcfunction(L, lua_pin_read);
+  lua_setfield(L, -2, "read");
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+
+  //Metatable for recording readers
+  luaL_newmetatable(L, RECORDING_MT_NAME);
+  lua_pushcfunction(L, lua_recording_close);
+  lua_setfield(L, -2, "__gc");
+  lua_pop(L, 1);
+
+  //luaL_newlib(L, gpio_lib);
+  luaL_register(L, "GPIO", gpio_lib);
+  
+  lua_pushboolean(L, 1);
+  lua_setfield(L, -2, "HIGH");
+
+  lua_pushboolean(L, 0);
+  lua_setfield(L, -2, "LOW");
+
+  lua_pushnumber(L, OUTPUT);
+  lua_setfield(L, -2, "OUT");
+
+  lua_pushnumber(L, INPUT);
+  lua_setfield(L, -2, "IN");
+  
+  lua_pushnumber(L, PWM);
+  lua_setfield(L, -2, "PWM");
 
   lua_pushnumber(L, SERIAL);
   lua_setfield(L, -2, "SERIAL");
@@ -973,6 +3183,99 @@ int luaopen_GPIO (lua_State *L){
   lua_pushnumber(L, BOTH_EDGE + LUA_EVENT_CONST_OFFSET);
   lua_setfield(L, -2, "BOTH");
 
+  lua_pushnumber(L, SYNTH_FIXED);
+  lua_setfield(L, -2, "SYNTH_FIXED");
+
+  lua_pushnumber(L, SYNTH_BURST);
+  lua_setfield(L, -2, "SYNTH_BURST");
+
+  lua_pushnumber(L, SYNTH_POISSON);
+  lua_setfield(L, -2, "SYNTH_POISSON");
+
+  lua_pushnumber(L, SYNTH_SQUARE);
+  lua_setfield(L, -2, "SYNTH_SQUARE");
+
+  lua_pushnumber(L, QUEUE_DROP_OLDEST);
+  lua_setfield(L, -2, "DROP_OLDEST");
+
+  lua_pushnumber(L, QUEUE_DROP_NEWEST);
+  lua_setfield(L, -2, "DROP_NEWEST");
+
+  lua_pushnumber(L, QUEUE_COALESCE);
+  lua_setfield(L, -2, "COALESCE");
+
+  lua_pushnumber(L, SAMPLER_IDLE);
+  lua_setfield(L, -2, "SAMPLER_IDLE");
+
+  lua_pushnumber(L, SAMPLER_ARMED);
+  lua_setfield(L, -2, "SAMPLER_ARMED");
+
+  lua_pushnumber(L, SAMPLER_TRIGGERED);
+  lua_setfield(L, -2, "SAMPLER_TRIGGERED");
+
+  lua_pushnumber(L, SAMPLER_DONE);
+  lua_setfield(L, -2, "SAMPLER_DONE");
+
+  lua_pushnumber(L, SAMPLER_RAW);
+  lua_setfield(L, -2, "SAMPLER_RAW");
+
+  lua_pushnumber(L, SAMPLER_RLE);
+  lua_setfield(L, -2, "SAMPLER_RLE");
+
+  lua_pushnumber(L, DECODE_DATA);
+  lua_setfield(L, -2, "DECODE_DATA");
+
+  lua_pushnumber(L, DECODE_START);
+  lua_setfield(L, -2, "DECODE_START");
+
+  lua_pushnumber(L, DECODE_STOP);
+  lua_setfield(L, -2, "DECODE_STOP");
+
+  lua_pushnumber(L, DECODE_ADDRESS);
+  lua_setfield(L, -2, "DECODE_ADDRESS");
+
+  lua_pushnumber(L, DECODE_RESET);
+  lua_setfield(L, -2, "DECODE_RESET");
+
+  lua_pushnumber(L, DECODE_PARITY_ERROR);
+  lua_setfield(L, -2, "DECODE_PARITY_ERROR");
+
+  lua_pushnumber(L, DECODE_FRAMING_ERROR);
+  lua_setfield(L, -2, "DECODE_FRAMING_ERROR");
+
+  lua_pushnumber(L, DECODE_NACK);
+  lua_setfield(L, -2, "DECODE_NACK");
+
+  lua_pushnumber(L, DECODE_INCOMPLETE);
+  lua_setfield(L, -2, "DECODE_INCOMPLETE");
+
+  lua_pushnumber(L, DECODE_PRESENCE);
+  lua_setfield(L, -2, "DECODE_PRESENCE");
+
+  lua_pushnumber(L, 1 << RT_POLL);
+  lua_setfield(L, -2, "THREAD_POLL");
+
+  lua_pushnumber(L, 1 << RT_PWM);
+  lua_setfield(L, -2, "THREAD_PWM");
+
+  lua_pushnumber(L, 1 << RT_EXECUTOR);
+  lua_setfield(L, -2, "THREAD_EXECUTOR");
+
+  lua_pushnumber(L, 1 << RT_SERVICE);
+  lua_setfield(L, -2, "THREAD_SERVICE");
+
+  lua_pushnumber(L, (1 << RT_CLASSES) - 1);
+  lua_setfield(L, -2, "THREAD_ALL");
+
+  lua_pushnumber(L, SCHED_OTHER);
+  lua_setfield(L, -2, "SCHED_OTHER");
+
+  lua_pushnumber(L, SCHED_FIFO);
+  lua_setfield(L, -2, "SCHED_FIFO");
+
+  lua_pushnumber(L, SCHED_RR);
+  lua_setfield(L, -2, "SCHED_RR");
+
   lua_pushstring(L, LUA_MODULE_VERSION);
   lua_setfield(L, -2, "VERSION");
   
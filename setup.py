@@ -1,4 +1,14 @@
+import sys
 from distutils.core import setup, Extension
+from distutils.command.build_py import build_py
+
+class build_py_versioned(build_py):
+    """Leaves out RPi._asyncio before Python 3.5, it uses async def"""
+    def find_package_modules(self, package, package_dir):
+        modules = build_py.find_package_modules(self, package, package_dir)
+        if sys.version_info < (3, 5):
+            modules = [m for m in modules if m[1] != '_asyncio']
+        return modules
 
 classifiers = ['Development Status :: 5 - Production/Stable',
                'Operating System :: POSIX :: Linux',
@@ -22,4 +32,5 @@ setup(name             = 'RPi.GPIO',
       url              = 'http://sourceforge.net/projects/raspberry-gpio-python/',
       classifiers      = classifiers,
       packages         = ['RPi'],
-      ext_modules      = [Extension('RPi.GPIO', ['source/py_gpio.c', 'source/c_gpio.c', 'source/cpuinfo.c', 'source/event_gpio.c', 'source/soft_pwm.c', 'source/py_pwm.c', 'source/common.c', 'source/constants.c'])])
+      cmdclass         = {'build_py': build_py_versioned},
+      ext_modules      = [Extension('RPi.GPIO', ['source/py_gpio.c', 'source/c_gpio.c', 'source/cpuinfo.c', 'source/event_gpio.c', 'source/event_synth.c', 'source/event_filter.c', 'source/event_queue.c', 'source/event_burst.c', 'source/event_stream.c', 'source/event_wait.c', 'source/event_count.c', 'source/event_measure.c', 'source/event_reflex.c', 'source/event_pattern.c', 'source/event_stats.c', 'source/event_record.c', 'source/event_replay.c', 'source/event_timer.c', 'source/trace.c', 'source/rt_thread.c', 'source/sampler.c', 'source/decode.c', 'source/output_sched.c', 'source/waveform.c', 'source/soft_pwm.c', 'source/py_pwm.c', 'source/py_sampler.c', 'source/py_waveform.c', 'source/py_timer.c', 'source/py_pin.c', 'source/common.c', 'source/constants.c'], libraries = ['m'])])
@@ -20,11 +20,13 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include "c_gpio.h"
+#include "trace.h"
 
 #define BCM2708_PERI_BASE   0x20000000
 #define GPIO_BASE           (BCM2708_PERI_BASE + 0x200000)
@@ -43,7 +45,16 @@ SOFTWARE.
 #define PAGE_SIZE  (4*1024)
 #define BLOCK_SIZE (4*1024)
 
-static volatile uint32_t *gpio_map;
+static volatile uint32_t *gpio_map = NULL;
+static int simulated = 0;
+
+// the registers written by read-modify-write, locked per register so callers on other registers do not wait;
+// SET and CLR need no lock, a write only changes the gpios whose bits are set
+static pthread_mutex_t map_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t fsel_lock[6] = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER};
+static pthread_mutex_t event_reg_lock[2] = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER};
+static pthread_mutex_t pud_lock = PTHREAD_MUTEX_INITIALIZER;    // one pull up/down register drives both banks
 
 void short_wait(void)
 {
@@ -55,11 +66,25 @@ void short_wait(void)
     }
 }
 
-int setup(void)
+static int map_registers(void)
+// called with map_lock held
 {
     int mem_fd;
     uint8_t *gpio_mem;
 
+    // simulated register block, for running without a Raspberry Pi
+    if (getenv(SIMULATE_ENV) != NULL)
+    {
+        gpio_map = (uint32_t *)mmap(NULL, BLOCK_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (gpio_map == MAP_FAILED)
+        {
+            gpio_map = NULL;
+            return SETUP_MMAP_FAIL;
+        }
+        simulated = 1;
+        return SETUP_OK;
+    }
+
     if ((mem_fd = open("/dev/mem", O_RDWR|O_SYNC) ) < 0)
     {
         return SETUP_DEVMEM_FAIL;
@@ -79,88 +104,91 @@ int setup(void)
     return SETUP_OK;
 }
 
-void clear_event_detect(int gpio)
+int setup(void)
+// maps the registers once, later calls (e.g. from another Lua state) share the mapping
 {
-	int offset = EVENT_DETECT_OFFSET + (gpio/32);
+    int result;
+
+    pthread_mutex_lock(&map_lock);
+    result = (gpio_map != NULL) ? SETUP_OK : map_registers();
+    pthread_mutex_unlock(&map_lock);
+    return result;
+}
+
+static void clear_event_detect_locked(int gpio)
+// called with the event_reg_lock of the bank held
+{
+    int offset = EVENT_DETECT_OFFSET + (gpio/32);
     int shift = (gpio%32);
 
-    *(gpio_map+offset) |= (1 << shift);
+    // writing 1 clears a bit, only this gpio's so pending events of the others survive
+    *(gpio_map+offset) = (1 << shift);
     short_wait();
     *(gpio_map+offset) = 0;
 }
 
+void clear_event_detect(int gpio)
+{
+    pthread_mutex_lock(&event_reg_lock[gpio/32]);
+    clear_event_detect_locked(gpio);
+    pthread_mutex_unlock(&event_reg_lock[gpio/32]);
+}
+
 int eventdetected(int gpio)
 {
-	int offset, value, bit;
-   
+    int offset, value, bit;
+
     offset = EVENT_DETECT_OFFSET + (gpio/32);
     bit = (1 << (gpio%32));
+    pthread_mutex_lock(&event_reg_lock[gpio/32]);
     value = *(gpio_map+offset) & bit;
     if (value)
-    {
-        clear_event_detect(gpio);
-	}
+        clear_event_detect_locked(gpio);
+    pthread_mutex_unlock(&event_reg_lock[gpio/32]);
     return value;
 }
 
-void set_rising_event(int gpio, int enable)
+static void set_event_register(int reg_offset, int gpio, int enable)
+// sets or clears the bit of gpio in an edge/level detect enable register
 {
-	int offset = RISING_ED_OFFSET + (gpio/32);
+    int offset = reg_offset + (gpio/32);
     int shift = (gpio%32);
 
-	if (enable)
-	    *(gpio_map+offset) |= 1 << shift;
-	else
-	    *(gpio_map+offset) &= ~(1 << shift);
-    clear_event_detect(gpio);
+    pthread_mutex_lock(&event_reg_lock[gpio/32]);
+    if (enable)
+        *(gpio_map+offset) |= (1 << shift);
+    else
+        *(gpio_map+offset) &= ~(1 << shift);
+    clear_event_detect_locked(gpio);
+    pthread_mutex_unlock(&event_reg_lock[gpio/32]);
 }
 
-void set_falling_event(int gpio, int enable)
+void set_rising_event(int gpio, int enable)
 {
-	int offset = FALLING_ED_OFFSET + (gpio/32);
-    int shift = (gpio%32);
+    set_event_register(RISING_ED_OFFSET, gpio, enable);
+}
 
-	if (enable)
-	{
-	    *(gpio_map+offset) |= (1 << shift);
-	    *(gpio_map+offset) = (1 << shift);
-	} else {
-	    *(gpio_map+offset) &= ~(1 << shift);
-	}
-    clear_event_detect(gpio);
+void set_falling_event(int gpio, int enable)
+{
+    set_event_register(FALLING_ED_OFFSET, gpio, enable);
 }
 
 void set_high_event(int gpio, int enable)
 {
-	int offset = HIGH_DETECT_OFFSET + (gpio/32);
-    int shift = (gpio%32);
-
-	if (enable)
-	{
-	    *(gpio_map+offset) |= (1 << shift);
-	} else {
-	    *(gpio_map+offset) &= ~(1 << shift);
-	}
-    clear_event_detect(gpio);
+    set_event_register(HIGH_DETECT_OFFSET, gpio, enable);
 }
 
 void set_low_event(int gpio, int enable)
 {
-	int offset = LOW_DETECT_OFFSET + (gpio/32);
-    int shift = (gpio%32);
-
-	if (enable)
-	    *(gpio_map+offset) |= 1 << shift;
-	else
-	    *(gpio_map+offset) &= ~(1 << shift);
-    clear_event_detect(gpio);
+    set_event_register(LOW_DETECT_OFFSET, gpio, enable);
 }
 
 void set_pullupdn(int gpio, int pud)
 {
     int clk_offset = PULLUPDNCLK_OFFSET + (gpio/32);
     int shift = (gpio%32);
-    
+
+    pthread_mutex_lock(&pud_lock);
     if (pud == PUD_DOWN)
        *(gpio_map+PULLUPDN_OFFSET) = (*(gpio_map+PULLUPDN_OFFSET) & ~3) | PUD_DOWN;
     else if (pud == PUD_UP)
@@ -173,6 +201,7 @@ void set_pullupdn(int gpio, int pud)
     short_wait();
     *(gpio_map+PULLUPDN_OFFSET) &= ~3;
     *(gpio_map+clk_offset) = 0;
+    pthread_mutex_unlock(&pud_lock);
 }
 
 void setup_gpio(int gpio, int direction, int pud)
@@ -181,10 +210,12 @@ void setup_gpio(int gpio, int direction, int pud)
     int shift = (gpio%10)*3;
 
     set_pullupdn(gpio, pud);
+    pthread_mutex_lock(&fsel_lock[gpio/10]);
     if (direction == OUTPUT)
         *(gpio_map+offset) = (*(gpio_map+offset) & ~(7<<shift)) | (1<<shift);
     else  // direction == INPUT
         *(gpio_map+offset) = (*(gpio_map+offset) & ~(7<<shift));
+    pthread_mutex_unlock(&fsel_lock[gpio/10]);
 }
 
 // Contribution by Eric Ptak <trouch@trouch.com>
@@ -198,6 +229,13 @@ int gpio_function(int gpio)
    return value; // 0=input, 1=output, 4=alt0
 }
 
+void simulate_levels(int bank, uint32_t set, uint32_t clear)
+// the simulated block has nothing behind it, copy output writes to the level register
+{
+    __atomic_or_fetch(gpio_map+PINLEVEL_OFFSET+bank, set, __ATOMIC_RELAXED);
+    __atomic_and_fetch(gpio_map+PINLEVEL_OFFSET+bank, ~clear, __ATOMIC_RELAXED);
+}
+
 void output_gpio(int gpio, int value)
 {
     int offset, shift;
@@ -210,6 +248,31 @@ void output_gpio(int gpio, int value)
     shift = (gpio%32);
 
     *(gpio_map+offset) = 1 << shift;
+    TRACE(TRACE_OUTPUT, gpio, value);
+    if (simulated)
+        simulate_levels(gpio/32, value ? 1 << shift : 0, value ? 0 : 1 << shift);
+}
+
+void output_gpio_mask(unsigned long long set, unsigned long long clear)
+// sets and clears several outputs with one register write per bank, bit n is gpio n
+{
+    if (set & 0xffffffffULL)
+        *(gpio_map+SET_OFFSET) = (uint32_t)set;
+    if (set >> 32)
+        *(gpio_map+SET_OFFSET+1) = (uint32_t)(set >> 32);
+    if (clear & 0xffffffffULL)
+        *(gpio_map+CLR_OFFSET) = (uint32_t)clear;
+    if (clear >> 32)
+        *(gpio_map+CLR_OFFSET+1) = (uint32_t)(clear >> 32);
+    if (set)
+        TRACE(TRACE_SET_MASK, 0, set);
+    if (clear)
+        TRACE(TRACE_CLEAR_MASK, 0, clear);
+    if (simulated)
+    {
+        simulate_levels(0, (uint32_t)set, (uint32_t)clear);
+        simulate_levels(1, (uint32_t)(set >> 32), (uint32_t)(clear >> 32));
+    }
 }
 
 int input_gpio(int gpio)
@@ -222,8 +285,58 @@ int input_gpio(int gpio)
    return value;
 }
 
+void resolve_pin(int gpio, struct gpio_pin *pin)
+{
+    pin->gpio = gpio;
+    pin->set_offset = SET_OFFSET + (gpio/32);
+    pin->clr_offset = CLR_OFFSET + (gpio/32);
+    pin->lev_offset = PINLEVEL_OFFSET + (gpio/32);
+    pin->mask = 1 << (gpio%32);
+}
+
+void output_pin(const struct gpio_pin *pin, int value)
+{
+    *(gpio_map + (value ? pin->set_offset : pin->clr_offset)) = pin->mask;
+    TRACE(TRACE_OUTPUT, pin->gpio, value);
+    if (simulated)
+        simulate_levels(pin->gpio/32, value ? pin->mask : 0, value ? 0 : pin->mask);
+}
+
+int input_pin(const struct gpio_pin *pin)
+{
+    return (*(gpio_map + pin->lev_offset) & pin->mask) != 0;
+}
+
+int toggle_pin(const struct gpio_pin *pin)
+// inverts an output from its level register, returns the new level
+{
+    int value = !input_pin(pin);
+
+    output_pin(pin, value);
+    return value;
+}
+
+unsigned int input_gpio_bank(int bank)
+// levels of gpios 0-31 (bank 0) or 32-53 (bank 1) in a single register read
+{
+    return *(gpio_map+PINLEVEL_OFFSET+bank);
+}
+
+unsigned long long input_gpio_mask(void)
+// levels of all gpios, bit n is gpio n
+{
+    uint32_t low = *(gpio_map+PINLEVEL_OFFSET);
+    uint32_t high = *(gpio_map+PINLEVEL_OFFSET+1);
+
+    return ((unsigned long long)high << 32) | low;
+}
+
 void cleanup(void)
 {
     // fixme - set all gpios back to input
-    munmap((caddr_t)gpio_map, BLOCK_SIZE);
+    pthread_mutex_lock(&map_lock);
+    if (gpio_map != NULL)
+        munmap((caddr_t)gpio_map, BLOCK_SIZE);
+    gpio_map = NULL;
+    pthread_mutex_unlock(&map_lock);
 }
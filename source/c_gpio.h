@@ -24,7 +24,10 @@ int setup(void);
 void setup_gpio(int gpio, int direction, int pud);
 int gpio_function(int gpio);
 void output_gpio(int gpio, int value);
+void output_gpio_mask(unsigned long long set, unsigned long long clear);
 int input_gpio(int gpio);
+unsigned long long input_gpio_mask(void);
+unsigned int input_gpio_bank(int bank);
 void set_rising_event(int gpio, int enable);
 void set_falling_event(int gpio, int enable);
 void set_high_event(int gpio, int enable);
@@ -32,11 +35,28 @@ void set_low_event(int gpio, int enable);
 int eventdetected(int gpio);
 void cleanup(void);
 
+// a gpio resolved once to its register words and bit, for tight loops on one channel
+struct gpio_pin
+{
+    int gpio;
+    int set_offset;
+    int clr_offset;
+    int lev_offset;
+    unsigned int mask;
+};
+void resolve_pin(int gpio, struct gpio_pin *pin);
+void output_pin(const struct gpio_pin *pin, int value);
+int input_pin(const struct gpio_pin *pin);
+int toggle_pin(const struct gpio_pin *pin);
+
 #define SETUP_OK          0
 #define SETUP_DEVMEM_FAIL 1
 #define SETUP_MALLOC_FAIL 2
 #define SETUP_MMAP_FAIL   3
 
+// set this environment variable to use a simulated register block instead of /dev/mem
+#define SIMULATE_ENV "RPI_GPIO_SIMULATE"
+
 #define INPUT  1 // is really 0 for control register!
 #define OUTPUT 0 // is really 1 for control register!
 #define ALT0   4
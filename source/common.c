@@ -20,6 +20,7 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#include <pthread.h>
 #include "Python.h"
 #include "c_gpio.h"
 #include "common.h"
@@ -80,3 +81,62 @@ int get_gpio_number(int channel, unsigned int *gpio)
 
     return 0;
 }
+
+// threads of the core attached to subinterpreters
+static int subinterpreter_calls = 0;
+static pthread_mutex_t subinterpreter_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t subinterpreter_idle = PTHREAD_COND_INITIALIZER;
+
+PyInterpreterState *current_interpreter(void)
+{
+#if PY_VERSION_HEX >= 0x03090000
+    PyInterpreterState *interp = PyInterpreterState_Get();
+
+    return interp == PyInterpreterState_Main() ? NULL : interp;
+#else
+    return NULL;
+#endif
+}
+
+PyThreadState *enter_interpreter(PyInterpreterState *interp, PyGILState_STATE *gstate)
+// attaches a thread of the core, the GIL state API only knows the main interpreter
+{
+    PyThreadState *tstate;
+
+    if (interp == NULL)
+    {
+        *gstate = PyGILState_Ensure();
+        return NULL;
+    }
+    pthread_mutex_lock(&subinterpreter_lock);
+    subinterpreter_calls++;
+    pthread_mutex_unlock(&subinterpreter_lock);
+    tstate = PyThreadState_New(interp);
+    PyEval_RestoreThread(tstate);
+    return tstate;
+}
+
+void leave_interpreter(PyThreadState *tstate, PyGILState_STATE gstate)
+{
+    if (tstate == NULL)
+    {
+        PyGILState_Release(gstate);
+        return;
+    }
+    PyThreadState_Clear(tstate);
+    PyThreadState_DeleteCurrent();
+    pthread_mutex_lock(&subinterpreter_lock);
+    if (--subinterpreter_calls == 0)
+        pthread_cond_broadcast(&subinterpreter_idle);
+    pthread_mutex_unlock(&subinterpreter_lock);
+}
+
+void wait_interpreter_calls(void)
+// a subinterpreter only ends with no other thread state left, the caller must not hold the GIL
+{
+    pthread_mutex_lock(&subinterpreter_lock);
+    while (subinterpreter_calls > 0)
+        pthread_cond_wait(&subinterpreter_idle, &subinterpreter_lock);
+    pthread_mutex_unlock(&subinterpreter_lock);
+}
+
@@ -38,3 +38,11 @@ int revision;
 int get_gpio_number(int channel, unsigned int *gpio);
 int setup_error;
 int module_setup;
+
+#ifdef Py_PYTHON_H
+// callbacks run in the interpreter they were registered from, NULL is the main interpreter
+PyInterpreterState *current_interpreter(void);
+PyThreadState *enter_interpreter(PyInterpreterState *interp, PyGILState_STATE *gstate);
+void leave_interpreter(PyThreadState *tstate, PyGILState_STATE gstate);
+void wait_interpreter_calls(void);
+#endif
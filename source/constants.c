@@ -25,6 +25,11 @@ SOFTWARE.
 #include "common.h"
 #include "c_gpio.h"
 #include "event_gpio.h"
+#include "event_synth.h"
+#include "sampler.h"
+#include "decode.h"
+#include "event_queue.h"
+#include "rt_thread.h"
 
 void define_constants(PyObject *module)
 {
@@ -79,6 +84,99 @@ void define_constants(PyObject *module)
    both_edge = Py_BuildValue("i", BOTH_EDGE + PY_EVENT_CONST_OFFSET);
    PyModule_AddObject(module, "BOTH", both_edge);
 
+   synth_fixed = Py_BuildValue("i", SYNTH_FIXED);
+   PyModule_AddObject(module, "SYNTH_FIXED", synth_fixed);
+
+   synth_burst = Py_BuildValue("i", SYNTH_BURST);
+   PyModule_AddObject(module, "SYNTH_BURST", synth_burst);
+
+   synth_poisson = Py_BuildValue("i", SYNTH_POISSON);
+   PyModule_AddObject(module, "SYNTH_POISSON", synth_poisson);
+
+   synth_square = Py_BuildValue("i", SYNTH_SQUARE);
+   PyModule_AddObject(module, "SYNTH_SQUARE", synth_square);
+
+   drop_oldest = Py_BuildValue("i", QUEUE_DROP_OLDEST);
+   PyModule_AddObject(module, "DROP_OLDEST", drop_oldest);
+
+   drop_newest = Py_BuildValue("i", QUEUE_DROP_NEWEST);
+   PyModule_AddObject(module, "DROP_NEWEST", drop_newest);
+
+   coalesce = Py_BuildValue("i", QUEUE_COALESCE);
+   PyModule_AddObject(module, "COALESCE", coalesce);
+
+   sampler_idle = Py_BuildValue("i", SAMPLER_IDLE);
+   PyModule_AddObject(module, "SAMPLER_IDLE", sampler_idle);
+
+   sampler_armed = Py_BuildValue("i", SAMPLER_ARMED);
+   PyModule_AddObject(module, "SAMPLER_ARMED", sampler_armed);
+
+   sampler_triggered = Py_BuildValue("i", SAMPLER_TRIGGERED);
+   PyModule_AddObject(module, "SAMPLER_TRIGGERED", sampler_triggered);
+
+   sampler_done = Py_BuildValue("i", SAMPLER_DONE);
+   PyModule_AddObject(module, "SAMPLER_DONE", sampler_done);
+
+   sampler_raw = Py_BuildValue("i", SAMPLER_RAW);
+   PyModule_AddObject(module, "SAMPLER_RAW", sampler_raw);
+
+   sampler_rle = Py_BuildValue("i", SAMPLER_RLE);
+   PyModule_AddObject(module, "SAMPLER_RLE", sampler_rle);
+
+   decode_data = Py_BuildValue("i", DECODE_DATA);
+   PyModule_AddObject(module, "DECODE_DATA", decode_data);
+
+   decode_start = Py_BuildValue("i", DECODE_START);
+   PyModule_AddObject(module, "DECODE_START", decode_start);
+
+   decode_stop = Py_BuildValue("i", DECODE_STOP);
+   PyModule_AddObject(module, "DECODE_STOP", decode_stop);
+
+   decode_address = Py_BuildValue("i", DECODE_ADDRESS);
+   PyModule_AddObject(module, "DECODE_ADDRESS", decode_address);
+
+   decode_reset = Py_BuildValue("i", DECODE_RESET);
+   PyModule_AddObject(module, "DECODE_RESET", decode_reset);
+
+   decode_parity_error = Py_BuildValue("i", DECODE_PARITY_ERROR);
+   PyModule_AddObject(module, "DECODE_PARITY_ERROR", decode_parity_error);
+
+   decode_framing_error = Py_BuildValue("i", DECODE_FRAMING_ERROR);
+   PyModule_AddObject(module, "DECODE_FRAMING_ERROR", decode_framing_error);
+
+   decode_nack = Py_BuildValue("i", DECODE_NACK);
+   PyModule_AddObject(module, "DECODE_NACK", decode_nack);
+
+   decode_incomplete = Py_BuildValue("i", DECODE_INCOMPLETE);
+   PyModule_AddObject(module, "DECODE_INCOMPLETE", decode_incomplete);
+
+   decode_presence = Py_BuildValue("i", DECODE_PRESENCE);
+   PyModule_AddObject(module, "DECODE_PRESENCE", decode_presence);
+
+   thread_poll = Py_BuildValue("i", 1 << RT_POLL);
+   PyModule_AddObject(module, "THREAD_POLL", thread_poll);
+
+   thread_pwm = Py_BuildValue("i", 1 << RT_PWM);
+   PyModule_AddObject(module, "THREAD_PWM", thread_pwm);
+
+   thread_executor = Py_BuildValue("i", 1 << RT_EXECUTOR);
+   PyModule_AddObject(module, "THREAD_EXECUTOR", thread_executor);
+
+   thread_service = Py_BuildValue("i", 1 << RT_SERVICE);
+   PyModule_AddObject(module, "THREAD_SERVICE", thread_service);
+
+   thread_all = Py_BuildValue("i", (1 << RT_CLASSES) - 1);
+   PyModule_AddObject(module, "THREAD_ALL", thread_all);
+
+   sched_other = Py_BuildValue("i", SCHED_OTHER);
+   PyModule_AddObject(module, "SCHED_OTHER", sched_other);
+
+   sched_fifo = Py_BuildValue("i", SCHED_FIFO);
+   PyModule_AddObject(module, "SCHED_FIFO", sched_fifo);
+
+   sched_rr = Py_BuildValue("i", SCHED_RR);
+   PyModule_AddObject(module, "SCHED_RR", sched_rr);
+
    version = Py_BuildValue("s", "0.5.4");
    PyModule_AddObject(module, "VERSION", version);
 }
@@ -40,6 +40,37 @@ PyObject *pud_down;
 PyObject *rising_edge;
 PyObject *falling_edge;
 PyObject *both_edge;
+PyObject *synth_fixed;
+PyObject *synth_burst;
+PyObject *synth_poisson;
+PyObject *synth_square;
+PyObject *drop_oldest;
+PyObject *drop_newest;
+PyObject *coalesce;
+PyObject *sampler_idle;
+PyObject *sampler_armed;
+PyObject *sampler_triggered;
+PyObject *sampler_done;
+PyObject *sampler_raw;
+PyObject *sampler_rle;
+PyObject *decode_data;
+PyObject *decode_start;
+PyObject *decode_stop;
+PyObject *decode_address;
+PyObject *decode_reset;
+PyObject *decode_parity_error;
+PyObject *decode_framing_error;
+PyObject *decode_nack;
+PyObject *decode_incomplete;
+PyObject *decode_presence;
+PyObject *thread_poll;
+PyObject *thread_pwm;
+PyObject *thread_executor;
+PyObject *thread_service;
+PyObject *thread_all;
+PyObject *sched_other;
+PyObject *sched_fifo;
+PyObject *sched_rr;
 PyObject *version;
 
 void define_constants(PyObject *module);
@@ -21,7 +21,9 @@ SOFTWARE.
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include "c_gpio.h"
 #include "cpuinfo.h"
 
 char *get_cpuinfo_revision(char *revision)
@@ -53,7 +55,12 @@ char *get_cpuinfo_revision(char *revision)
 int get_rpi_revision(void)
 {
    char revision[1024] = {'\0'};
-   
+   char *simulate;
+
+   // simulated board, the variable holds the revision to report
+   if ((simulate = getenv(SIMULATE_ENV)) != NULL)
+      return (atoi(simulate) == 1) ? 1 : 2;
+
    if (get_cpuinfo_revision(revision) == NULL)
       return -1;
       
@@ -0,0 +1,390 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include "event_gpio.h"
+#include "event_record.h"
+#include "sampler.h"
+#include "decode.h"
+
+#define BIT(levels, gpio) (((levels) >> (gpio)) & 1)
+
+void free_transitions(struct transitions *tr)
+{
+    free(tr->items);
+    tr->items = NULL;
+    tr->count = tr->size = 0;
+}
+
+int add_transition(struct transitions *tr, unsigned long long t, unsigned int levels)
+// returns 0 on success, 2 if out of memory
+{
+    struct transition *items;
+
+    if (tr->count == tr->size)
+    {
+        if ((items = realloc(tr->items, (tr->size ? tr->size * 2 : 1024) * sizeof(struct transition))) == NULL)
+            return 2;
+        tr->items = items;
+        tr->size = tr->size ? tr->size * 2 : 1024;
+    }
+    tr->items[tr->count].t = t;
+    tr->items[tr->count].levels = levels;
+    tr->count++;
+    return 0;
+}
+
+int decode_block(struct sample_block *block, unsigned int gpios, struct transitions *tr)
+// the changes of the gpios in the bit mask gpios in a logic analyser capture
+// returns 0 on success, 2 if out of memory
+{
+    unsigned long long t = 0;
+    unsigned int i, levels, prev = 0;
+
+    tr->items = NULL;
+    tr->count = tr->size = 0;
+    tr->rate = block->rate;
+    tr->end = block->span;
+    tr->origin = 0;
+    for (i = 0; i < block->length; i++)
+    {
+        if (block->encoding == SAMPLER_RLE)
+        {
+            t += block->samples[2 * i];
+            levels = block->samples[2 * i + 1];
+        } else {
+            t = i;
+            levels = block->samples[i];
+        }
+        if ((i == 0 || ((levels ^ prev) & gpios)) && add_transition(tr, t, levels) != 0)
+        {
+            free_transitions(tr);
+            return 2;
+        }
+        prev = levels;
+    }
+    return 0;
+}
+
+int decode_recording(const char *path, unsigned int gpios, struct transitions *tr)
+// the edges of the gpios in the bit mask gpios in a recording, timed in microseconds
+// a gpio is taken to have been at the other level before its first edge
+// return values:
+// 0 - Success
+// 1 - No readable recording at path
+// 2 - Out of memory
+{
+    struct record_reader *reader;
+    struct gpio_event ev;
+    unsigned int levels = 0, seen = 0;
+    int first = 1;
+
+    tr->items = NULL;
+    tr->count = tr->size = 0;
+    tr->rate = 1000000;
+    tr->end = 1;
+    tr->origin = 0;
+
+    // the levels before the first edges are sample 0
+    if ((reader = record_open(path)) == NULL)
+        return 1;
+    while (record_next(reader, &ev))
+    {
+        if (ev.gpio >= 32 || !BIT(gpios, ev.gpio) || BIT(seen, ev.gpio))
+            continue;
+        if (first)
+            tr->origin = ev.timestamp - 1;
+        first = 0;
+        seen |= 1U << ev.gpio;
+        if (!ev.level)
+            levels |= 1U << ev.gpio;
+    }
+    record_close(reader);
+
+    if ((reader = record_open(path)) == NULL)
+        return 1;
+    if (add_transition(tr, 0, levels) != 0)
+    {
+        record_close(reader);
+        return 2;
+    }
+    while (record_next(reader, &ev))
+    {
+        if (ev.gpio >= 32 || !BIT(gpios, ev.gpio) || ev.timestamp <= tr->origin)
+            continue;
+        levels = (levels & ~(1U << ev.gpio)) | ((unsigned int)(ev.level != 0) << ev.gpio);
+        if (add_transition(tr, ev.timestamp - tr->origin, levels) != 0)
+        {
+            record_close(reader);
+            free_transitions(tr);
+            return 2;
+        }
+    }
+    record_close(reader);
+    tr->end = tr->items[tr->count - 1].t + 1;
+    return 0;
+}
+
+void free_frames(struct decode_frames *out)
+{
+    free(out->frames);
+    out->frames = NULL;
+    out->count = out->size = 0;
+}
+
+int add_frame(struct decode_frames *out, struct transitions *tr, unsigned long long start, unsigned long long end,
+              int type, unsigned int value, unsigned int value2, unsigned int flags)
+// start and end in samples, returns 0 on success, 2 if out of memory
+{
+    struct decode_frame *frames, *f;
+
+    if (out->count == out->size)
+    {
+        if ((frames = realloc(out->frames, (out->size ? out->size * 2 : 256) * sizeof(struct decode_frame))) == NULL)
+            return 2;
+        out->frames = frames;
+        out->size = out->size ? out->size * 2 : 256;
+    }
+    f = &out->frames[out->count++];
+    f->start = tr->origin + start * 1000000ULL / tr->rate;
+    f->end = tr->origin + end * 1000000ULL / tr->rate;
+    f->type = type;
+    f->value = value;
+    f->value2 = value2;
+    f->flags = flags;
+    return 0;
+}
+
+unsigned int level_at(struct transitions *tr, unsigned int *i, unsigned long long t)
+// levels at sample t, *i is a cursor that only moves forward
+{
+    while (*i + 1 < tr->count && tr->items[*i + 1].t <= t)
+        (*i)++;
+    return tr->items[*i].levels;
+}
+
+int decode_uart(struct transitions *tr, struct uart_config *cfg, struct decode_frames *out)
+// frames are sampled in the middle of each bit from the falling edge of the start bit
+// returns 0 on success, 2 if out of memory
+{
+    double period = (double)tr->rate / cfg->baud;
+    unsigned long long t0, resume = 0, t;
+    unsigned int i, cursor, b, bit, value, ones, flags;
+    double pos;
+
+    out->frames = NULL;
+    out->count = out->size = 0;
+    for (i = 1; i < tr->count; i++)
+    {
+        // start bit, a falling edge after the middle of the last stop bit
+        if (tr->items[i].t < resume || !BIT(tr->items[i - 1].levels, cfg->gpio) || BIT(tr->items[i].levels, cfg->gpio))
+            continue;
+        t0 = tr->items[i].t;
+        cursor = i;
+        value = ones = flags = 0;
+        pos = 1.5;
+        for (b = 0; b < cfg->bits; b++, pos += 1.0)
+        {
+            bit = BIT(level_at(tr, &cursor, t0 + (unsigned long long)(pos * period)), cfg->gpio);
+            value |= bit << b;
+            ones += bit;
+        }
+        if (cfg->parity == 'E' || cfg->parity == 'O')
+        {
+            bit = BIT(level_at(tr, &cursor, t0 + (unsigned long long)(pos * period)), cfg->gpio);
+            if (((ones + bit) & 1) != (cfg->parity == 'O'))
+                flags |= DECODE_PARITY_ERROR;
+            pos += 1.0;
+        }
+        for (b = 0; b < cfg->stopbits; b++, pos += 1.0)
+            if (!BIT(level_at(tr, &cursor, t0 + (unsigned long long)(pos * period)), cfg->gpio))
+                flags |= DECODE_FRAMING_ERROR;
+
+        t = t0 + (unsigned long long)((pos - 0.5) * period);
+        if (t > tr->end)
+        {
+            flags |= DECODE_INCOMPLETE;
+            t = tr->end;
+        }
+        if (add_frame(out, tr, t0, t, DECODE_DATA, value, 0, flags) != 0)
+            return 2;
+        resume = t0 + (unsigned long long)((pos - 1.0) * period);
+    }
+    return 0;
+}
+
+int decode_spi(struct transitions *tr, struct spi_config *cfg, struct decode_frames *out)
+// words are sampled on the clock edge the mode samples on, while chip select is low if it was captured
+// returns 0 on success, 2 if out of memory
+{
+    unsigned int sample_level = ((cfg->mode >> 1) & 1) == (cfg->mode & 1);   // rising edge for modes 0 and 3
+    unsigned long long start = 0;
+    unsigned int i, prev, cur, count = 0, mosi = 0, miso = 0;
+
+    out->frames = NULL;
+    out->count = out->size = 0;
+    for (i = 1; i < tr->count; i++)
+    {
+        prev = tr->items[i - 1].levels;
+        cur = tr->items[i].levels;
+
+        if (cfg->cs >= 0 && BIT(prev ^ cur, cfg->cs))
+        {
+            // chip select ends a word cut short, or starts a new one
+            if (count > 0 && add_frame(out, tr, start, tr->items[i].t, DECODE_DATA, mosi, miso, DECODE_INCOMPLETE) != 0)
+                return 2;
+            count = mosi = miso = 0;
+        }
+        if (cfg->cs >= 0 && BIT(cur, cfg->cs))
+            continue;
+        if (!BIT(prev ^ cur, cfg->clk) || BIT(cur, cfg->clk) != sample_level)
+            continue;
+
+        if (count == 0)
+            start = tr->items[i].t;
+        if (cfg->lsb_first)
+        {
+            if (cfg->mosi >= 0)
+                mosi |= BIT(cur, cfg->mosi) << count;
+            if (cfg->miso >= 0)
+                miso |= BIT(cur, cfg->miso) << count;
+        } else {
+            if (cfg->mosi >= 0)
+                mosi = (mosi << 1) | BIT(cur, cfg->mosi);
+            if (cfg->miso >= 0)
+                miso = (miso << 1) | BIT(cur, cfg->miso);
+        }
+        if (++count == cfg->bits)
+        {
+            if (add_frame(out, tr, start, tr->items[i].t, DECODE_DATA, mosi, miso, 0) != 0)
+                return 2;
+            count = mosi = miso = 0;
+        }
+    }
+    if (count > 0 && add_frame(out, tr, start, tr->end, DECODE_DATA, mosi, miso, DECODE_INCOMPLETE) != 0)
+        return 2;
+    return 0;
+}
+
+int decode_i2c(struct transitions *tr, unsigned int scl, unsigned int sda, struct decode_frames *out)
+// returns 0 on success, 2 if out of memory
+{
+    unsigned long long start = 0;
+    unsigned int i, prev, cur, count = 0, byte = 0;
+    int state = -1;     // -1 idle, else the type of the next byte
+
+    out->frames = NULL;
+    out->count = out->size = 0;
+    for (i = 1; i < tr->count; i++)
+    {
+        prev = tr->items[i - 1].levels;
+        cur = tr->items[i].levels;
+
+        // data changing while the clock stays high is a start or a stop
+        if (BIT(prev ^ cur, sda) && BIT(prev, scl) && BIT(cur, scl))
+        {
+            // a lone bit is the clock rising ahead of the condition, not a byte cut short
+            if (count > 1 && add_frame(out, tr, start, tr->items[i].t, state, byte, 0, DECODE_INCOMPLETE) != 0)
+                return 2;
+            count = byte = 0;
+            if (BIT(cur, sda))
+            {
+                state = -1;
+                if (add_frame(out, tr, tr->items[i].t, tr->items[i].t, DECODE_STOP, 0, 0, 0) != 0)
+                    return 2;
+            } else {
+                state = DECODE_ADDRESS;
+                if (add_frame(out, tr, tr->items[i].t, tr->items[i].t, DECODE_START, 0, 0, 0) != 0)
+                    return 2;
+            }
+            continue;
+        }
+
+        // bits are read on the rising clock edge, the ninth is the acknowledge
+        if (state < 0 || !BIT(prev ^ cur, scl) || !BIT(cur, scl))
+            continue;
+        if (count == 0)
+            start = tr->items[i].t;
+        if (count < 8)
+        {
+            byte = (byte << 1) | BIT(cur, sda);
+            count++;
+        } else {
+            if (add_frame(out, tr, start, tr->items[i].t, state, byte, 0, BIT(cur, sda) ? DECODE_NACK : 0) != 0)
+                return 2;
+            state = DECODE_DATA;
+            count = byte = 0;
+        }
+    }
+    return 0;
+}
+
+int decode_onewire(struct transitions *tr, unsigned int gpio, struct decode_frames *out)
+// standard speed timing: a low pulse of 480us or more is a reset, one shorter than 15us a 1 and any other a 0
+// returns 0 on success, 2 if out of memory
+{
+    unsigned long long fall = 0, start = 0, reset_end = 0, width;
+    unsigned int i, count = 0, byte = 0;
+    int low = 0, presence = 0;
+
+    out->frames = NULL;
+    out->count = out->size = 0;
+    for (i = 1; i < tr->count; i++)
+    {
+        if (!BIT(tr->items[i - 1].levels ^ tr->items[i].levels, gpio))
+            continue;
+        if (!BIT(tr->items[i].levels, gpio))
+        {
+            fall = tr->items[i].t;
+            low = 1;
+            continue;
+        }
+        if (!low)
+            continue;   // high at the start of the capture
+        low = 0;
+        width = (tr->items[i].t - fall) * 1000000ULL / tr->rate;
+
+        if (width >= 480)
+        {
+            if (add_frame(out, tr, fall, tr->items[i].t, DECODE_RESET, 0, 0, 0) != 0)
+                return 2;
+            reset_end = tr->items[i].t;
+            presence = 1;
+            count = byte = 0;
+        } else if (presence && (fall - reset_end) * 1000000ULL / tr->rate <= 60) {
+            out->frames[out->count - 1].flags |= DECODE_PRESENCE;
+            presence = 0;
+        } else {
+            presence = 0;
+            if (count == 0)
+                start = fall;
+            byte |= (width < 15 ? 1U : 0U) << count;
+            if (++count == 8)
+            {
+                if (add_frame(out, tr, start, tr->items[i].t, DECODE_DATA, byte, 0, 0) != 0)
+                    return 2;
+                count = byte = 0;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,96 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Protocol decoders for logic analyser captures and edge recordings */
+
+// frame types
+#define DECODE_DATA    0   // a data word
+#define DECODE_START   1   // I2C start or repeated start
+#define DECODE_STOP    2   // I2C stop
+#define DECODE_ADDRESS 3   // I2C address byte, with the read/write bit
+#define DECODE_RESET   4   // 1-Wire reset pulse
+
+// frame flags
+#define DECODE_PARITY_ERROR  1
+#define DECODE_FRAMING_ERROR 2   // UART stop bit low
+#define DECODE_NACK          4   // I2C byte not acknowledged
+#define DECODE_INCOMPLETE    8   // the capture or chip select ended inside the frame
+#define DECODE_PRESENCE      16  // 1-Wire reset answered by a presence pulse
+
+// the levels of gpios 0-31 at each change, t counts samples at rate from the start of the capture
+struct transition
+{
+    unsigned long long t;
+    unsigned int levels;
+};
+
+struct transitions
+{
+    struct transition *items;
+    unsigned int count, size;
+    unsigned int rate;              // samples per second
+    unsigned long long end;         // samples in the capture
+    unsigned long long origin;      // time in microseconds of sample 0
+};
+
+struct decode_frame
+{
+    unsigned long long start, end;  // in microseconds
+    int type;
+    unsigned int value;             // data word, MOSI for SPI
+    unsigned int value2;            // MISO for SPI
+    unsigned int flags;
+};
+
+struct decode_frames
+{
+    struct decode_frame *frames;
+    unsigned int count, size;
+};
+
+struct uart_config
+{
+    unsigned int gpio;
+    unsigned int baud;
+    unsigned int bits;              // 5 to 9
+    char parity;                    // 'N', 'E' or 'O'
+    unsigned int stopbits;          // 1 or 2
+};
+
+struct spi_config
+{
+    unsigned int clk;
+    int mosi, miso, cs;             // -1 if not captured
+    int mode;                       // 0 to 3, clock polarity in bit 1 and phase in bit 0
+    unsigned int bits;              // 1 to 32
+    int lsb_first;
+};
+
+int decode_block(struct sample_block *block, unsigned int gpios, struct transitions *tr);
+int decode_recording(const char *path, unsigned int gpios, struct transitions *tr);
+void free_transitions(struct transitions *tr);
+
+int decode_uart(struct transitions *tr, struct uart_config *cfg, struct decode_frames *out);
+int decode_spi(struct transitions *tr, struct spi_config *cfg, struct decode_frames *out);
+int decode_i2c(struct transitions *tr, unsigned int scl, unsigned int sda, struct decode_frames *out);
+int decode_onewire(struct transitions *tr, unsigned int gpio, struct decode_frames *out);
+void free_frames(struct decode_frames *out);
@@ -0,0 +1,114 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "event_gpio.h"
+#include "event_burst.h"
+
+// burst state, only touched by the poll thread apart from the settings
+struct burst_state
+{
+    struct event_burst cfg;
+    int active;              // a burst has been started
+    struct gpio_event ev;    // the burst so far, first edge in ev.first
+};
+struct burst_state bursts[54];
+
+void set_event_burst(unsigned int gpio, struct event_burst *burst)
+{
+    bursts[gpio].cfg = *burst;
+}
+
+void get_event_burst(unsigned int gpio, struct event_burst *burst)
+{
+    *burst = bursts[gpio].cfg;
+}
+
+int event_burst_enabled(unsigned int gpio)
+{
+    return bursts[gpio].cfg.window || bursts[gpio].cfg.count;
+}
+
+void reset_event_burst(unsigned int gpio)
+{
+    bursts[gpio].cfg.window = bursts[gpio].cfg.count = 0;
+    bursts[gpio].active = 0;
+}
+
+int burst_edge(struct gpio_event *ev)
+{
+    struct burst_state *b = &bursts[ev->gpio];
+    int result = BURST_HOLD;
+
+    if (!event_burst_enabled(ev->gpio))
+        return BURST_PASS;
+
+    if (!b->active)
+    {
+        b->active = 1;
+        b->ev = *ev;
+        result = BURST_OPEN;
+    } else {
+        b->ev.count += ev->count;
+        b->ev.level = ev->level;
+        b->ev.timestamp = ev->timestamp;
+    }
+
+    if (b->cfg.count && b->ev.count >= b->cfg.count)
+    {
+        b->active = 0;
+        *ev = b->ev;
+        return BURST_FLUSH;
+    }
+    return result;
+}
+
+int burst_expire(unsigned long long now, struct gpio_event *ev)
+// returns 1 and the burst in ev for a window that has ended by now, 0 if there is none left
+{
+    unsigned int gpio;
+    struct burst_state *b;
+
+    for (gpio = 0; gpio < 54; gpio++)
+    {
+        b = &bursts[gpio];
+        if (!b->active || !b->cfg.window || b->ev.first + b->cfg.window > now)
+            continue;
+
+        b->active = 0;
+        *ev = b->ev;
+        return 1;
+    }
+    return 0;
+}
+
+unsigned long long burst_next_deadline(void)
+// returns the time the first open window ends, or 0 if there is none
+{
+    unsigned int gpio;
+    unsigned long long deadline = 0;
+
+    for (gpio = 0; gpio < 54; gpio++)
+        if (bursts[gpio].active && bursts[gpio].cfg.window &&
+            (deadline == 0 || bursts[gpio].ev.first + bursts[gpio].cfg.window < deadline))
+            deadline = bursts[gpio].ev.first + bursts[gpio].cfg.window;
+    return deadline;
+}
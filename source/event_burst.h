@@ -0,0 +1,43 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Burst coalescing, accepted edges of a gpio are merged into one event per window or count */
+
+#define BURST_PASS  0   // coalescing is off, deliver the edge as it is
+#define BURST_HOLD  1   // the edge was added to the current burst
+#define BURST_OPEN  2   // the edge started a new burst, see burst_next_deadline()
+#define BURST_FLUSH 3   // the burst is complete and was returned in place of the edge
+
+// burst settings, 0 disables
+struct event_burst
+{
+    unsigned int window;   // deliver a burst this many microseconds after its first edge
+    unsigned int count;    // deliver a burst once it holds this many edges
+};
+
+void set_event_burst(unsigned int gpio, struct event_burst *burst);
+void get_event_burst(unsigned int gpio, struct event_burst *burst);
+int event_burst_enabled(unsigned int gpio);
+void reset_event_burst(unsigned int gpio);
+int burst_edge(struct gpio_event *ev);
+int burst_expire(unsigned long long now, struct gpio_event *ev);
+unsigned long long burst_next_deadline(void);
@@ -0,0 +1,60 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "event_gpio.h"
+#include "event_count.h"
+
+// counters are added to by the poll thread and read from any thread, without locks
+int counting[54] = { 0 };
+unsigned long long counters[54] = { 0 };
+
+void set_event_counting(unsigned int gpio, int on)
+{
+    counting[gpio] = on;
+}
+
+int event_counting(unsigned int gpio)
+{
+    return counting[gpio];
+}
+
+void reset_event_count(unsigned int gpio)
+{
+    counting[gpio] = 0;
+    __atomic_store_n(&counters[gpio], 0, __ATOMIC_RELAXED);
+}
+
+void count_event(struct gpio_event *ev)
+{
+    __atomic_add_fetch(&counters[ev->gpio], ev->count, __ATOMIC_RELAXED);
+}
+
+unsigned long long event_count(unsigned int gpio)
+{
+    return __atomic_load_n(&counters[gpio], __ATOMIC_RELAXED);
+}
+
+unsigned long long event_count_reset(unsigned int gpio)
+// reads and clears the counter in one step, no edge is lost or counted twice
+{
+    return __atomic_exchange_n(&counters[gpio], 0, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,192 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "event_gpio.h"
+#include "event_filter.h"
+#include "event_stats.h"
+
+#define FILTER_RETRY 200    // us until a held edge is looked at again while its source lags behind
+
+// filter state, only touched by the poll thread apart from the settings
+struct filter_state
+{
+    struct event_filter cfg;
+    int level;                       // last accepted level, -1 if unknown
+    unsigned long long accepted;     // timestamp of the last accepted edge
+    unsigned long long last_edge;    // timestamp of the last edge seen
+    int pending;                     // an edge is held back for the stable or min pulse time
+    struct gpio_event pending_ev;
+    unsigned long long retry;        // held edge due, but its source had not handed over the edges up to then
+    unsigned long long rejected;
+};
+struct filter_state filters[54];
+
+void set_event_filter(unsigned int gpio, struct event_filter *filter)
+{
+    filters[gpio].cfg = *filter;
+}
+
+void get_event_filter(unsigned int gpio, struct event_filter *filter)
+{
+    *filter = filters[gpio].cfg;
+}
+
+void reset_event_filter(unsigned int gpio)
+{
+    struct filter_state *f = &filters[gpio];
+
+    f->cfg.lockout = f->cfg.stable = f->cfg.min_pulse = 0;
+    f->level = event_level(gpio);   // the first edge must change it to pass the stable time check
+    f->accepted = f->last_edge = 0;
+    f->pending = 0;
+    f->rejected = 0;
+}
+
+void drop_filter_edge(unsigned int gpio)
+// forgets an edge still held back, edge detection of the gpio is removed
+{
+    filters[gpio].pending = 0;
+}
+
+unsigned long long event_filter_rejected(unsigned int gpio)
+{
+    return filters[gpio].rejected;
+}
+
+void reject_edge(struct filter_state *f)
+{
+    f->rejected++;
+    stats_bounced(f - filters);
+}
+
+int filter_lockout(struct filter_state *f, struct gpio_event *ev)
+// final check before an edge is accepted
+{
+    if (f->cfg.lockout && f->accepted && ev->timestamp - f->accepted < f->cfg.lockout)
+    {
+        reject_edge(f);
+        return FILTER_REJECT;
+    }
+    f->accepted = ev->timestamp;
+    f->level = ev->level;
+    return FILTER_ACCEPT;
+}
+
+unsigned long long filter_hold(struct filter_state *f)
+// time an edge is held back before it is accepted
+{
+    return f->cfg.stable > f->cfg.min_pulse ? f->cfg.stable : f->cfg.min_pulse;
+}
+
+int filter_edge(struct gpio_event *ev)
+{
+    struct filter_state *f = &filters[ev->gpio];
+
+    f->last_edge = ev->timestamp;
+    if (!f->cfg.stable && !f->cfg.min_pulse)
+        return filter_lockout(f, ev);
+
+    // a new edge before the hold time passed cancels the pending one
+    if (f->pending)
+    {
+        f->pending = 0;
+        reject_edge(f);
+        // the pulse started by the pending edge was too short, drop this edge ending it as well
+        if (f->cfg.min_pulse && ev->timestamp - f->pending_ev.timestamp < f->cfg.min_pulse)
+        {
+            reject_edge(f);
+            return FILTER_REJECT;
+        }
+    }
+    // back at the level accepted last, nothing changed
+    if (f->cfg.stable && ev->level == f->level)
+    {
+        reject_edge(f);
+        return FILTER_REJECT;
+    }
+    f->pending = 1;
+    f->pending_ev = *ev;
+    f->retry = 0;
+    return FILTER_DEFER;
+}
+
+int filter_held(struct gpio_event *ev, struct gpio_event *held)
+// returns 1 and the pending edge of the gpio of ev in held if it was accepted before ev came, the timer was late
+{
+    struct filter_state *f = &filters[ev->gpio];
+
+    if (!f->pending || ev->timestamp < f->pending_ev.timestamp + filter_hold(f))
+        return 0;
+    f->pending = 0;
+    *held = f->pending_ev;
+    return filter_lockout(f, held) == FILTER_ACCEPT;
+}
+
+int filter_expire(unsigned long long now, struct gpio_event *ev)
+// returns 1 and the edge in ev for a pending edge accepted by now, 0 if there is none left
+{
+    unsigned int gpio;
+    struct filter_state *f;
+
+    for (gpio = 0; gpio < 54; gpio++)
+    {
+        f = &filters[gpio];
+        if (!f->pending || f->pending_ev.timestamp + filter_hold(f) > now)
+            continue;
+        // a newer edge may still be on its way from the source
+        if (f->pending_ev.timestamp + filter_hold(f) > event_horizon(gpio, now))
+        {
+            f->retry = now + FILTER_RETRY;
+            continue;
+        }
+
+        f->pending = 0;
+        if (event_level(gpio) != f->pending_ev.level)
+        {
+            reject_edge(f);
+            continue;
+        }
+        *ev = f->pending_ev;
+        if (filter_lockout(f, ev) == FILTER_ACCEPT)
+            return 1;
+    }
+    return 0;
+}
+
+unsigned long long filter_next_deadline(void)
+// returns the time the first pending edge is due, or 0 if nothing is pending
+{
+    unsigned int gpio;
+    unsigned long long due, deadline = 0;
+
+    for (gpio = 0; gpio < 54; gpio++)
+    {
+        if (!filters[gpio].pending)
+            continue;
+        due = filters[gpio].pending_ev.timestamp + filter_hold(&filters[gpio]);
+        if (filters[gpio].retry > due)
+            due = filters[gpio].retry;
+        if (deadline == 0 || due < deadline)
+            deadline = due;
+    }
+    return deadline;
+}
@@ -0,0 +1,45 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Per-gpio debounce and glitch filter, applied between event capture and dispatch */
+
+#define FILTER_REJECT 0
+#define FILTER_ACCEPT 1
+#define FILTER_DEFER  2   // accepted or rejected later, see filter_expire()
+
+// filter settings, all times in microseconds, 0 disables
+struct event_filter
+{
+    unsigned int lockout;    // ignore edges for this long after an accepted edge
+    unsigned int stable;     // the new level must hold for this long before the edge is accepted
+    unsigned int min_pulse;  // hold edges this long, both edges of a shorter pulse are rejected
+};
+
+void set_event_filter(unsigned int gpio, struct event_filter *filter);
+void get_event_filter(unsigned int gpio, struct event_filter *filter);
+void reset_event_filter(unsigned int gpio);
+void drop_filter_edge(unsigned int gpio);
+unsigned long long event_filter_rejected(unsigned int gpio);
+int filter_edge(struct gpio_event *ev);
+int filter_held(struct gpio_event *ev, struct gpio_event *held);
+int filter_expire(unsigned long long now, struct gpio_event *ev);
+unsigned long long filter_next_deadline(void);
@@ -20,14 +20,38 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#define _GNU_SOURCE     // for pthread_timedjoin_np()
 #include <pthread.h>
+#include <errno.h>
 #include <sys/epoll.h>
+#include <sys/timerfd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <stdint.h>
 #include <string.h>
+#include <time.h>
 #include "event_gpio.h"
+#include "event_filter.h"
+#include "event_queue.h"
+#include "event_burst.h"
+#include "event_stream.h"
+#include "event_wait.h"
+#include "event_count.h"
+#include "event_reflex.h"
+#include "event_pattern.h"
+#include "event_stats.h"
+#include "trace.h"
+#include "event_record.h"
+#include "sampler.h"
+#include "output_sched.h"
+#include "waveform.h"
+#include "event_timer.h"
+#include "event_measure.h"
+#include "rt_thread.h"
+
+#define POLL_JOIN_TIMEOUT 1   // seconds cleanup waits for the poll thread
 
 const char *stredge[4] = {"none", "rising", "falling", "both"};
 
@@ -40,15 +64,17 @@ struct fdx
     struct fdx *next;
 };
 struct fdx *fd_list = NULL;
+pthread_mutex_t fd_lock = PTHREAD_MUTEX_INITIALIZER;       // the poll thread looks up fds while callers add them
 
 // event callbacks
 struct callback
 {
     unsigned int gpio;
-    void (*func)(unsigned int gpio);
+    void (*func)(struct gpio_event *ev);
     struct callback *next;
 };
 struct callback *callbacks = NULL;
+pthread_mutex_t callback_lock = PTHREAD_MUTEX_INITIALIZER;
 
 // gpio exports
 struct gpio_exp
@@ -57,11 +83,34 @@ struct gpio_exp
     struct gpio_exp *next;
 };
 struct gpio_exp *exported_gpios = NULL;
+pthread_mutex_t export_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// event sources, protected by source_lock as the poll thread reads from them
+struct event_source *sources = NULL;
+pthread_mutex_t source_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// the poll thread, started and stopped under poll_lock
+pthread_t poll_thread_id;
+int poll_started = 0;
+unsigned long poll_generation = 0;  // bumped to stop the poll thread, also one left running detached
+pthread_mutex_t poll_lock = PTHREAD_MUTEX_INITIALIZER;
 
-pthread_t threads;
 int event_occurred[54] = { 0 };
+unsigned int event_edge[54] = { NO_EDGE };
+int event_level_seen[54] = { 0 };
+int event_wait_only[54] = { 0 };   // edge detection added by wait_for_any() and not asked for otherwise
+unsigned int event_seq[54] = { 0 };  // events delivered since edge detection was added
 int thread_running = 0;
 int epfd = -1;
+int timer_fd = -1;
+
+unsigned long long event_timestamp(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
 
 int gpio_export(unsigned int gpio)
 {
@@ -85,6 +134,7 @@ int gpio_export(unsigned int gpio)
     new_gpio->gpio = gpio;
     new_gpio->next = NULL;
 
+    pthread_mutex_lock(&export_lock);
     if (exported_gpios == NULL)
     {
         // create new list
@@ -96,15 +146,18 @@ int gpio_export(unsigned int gpio)
             g = g->next;
         g->next = new_gpio;
     }
+    pthread_mutex_unlock(&export_lock);
     return 0;
 }
 
 void close_value_fd(unsigned int gpio)
 {
-    struct fdx *f = fd_list;
+    struct fdx *f;
     struct fdx *temp;
     struct fdx *prev = NULL;
 
+    pthread_mutex_lock(&fd_lock);
+    f = fd_list;
     while (f != NULL)
     {
         if (f->gpio == gpio)
@@ -122,6 +175,7 @@ void close_value_fd(unsigned int gpio)
             f = f->next;
         }
     }
+    pthread_mutex_unlock(&fd_lock);
 }
 
 int gpio_unexport(unsigned int gpio)
@@ -140,6 +194,7 @@ int gpio_unexport(unsigned int gpio)
     close(fd);
 
     // remove from list
+    pthread_mutex_lock(&export_lock);
     g = exported_gpios;
     while (g != NULL)
     {
@@ -157,6 +212,7 @@ int gpio_unexport(unsigned int gpio)
             g = g->next;
         }
     }
+    pthread_mutex_unlock(&export_lock);
     return 0;
 }
 
@@ -204,37 +260,37 @@ int add_fd_list(unsigned int gpio, int fd)
     new_fd->fd = fd;
     new_fd->gpio = gpio;
     new_fd->initial = 1;
-    if (fd_list == NULL) {
-        new_fd->next = NULL;
-    } else {
-        new_fd->next = fd_list;
-    }
+    pthread_mutex_lock(&fd_lock);
+    new_fd->next = fd_list;
     fd_list = new_fd;
+    pthread_mutex_unlock(&fd_lock);
     return 0;
 }
 
-unsigned int gpio_lookup(int fd)
+int gpio_lookup(int fd)
 {
-    struct fdx *f = fd_list;
-    while (f != NULL)
-    {
+    struct fdx *f;
+    int gpio = -1;
+
+    pthread_mutex_lock(&fd_lock);
+    for (f = fd_list; f != NULL && gpio == -1; f = f->next)
         if (f->fd == fd)
-            return f->gpio;
-        f = f->next;
-    }
-    return 0;
+            gpio = f->gpio;
+    pthread_mutex_unlock(&fd_lock);
+    return gpio;
 }
 
 int fd_lookup(unsigned int gpio)
 {
-    struct fdx *f = fd_list;
-    while (f != NULL)
-    {
+    struct fdx *f;
+    int fd = 0;
+
+    pthread_mutex_lock(&fd_lock);
+    for (f = fd_list; f != NULL && fd == 0; f = f->next)
         if (f->gpio == gpio)
-            return f->fd;
-        f = f->next;
-    }
-    return 0;
+            fd = f->fd;
+    pthread_mutex_unlock(&fd_lock);
+    return fd;
 }
 
 int open_value_file(unsigned int gpio)
@@ -252,14 +308,24 @@ int open_value_file(unsigned int gpio)
 
 void exports_cleanup(void)
 {
+    unsigned int gpio;
+
     // unexport everything
+    pthread_mutex_lock(&export_lock);
     while (exported_gpios != NULL)
-        gpio_unexport(exported_gpios->gpio);
+    {
+        gpio = exported_gpios->gpio;
+        pthread_mutex_unlock(&export_lock);
+        gpio_unexport(gpio);
+        pthread_mutex_lock(&export_lock);
+    }
+    pthread_mutex_unlock(&export_lock);
 }
 
-int add_edge_callback(unsigned int gpio, void (*func)(unsigned int gpio))
+int add_edge_callback(unsigned int gpio, void (*func)(struct gpio_event *ev))
+// a func already added for gpio is not added again, it is called once per event
 {
-    struct callback *cb = callbacks;
+    struct callback *cb;
     struct callback *new_cb;
 
     new_cb = malloc(sizeof(struct callback));
@@ -270,35 +336,71 @@ int add_edge_callback(unsigned int gpio, void (*func)(unsigned int gpio))
     new_cb->func = func;
     new_cb->next = NULL;
 
+    pthread_mutex_lock(&callback_lock);
+    for (cb = callbacks; cb != NULL; cb = cb->next)
+    {
+        if (cb->gpio == gpio && cb->func == func)
+        {
+            pthread_mutex_unlock(&callback_lock);
+            free(new_cb);
+            return 0;
+        }
+    }
     if (callbacks == NULL) {
         // start new list
         callbacks = new_cb;
     } else {
         // add to end of list
+        cb = callbacks;
         while (cb->next != NULL)
             cb = cb->next;
         cb->next = new_cb;
     }
+    pthread_mutex_unlock(&callback_lock);
     return 0;
 }
 
-void run_callbacks(unsigned int gpio)
+static void (*next_callback(unsigned int gpio, int skip))(struct gpio_event *ev)
+// the callback of gpio after skip others, or NULL
 {
-    struct callback *cb = callbacks;
-    while (cb != NULL)
+    struct callback *cb;
+    void (*func)(struct gpio_event *ev) = NULL;
+
+    pthread_mutex_lock(&callback_lock);
+    for (cb = callbacks; cb != NULL && func == NULL; cb = cb->next)
+        if (cb->gpio == gpio && skip-- == 0)
+            func = cb->func;
+    pthread_mutex_unlock(&callback_lock);
+    return func;
+}
+
+void run_callbacks(struct gpio_event *ev)
+// the list is not locked while a callback runs, it may add or remove callbacks
+{
+    void (*func)(struct gpio_event *ev);
+    unsigned long long start = 0;
+    int n = 0;
+
+    while ((func = next_callback(ev->gpio, n++)) != NULL)
     {
-        if (cb->gpio == gpio)
-            cb->func(cb->gpio);
-        cb = cb->next;
+        if (start == 0)
+            start = event_timestamp();
+        TRACE(TRACE_CALLBACK_BEGIN, ev->gpio, ev->level);
+        func(ev);
+        TRACE(TRACE_CALLBACK_END, ev->gpio, 0);
     }
+    if (start)
+        stats_delivered(ev, start, event_timestamp());
 }
 
 void remove_callbacks(unsigned int gpio)
 {
-    struct callback *cb = callbacks;
+    struct callback *cb;
     struct callback *temp;
     struct callback *prev = NULL;
 
+    pthread_mutex_lock(&callback_lock);
+    cb = callbacks;
     while (cb != NULL)
     {
         if (cb->gpio == gpio)
@@ -315,80 +417,435 @@ void remove_callbacks(unsigned int gpio)
             cb = cb->next;
         }
     }
+    pthread_mutex_unlock(&callback_lock);
 }
 
 void set_initial_false(unsigned int gpio)
 {
-    struct fdx *f = fd_list;
+    struct fdx *f;
 
-    while (f != NULL)
-    {
+    pthread_mutex_lock(&fd_lock);
+    for (f = fd_list; f != NULL; f = f->next)
         if (f->gpio == gpio)
             f->initial = 0;
-        f = f->next;
-    }
+    pthread_mutex_unlock(&fd_lock);
 }
 
 int gpio_initial(unsigned int gpio)
 {
-    struct fdx *f = fd_list;
+    struct fdx *f;
+    int initial = 0;
 
-    while (f != NULL)
-    {
+    pthread_mutex_lock(&fd_lock);
+    for (f = fd_list; f != NULL && !initial; f = f->next)
         if ((f->gpio == gpio) && f->initial)
+            initial = 1;
+    pthread_mutex_unlock(&fd_lock);
+    return initial;
+}
+
+int event_level(unsigned int gpio)
+// current level of a gpio with edge detection, as reported by its value file or event source
+{
+    int fd = fd_lookup(gpio);
+    char buf;
+
+    if (fd > 0)
+    {
+        lseek(fd, 0, SEEK_SET);
+        if (read(fd, &buf, 1) == 1)
+            return (buf == '1');
+    }
+    return event_level_seen[gpio];
+}
+
+unsigned long long event_horizon(unsigned int gpio, unsigned long long now)
+// time up to which every edge of a gpio has been captured, a source stamping its edges itself can lag behind now
+{
+    struct event_source *src;
+    unsigned long long horizon = now;
+
+    pthread_mutex_lock(&source_lock);
+    for (src = sources; src != NULL; src = src->next)
+        if (src->gpio == (int)gpio && src->horizon != NULL)
+            horizon = src->horizon(src);
+    pthread_mutex_unlock(&source_lock);
+    return horizon < now ? horizon : now;
+}
+
+void deliver_event(struct gpio_event *ev)
+// hands an accepted event to the event stream and the callbacks
+{
+    ev->seq = __atomic_add_fetch(&event_seq[ev->gpio], 1, __ATOMIC_RELAXED);
+    stream_event(ev);
+    queue_event(ev);
+}
+
+int dispatch_event(struct gpio_event *ev)
+// returns 1 if the poll timer needs rearming
+{
+    int rearm;
+
+    // input capture sees both edges, whatever edge type the gpio is set up for
+    measure_edge(ev);
+
+    // reflex rules see both edges too and apply their own edge type, patterns follow the level of every edge
+    rearm = reflex_edge(ev);
+    pattern_edge(ev);
+
+    // sysfs and sources report every edge, apply the edge type configured for the gpio
+    if ((ev->level && !(event_edge[ev->gpio] & RISING_EDGE)) ||
+        (!ev->level && !(event_edge[ev->gpio] & FALLING_EDGE)))
+        return rearm;
+
+    // waits see every edge, also of gpios whose edges are counted or coalesced into bursts
+    wake_waiters(ev);
+    __atomic_store_n(&event_occurred[ev->gpio], 1, __ATOMIC_RELEASE);
+    if (event_counting(ev->gpio))
+    {
+        count_event(ev);
+        return rearm;
+    }
+    switch (burst_edge(ev))
+    {
+        case BURST_HOLD:
+            return rearm;
+        case BURST_OPEN:
             return 1;
-        f = f->next;
+        default:
+            deliver_event(ev);
+            return rearm;
     }
-    return 0;
+}
+
+void arm_poll_timer(void)
+{
+    struct itimerspec its = { {0, 0}, {0, 0} };
+    unsigned long long deadline = filter_next_deadline();
+    unsigned long long burst_deadline = burst_next_deadline();
+    unsigned long long reflex_deadline = reflex_next_deadline();
+    unsigned long long pattern_deadline = pattern_next_deadline();
+
+    if (burst_deadline && (deadline == 0 || burst_deadline < deadline))
+        deadline = burst_deadline;
+    if (reflex_deadline && (deadline == 0 || reflex_deadline < deadline))
+        deadline = reflex_deadline;
+    if (pattern_deadline && (deadline == 0 || pattern_deadline < deadline))
+        deadline = pattern_deadline;
+    if (deadline)
+    {
+        its.it_value.tv_sec = deadline / 1000000ULL;
+        its.it_value.tv_nsec = (deadline % 1000000ULL) * 1000;
+    }
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+void wake_poll_timer(void)
+// lets the poll thread pick up a new deadline set from another thread
+{
+    struct itimerspec its = { {0, 0}, {0, 1} };
+
+    if (timer_fd != -1)
+        timerfd_settime(timer_fd, 0, &its, NULL);
+}
+
+void poll_timer_expired(void)
+{
+    struct gpio_event ev;
+    unsigned long long now = event_timestamp();
+    uint64_t expirations;
+
+    read(timer_fd, &expirations, sizeof(expirations));
+    while (filter_expire(now, &ev))
+        dispatch_event(&ev);
+    while (burst_expire(now, &ev))
+        deliver_event(&ev);
+    reflex_expire(now);
+    pattern_tick(now);
+}
+
+int capture_event(struct gpio_event *ev)
+// runs a captured edge through the filter, returns 1 if the poll timer needs rearming
+{
+    struct gpio_event held;
+    int rearm = 0;
+
+    if (ev->gpio >= 54)
+        return 0;
+
+    stats_seen(ev->gpio);
+    TRACE(TRACE_EDGE, ev->gpio, ev->level);
+    ev->first = ev->timestamp;
+    ev->count = 1;
+    record_edge(ev);
+    event_level_seen[ev->gpio] = ev->level;
+    if (filter_held(ev, &held))
+        rearm = dispatch_event(&held);
+    switch (filter_edge(ev))
+    {
+        case FILTER_ACCEPT:
+            return dispatch_event(ev) | rearm;
+        case FILTER_DEFER:
+            return 1;
+        default:
+            return rearm;
+    }
+}
+
+int read_source_events(int fd, struct gpio_event *evs, int max)
+// returns the number of events copied from the source owning fd, or -1 if fd is not a source
+{
+    struct event_source *src;
+    int n = 0;
+
+    pthread_mutex_lock(&source_lock);
+    for (src = sources; src != NULL; src = src->next)
+        if (src->fd == fd)
+            break;
+    if (src == NULL)
+    {
+        pthread_mutex_unlock(&source_lock);
+        return -1;
+    }
+    while (n < max && src->next_event(src, &evs[n]))
+        n++;
+    pthread_mutex_unlock(&source_lock);
+    return n;
+}
+
+static int poll_current(unsigned long generation)
+// 0 once the poll thread of this generation has been told to stop
+{
+    return __atomic_load_n(&poll_generation, __ATOMIC_ACQUIRE) == generation;
+}
+
+static void poll_thread_exit(unsigned long generation)
+{
+    // a newer poll thread owns thread_running once the generation moved on
+    pthread_mutex_lock(&poll_lock);
+    if (poll_generation == generation)
+        thread_running = 0;
+    pthread_mutex_unlock(&poll_lock);
+    pthread_exit(NULL);
 }
 
 void *poll_thread(void *threadarg)
 {
+    unsigned long generation = (unsigned long)threadarg;
     struct epoll_event events;
+    struct gpio_event ev[64];
     char buf;
-    unsigned int gpio;
-    int n;
+    int n, i, rearm;
 
-    thread_running = 1;
-    while (thread_running)
+    trace_thread_name("poll");
+    rt_thread_enter(RT_POLL);
+    while (poll_current(generation))
     {
         if ((n = epoll_wait(epfd, &events, 1, -1)) == -1)
         {
-            thread_running = 0;
-            pthread_exit(NULL);
+            if (errno == EINTR)
+                continue;
+            poll_thread_exit(generation);
         }
+        if (!poll_current(generation))
+            break;
         if (n > 0) {
-            lseek(events.data.fd, 0, SEEK_SET);
-            if (read(events.data.fd, &buf, 1) != 1)
+            ev[0].timestamp = event_timestamp();
+
+            if (events.data.fd == timer_fd)
             {
-                thread_running = 0;
-                pthread_exit(NULL);
+                poll_timer_expired();
+                arm_poll_timer();
+                continue;
             }
-            gpio = gpio_lookup(events.data.fd);
-            if (gpio_initial(gpio)) {     // ignore first epoll trigger
-                set_initial_false(gpio);
-            } else {
-                event_occurred[gpio] = 1;
-                run_callbacks(gpio);
+
+            // events from an event source, dispatched outside of source_lock
+            rearm = 0;
+            while (poll_current(generation) && (n = read_source_events(events.data.fd, ev, 64)) > 0)
+                for (i = 0; i < n; i++)
+                    rearm |= capture_event(&ev[i]);
+            if (rearm)
+                arm_poll_timer();
+            if (n == 0 || gpio_lookup(events.data.fd) == -1)
+                continue;   // drained, or removed while the event was pending
+
+            lseek(events.data.fd, 0, SEEK_SET);
+            if (read(events.data.fd, &buf, 1) != 1)
+                poll_thread_exit(generation);
+            ev[0].gpio = gpio_lookup(events.data.fd);
+            ev[0].level = (buf == '1');
+            if (gpio_initial(ev[0].gpio)) {     // ignore first epoll trigger
+                set_initial_false(ev[0].gpio);
+                event_level_seen[ev[0].gpio] = ev[0].level;
+            } else if (capture_event(&ev[0])) {
+                arm_poll_timer();
             }
         }
     }
-    thread_running = 0;
-    pthread_exit(NULL);
+    poll_thread_exit(generation);
+    return NULL;
 }
 
-int gpio_event_added(unsigned int gpio)
+static int start_poll_thread_locked(void)
+// called with poll_lock held
 {
-    struct fdx *f = fd_list;
-    while (f != NULL)
+    struct epoll_event ev;
+
+    // create epfd if not already open
+    if ((epfd == -1) && ((epfd = epoll_create(1)) == -1))
+        return 2;
+
+    // timer for edges the filter has to wait for, also wakes the thread to stop it
+    if (timer_fd == -1)
     {
-        if (f->gpio == gpio)
-            return 1;
-        f = f->next;
+        if ((timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK)) == -1)
+            return 2;
+        ev.events = EPOLLIN;
+        ev.data.fd = timer_fd;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, timer_fd, &ev) == -1)
+        {
+            close(timer_fd);
+            timer_fd = -1;
+            return 2;
+        }
+    }
+
+    // start poll thread if it is not already running
+    if (!thread_running)
+    {
+        if (ensure_executor() != 0)
+            return 2;
+        if (poll_started)
+            pthread_join(poll_thread_id, NULL);     // ended on an error
+        poll_started = 0;
+        thread_running = 1;
+        if (pthread_create(&poll_thread_id, NULL, poll_thread, (void *)poll_generation) != 0)
+        {
+            thread_running = 0;
+            return 2;
+        }
+        poll_started = 1;
     }
     return 0;
 }
 
+int start_poll_thread(void)
+{
+    int result;
+
+    pthread_mutex_lock(&poll_lock);
+    result = start_poll_thread_locked();
+    pthread_mutex_unlock(&poll_lock);
+    return result;
+}
+
+static void stop_poll_thread(void)
+// waits up to POLL_JOIN_TIMEOUT seconds for the poll thread, a callback run on it may be stuck, e.g. waiting for
+// the python GIL held by the caller; a thread still busy then is left to end on its own, it sees its generation is
+// over and does not touch the state of a poll thread started after it
+{
+    struct timespec ts;
+    pthread_t thread;
+    int started;
+
+    pthread_mutex_lock(&poll_lock);
+    __atomic_add_fetch(&poll_generation, 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&thread_running, 0, __ATOMIC_RELEASE);
+    wake_poll_timer();
+    started = poll_started;
+    thread = poll_thread_id;
+    poll_started = 0;
+    pthread_mutex_unlock(&poll_lock);
+
+    if (!started)
+        return;
+    if (pthread_equal(thread, pthread_self()))
+    {
+        pthread_detach(thread);    // cleaning up from a callback on the poll thread
+        return;
+    }
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += POLL_JOIN_TIMEOUT;
+    if (pthread_timedjoin_np(thread, NULL, &ts) != 0)
+        pthread_detach(thread);
+}
+
+static void unlink_event_source(struct event_source *src)
+{
+    struct epoll_event ev;
+    struct event_source **s;
+
+    epoll_ctl(epfd, EPOLL_CTL_DEL, src->fd, &ev);
+
+    pthread_mutex_lock(&source_lock);
+    for (s = &sources; *s != NULL; s = &(*s)->next)
+    {
+        if (*s == src)
+        {
+            *s = src->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&source_lock);
+}
+
+int add_event_source(struct event_source *src)
+// return values:
+// 0 - Success
+// 2 - Other error, the source is not closed, the caller still owns it
+{
+    struct epoll_event ev;
+
+    if (start_poll_thread() != 0)
+        return 2;
+
+    pthread_mutex_lock(&source_lock);
+    src->next = sources;
+    sources = src;
+    pthread_mutex_unlock(&source_lock);
+
+    ev.events = EPOLLIN;
+    ev.data.fd = src->fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, src->fd, &ev) == -1)
+    {
+        unlink_event_source(src);
+        return 2;
+    }
+    return 0;
+}
+
+void remove_event_source(struct event_source *src)
+{
+    unlink_event_source(src);
+
+    if (src->close != NULL)
+        src->close(src);
+}
+
+void remove_gpio_sources(unsigned int gpio)
+{
+    struct event_source *src;
+
+    do {
+        pthread_mutex_lock(&source_lock);
+        for (src = sources; src != NULL; src = src->next)
+            if (src->gpio == (int)gpio)
+                break;
+        pthread_mutex_unlock(&source_lock);
+        if (src != NULL)
+            remove_event_source(src);
+    } while (src != NULL);
+}
+
+int gpio_event_added(unsigned int gpio)
+{
+    if (event_wait_only[gpio])
+        return 0;
+    if (event_edge[gpio] != NO_EDGE)
+        return 1;
+    return fd_lookup(gpio) != 0;
+}
+
 int add_edge_detect(unsigned int gpio, unsigned int edge)
 // return values:
 // 0 - Success
@@ -396,24 +853,26 @@ int add_edge_detect(unsigned int gpio, unsigned int edge)
 // 2 - Other error
 {
     int fd;
-    pthread_t threads;
     struct epoll_event ev;
-    long t = 0;
+
+    // take over edge detection left behind by wait_for_any()
+    if (event_wait_only[gpio])
+        remove_edge_detect(gpio);
 
     // check to see if this gpio has been added already
     if (gpio_event_added(gpio) != 0)
         return 1;
 
-    // export /sys/class/gpio interface
+    // export /sys/class/gpio interface, the kernel reports both edges for input capture, reflex rules and patterns,
+    // dispatch_event() applies the edge type
     gpio_export(gpio);
     gpio_set_direction(gpio, 1); // 1=input
-    gpio_set_edge(gpio, edge);
+    gpio_set_edge(gpio, BOTH_EDGE);
     if ((fd = open_value_file(gpio)) == -1)
         return 2;
-    add_fd_list(gpio,fd);
 
-    // create epfd if not already open
-    if ((epfd == -1) && ((epfd = epoll_create(1)) == -1))
+    // create epfd and start poll thread if not already running
+    if (start_poll_thread() != 0)
         return 2;
 
     // add to epoll fd
@@ -422,13 +881,87 @@ int add_edge_detect(unsigned int gpio, unsigned int edge)
     if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1)
         return 2;
 
-    // start poll thread if it is not already running
-    if (!thread_running)
+    reset_event_filter(gpio);
+    reset_event_burst(gpio);
+    reset_event_count(gpio);
+    reset_measure(gpio);
+    event_edge[gpio] = edge;
+    return 0;
+}
+
+int add_source_edge_detect(unsigned int gpio, unsigned int edge, struct event_source *src)
+// edge detection fed by an event source instead of the sysfs interface
+// return values:
+// 0 - Success
+// 1 - Edge detection already added
+// 2 - Other error
+{
+    if (event_wait_only[gpio])
+        remove_edge_detect(gpio);
+    if (gpio_event_added(gpio) != 0)
+        return 1;
+
+    src->gpio = gpio;
+    event_level_seen[gpio] = 0;    // a source starts from low, its first edge rises
+    reset_event_filter(gpio);
+    reset_event_burst(gpio);
+    reset_event_count(gpio);
+    reset_measure(gpio);
+    event_edge[gpio] = edge;
+    if (add_event_source(src) != 0)
     {
-        if (pthread_create(&threads, NULL, poll_thread, (void *)t) != 0)
-            return 2;
+        event_edge[gpio] = NO_EDGE;
+        return 2;
+    }
+    return 0;
+}
+
+int add_shared_source_edge_detect(unsigned long long gpios, unsigned int edge, struct event_source *src)
+// edge detection on every gpio in the bit mask gpios, all fed by one event source
+// return values as add_source_edge_detect()
+{
+    unsigned int gpio;
+
+    for (gpio = 0; gpio < 54; gpio++)
+    {
+        if (!((gpios >> gpio) & 1))
+            continue;
+        if (event_wait_only[gpio])
+            remove_edge_detect(gpio);
+        if (gpio_event_added(gpio) != 0)
+            return 1;
+    }
+
+    src->gpio = -1;
+    for (gpio = 0; gpio < 54; gpio++)
+    {
+        if (!((gpios >> gpio) & 1))
+            continue;
+        event_level_seen[gpio] = 0;
+        reset_event_filter(gpio);
+        reset_event_burst(gpio);
+        reset_event_count(gpio);
+        reset_measure(gpio);
+        event_edge[gpio] = edge;
+    }
+    if (add_event_source(src) != 0)
+    {
+        for (gpio = 0; gpio < 54; gpio++)
+            if ((gpios >> gpio) & 1)
+                event_edge[gpio] = NO_EDGE;
+        return 2;
     }
+    return 0;
+}
 
+int add_wait_edge_detect(unsigned int gpio)
+// makes sure a gpio has edge detection for wait_for_any(), return values as add_edge_detect()
+{
+    if (event_edge[gpio] != NO_EDGE)
+        return 0;
+    if (add_edge_detect(gpio, BOTH_EDGE) != 0)
+        return 2;
+    event_wait_only[gpio] = 1;
     return 0;
 }
 
@@ -440,6 +973,17 @@ void remove_edge_detect(unsigned int gpio)
     // delete callbacks for gpio
     remove_callbacks(gpio);
 
+    // stop any event source feeding this gpio
+    event_edge[gpio] = NO_EDGE;
+    event_wait_only[gpio] = 0;
+    remove_gpio_sources(gpio);
+    remove_gpio_reflexes(gpio);
+    drop_filter_edge(gpio);
+    reset_pattern_level(gpio);
+    reset_event_burst(gpio);
+    reset_event_count(gpio);
+    reset_measure(gpio);
+
     // delete epoll of fd
     epoll_ctl(epfd, EPOLL_CTL_DEL, fd, &ev);
 
@@ -453,23 +997,43 @@ void remove_edge_detect(unsigned int gpio)
     gpio_unexport(gpio);
 
     // clear detected flag
-    event_occurred[gpio] = 0;
+    __atomic_store_n(&event_occurred[gpio], 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&event_seq[gpio], 0, __ATOMIC_RELAXED);
 }
 
 int event_detected(unsigned int gpio)
 {
-    if (event_occurred[gpio]) {
-        event_occurred[gpio] = 0;
-        return 1;
-    } else {
-        return 0;
-    }
+    return __atomic_exchange_n(&event_occurred[gpio], 0, __ATOMIC_ACQ_REL);
 }
 
 void event_cleanup(void)
 {
+    int i;
+
+    // nothing new is dispatched from here on
+    stop_poll_thread();
+
+    for (i=0; i<54; i++)
+    {
+        event_edge[i] = NO_EDGE;
+        event_wait_only[i] = 0;
+        reset_stats(i);
+    }
+    while (sources != NULL)
+        remove_event_source(sources);
     close(epfd);
-    thread_running = 0;
+    epfd = -1;
+    close(timer_fd);
+    timer_fd = -1;
+    clear_reflexes();
+    clear_patterns();
+    clear_timers();
+    record_stop();
+    sampler_stop();
+    output_sched_stop();
+    wave_cleanup();
+    stop_executor();
+    stream_close();
     exports_cleanup();
 }
 
@@ -25,9 +25,46 @@ SOFTWARE.
 #define FALLING_EDGE 2
 #define BOTH_EDGE    3
 
+// a captured edge, or several edges of one gpio merged into one event
+struct gpio_event
+{
+    unsigned int gpio;
+    int level;                      // level after the (last) edge, 0 or 1
+    unsigned long long timestamp;   // CLOCK_MONOTONIC, in microseconds, of the last edge
+    unsigned long long first;       // timestamp of the first edge
+    unsigned int count;             // number of edges this event stands for
+    unsigned int seq;               // per gpio number of the event handed to the callbacks, gaps are events lost
+};
+
+// Event sources feed edges from somewhere other than the sysfs value files into
+// the same dispatch path. The fd is added to the epoll set of the poll thread and
+// must be readable while events are pending. next_event() is called from the poll
+// thread until it returns 0, and must clear the readable state of the fd itself.
+struct event_source
+{
+    int fd;
+    int gpio;       // gpio fed by this source, or -1 if it feeds several
+    int (*next_event)(struct event_source *src, struct gpio_event *ev);
+    void (*close)(struct event_source *src);
+    unsigned long long (*horizon)(struct event_source *src);  // every edge before this time is handed over, NULL for now
+    void *data;
+    struct event_source *next;
+};
+
+unsigned long long event_timestamp(void);
+int event_level(unsigned int gpio);
+unsigned long long event_horizon(unsigned int gpio, unsigned long long now);
+int add_event_source(struct event_source *src);
+void remove_event_source(struct event_source *src);
+int add_source_edge_detect(unsigned int gpio, unsigned int edge, struct event_source *src);
+int add_shared_source_edge_detect(unsigned long long gpios, unsigned int edge, struct event_source *src);
 int add_edge_detect(unsigned int gpio, unsigned int edge);
+int add_wait_edge_detect(unsigned int gpio);
 void remove_edge_detect(unsigned int gpio);
-int add_edge_callback(unsigned int gpio, void (*func)(unsigned int gpio));
+int add_edge_callback(unsigned int gpio, void (*func)(struct gpio_event *ev));
+void run_callbacks(struct gpio_event *ev);
+void remove_callbacks(unsigned int gpio);
+void wake_poll_timer(void);
 int event_detected(unsigned int gpio);
 int gpio_event_added(unsigned int gpio);
 int event_initialise(void);
@@ -0,0 +1,112 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <pthread.h>
+#include "event_gpio.h"
+#include "event_measure.h"
+
+#define MEASURE_EMA 16  // weight of the moving averages, a new sample counts for 1/MEASURE_EMA
+
+// writers hold measure_lock, readers don't lock. seq is odd while an update is in progress,
+// so readers retry instead of seeing half an update and never hold up the poll thread.
+struct measure_state
+{
+    unsigned int seq;
+    struct measure_result r;
+    unsigned long long rise;    // timestamp of the last rising edge, 0 if none
+    unsigned long long highs;   // number of high times seen
+};
+struct measure_state measures[54];
+pthread_mutex_t measure_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void update_stat(struct measure_stat *s, unsigned int value, unsigned long long samples)
+{
+    s->last = value;
+    if (samples == 1)
+    {
+        s->min = s->max = value;
+        s->avg = value;
+        return;
+    }
+    if (value < s->min)
+        s->min = value;
+    if (value > s->max)
+        s->max = value;
+    s->avg += (value - s->avg) / MEASURE_EMA;
+}
+
+void measure_edge(struct gpio_event *ev)
+{
+    struct measure_state *m = &measures[ev->gpio];
+
+    pthread_mutex_lock(&measure_lock);
+    __atomic_add_fetch(&m->seq, 1, __ATOMIC_RELEASE);
+    if (ev->level)
+    {
+        if (m->rise)
+        {
+            m->r.periods++;
+            update_stat(&m->r.period, (unsigned int)(ev->timestamp - m->rise), m->r.periods);
+            if (m->r.high.last <= m->r.period.last)
+            {
+                m->r.duty = (double)m->r.high.last / m->r.period.last;
+                if (m->r.periods == 1)
+                    m->r.duty_avg = m->r.duty;
+                else
+                    m->r.duty_avg += (m->r.duty - m->r.duty_avg) / MEASURE_EMA;
+            }
+        }
+        m->rise = ev->timestamp;
+    } else if (m->rise) {
+        m->highs++;
+        update_stat(&m->r.high, (unsigned int)(ev->timestamp - m->rise), m->highs);
+    }
+    m->r.last_edge = ev->timestamp;
+    __atomic_add_fetch(&m->seq, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&measure_lock);
+}
+
+void reset_measure(unsigned int gpio)
+{
+    struct measure_state *m = &measures[gpio];
+    struct measure_result empty = { {0, 0, 0, 0.0}, {0, 0, 0, 0.0}, 0.0, 0.0, 0, 0 };
+
+    pthread_mutex_lock(&measure_lock);
+    __atomic_add_fetch(&m->seq, 1, __ATOMIC_RELEASE);
+    m->r = empty;
+    m->rise = m->highs = 0;
+    __atomic_add_fetch(&m->seq, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&measure_lock);
+}
+
+void read_measure(unsigned int gpio, struct measure_result *result)
+{
+    struct measure_state *m = &measures[gpio];
+    unsigned int seq;
+
+    do {
+        while ((seq = __atomic_load_n(&m->seq, __ATOMIC_ACQUIRE)) & 1)
+            ;
+        *result = m->r;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&m->seq, __ATOMIC_RELAXED) != seq);
+}
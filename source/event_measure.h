@@ -0,0 +1,45 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Input capture, rolling period, high time and duty cycle statistics per gpio from the edge timestamps */
+
+struct measure_stat
+{
+    unsigned int last;      // in microseconds
+    unsigned int min;
+    unsigned int max;
+    double avg;             // exponential moving average
+};
+
+struct measure_result
+{
+    struct measure_stat period;     // rising edge to rising edge
+    struct measure_stat high;       // rising edge to falling edge
+    double duty;                    // high time / period of the last full period, 0 to 1
+    double duty_avg;
+    unsigned long long periods;     // number of full periods seen
+    unsigned long long last_edge;   // timestamp of the last edge, 0 if none
+};
+
+void measure_edge(struct gpio_event *ev);
+void reset_measure(unsigned int gpio);
+void read_measure(unsigned int gpio, struct measure_result *result);
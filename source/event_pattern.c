@@ -0,0 +1,228 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <pthread.h>
+#include "c_gpio.h"
+#include "event_gpio.h"
+#include "event_queue.h"
+#include "event_pattern.h"
+
+struct pattern
+{
+    int used;
+    unsigned long long mask;    // gpios in the pattern, bit n is gpio n
+    unsigned long long value;   // their levels for a match
+    int callback;               // queue an event on entry and exit
+    unsigned int poll;          // also check every this many us, 0 only checks on edges
+    unsigned long long next_poll;
+    struct pattern_state state;
+};
+struct pattern patterns[PATTERN_MAX];
+int pattern_count = 0;      // checked without the lock
+
+// gpios with edge detection take part with the level of their last accepted edge, so the
+// filters apply to patterns as well and ticks agree with the edges seen so far
+unsigned long long edge_gpios = 0;
+unsigned long long edge_levels = 0;
+pthread_mutex_t pattern_lock = PTHREAD_MUTEX_INITIALIZER;
+
+unsigned long long pattern_levels(void)
+// called with pattern_lock held
+{
+    return (input_gpio_mask() & ~edge_gpios) | (edge_levels & edge_gpios);
+}
+
+int add_pattern(unsigned long long mask, unsigned long long value, unsigned int poll, int callback)
+// returns the id of the new pattern, or -1 if the table is full
+{
+    int i;
+
+    pthread_mutex_lock(&pattern_lock);
+    for (i = 0; i < PATTERN_MAX; i++)
+    {
+        if (patterns[i].used)
+            continue;
+        patterns[i].mask = mask;
+        patterns[i].value = value & mask;
+        patterns[i].callback = callback;
+        patterns[i].poll = poll;
+        patterns[i].next_poll = poll ? event_timestamp() + poll : 0;
+        patterns[i].state.matched = (pattern_levels() & mask) == patterns[i].value;
+        patterns[i].state.entries = patterns[i].state.exits = 0;
+        patterns[i].used = 1;
+        __atomic_add_fetch(&pattern_count, 1, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&pattern_lock);
+        if (poll)
+            wake_poll_timer();
+        return i;
+    }
+    pthread_mutex_unlock(&pattern_lock);
+    return -1;
+}
+
+int remove_pattern(int id)
+// returns 0 on success, 1 if there is no such pattern
+{
+    int result = 1;
+
+    pthread_mutex_lock(&pattern_lock);
+    if (id >= 0 && id < PATTERN_MAX && patterns[id].used)
+    {
+        patterns[id].used = 0;
+        __atomic_sub_fetch(&pattern_count, 1, __ATOMIC_RELEASE);
+        result = 0;
+    }
+    pthread_mutex_unlock(&pattern_lock);
+    remove_callbacks(PATTERN_GPIO + id);
+    return result;
+}
+
+int get_pattern_state(int id, struct pattern_state *state)
+// returns 0 on success, 1 if there is no such pattern
+{
+    int result = 1;
+
+    pthread_mutex_lock(&pattern_lock);
+    if (id >= 0 && id < PATTERN_MAX && patterns[id].used)
+    {
+        *state = patterns[id].state;
+        result = 0;
+    }
+    pthread_mutex_unlock(&pattern_lock);
+    return result;
+}
+
+void clear_patterns(void)
+{
+    int i;
+
+    for (i = 0; i < PATTERN_MAX; i++)
+        remove_pattern(i);
+    pthread_mutex_lock(&pattern_lock);
+    edge_gpios = 0;
+    pthread_mutex_unlock(&pattern_lock);
+}
+
+void reset_pattern_level(unsigned int gpio)
+// the gpio has lost edge detection, go back to its register level
+{
+    pthread_mutex_lock(&pattern_lock);
+    edge_gpios &= ~(1ULL << gpio);
+    pthread_mutex_unlock(&pattern_lock);
+}
+
+void check_patterns(struct gpio_event *ev, unsigned long long timestamp)
+// checks the patterns against the levels now, with the edge ev if there is one
+{
+    struct gpio_event fired[PATTERN_MAX];
+    struct pattern *p;
+    int i, matched;
+    int n = 0;
+    unsigned long long levels;
+
+    pthread_mutex_lock(&pattern_lock);
+    if (ev != NULL)
+    {
+        edge_gpios |= 1ULL << ev->gpio;
+        if (ev->level)
+            edge_levels |= 1ULL << ev->gpio;
+        else
+            edge_levels &= ~(1ULL << ev->gpio);
+    }
+    levels = pattern_levels();
+    for (i = 0; i < PATTERN_MAX; i++)
+    {
+        p = &patterns[i];
+        if (!p->used)
+            continue;
+        matched = (levels & p->mask) == p->value;
+        if (matched == p->state.matched)
+            continue;
+
+        p->state.matched = matched;
+        if (matched)
+            p->state.entries++;
+        else
+            p->state.exits++;
+        if (p->callback)
+        {
+            fired[n].gpio = PATTERN_GPIO + i;
+            fired[n].level = matched;
+            fired[n].timestamp = fired[n].first = timestamp;
+            fired[n].count = 1;
+            n++;
+        }
+    }
+    pthread_mutex_unlock(&pattern_lock);
+
+    // callbacks can run right here without an executor, so not under the lock
+    for (i = 0; i < n; i++)
+        queue_event(&fired[i]);
+}
+
+void pattern_edge(struct gpio_event *ev)
+// checks the patterns against the levels at an edge
+{
+    if (__atomic_load_n(&pattern_count, __ATOMIC_ACQUIRE) == 0)
+        return;
+    check_patterns(ev, ev->timestamp);
+}
+
+void pattern_tick(unsigned long long now)
+// checks the patterns on a poll timer tick, for gpios without edge detection
+{
+    int i, due = 0;
+
+    if (__atomic_load_n(&pattern_count, __ATOMIC_ACQUIRE) == 0)
+        return;
+
+    pthread_mutex_lock(&pattern_lock);
+    for (i = 0; i < PATTERN_MAX; i++)
+    {
+        if (!patterns[i].used || !patterns[i].poll || patterns[i].next_poll > now)
+            continue;
+        // skip ticks missed rather than catching up
+        while (patterns[i].next_poll <= now)
+            patterns[i].next_poll += patterns[i].poll;
+        due = 1;
+    }
+    pthread_mutex_unlock(&pattern_lock);
+    if (due)
+        check_patterns(NULL, now);
+}
+
+unsigned long long pattern_next_deadline(void)
+// returns the time of the first poll tick, or 0 if no pattern polls
+{
+    int i;
+    unsigned long long deadline = 0;
+
+    if (__atomic_load_n(&pattern_count, __ATOMIC_ACQUIRE) == 0)
+        return 0;
+
+    pthread_mutex_lock(&pattern_lock);
+    for (i = 0; i < PATTERN_MAX; i++)
+        if (patterns[i].used && patterns[i].poll && (deadline == 0 || patterns[i].next_poll < deadline))
+            deadline = patterns[i].next_poll;
+    pthread_mutex_unlock(&pattern_lock);
+    return deadline;
+}
@@ -0,0 +1,42 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Pattern triggers, (mask, value) pairs checked against one snapshot of all gpio levels on each edge */
+
+#define PATTERN_MAX 32
+#define PATTERN_GPIO 64     // callbacks of pattern id run as edge callbacks of gpio PATTERN_GPIO + id
+
+struct pattern_state
+{
+    int matched;                // the levels matched the pattern at the last check
+    unsigned long long entries; // times the pattern started to match
+    unsigned long long exits;   // times it stopped matching
+};
+
+int add_pattern(unsigned long long mask, unsigned long long value, unsigned int poll, int callback);
+int remove_pattern(int id);
+int get_pattern_state(int id, struct pattern_state *state);
+void clear_patterns(void);
+void reset_pattern_level(unsigned int gpio);
+void pattern_edge(struct gpio_event *ev);
+void pattern_tick(unsigned long long now);
+unsigned long long pattern_next_deadline(void);
@@ -0,0 +1,238 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "event_gpio.h"
+#include "event_queue.h"
+#include "event_stats.h"
+#include "trace.h"
+#include "rt_thread.h"
+
+// ring buffer of events, protected by queue_lock
+struct gpio_event *queue = NULL;
+unsigned int queue_size = 0;
+unsigned int queue_head = 0;     // next event to run
+unsigned int queue_len = 0;
+int queue_policy = QUEUE_DROP_OLDEST;
+struct queue_stats stats = { 0 };
+pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+
+// executor settings, applied by start_executor()
+unsigned int cfg_threads = EXECUTOR_THREADS;
+unsigned int cfg_size = QUEUE_SIZE;
+int cfg_policy = QUEUE_DROP_OLDEST;
+
+// executor threads exit once the generation they were started for has passed
+int executor_running = 0;
+unsigned int executor_threads = 0;
+unsigned int generation = 0;
+unsigned int executor_idle = 0;  // threads waiting for an event, of any generation
+
+void *executor_thread(void *threadarg)
+{
+    unsigned int gen = (unsigned int)(unsigned long)threadarg;
+    struct gpio_event ev;
+
+    trace_thread_name("callbacks");
+    rt_thread_enter(RT_EXECUTOR);
+    pthread_mutex_lock(&queue_lock);
+    while (gen == generation)
+    {
+        if (queue_len == 0)
+        {
+            executor_idle++;
+            pthread_cond_wait(&queue_cond, &queue_lock);
+            if (--executor_idle == 0)
+                pthread_cond_broadcast(&idle_cond);
+            continue;
+        }
+        ev = queue[queue_head];
+        queue_head = (queue_head + 1) % queue_size;
+        queue_len--;
+
+        // run the callbacks without holding the lock, others may need it meanwhile
+        pthread_mutex_unlock(&queue_lock);
+        run_callbacks(&ev);
+        pthread_mutex_lock(&queue_lock);
+    }
+    pthread_mutex_unlock(&queue_lock);
+    pthread_exit(NULL);
+}
+
+void retire_executor(struct gpio_event *new_queue, unsigned int size)
+// called with queue_lock held, current threads may still be running a callback so don't wait for them
+{
+    generation++;
+    pthread_cond_broadcast(&queue_cond);
+    free(queue);
+    queue = new_queue;
+    queue_size = size;
+    queue_head = queue_len = 0;
+}
+
+int set_executor(unsigned int threads, unsigned int size, int policy)
+// threads 0 runs the callbacks on the poll thread itself, takes effect immediately if already running
+// return values: see start_executor()
+{
+    cfg_threads = threads;
+    cfg_size = (size > 0) ? size : 1;
+    cfg_policy = policy;
+    if (executor_running)
+        return start_executor();
+    return 0;
+}
+
+int start_executor(void)
+// return values:
+// 0 - Success
+// 1 - Out of memory
+// 2 - Failed to start a thread
+{
+    struct gpio_event *new_queue = NULL;
+    pthread_attr_t attr;
+    pthread_t thread;
+    unsigned int i, gen;
+
+    if (cfg_threads > 0 && (new_queue = malloc(cfg_size * sizeof(struct gpio_event))) == NULL)
+        return 1;
+
+    pthread_mutex_lock(&queue_lock);
+    retire_executor(new_queue, cfg_size);
+    queue_policy = cfg_policy;
+    executor_threads = cfg_threads;
+    executor_running = 1;
+    memset(&stats, 0, sizeof(stats));
+    stats.size = cfg_size;
+    gen = generation;
+    pthread_mutex_unlock(&queue_lock);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (i = 0; i < cfg_threads; i++)
+    {
+        if (pthread_create(&thread, &attr, executor_thread, (void *)(unsigned long)gen) != 0)
+        {
+            pthread_attr_destroy(&attr);
+            if (i == 0)
+                stop_executor();
+            return 2;
+        }
+    }
+    pthread_attr_destroy(&attr);
+    return 0;
+}
+
+int ensure_executor(void)
+// starts the executor for callbacks that do not come from the poll thread, unless it runs already
+// return values: see start_executor()
+{
+    int running;
+
+    pthread_mutex_lock(&queue_lock);
+    running = executor_running;
+    pthread_mutex_unlock(&queue_lock);
+    return running ? 0 : start_executor();
+}
+
+void stop_executor(void)
+// waits for the idle threads to leave, a thread busy with a callback exits once it returns
+{
+    pthread_mutex_lock(&queue_lock);
+    retire_executor(NULL, 0);
+    executor_threads = 0;
+    executor_running = 0;
+    while (executor_idle > 0)
+        pthread_cond_wait(&idle_cond, &queue_lock);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+int coalesce_event(struct gpio_event *ev)
+// merges ev into the newest queued event of the same gpio, returns 0 if there is none
+{
+    unsigned int i, pos;
+
+    for (i = queue_len; i > 0; i--)
+    {
+        pos = (queue_head + i - 1) % queue_size;
+        if (queue[pos].gpio == ev->gpio)
+        {
+            queue[pos].count += ev->count;
+            queue[pos].level = ev->level;
+            queue[pos].timestamp = ev->timestamp;
+            queue[pos].seq = ev->seq;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void queue_event(struct gpio_event *ev)
+{
+    pthread_mutex_lock(&queue_lock);
+    if (executor_threads == 0)
+    {
+        // no executor threads, run on the calling thread
+        pthread_mutex_unlock(&queue_lock);
+        run_callbacks(ev);
+        return;
+    }
+
+    stats.queued++;
+    if (queue_len == queue_size)
+    {
+        if (queue_policy == QUEUE_DROP_NEWEST)
+        {
+            stats.dropped++;
+            stats_dropped(ev->gpio);
+            pthread_mutex_unlock(&queue_lock);
+            return;
+        }
+        if (queue_policy == QUEUE_COALESCE && coalesce_event(ev))
+        {
+            stats.coalesced++;
+            pthread_mutex_unlock(&queue_lock);
+            return;
+        }
+        // drop the oldest to make room
+        stats_dropped(queue[queue_head].gpio);
+        queue_head = (queue_head + 1) % queue_size;
+        queue_len--;
+        stats.dropped++;
+    }
+    queue[(queue_head + queue_len) % queue_size] = *ev;
+    queue_len++;
+    if (queue_len > stats.high_water)
+        stats.high_water = queue_len;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+void get_queue_stats(struct queue_stats *s)
+{
+    pthread_mutex_lock(&queue_lock);
+    *s = stats;
+    pthread_mutex_unlock(&queue_lock);
+}
@@ -0,0 +1,46 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Bounded queue between the poll thread and the threads running the callbacks */
+
+#define EXECUTOR_THREADS 1   // default number of executor threads
+#define QUEUE_SIZE       1024 // default queue size
+
+#define QUEUE_DROP_OLDEST 0   // a full queue drops its oldest event
+#define QUEUE_DROP_NEWEST 1   // a full queue drops the new event
+#define QUEUE_COALESCE    2   // a full queue merges the new event into a queued event of the same gpio
+
+struct queue_stats
+{
+    unsigned long long queued;      // events added to the queue
+    unsigned long long dropped;     // events lost because the queue was full
+    unsigned long long coalesced;   // events merged into a queued event
+    unsigned int high_water;        // highest number of events waiting
+    unsigned int size;
+};
+
+int set_executor(unsigned int threads, unsigned int size, int policy);
+int start_executor(void);
+int ensure_executor(void);
+void stop_executor(void);
+void queue_event(struct gpio_event *ev);
+void get_queue_stats(struct queue_stats *stats);
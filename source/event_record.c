@@ -0,0 +1,335 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "event_gpio.h"
+#include "event_record.h"
+
+// recorder state, records are written by the poll thread
+struct recorder
+{
+    char path[256];
+    unsigned long long gpios;       // gpios recorded, bit n is gpio n
+    unsigned int segment_records;
+    unsigned int max_segments;      // older segments are deleted, 0 keeps them all
+    unsigned long long sequence;    // next segment
+    struct record_header *map;      // current segment, NULL if none
+    struct record_stats stats;
+};
+struct recorder rec;
+int recording = 0;      // checked without the lock
+pthread_mutex_t record_lock = PTHREAD_MUTEX_INITIALIZER;
+
+size_t segment_bytes(unsigned long long records)
+{
+    return sizeof(struct record_header) + records * sizeof(struct record);
+}
+
+void segment_name(char *name, size_t size, const char *path, unsigned long long sequence)
+{
+    snprintf(name, size, "%s.%06llu", path, sequence);
+}
+
+void close_segment(void)
+{
+    if (rec.map == NULL)
+        return;
+    msync(rec.map, segment_bytes(rec.map->capacity), MS_ASYNC);
+    munmap(rec.map, segment_bytes(rec.map->capacity));
+    rec.map = NULL;
+}
+
+int open_segment(void)
+// starts the next segment, returns 0 on success
+{
+    char name[300];
+    int fd;
+    size_t size = segment_bytes(rec.segment_records);
+    struct record_header *map;
+
+    close_segment();
+    segment_name(name, sizeof(name), rec.path, rec.sequence);
+    if ((fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1)
+        return 1;
+    if (ftruncate(fd, size) == -1)
+    {
+        close(fd);
+        return 1;
+    }
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return 1;
+
+    memcpy(map->magic, RECORD_MAGIC, sizeof(map->magic));
+    map->version = RECORD_VERSION;
+    map->record_size = sizeof(struct record);
+    map->sequence = rec.sequence;
+    map->capacity = rec.segment_records;
+    map->count = 0;
+    rec.map = map;
+    rec.stats.segments++;
+
+    if (rec.max_segments && rec.sequence >= rec.max_segments)
+    {
+        segment_name(name, sizeof(name), rec.path, rec.sequence - rec.max_segments);
+        unlink(name);
+    }
+    rec.sequence++;
+    return 0;
+}
+
+int segment_range(const char *path, unsigned long long *first, unsigned long long *last);
+
+void remove_segments(const char *path)
+// deletes the segments of an earlier recording to path, so they are not read back as part of the new one
+{
+    char name[300];
+    unsigned long long first, last, sequence;
+
+    if (segment_range(path, &first, &last) != 0)
+        return;
+    for (sequence = first; sequence <= last; sequence++)
+    {
+        segment_name(name, sizeof(name), path, sequence);
+        unlink(name);
+    }
+}
+
+int record_start(const char *path, unsigned long long gpios, unsigned int segment_records, unsigned int max_segments)
+// return values:
+// 0 - Success
+// 1 - Already recording
+// 2 - The first segment could not be made
+{
+    int result = 0;
+
+    pthread_mutex_lock(&record_lock);
+    if (recording)
+    {
+        pthread_mutex_unlock(&record_lock);
+        return 1;
+    }
+    memset(&rec, 0, sizeof(rec));
+    strncpy(rec.path, path, sizeof(rec.path) - 1);
+    rec.gpios = gpios;
+    rec.segment_records = segment_records ? segment_records : RECORD_SEGMENT;
+    rec.max_segments = max_segments;
+    remove_segments(rec.path);
+    if (open_segment() != 0)
+        result = 2;
+    else
+        __atomic_store_n(&recording, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&record_lock);
+    return result;
+}
+
+void record_stop(void)
+{
+    pthread_mutex_lock(&record_lock);
+    __atomic_store_n(&recording, 0, __ATOMIC_RELEASE);
+    close_segment();
+    pthread_mutex_unlock(&record_lock);
+}
+
+void record_edge(struct gpio_event *ev)
+{
+    struct record *r;
+
+    if (!__atomic_load_n(&recording, __ATOMIC_ACQUIRE) || !(rec.gpios & (1ULL << ev->gpio)))
+        return;
+
+    pthread_mutex_lock(&record_lock);
+    if (!recording)
+    {
+        pthread_mutex_unlock(&record_lock);
+        return;
+    }
+    if ((rec.map == NULL || rec.map->count == rec.map->capacity) && open_segment() != 0)
+    {
+        rec.stats.failed++;
+        pthread_mutex_unlock(&record_lock);
+        return;
+    }
+    r = (struct record *)(rec.map + 1) + rec.map->count;
+    r->timestamp = ev->timestamp;
+    r->count = ev->count;
+    r->gpio = ev->gpio;
+    r->level = ev->level;
+    r->reserved = 0;
+    // a reader of the live file only looks at records below count
+    __atomic_store_n(&rec.map->count, rec.map->count + 1, __ATOMIC_RELEASE);
+    rec.stats.records++;
+    pthread_mutex_unlock(&record_lock);
+}
+
+void get_record_stats(struct record_stats *stats)
+{
+    pthread_mutex_lock(&record_lock);
+    *stats = rec.stats;
+    pthread_mutex_unlock(&record_lock);
+}
+
+struct record_reader
+{
+    char path[256];
+    unsigned long long sequence;    // segment being read
+    unsigned long long last;        // last segment
+    struct record_header *map;
+    size_t size;
+    unsigned long long pos;         // next record in the segment
+};
+
+int segment_range(const char *path, unsigned long long *first, unsigned long long *last)
+// finds the segments of a recording, returns 0 if there is at least one
+{
+    char dir[256];
+    const char *base;
+    char *end;
+    size_t len;
+    DIR *d;
+    struct dirent *entry;
+    unsigned long long sequence;
+    int found = 0;
+
+    if ((base = strrchr(path, '/')) != NULL)
+    {
+        snprintf(dir, sizeof(dir), "%.*s", (int)(base - path), path);
+        if (dir[0] == '\0')
+            strcpy(dir, "/");
+        base++;
+    } else {
+        strcpy(dir, ".");
+        base = path;
+    }
+    len = strlen(base);
+
+    if ((d = opendir(dir)) == NULL)
+        return 1;
+    while ((entry = readdir(d)) != NULL)
+    {
+        if (strncmp(entry->d_name, base, len) != 0 || entry->d_name[len] != '.' || entry->d_name[len + 1] == '\0')
+            continue;
+        sequence = strtoull(entry->d_name + len + 1, &end, 10);
+        if (*end != '\0')
+            continue;
+        if (!found || sequence < *first)
+            *first = sequence;
+        if (!found || sequence > *last)
+            *last = sequence;
+        found = 1;
+    }
+    closedir(d);
+    return !found;
+}
+
+void unmap_reader_segment(struct record_reader *reader)
+{
+    if (reader->map != NULL)
+        munmap(reader->map, reader->size);
+    reader->map = NULL;
+}
+
+int map_reader_segment(struct record_reader *reader)
+// maps the segment reader->sequence, returns 0 on success
+{
+    char name[300];
+    int fd;
+    off_t size;
+    struct record_header *map;
+
+    unmap_reader_segment(reader);
+    segment_name(name, sizeof(name), reader->path, reader->sequence);
+    if ((fd = open(name, O_RDONLY)) == -1)
+        return 1;
+    size = lseek(fd, 0, SEEK_END);
+    if (size < (off_t)sizeof(struct record_header))
+    {
+        close(fd);
+        return 1;
+    }
+    map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return 1;
+    if (memcmp(map->magic, RECORD_MAGIC, sizeof(map->magic)) != 0 || map->version != RECORD_VERSION ||
+        map->record_size != sizeof(struct record) || (off_t)segment_bytes(map->capacity) > size)
+    {
+        munmap(map, size);
+        return 1;
+    }
+    reader->map = map;
+    reader->size = size;
+    reader->pos = 0;
+    return 0;
+}
+
+struct record_reader *record_open(const char *path)
+// returns NULL if there is no readable recording at path
+{
+    struct record_reader *reader;
+
+    if ((reader = calloc(1, sizeof(struct record_reader))) == NULL)
+        return NULL;
+    strncpy(reader->path, path, sizeof(reader->path) - 1);
+    if (segment_range(path, &reader->sequence, &reader->last) != 0 || map_reader_segment(reader) != 0)
+    {
+        free(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+int record_next(struct record_reader *reader, struct gpio_event *ev)
+// returns 1 and the next recorded edge in ev, 0 at the end of the recording
+{
+    struct record *r;
+
+    while (reader->map == NULL || reader->pos >= __atomic_load_n(&reader->map->count, __ATOMIC_ACQUIRE))
+    {
+        // segments missing in between are skipped
+        do {
+            if (reader->sequence >= reader->last)
+                return 0;
+            reader->sequence++;
+        } while (map_reader_segment(reader) != 0);
+    }
+    r = (struct record *)(reader->map + 1) + reader->pos++;
+    ev->gpio = r->gpio;
+    ev->level = r->level;
+    ev->timestamp = ev->first = r->timestamp;
+    ev->count = r->count;
+    return 1;
+}
+
+void record_close(struct record_reader *reader)
+{
+    unmap_reader_segment(reader);
+    free(reader);
+}
@@ -0,0 +1,65 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Edge recorder, captured edges appended to memory mapped segment files <path>.<sequence> */
+
+#define RECORD_MAGIC "RPIGPIOR"
+#define RECORD_VERSION 1
+#define RECORD_SEGMENT 65536    // default records per segment
+
+struct record_header
+{
+    char magic[8];
+    unsigned int version;
+    unsigned int record_size;
+    unsigned long long sequence;    // number of the segment
+    unsigned long long capacity;    // records the segment holds
+    unsigned long long count;       // records written so far
+    char reserved[24];
+};
+
+struct record
+{
+    unsigned long long timestamp;   // CLOCK_MONOTONIC in microseconds
+    unsigned int count;
+    unsigned char gpio;
+    unsigned char level;
+    unsigned short reserved;
+};
+
+struct record_stats
+{
+    unsigned long long records;     // records written
+    unsigned long long segments;    // segments started
+    unsigned long long failed;      // records lost because a segment could not be made
+};
+
+int record_start(const char *path, unsigned long long gpios, unsigned int segment_records, unsigned int max_segments);
+void record_stop(void);
+void record_edge(struct gpio_event *ev);
+void get_record_stats(struct record_stats *stats);
+
+// reading a recording back, segment by segment
+struct record_reader;
+struct record_reader *record_open(const char *path);
+int record_next(struct record_reader *reader, struct gpio_event *ev);
+void record_close(struct record_reader *reader);
@@ -0,0 +1,193 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <pthread.h>
+#include "c_gpio.h"
+#include "soft_pwm.h"
+#include "event_gpio.h"
+#include "event_reflex.h"
+
+struct reflex_slot
+{
+    int used;
+    struct reflex_rule rule;
+    unsigned long long due;     // timestamp of a pending delayed action, 0 if none
+};
+struct reflex_slot reflexes[REFLEX_MAX];
+unsigned long long reflex_gpios = 0;   // inputs with at least one rule, checked without the lock
+unsigned long long reflex_pwms = 0;    // software PWMs started by rules, stopped by clear_reflexes()
+pthread_mutex_t reflex_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void update_reflex_gpios(void)
+{
+    int i;
+    unsigned long long gpios = 0;
+
+    for (i = 0; i < REFLEX_MAX; i++)
+        if (reflexes[i].used)
+            gpios |= 1ULL << reflexes[i].rule.gpio;
+    __atomic_store_n(&reflex_gpios, gpios, __ATOMIC_RELEASE);
+}
+
+int add_reflex(struct reflex_rule *rule)
+// returns the id of the new rule, or -1 if the table is full
+{
+    int i;
+
+    pthread_mutex_lock(&reflex_lock);
+    for (i = 0; i < REFLEX_MAX; i++)
+    {
+        if (reflexes[i].used)
+            continue;
+        reflexes[i].rule = *rule;
+        reflexes[i].due = 0;
+        reflexes[i].used = 1;
+        update_reflex_gpios();
+        pthread_mutex_unlock(&reflex_lock);
+        return i;
+    }
+    pthread_mutex_unlock(&reflex_lock);
+    return -1;
+}
+
+int remove_reflex(int id)
+// returns 0 on success, 1 if there is no such rule
+{
+    int result = 1;
+
+    pthread_mutex_lock(&reflex_lock);
+    if (id >= 0 && id < REFLEX_MAX && reflexes[id].used)
+    {
+        reflexes[id].used = 0;
+        update_reflex_gpios();
+        result = 0;
+    }
+    pthread_mutex_unlock(&reflex_lock);
+    return result;
+}
+
+void remove_gpio_reflexes(unsigned int gpio)
+{
+    int i;
+
+    pthread_mutex_lock(&reflex_lock);
+    for (i = 0; i < REFLEX_MAX; i++)
+        if (reflexes[i].rule.gpio == gpio)
+            reflexes[i].used = 0;
+    update_reflex_gpios();
+    pthread_mutex_unlock(&reflex_lock);
+}
+
+void clear_reflexes(void)
+{
+    int i;
+
+    pthread_mutex_lock(&reflex_lock);
+    for (i = 0; i < REFLEX_MAX; i++)
+        reflexes[i].used = 0;
+    update_reflex_gpios();
+    for (i = 0; i < 54; i++)
+        if (reflex_pwms & (1ULL << i))
+            pwm_stop(i);
+    reflex_pwms = 0;
+    pthread_mutex_unlock(&reflex_lock);
+}
+
+void run_reflex(struct reflex_slot *r)
+// called with reflex_lock held
+{
+    unsigned long long level = 0;
+
+    if (r->rule.toggle)
+        level = input_gpio_mask();
+    if (r->rule.set || r->rule.clear || r->rule.toggle)
+        output_gpio_mask(r->rule.set | (r->rule.toggle & ~level), r->rule.clear | (r->rule.toggle & level));
+    if (r->rule.pwm_gpio >= 0)
+    {
+        pwm_set_frequency(r->rule.pwm_gpio, r->rule.frequency);
+        pwm_set_duty_cycle(r->rule.pwm_gpio, r->rule.dutycycle);
+        pwm_start(r->rule.pwm_gpio);
+        reflex_pwms |= 1ULL << r->rule.pwm_gpio;
+    }
+    r->due = 0;
+    if (r->rule.oneshot)
+    {
+        r->used = 0;
+        update_reflex_gpios();
+    }
+}
+
+int reflex_edge(struct gpio_event *ev)
+// runs the rules for an edge, returns 1 if a delayed action needs the poll timer
+{
+    int i;
+    int result = 0;
+    unsigned int edge = ev->level ? RISING_EDGE : FALLING_EDGE;
+    struct reflex_slot *r;
+
+    if (!(__atomic_load_n(&reflex_gpios, __ATOMIC_ACQUIRE) & (1ULL << ev->gpio)))
+        return 0;
+
+    pthread_mutex_lock(&reflex_lock);
+    for (i = 0; i < REFLEX_MAX; i++)
+    {
+        r = &reflexes[i];
+        if (!r->used || r->rule.gpio != ev->gpio || !(r->rule.edge & edge))
+            continue;
+        if (r->rule.delay == 0)
+        {
+            run_reflex(r);
+        } else if (r->due == 0) {
+            // a pending action is not pushed back by further edges
+            r->due = ev->timestamp + r->rule.delay;
+            result = 1;
+        }
+    }
+    pthread_mutex_unlock(&reflex_lock);
+    return result;
+}
+
+void reflex_expire(unsigned long long now)
+// runs the delayed actions that are due by now
+{
+    int i;
+
+    pthread_mutex_lock(&reflex_lock);
+    for (i = 0; i < REFLEX_MAX; i++)
+        if (reflexes[i].used && reflexes[i].due && reflexes[i].due <= now)
+            run_reflex(&reflexes[i]);
+    pthread_mutex_unlock(&reflex_lock);
+}
+
+unsigned long long reflex_next_deadline(void)
+// returns the time of the first pending action, or 0 if there is none
+{
+    int i;
+    unsigned long long deadline = 0;
+
+    pthread_mutex_lock(&reflex_lock);
+    for (i = 0; i < REFLEX_MAX; i++)
+        if (reflexes[i].used && reflexes[i].due && (deadline == 0 || reflexes[i].due < deadline))
+            deadline = reflexes[i].due;
+    pthread_mutex_unlock(&reflex_lock);
+    return deadline;
+}
@@ -0,0 +1,47 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Reflex rules, an input edge drives outputs straight from the poll thread */
+
+#define REFLEX_MAX 64
+
+struct reflex_rule
+{
+    unsigned int gpio;          // input gpio
+    unsigned int edge;          // RISING_EDGE, FALLING_EDGE or BOTH_EDGE
+    unsigned long long set;     // outputs to set high, bit n is gpio n
+    unsigned long long clear;   // outputs to set low
+    unsigned long long toggle;  // outputs to invert
+    int pwm_gpio;               // software PWM to start, -1 for none
+    float frequency;
+    float dutycycle;
+    unsigned int delay;         // in microseconds from the edge, 0 acts at once
+    int oneshot;                // remove the rule once it has acted
+};
+
+int add_reflex(struct reflex_rule *rule);
+int remove_reflex(int id);
+void remove_gpio_reflexes(unsigned int gpio);
+void clear_reflexes(void);
+int reflex_edge(struct gpio_event *ev);
+void reflex_expire(unsigned long long now);
+unsigned long long reflex_next_deadline(void);
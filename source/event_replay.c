@@ -0,0 +1,309 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "event_gpio.h"
+#include "event_record.h"
+#include "event_replay.h"
+
+#define REPLAY_RING_SIZE 4096
+
+struct replay
+{
+    struct event_source src;     // must be first, the source is handed back to us
+    struct record_reader *reader;
+    unsigned long long gpios;    // bit mask of the gpios replayed
+    double speed;                // 1.0 is the recorded timing, 0 replays as fast as possible
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;         // signalled on stop and when the ring has room again
+    int running, started, finished;
+    struct gpio_event ring[REPLAY_RING_SIZE];
+    unsigned int head, tail;     // head == tail means empty
+};
+struct replay *replay = NULL;
+pthread_mutex_t replay_lock = PTHREAD_MUTEX_INITIALIZER;
+
+unsigned long long replayed = 0;
+unsigned long long replay_begin = 0, replay_end = 0;
+int replay_running = 0;
+
+void replay_done(void)
+{
+    __atomic_store_n(&replay_end, event_timestamp(), __ATOMIC_RELAXED);
+    __atomic_store_n(&replay_running, 0, __ATOMIC_RELEASE);
+}
+
+void *replay_thread(void *threadarg)
+{
+    struct replay *r = (struct replay *)threadarg;
+    struct gpio_event ev;
+    unsigned long long start, first = 0, due = 0;
+    struct timespec ts;
+    uint64_t one = 1;
+
+    start = event_timestamp();
+    while (record_next(r->reader, &ev))
+    {
+        if (ev.gpio >= 54 || !((r->gpios >> ev.gpio) & 1))
+            continue;
+        if (first == 0)
+            first = ev.timestamp;
+        if (r->speed > 0)
+            due = start + (unsigned long long)((ev.timestamp - first) / r->speed);
+
+        pthread_mutex_lock(&r->lock);
+        // a full ring holds the replay back instead of dropping edges
+        while (r->running && ((r->head + 1) % REPLAY_RING_SIZE == r->tail || due > event_timestamp()))
+        {
+            if ((r->head + 1) % REPLAY_RING_SIZE == r->tail)
+            {
+                pthread_cond_wait(&r->wake, &r->lock);
+            } else {
+                ts.tv_sec = due / 1000000ULL;
+                ts.tv_nsec = (due % 1000000ULL) * 1000;
+                pthread_cond_timedwait(&r->wake, &r->lock, &ts);
+            }
+        }
+        if (!r->running)
+        {
+            pthread_mutex_unlock(&r->lock);
+            pthread_exit(NULL);
+        }
+
+        // the edge is timed as if it happened now, so the filter sees the replayed timing
+        ev.timestamp = ev.first = r->speed > 0 ? due : event_timestamp();
+        ev.count = 1;
+        if (r->head == r->tail)
+            write(r->src.fd, &one, sizeof(one));   // the poll thread has drained the ring
+        r->ring[r->head] = ev;
+        r->head = (r->head + 1) % REPLAY_RING_SIZE;
+        pthread_mutex_unlock(&r->lock);
+    }
+
+    pthread_mutex_lock(&r->lock);
+    r->finished = 1;
+    if (r->head == r->tail)
+        replay_done();
+    pthread_mutex_unlock(&r->lock);
+    pthread_exit(NULL);
+}
+
+int replay_next_event(struct event_source *src, struct gpio_event *ev)
+{
+    struct replay *r = (struct replay *)src;
+    uint64_t count;
+    int found = 0;
+
+    pthread_mutex_lock(&r->lock);
+    if (r->head == r->tail)
+    {
+        // drained, clear the eventfd and check again for events added meanwhile
+        read(src->fd, &count, sizeof(count));
+    }
+    if (r->head != r->tail)
+    {
+        if ((r->head + 1) % REPLAY_RING_SIZE == r->tail)
+            pthread_cond_signal(&r->wake);
+        *ev = r->ring[r->tail];
+        r->tail = (r->tail + 1) % REPLAY_RING_SIZE;
+        __atomic_add_fetch(&replayed, 1, __ATOMIC_RELAXED);
+        if (r->finished && r->head == r->tail)
+            replay_done();
+        found = 1;
+    }
+    pthread_mutex_unlock(&r->lock);
+    return found;
+}
+
+void free_replay(struct replay *r)
+{
+    record_close(r->reader);
+    close(r->src.fd);
+    pthread_cond_destroy(&r->wake);
+    pthread_mutex_destroy(&r->lock);
+    free(r);
+}
+
+void replay_close(struct event_source *src)
+{
+    struct replay *r = (struct replay *)src;
+
+    pthread_mutex_lock(&r->lock);
+    r->running = 0;
+    pthread_cond_signal(&r->wake);
+    pthread_mutex_unlock(&r->lock);
+    if (r->started)
+        pthread_join(r->thread, NULL);
+
+    pthread_mutex_lock(&replay_lock);
+    if (replay == r)
+        replay = NULL;
+    pthread_mutex_unlock(&replay_lock);
+    if (__atomic_load_n(&replay_running, __ATOMIC_ACQUIRE))
+        replay_done();   // stopped before the end
+    free_replay(r);
+}
+
+unsigned long long recorded_gpios(const char *path)
+// returns the bit mask of the gpios that have edges in a recording
+{
+    struct record_reader *reader;
+    struct gpio_event ev;
+    unsigned long long gpios = 0;
+
+    if ((reader = record_open(path)) == NULL)
+        return 0;
+    while (record_next(reader, &ev))
+        if (ev.gpio < 54)
+            gpios |= 1ULL << ev.gpio;
+    record_close(reader);
+    return gpios;
+}
+
+int replay_open(const char *path, unsigned long long *gpios, unsigned int edge, double speed)
+// sets up edge detection on the gpios in *gpios that appear in the recording and narrows
+// *gpios down to them, replay_run() then starts the replay
+// return values:
+// 0 - Success
+// 1 - Already replaying
+// 2 - No readable recording at path
+// 3 - Edge detection already added to one of the gpios
+// 4 - Other error
+{
+    struct replay *r;
+    pthread_condattr_t attr;
+    int result;
+
+    pthread_mutex_lock(&replay_lock);
+    if (replay != NULL)
+    {
+        pthread_mutex_unlock(&replay_lock);
+        return 1;
+    }
+
+    if ((r = calloc(1, sizeof(struct replay))) == NULL)
+    {
+        pthread_mutex_unlock(&replay_lock);
+        return 4;   // out of memory
+    }
+    if ((r->reader = record_open(path)) == NULL)
+    {
+        free(r);
+        pthread_mutex_unlock(&replay_lock);
+        return 2;
+    }
+    *gpios &= recorded_gpios(path);
+    r->gpios = *gpios;
+    r->speed = speed;
+    r->src.next_event = replay_next_event;
+    r->src.close = NULL;    // freed below if edge detection can not be added
+    if ((r->src.fd = eventfd(0, EFD_NONBLOCK)) == -1)
+    {
+        record_close(r->reader);
+        free(r);
+        pthread_mutex_unlock(&replay_lock);
+        return 4;
+    }
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&r->wake, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if ((result = add_shared_source_edge_detect(r->gpios, edge, &r->src)) != 0)
+    {
+        free_replay(r);
+        pthread_mutex_unlock(&replay_lock);
+        return result == 1 ? 3 : 4;
+    }
+    r->src.close = replay_close;
+    replay = r;
+    pthread_mutex_unlock(&replay_lock);
+    return 0;
+}
+
+int replay_run(void)
+// starts the replay set up by replay_open(), returns 0 on success
+{
+    struct replay *r;
+
+    pthread_mutex_lock(&replay_lock);
+    if ((r = replay) == NULL || r->started)
+    {
+        pthread_mutex_unlock(&replay_lock);
+        return 1;
+    }
+    __atomic_store_n(&replayed, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&replay_begin, event_timestamp(), __ATOMIC_RELAXED);
+    __atomic_store_n(&replay_running, 1, __ATOMIC_RELEASE);
+    r->running = 1;
+    if (pthread_create(&r->thread, NULL, replay_thread, (void *)r) != 0)
+    {
+        r->running = 0;
+        __atomic_store_n(&replay_running, 0, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&replay_lock);
+        return 2;
+    }
+    r->started = 1;
+    pthread_mutex_unlock(&replay_lock);
+    return 0;
+}
+
+unsigned long long replay_stop(void)
+// stops the replay and removes edge detection from the replayed gpios, which are returned as a bit mask
+{
+    struct replay *r;
+    unsigned long long gpios;
+    unsigned int gpio;
+
+    pthread_mutex_lock(&replay_lock);
+    r = replay;
+    replay = NULL;
+    pthread_mutex_unlock(&replay_lock);
+    if (r == NULL)
+        return 0;
+
+    gpios = r->gpios;
+    remove_event_source(&r->src);   // closes r
+    for (gpio = 0; gpio < 54; gpio++)
+        if ((gpios >> gpio) & 1)
+            remove_edge_detect(gpio);
+    return gpios;
+}
+
+void get_replay_stats(struct replay_stats *stats)
+{
+    unsigned long long begin = __atomic_load_n(&replay_begin, __ATOMIC_RELAXED);
+
+    stats->running = __atomic_load_n(&replay_running, __ATOMIC_ACQUIRE);
+    stats->replayed = __atomic_load_n(&replayed, __ATOMIC_RELAXED);
+    if (begin == 0)
+        stats->elapsed = 0;
+    else
+        stats->elapsed = (stats->running ? event_timestamp() : __atomic_load_n(&replay_end, __ATOMIC_RELAXED)) - begin;
+}
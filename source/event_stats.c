@@ -0,0 +1,92 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "event_gpio.h"
+#include "event_stats.h"
+
+struct event_stats pin_stats[54];
+
+unsigned int stats_bucket(unsigned long long us)
+{
+    unsigned int bucket;
+
+    if (us == 0)
+        return 0;
+    bucket = 64 - __builtin_clzll(us);
+    return bucket < STATS_BUCKETS ? bucket : STATS_BUCKETS - 1;
+}
+
+void stats_add(unsigned long long *counter)
+{
+    __atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+}
+
+void stats_seen(unsigned int gpio)
+{
+    if (gpio < 54)
+        stats_add(&pin_stats[gpio].seen);
+}
+
+void stats_bounced(unsigned int gpio)
+{
+    if (gpio < 54)
+        stats_add(&pin_stats[gpio].bounced);
+}
+
+void stats_dropped(unsigned int gpio)
+{
+    if (gpio < 54)
+        stats_add(&pin_stats[gpio].dropped);
+}
+
+void stats_delivered(struct gpio_event *ev, unsigned long long start, unsigned long long end)
+// start and end of running the callbacks of ev
+{
+    struct event_stats *s;
+
+    if (ev->gpio >= 54)
+        return;
+    s = &pin_stats[ev->gpio];
+    stats_add(&s->delivered);
+    stats_add(&s->latency[stats_bucket(start > ev->timestamp ? start - ev->timestamp : 0)]);
+    stats_add(&s->duration[stats_bucket(end - start)]);
+}
+
+void read_stats(unsigned int gpio, struct event_stats *stats)
+// the counters are read one by one, they are not a consistent snapshot while events come in
+{
+    unsigned long long *from = (unsigned long long *)&pin_stats[gpio];
+    unsigned long long *to = (unsigned long long *)stats;
+    unsigned int i;
+
+    for (i = 0; i < sizeof(struct event_stats) / sizeof(unsigned long long); i++)
+        to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+}
+
+void reset_stats(unsigned int gpio)
+{
+    unsigned long long *counters = (unsigned long long *)&pin_stats[gpio];
+    unsigned int i;
+
+    for (i = 0; i < sizeof(struct event_stats) / sizeof(unsigned long long); i++)
+        __atomic_store_n(&counters[i], 0, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,42 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Per gpio event telemetry, counters and log2 histograms updated with relaxed atomics */
+
+#define STATS_BUCKETS 32    // bucket 0 counts 0 us, bucket n counts 2^(n-1) to 2^n - 1 us, the last one anything longer
+
+struct event_stats
+{
+    unsigned long long seen;        // edges captured
+    unsigned long long bounced;     // edges rejected by the switch bounce and glitch filter
+    unsigned long long dropped;     // events dropped by a full callback queue
+    unsigned long long delivered;   // events that ran callbacks
+    unsigned long long latency[STATS_BUCKETS];   // edge to start of the callbacks
+    unsigned long long duration[STATS_BUCKETS];  // time spent in the callbacks
+};
+
+void stats_seen(unsigned int gpio);
+void stats_bounced(unsigned int gpio);
+void stats_dropped(unsigned int gpio);
+void stats_delivered(struct gpio_event *ev, unsigned long long start, unsigned long long end);
+void read_stats(unsigned int gpio, struct event_stats *stats);
+void reset_stats(unsigned int gpio);
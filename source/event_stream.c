@@ -0,0 +1,137 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "event_gpio.h"
+#include "event_stream.h"
+
+// ring of events, protected by stream_lock. The eventfd is readable while the ring is not empty.
+int stream_fd = -1;
+struct gpio_event *stream = NULL;
+unsigned int stream_size = 0;
+unsigned int stream_head = 0;
+unsigned int stream_len = 0;
+unsigned long long stream_lost = 0;
+pthread_mutex_t stream_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int stream_open(unsigned int size)
+// returns the eventfd of the stream, opening it if needed, or -1 on error
+{
+    int fd;
+
+    pthread_mutex_lock(&stream_lock);
+    if (stream_fd != -1)
+    {
+        fd = stream_fd;
+        pthread_mutex_unlock(&stream_lock);
+        return fd;
+    }
+
+    if (size == 0)
+        size = STREAM_SIZE;
+    if ((stream = malloc(size * sizeof(struct gpio_event))) == NULL)
+    {
+        pthread_mutex_unlock(&stream_lock);
+        return -1;
+    }
+    if ((stream_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+    {
+        free(stream);
+        stream = NULL;
+        pthread_mutex_unlock(&stream_lock);
+        return -1;
+    }
+    stream_size = size;
+    stream_head = stream_len = 0;
+    stream_lost = 0;
+    fd = stream_fd;
+    pthread_mutex_unlock(&stream_lock);
+    return fd;
+}
+
+void stream_close(void)
+{
+    pthread_mutex_lock(&stream_lock);
+    if (stream_fd != -1)
+    {
+        close(stream_fd);
+        stream_fd = -1;
+    }
+    free(stream);
+    stream = NULL;
+    stream_size = stream_head = stream_len = 0;
+    pthread_mutex_unlock(&stream_lock);
+}
+
+void stream_event(struct gpio_event *ev)
+{
+    uint64_t one = 1;
+
+    if (stream_fd == -1)    // not opened, nothing to do
+        return;
+
+    pthread_mutex_lock(&stream_lock);
+    if (stream == NULL)
+    {
+        pthread_mutex_unlock(&stream_lock);
+        return;
+    }
+    if (stream_len == stream_size)
+    {
+        // full, drop the oldest event
+        stream_head = (stream_head + 1) % stream_size;
+        stream_len--;
+        stream_lost++;
+    }
+    stream[(stream_head + stream_len) % stream_size] = *ev;
+    if (stream_len++ == 0)
+        write(stream_fd, &one, sizeof(one));
+    pthread_mutex_unlock(&stream_lock);
+}
+
+int stream_read(struct gpio_event *evs, int max)
+// copies up to max events without blocking, returns the number of events copied
+{
+    uint64_t value;
+    int n = 0;
+
+    pthread_mutex_lock(&stream_lock);
+    while (n < max && stream_len > 0)
+    {
+        evs[n++] = stream[stream_head];
+        stream_head = (stream_head + 1) % stream_size;
+        stream_len--;
+    }
+    if (stream_len == 0 && stream_fd != -1)
+        read(stream_fd, &value, sizeof(value));
+    pthread_mutex_unlock(&stream_lock);
+    return n;
+}
+
+unsigned long long stream_dropped(void)
+{
+    return stream_lost;
+}
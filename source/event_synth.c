@@ -0,0 +1,265 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "event_gpio.h"
+#include "event_synth.h"
+
+#define SYNTH_RING_SIZE 4096
+
+struct synth
+{
+    struct event_source src;     // must be first, the source is handed back to us
+    struct synth_schedule sched;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t stop;
+    int running;
+    int started;                 // the thread was created
+    unsigned int seed;
+    struct gpio_event ring[SYNTH_RING_SIZE];
+    unsigned int head, tail;     // head == tail means empty
+    unsigned long long due;      // time of the next edge to generate
+    unsigned long long generated, dropped;
+};
+struct synth *synths[54] = { NULL };
+pthread_mutex_t synth_lock = PTHREAD_MUTEX_INITIALIZER;   // protects synths, stats are read under it
+
+unsigned long long next_interval(struct synth *s, unsigned long long *ideal)
+// returns the time of the next edge and advances the ideal edge time
+{
+    double u;
+    long jitter;
+
+    switch (s->sched.type)
+    {
+        case SYNTH_BURST:
+            if (s->sched.burst > 0 && s->generated > 0 && s->generated % s->sched.burst == 0)
+                *ideal += s->sched.gap;
+            *ideal += s->sched.interval;
+            return *ideal;
+
+        case SYNTH_POISSON:
+            u = (double)rand_r(&s->seed) / ((double)RAND_MAX + 1.0);
+            *ideal += (unsigned long long)(-log(1.0 - u) * s->sched.interval);
+            return *ideal;
+
+        case SYNTH_SQUARE:
+            *ideal += s->sched.interval;
+            if (s->sched.jitter == 0)
+                return *ideal;
+            jitter = (long)(rand_r(&s->seed) % (2 * s->sched.jitter + 1)) - (long)s->sched.jitter;
+            return *ideal + jitter;
+
+        default: // SYNTH_FIXED
+            *ideal += s->sched.interval;
+            return *ideal;
+    }
+}
+
+void *synth_thread(void *threadarg)
+{
+    struct synth *s = (struct synth *)threadarg;
+    unsigned long long ideal, due;
+    struct timespec ts;
+    uint64_t one = 1;
+    int level = 0;
+    int pending = 0;
+
+    ideal = event_timestamp();
+    due = next_interval(s, &ideal);
+
+    pthread_mutex_lock(&s->lock);
+    s->due = due;
+    while (s->running && (s->sched.count == 0 || s->generated < s->sched.count))
+    {
+        if (due > event_timestamp())
+        {
+            // wake up the poll thread for everything generated so far, then wait
+            if (pending && write(s->src.fd, &one, sizeof(one)) == sizeof(one))
+                pending = 0;
+            ts.tv_sec = due / 1000000ULL;
+            ts.tv_nsec = (due % 1000000ULL) * 1000;
+            pthread_cond_timedwait(&s->stop, &s->lock, &ts);
+            continue;
+        }
+
+        level = !level;
+        if ((s->head + 1) % SYNTH_RING_SIZE == s->tail)
+        {
+            s->dropped++;
+        } else {
+            s->ring[s->head].gpio = s->src.gpio;
+            s->ring[s->head].level = level;
+            s->ring[s->head].timestamp = due;
+            s->head = (s->head + 1) % SYNTH_RING_SIZE;
+            pending = 1;
+        }
+        s->generated++;
+        due = s->due = next_interval(s, &ideal);
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    if (pending)
+        write(s->src.fd, &one, sizeof(one));
+    pthread_exit(NULL);
+}
+
+int synth_next_event(struct event_source *src, struct gpio_event *ev)
+{
+    struct synth *s = (struct synth *)src;
+    uint64_t count;
+    int found = 0;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->head == s->tail)
+    {
+        // drained, clear the eventfd and check again for events added meanwhile
+        read(src->fd, &count, sizeof(count));
+    }
+    if (s->head != s->tail)
+    {
+        *ev = s->ring[s->tail];
+        s->tail = (s->tail + 1) % SYNTH_RING_SIZE;
+        found = 1;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return found;
+}
+
+unsigned long long synth_horizon(struct event_source *src)
+// the edges carry their scheduled time, the thread may make them later than that
+{
+    struct synth *s = (struct synth *)src;
+    unsigned long long horizon;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->head != s->tail)
+        horizon = s->ring[s->tail].timestamp;   // not read by the poll thread yet
+    else if (s->due == 0 || (s->sched.count != 0 && s->generated >= s->sched.count))
+        horizon = ~0ULL;                        // not started or done, no more edges
+    else
+        horizon = s->due;
+    pthread_mutex_unlock(&s->lock);
+    return horizon;
+}
+
+void synth_close(struct event_source *src)
+{
+    struct synth *s = (struct synth *)src;
+
+    pthread_mutex_lock(&s->lock);
+    s->running = 0;
+    pthread_cond_signal(&s->stop);
+    pthread_mutex_unlock(&s->lock);
+    if (s->started)
+        pthread_join(s->thread, NULL);
+
+    pthread_mutex_lock(&synth_lock);
+    if (src->gpio >= 0 && src->gpio < 54 && synths[src->gpio] == s)
+        synths[src->gpio] = NULL;
+    pthread_mutex_unlock(&synth_lock);
+    close(src->fd);
+    pthread_cond_destroy(&s->stop);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
+
+int synth_start(unsigned int gpio, unsigned int edge, struct synth_schedule *sched)
+// return values:
+// 0 - Success
+// 1 - Edge detection already added
+// 2 - Other error
+{
+    struct synth *s;
+    pthread_condattr_t attr;
+    int result;
+
+    if (sched->interval == 0)
+        return 2;
+
+    if ((s = calloc(1, sizeof(struct synth))) == NULL)
+        return 2;   // out of memory
+
+    s->sched = *sched;
+    if (s->sched.type == SYNTH_SQUARE && 2 * s->sched.jitter >= s->sched.interval)
+        s->sched.jitter = (s->sched.interval - 1) / 2;   // keep the edges in order
+    s->seed = (unsigned int)event_timestamp() ^ gpio;
+    s->src.gpio = gpio;
+    s->src.next_event = synth_next_event;
+    s->src.horizon = synth_horizon;
+    s->src.close = synth_close;     // set before the source is visible, a cleanup may close it at once
+    if ((s->src.fd = eventfd(0, EFD_NONBLOCK)) == -1)
+    {
+        free(s);
+        return 2;
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&s->stop, &attr);
+    pthread_condattr_destroy(&attr);
+
+    // the thread runs before the source is added, edges made meanwhile wait in the ring
+    s->running = 1;
+    if (pthread_create(&s->thread, NULL, synth_thread, (void *)s) != 0)
+    {
+        synth_close(&s->src);
+        return 2;
+    }
+    s->started = 1;
+
+    // in the table before the source is visible, so a close right after it clears the slot again
+    pthread_mutex_lock(&synth_lock);
+    if (synths[gpio] == NULL)
+        synths[gpio] = s;
+    pthread_mutex_unlock(&synth_lock);
+
+    if ((result = add_source_edge_detect(gpio, edge, &s->src)) != 0)
+        synth_close(&s->src);   // not added, so still ours
+    return result;
+}
+
+int synth_stats(unsigned int gpio, unsigned long long *generated, unsigned long long *dropped)
+// returns 0 on success, 1 if no generator is running for the gpio
+{
+    struct synth *s;
+
+    pthread_mutex_lock(&synth_lock);
+    if ((s = synths[gpio]) == NULL)
+    {
+        pthread_mutex_unlock(&synth_lock);
+        return 1;
+    }
+    pthread_mutex_lock(&s->lock);
+    *generated = s->generated;
+    *dropped = s->dropped;
+    pthread_mutex_unlock(&s->lock);
+    pthread_mutex_unlock(&synth_lock);
+    return 0;
+}
@@ -0,0 +1,41 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Synthetic edge generator, an event source for testing without a signal */
+
+#define SYNTH_FIXED   0   // an edge every interval
+#define SYNTH_BURST   1   // bursts of edges every interval, separated by gap
+#define SYNTH_POISSON 2   // random edges, interval is the mean time between them
+#define SYNTH_SQUARE  3   // square wave with a half period of interval, edges moved by up to +/- jitter
+
+struct synth_schedule
+{
+    int type;
+    unsigned int interval;      // in microseconds
+    unsigned int burst;         // edges per burst (SYNTH_BURST)
+    unsigned int gap;           // idle time between bursts in microseconds (SYNTH_BURST)
+    unsigned int jitter;        // in microseconds (SYNTH_SQUARE)
+    unsigned long long count;   // number of edges to generate, 0 = unlimited
+};
+
+int synth_start(unsigned int gpio, unsigned int edge, struct synth_schedule *sched);
+int synth_stats(unsigned int gpio, unsigned long long *generated, unsigned long long *dropped);
@@ -0,0 +1,288 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+#include "c_gpio.h"
+#include "event_gpio.h"
+#include "event_queue.h"
+#include "event_timer.h"
+#include "rt_thread.h"
+
+struct timer
+{
+    int used;
+    struct timer_config cfg;
+    unsigned long long next;        // deadline of the next tick in ns
+    struct timer_stats stats;
+    double late_total;
+    struct timer_sample *ring;      // cfg.samples entries
+    unsigned int head, len;
+};
+struct timer timers[TIMER_MAX];
+pthread_t timer_thread;
+int timer_running = 0;
+pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t timer_cond;
+
+unsigned long long timer_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int run_tick(int id, struct timer *t, unsigned long long now, struct gpio_event *ev)
+// called with timer_lock held, returns 1 if ev is to be queued for the callbacks
+{
+    unsigned long long period = t->cfg.period * 1000ULL;
+    unsigned long long level, missed;
+    struct timer_sample *s;
+    double late;
+
+    // skip ticks missed rather than catching up
+    if ((missed = (now - t->next) / period) > 0)
+    {
+        t->stats.overruns += missed;
+        t->next += missed * period;
+    }
+    late = (now - t->next) / 1000.0;
+
+    if (t->cfg.toggle)
+    {
+        level = input_gpio_mask();
+        output_gpio_mask(t->cfg.toggle & ~level, t->cfg.toggle & level);
+    }
+    if (t->cfg.samples)
+    {
+        if (t->len == t->cfg.samples)
+        {
+            t->head = (t->head + 1) % t->cfg.samples;
+            t->len--;
+            t->stats.dropped++;
+        }
+        s = &t->ring[(t->head + t->len++) % t->cfg.samples];
+        s->timestamp = now / 1000ULL;
+        s->levels = input_gpio_bank(0);
+    }
+
+    t->stats.ticks++;
+    t->stats.late_last = late;
+    t->late_total += late;
+    if (late > t->stats.late_max)
+        t->stats.late_max = late;
+
+    ev->gpio = TIMER_GPIO + id;
+    ev->level = 0;
+    ev->timestamp = ev->first = t->next / 1000ULL;
+    ev->count = 1;
+    t->next += period;
+    return t->cfg.callback;
+}
+
+void *timer_loop(void *threadarg)
+{
+    struct gpio_event fired[TIMER_MAX];
+    struct timespec ts;
+    unsigned long long now, deadline;
+    int i, n;
+
+    rt_thread_enter(RT_SERVICE);
+    pthread_mutex_lock(&timer_lock);
+    while (timer_running)
+    {
+        deadline = 0;
+        for (i = 0; i < TIMER_MAX; i++)
+            if (timers[i].used && (deadline == 0 || timers[i].next < deadline))
+                deadline = timers[i].next;
+        if (deadline == 0)
+        {
+            pthread_cond_wait(&timer_cond, &timer_lock);
+            continue;
+        }
+
+        // sleeping to the deadline without spinning, timers may run for ever at high rates
+        now = timer_clock();
+        if (deadline > now)
+        {
+            ts.tv_sec = deadline / 1000000000ULL;
+            ts.tv_nsec = deadline % 1000000000ULL;
+            pthread_cond_timedwait(&timer_cond, &timer_lock, &ts);
+            continue;
+        }
+
+        n = 0;
+        for (i = 0; i < TIMER_MAX; i++)
+            if (timers[i].used && timers[i].next <= now && run_tick(i, &timers[i], now, &fired[n]))
+                n++;
+
+        // callbacks can run right here without an executor, so not under the lock
+        pthread_mutex_unlock(&timer_lock);
+        for (i = 0; i < n; i++)
+            queue_event(&fired[i]);
+        pthread_mutex_lock(&timer_lock);
+    }
+    pthread_mutex_unlock(&timer_lock);
+    return NULL;
+}
+
+int start_timer_thread(void)
+// called with timer_lock held, returns 0 on success
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&timer_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    timer_running = 1;
+    if (pthread_create(&timer_thread, NULL, timer_loop, NULL) != 0)
+    {
+        timer_running = 0;
+        pthread_cond_destroy(&timer_cond);
+        return 1;
+    }
+    return 0;
+}
+
+int add_timer(struct timer_config *cfg)
+// the first tick is a period from now
+// returns the id of the new timer, or
+// -1 - Too many timers
+// -2 - Out of memory
+// -3 - Thread could not be started
+{
+    struct timer_sample *ring = NULL;
+    int i;
+
+    if (cfg->callback && ensure_executor() != 0)
+        return -3;
+    if (cfg->samples && (ring = malloc(cfg->samples * sizeof(struct timer_sample))) == NULL)
+        return -2;
+
+    pthread_mutex_lock(&timer_lock);
+    if (!timer_running && start_timer_thread() != 0)
+    {
+        pthread_mutex_unlock(&timer_lock);
+        free(ring);
+        return -3;
+    }
+    for (i = 0; i < TIMER_MAX; i++)
+    {
+        if (timers[i].used)
+            continue;
+        timers[i].cfg = *cfg;
+        timers[i].next = timer_clock() + cfg->period * 1000ULL;
+        timers[i].stats = (struct timer_stats){0, 0, 0, 0.0, 0.0, 0.0};
+        timers[i].late_total = 0.0;
+        timers[i].ring = ring;
+        timers[i].head = timers[i].len = 0;
+        timers[i].used = 1;
+        pthread_cond_signal(&timer_cond);
+        pthread_mutex_unlock(&timer_lock);
+        return i;
+    }
+    pthread_mutex_unlock(&timer_lock);
+    free(ring);
+    return -1;
+}
+
+int remove_timer(int id)
+// returns 0 on success, 1 if there is no such timer
+{
+    int result = 1;
+
+    pthread_mutex_lock(&timer_lock);
+    if (id >= 0 && id < TIMER_MAX && timers[id].used)
+    {
+        timers[id].used = 0;
+        free(timers[id].ring);
+        timers[id].ring = NULL;
+        result = 0;
+    }
+    pthread_mutex_unlock(&timer_lock);
+    if (result == 0)
+        remove_callbacks(TIMER_GPIO + id);
+    return result;
+}
+
+int get_timer_stats(int id, struct timer_stats *stats)
+// returns 0 on success, 1 if there is no such timer
+{
+    int result = 1;
+
+    pthread_mutex_lock(&timer_lock);
+    if (id >= 0 && id < TIMER_MAX && timers[id].used)
+    {
+        *stats = timers[id].stats;
+        stats->late_avg = stats->ticks ? timers[id].late_total / stats->ticks : 0.0;
+        result = 0;
+    }
+    pthread_mutex_unlock(&timer_lock);
+    return result;
+}
+
+unsigned int timer_samples(int id, struct timer_sample *out, unsigned int max)
+// takes up to max samples from the ring, oldest first, returns how many
+{
+    unsigned int n = 0;
+    struct timer *t;
+
+    pthread_mutex_lock(&timer_lock);
+    if (id >= 0 && id < TIMER_MAX && timers[id].used)
+    {
+        t = &timers[id];
+        while (n < max && t->len > 0)
+        {
+            out[n++] = t->ring[t->head];
+            t->head = (t->head + 1) % t->cfg.samples;
+            t->len--;
+        }
+    }
+    pthread_mutex_unlock(&timer_lock);
+    return n;
+}
+
+void clear_timers(void)
+{
+    int i;
+
+    for (i = 0; i < TIMER_MAX; i++)
+        remove_timer(i);
+
+    pthread_mutex_lock(&timer_lock);
+    if (!timer_running)
+    {
+        pthread_mutex_unlock(&timer_lock);
+        return;
+    }
+    timer_running = 0;
+    pthread_cond_signal(&timer_cond);
+    pthread_mutex_unlock(&timer_lock);
+
+    pthread_join(timer_thread, NULL);
+    pthread_cond_destroy(&timer_cond);
+}
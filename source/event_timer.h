@@ -0,0 +1,56 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Periodic timers, fixed rate ticks at absolute deadlines from one thread shared by all timers */
+
+#define TIMER_MAX 32
+#define TIMER_GPIO 96       // callbacks of timer id run as edge callbacks of gpio TIMER_GPIO + id
+
+struct timer_config
+{
+    unsigned long long period;      // in microseconds
+    unsigned long long toggle;      // outputs inverted on each tick, bit n is gpio n
+    unsigned int samples;           // size of a ring of the levels of gpios 0-31 read on each tick, 0 for none
+    int callback;                   // queue an event for the callbacks of TIMER_GPIO + id on each tick
+};
+
+struct timer_sample
+{
+    unsigned long long timestamp;   // in microseconds
+    unsigned int levels;
+};
+
+struct timer_stats
+{
+    unsigned long long ticks;       // ticks run
+    unsigned long long overruns;    // ticks skipped because the thread was a period or more late
+    unsigned long long dropped;     // samples overwritten before they were read
+    double late_last;               // lateness of the last tick in microseconds
+    double late_avg;
+    double late_max;
+};
+
+int add_timer(struct timer_config *cfg);
+int remove_timer(int id);
+int get_timer_stats(int id, struct timer_stats *stats);
+unsigned int timer_samples(int id, struct timer_sample *out, unsigned int max);
+void clear_timers(void);
@@ -0,0 +1,125 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <pthread.h>
+#include <time.h>
+#include "event_gpio.h"
+#include "event_wait.h"
+
+// a thread blocked in wait_for_any(), lives on its stack
+struct waiter
+{
+    unsigned long long mask;    // bit n set to wait for gpio n
+    unsigned int edge;
+    int done;
+    struct gpio_event ev;
+    pthread_cond_t cond;
+    struct waiter *next;
+};
+struct waiter *waiters = NULL;
+pthread_mutex_t wait_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void wake_waiters(struct gpio_event *ev)
+{
+    struct waiter *w;
+
+    if (waiters == NULL)    // nobody waiting, nothing to do
+        return;
+
+    pthread_mutex_lock(&wait_lock);
+    for (w = waiters; w != NULL; w = w->next)
+    {
+        if (w->done || !(w->mask & (1ULL << ev->gpio)))
+            continue;
+        if ((ev->level && !(w->edge & RISING_EDGE)) || (!ev->level && !(w->edge & FALLING_EDGE)))
+            continue;
+        w->ev = *ev;
+        w->done = 1;
+        pthread_cond_signal(&w->cond);
+    }
+    pthread_mutex_unlock(&wait_lock);
+}
+
+int wait_for_any(unsigned int *gpios, int n, unsigned int edge, int timeout, struct gpio_event *ev)
+// timeout in ms, -1 waits forever. Gpios without edge detection get it added and keep it, so
+// the value files stay open for the next call.
+// return values:
+// 0 - Success, the edge is in ev
+// 1 - Timed out
+// 2 - Failed to add edge detection
+{
+    struct waiter w, **p;
+    pthread_condattr_t attr;
+    struct timespec deadline;
+    int i, result = 0;
+
+    w.mask = 0;
+    for (i = 0; i < n; i++)
+        w.mask |= 1ULL << gpios[i];
+    w.edge = edge;
+    w.done = 0;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&w.cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pthread_mutex_lock(&wait_lock);
+    w.next = waiters;
+    waiters = &w;
+    pthread_mutex_unlock(&wait_lock);
+
+    for (i = 0; i < n; i++)
+        if (add_wait_edge_detect(gpios[i]) != 0)
+            result = 2;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&wait_lock);
+    while (result == 0 && !w.done)
+    {
+        if (timeout < 0)
+            pthread_cond_wait(&w.cond, &wait_lock);
+        else if (pthread_cond_timedwait(&w.cond, &wait_lock, &deadline) != 0 && !w.done)
+            result = 1;
+    }
+    for (p = &waiters; *p != NULL; p = &(*p)->next)
+    {
+        if (*p == &w)
+        {
+            *p = w.next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&wait_lock);
+    pthread_cond_destroy(&w.cond);
+
+    if (result == 0)
+        *ev = w.ev;
+    return result;
+}
@@ -0,0 +1,239 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "c_gpio.h"
+#include "output_sched.h"
+#include "rt_thread.h"
+
+#define SPIN_NS 100000ULL           // the last stretch before a change is spun, not slept
+
+struct timed_output
+{
+    unsigned long long due;         // CLOCK_MONOTONIC in ns
+    unsigned long long seq;         // changes for the same time are made in the order queued
+    unsigned long long set, clear;
+};
+
+// a binary heap ordered by time, guarded by sched_lock
+struct timed_output timed_queue[OUTPUT_QUEUE_SIZE];
+unsigned int timed_count = 0;
+int spinning = 0;                   // a change is taken off the queue and waited for, cleared by a cancel
+unsigned long long next_seq = 0;
+struct output_sched_stats sched_stats = {0, 0, 0, 0.0, 0.0, 0.0};
+double late_total = 0.0;
+pthread_t sched_thread;
+int sched_running = 0;
+pthread_mutex_t sched_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t sched_cond;
+
+unsigned long long sched_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int timed_before(struct timed_output *a, struct timed_output *b)
+{
+    return a->due < b->due || (a->due == b->due && a->seq < b->seq);
+}
+
+void timed_swap(unsigned int i, unsigned int j)
+{
+    struct timed_output tmp = timed_queue[i];
+
+    timed_queue[i] = timed_queue[j];
+    timed_queue[j] = tmp;
+}
+
+void timed_pop(struct timed_output *out)
+// called with sched_lock held and the queue not empty
+{
+    unsigned int i = 0, child;
+
+    *out = timed_queue[0];
+    timed_queue[0] = timed_queue[--timed_count];
+    while ((child = 2 * i + 1) < timed_count)
+    {
+        if (child + 1 < timed_count && timed_before(&timed_queue[child + 1], &timed_queue[child]))
+            child++;
+        if (!timed_before(&timed_queue[child], &timed_queue[i]))
+            break;
+        timed_swap(i, child);
+        i = child;
+    }
+}
+
+void *sched_loop(void *threadarg)
+{
+    struct timed_output out;
+    struct timespec ts;
+    unsigned long long now;
+    double late;
+
+    rt_thread_enter(RT_SERVICE);
+    pthread_mutex_lock(&sched_lock);
+    while (sched_running)
+    {
+        if (timed_count == 0)
+        {
+            pthread_cond_wait(&sched_cond, &sched_lock);
+            continue;
+        }
+
+        // sleep until shortly before the first change, an earlier one queued meanwhile wakes the thread
+        now = sched_clock();
+        if (timed_queue[0].due > now + SPIN_NS)
+        {
+            ts.tv_sec = (timed_queue[0].due - SPIN_NS) / 1000000000ULL;
+            ts.tv_nsec = (timed_queue[0].due - SPIN_NS) % 1000000000ULL;
+            pthread_cond_timedwait(&sched_cond, &sched_lock, &ts);
+            continue;
+        }
+
+        timed_pop(&out);
+        spinning = 1;
+        pthread_mutex_unlock(&sched_lock);
+        while ((now = sched_clock()) < out.due)
+            ;
+
+        // made under the lock, so a change is either cancelled or made before a cancel returns
+        pthread_mutex_lock(&sched_lock);
+        if (!spinning)
+            continue;
+        spinning = 0;
+        output_gpio_mask(out.set, out.clear);
+        late = (now - out.due) / 1000.0;
+        sched_stats.executed++;
+        sched_stats.late_last = late;
+        late_total += late;
+        if (late > sched_stats.late_max)
+            sched_stats.late_max = late;
+    }
+    pthread_mutex_unlock(&sched_lock);
+    return NULL;
+}
+
+int start_sched_thread(void)
+// called with sched_lock held, returns 0 on success
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sched_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    sched_running = 1;
+    if (pthread_create(&sched_thread, NULL, sched_loop, NULL) != 0)
+    {
+        sched_running = 0;
+        pthread_cond_destroy(&sched_cond);
+        return 2;
+    }
+    return 0;
+}
+
+int output_at(unsigned long long t, unsigned long long set, unsigned long long clear)
+// queues setting the gpios in set high and those in clear low at timestamp t in microseconds, see event_timestamp()
+// a time already past is made at once
+// return values:
+// 0 - Success
+// 1 - Queue full
+// 2 - Thread could not be started
+{
+    unsigned int i;
+
+    pthread_mutex_lock(&sched_lock);
+    if (!sched_running && start_sched_thread() != 0)
+    {
+        pthread_mutex_unlock(&sched_lock);
+        return 2;
+    }
+    if (timed_count == OUTPUT_QUEUE_SIZE)
+    {
+        pthread_mutex_unlock(&sched_lock);
+        return 1;
+    }
+
+    i = timed_count++;
+    timed_queue[i].due = t * 1000ULL;
+    timed_queue[i].seq = next_seq++;
+    timed_queue[i].set = set;
+    timed_queue[i].clear = clear;
+    while (i > 0 && timed_before(&timed_queue[i], &timed_queue[(i - 1) / 2]))
+    {
+        timed_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    sched_stats.scheduled++;
+    if (i == 0)
+        pthread_cond_signal(&sched_cond);
+    pthread_mutex_unlock(&sched_lock);
+    return 0;
+}
+
+unsigned int output_sched_cancel(void)
+// drops the changes not made yet, returns how many
+{
+    unsigned int n;
+
+    pthread_mutex_lock(&sched_lock);
+    n = timed_count + spinning;
+    timed_count = 0;
+    spinning = 0;
+    pthread_mutex_unlock(&sched_lock);
+    return n;
+}
+
+void output_sched_stop(void)
+{
+    pthread_mutex_lock(&sched_lock);
+    if (!sched_running)
+    {
+        pthread_mutex_unlock(&sched_lock);
+        return;
+    }
+    timed_count = 0;
+    spinning = 0;
+    sched_running = 0;
+    sched_stats = (struct output_sched_stats){0, 0, 0, 0.0, 0.0, 0.0};
+    late_total = 0.0;
+    pthread_cond_signal(&sched_cond);
+    pthread_mutex_unlock(&sched_lock);
+
+    pthread_join(sched_thread, NULL);
+    pthread_cond_destroy(&sched_cond);
+}
+
+void get_output_sched_stats(struct output_sched_stats *stats)
+{
+    pthread_mutex_lock(&sched_lock);
+    *stats = sched_stats;
+    stats->pending = timed_count;
+    stats->late_avg = sched_stats.executed ? late_total / sched_stats.executed : 0.0;
+    pthread_mutex_unlock(&sched_lock);
+}
@@ -0,0 +1,40 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Timed outputs, pin changes queued for absolute times and made by a thread that spins the last stretch */
+
+#define OUTPUT_QUEUE_SIZE 4096
+
+struct output_sched_stats
+{
+    unsigned long long scheduled;   // changes queued since the start
+    unsigned long long executed;    // changes made
+    unsigned int pending;           // changes waiting in the queue
+    double late_last;               // lateness of the last change made in microseconds
+    double late_avg;                // mean lateness
+    double late_max;                // worst lateness
+};
+
+int output_at(unsigned long long t, unsigned long long set, unsigned long long clear);
+unsigned int output_sched_cancel(void);
+void output_sched_stop(void);
+void get_output_sched_stats(struct output_sched_stats *stats);
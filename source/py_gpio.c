@@ -20,37 +20,104 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#include <pthread.h>
+#include <unistd.h>
 #include "Python.h"
+#if PY_MAJOR_VERSION < 3
+#include "structseq.h"
+#endif
 #include "c_gpio.h"
 #include "event_gpio.h"
+#include "event_synth.h"
+#include "event_filter.h"
+#include "event_queue.h"
+#include "event_burst.h"
+#include "event_stream.h"
+#include "event_wait.h"
+#include "event_count.h"
+#include "event_measure.h"
+#include "event_reflex.h"
+#include "event_pattern.h"
+#include "event_stats.h"
+#include "trace.h"
+#include "event_record.h"
+#include "event_replay.h"
+#include "sampler.h"
+#include "decode.h"
+#include "output_sched.h"
+#include "waveform.h"
+#include "rt_thread.h"
 #include "py_pwm.h"
+#include "py_sampler.h"
+#include "py_waveform.h"
+#include "py_timer.h"
+#include "py_pin.h"
 #include "cpuinfo.h"
 #include "constants.h"
 #include "common.h"
 
-static PyObject *rpi_revision;
+// multi-phase init gives each interpreter its own module, the hardware state in the core stays process wide
+#if PY_VERSION_HEX >= 0x03050000
+#define MULTI_PHASE_INIT
+struct module_state
+{
+   int warnings;   // setwarnings() of the interpreter
+};
+#define WARNINGS(module) (((struct module_state *)PyModule_GetState(module))->warnings)
+#else
 static int gpio_warnings = 1;
+#define WARNINGS(module) gpio_warnings
+#endif
 
 struct py_callback
 {
    unsigned int gpio;
    PyObject *py_cb;
-   unsigned long long lastcall;
-   unsigned int bouncetime;
+   PyInterpreterState *interp;   // registered from, NULL for the main interpreter
+   int timestamped;              // called with an Event instead of the channel
+   int refs;                     // one for the list and one per running call
    struct py_callback *next;
 };
 static struct py_callback *py_callbacks = NULL;
+// the GIL is not enough, free threaded builds have none and subinterpreters run callbacks too
+static pthread_mutex_t py_callback_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t py_callback_released = PTHREAD_COND_INITIALIZER;   // a running call returned
+static pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
+static int exit_registered = 0;
+
+// the Event passed to timestamped callbacks, a struct sequence so no dict is made per event
+static PyStructSequence_Field event_fields[] = {
+   {"channel", "Channel of the event, in the numbering mode set"},
+   {"timestamp", "CLOCK_MONOTONIC time of the edge in us, of the last edge for a burst"},
+   {"level", "Level after the edge as seen by the poll thread, HIGH or LOW"},
+   {"edge", "RISING or FALLING"},
+   {"seq", "Number of the event on the channel since edge detection was added, a gap is events lost"},
+   {"count", "Number of edges the event stands for, more than 1 for bursts and coalesced events"},
+   {NULL}
+};
+static PyStructSequence_Desc event_desc = {
+   "RPi.GPIO.Event",
+   "Event(channel, timestamp, level, edge, seq, count), passed to callbacks added with timestamped=True",
+   event_fields,
+   6
+};
+static PyTypeObject EventType;
 
 static int init_module(void)
 {
-   int i, result;
+   int i, result = SETUP_OK;
 
-   module_setup = 0;
+   pthread_mutex_lock(&init_lock);
+   if (!module_setup)
+   {
+      for (i=0; i<54; i++)
+         gpio_direction[i] = -1;
 
-   for (i=0; i<54; i++)
-      gpio_direction[i] = -1;
+      result = setup();
+      module_setup = result == SETUP_OK;
+   }
+   pthread_mutex_unlock(&init_lock);
 
-   result = setup();
    if (result == SETUP_DEVMEM_FAIL)
    {
       PyErr_SetString(PyExc_RuntimeError, "No access to /dev/mem.  Try running as root!");
@@ -62,11 +129,84 @@ static int init_module(void)
       PyErr_SetString(PyExc_RuntimeError, "Mmap of GPIO registers failed");
       return SETUP_MALLOC_FAIL;
    } else { // result == SETUP_OK
-      module_setup = 1;
       return SETUP_OK;
    }
 }
 
+// drops a reference to a callback with an interpreter attached, the last one frees it
+static void release_py_callback(struct py_callback *cb)
+{
+   int last;
+
+   pthread_mutex_lock(&py_callback_lock);
+   last = --cb->refs == 0;
+   pthread_cond_broadcast(&py_callback_released);
+   pthread_mutex_unlock(&py_callback_lock);
+   if (last)
+   {
+      Py_XDECREF(cb->py_cb);
+      free(cb);
+   }
+}
+
+// unlinks the python callbacks for gpio, or of interp when gpio is -1
+static struct py_callback *unlink_py_callbacks(int gpio, PyInterpreterState *interp)
+{
+   struct py_callback **prev = &py_callbacks;
+   struct py_callback *cb;
+   struct py_callback *removed = NULL;
+
+   pthread_mutex_lock(&py_callback_lock);
+   while ((cb = *prev) != NULL)
+   {
+      if (gpio == -1 ? cb->interp == interp : cb->gpio == (unsigned int)gpio)
+      {
+         *prev = cb->next;
+         cb->next = removed;
+         removed = cb;
+      } else {
+         prev = &cb->next;
+      }
+   }
+   pthread_mutex_unlock(&py_callback_lock);
+   return removed;
+}
+
+// removes all python callbacks for gpio, a running one is freed when it returns
+static void remove_py_callbacks(unsigned int gpio)
+{
+   struct py_callback *cb = unlink_py_callbacks(gpio, NULL);
+   struct py_callback *temp;
+
+   while (cb != NULL)
+   {
+      temp = cb;
+      cb = cb->next;
+      release_py_callback(temp);
+   }
+}
+
+// removes the callbacks of an interpreter that is ending, after waiting for the running ones
+static void remove_interpreter_callbacks(PyInterpreterState *interp)
+{
+   struct py_callback *removed = unlink_py_callbacks(-1, interp);
+   struct py_callback *cb;
+
+   Py_BEGIN_ALLOW_THREADS // disable GIL
+   pthread_mutex_lock(&py_callback_lock);
+   for (cb = removed; cb != NULL; cb = cb->next)
+      while (cb->refs > 1)
+         pthread_cond_wait(&py_callback_released, &py_callback_lock);
+   pthread_mutex_unlock(&py_callback_lock);
+   Py_END_ALLOW_THREADS   // enable GIL
+   while (removed != NULL)
+   {
+      cb = removed;
+      removed = cb->next;
+      release_py_callback(cb);
+   }
+}
+
 // python function cleanup()
 static PyObject *py_cleanup(PyObject *self, PyObject *args)
 {
@@ -75,8 +215,16 @@ static PyObject *py_cleanup(PyObject *self, PyObject *args)
 
    if (module_setup && !setup_error)
    {
-      // clean up any /sys/class exports
+      // clean up any /sys/class exports, the poll thread may need the GIL to end
+      Py_BEGIN_ALLOW_THREADS // disable GIL
       event_cleanup();
+      Py_END_ALLOW_THREADS   // enable GIL
+      waveform_reap();
+      py_timers_cleanup();
+      for (i=0; i<PATTERN_MAX; i++)
+         remove_py_callbacks(PATTERN_GPIO + i);
+      for (i=0; i<54; i++)
+         remove_py_callbacks(i);
 
       // set everything back to input
       for (i=0; i<54; i++)
@@ -91,7 +239,7 @@ static PyObject *py_cleanup(PyObject *self, PyObject *args)
    }
 
    // check if any channels set up - if not warn about misuse of GPIO.cleanup()
-   if (!found && gpio_warnings)
+   if (!found && WARNINGS(self))
    {
       PyErr_WarnEx(NULL, "No channels have been set up yet - nothing to clean up!  Try cleaning up at the end of your program instead!", 1);
    }
@@ -143,18 +291,21 @@ static PyObject *py_setup_channel(PyObject *self, PyObject *args, PyObject *kwar
    }
 
    func = gpio_function(gpio);
-   if (gpio_warnings &&                             // warnings enabled and
+   if (WARNINGS(self) &&                            // warnings enabled and
        ((func != 0 && func != 1) ||                 // (already one of the alt functions or
        (gpio_direction[gpio] == -1 && func == 1)))  // already an output not set from this program)
    {
       PyErr_WarnEx(NULL, "This channel is already in use, continuing anyway.  Use GPIO.setwarnings(False) to disable warnings.", 1);
    }
 
+   // the registers are locked per bank, threads setting up other pins meanwhile do not wait
+   Py_BEGIN_ALLOW_THREADS // disable GIL
    if (direction == OUTPUT && (initial == LOW || initial == HIGH))
    {
       output_gpio(gpio, initial);
    }
    setup_gpio(gpio, direction, pud);
+   Py_END_ALLOW_THREADS   // enable GIL
    gpio_direction[gpio] = direction;
 
    Py_RETURN_NONE;
@@ -243,42 +394,103 @@ static unsigned int chan_from_gpio(unsigned int gpio)
    return -1;
 }
 
-static void run_py_callbacks(unsigned int gpio)
+static PyObject *build_event(struct gpio_event *ev)
+{
+   PyObject *event;
+   int i;
+
+   if ((event = PyStructSequence_New(&EventType)) == NULL)
+      return NULL;
+   PyStructSequence_SET_ITEM(event, 0, Py_BuildValue("i", chan_from_gpio(ev->gpio)));
+   PyStructSequence_SET_ITEM(event, 1, Py_BuildValue("K", ev->timestamp));
+   PyStructSequence_SET_ITEM(event, 2, Py_BuildValue("i", ev->level ? HIGH : LOW));
+   PyStructSequence_SET_ITEM(event, 3, Py_BuildValue("i", (ev->level ? RISING_EDGE : FALLING_EDGE) + PY_EVENT_CONST_OFFSET));
+   PyStructSequence_SET_ITEM(event, 4, Py_BuildValue("I", ev->seq));
+   PyStructSequence_SET_ITEM(event, 5, Py_BuildValue("I", ev->count));
+   for (i = 0; i < 6; i++)
+   {
+      if (PyStructSequence_GET_ITEM(event, i) == NULL)
+      {
+         Py_DECREF(event);
+         return NULL;
+      }
+   }
+   return event;
+}
+
+static void run_py_callbacks(struct gpio_event *ev)
+// a callback may change py_callbacks, so it is walked again after each one
 {
-   PyObject *result;
+   PyObject *result, *func, *event = NULL;
    PyGILState_STATE gstate;
-   struct py_callback *cb = py_callbacks;
-   struct timeval tv_timenow;
-   unsigned long long timenow;
+   PyThreadState *tstate;
+   struct py_callback *cb;
+   int pattern = ev->gpio >= PATTERN_GPIO;
+   int burst = !pattern && event_burst_enabled(ev->gpio);
+   int n = 0, i;
 
-   while (cb != NULL)
+   for (;;)
    {
-      if (cb->gpio == gpio)
-      {
-         gettimeofday(&tv_timenow, NULL);
-         timenow = tv_timenow.tv_sec*1E6 + tv_timenow.tv_usec;
-         if (cb->bouncetime == 0 || timenow - cb->lastcall > cb->bouncetime*1000 || cb->lastcall == 0 || cb->lastcall > timenow) {
-            // run callback
-            gstate = PyGILState_Ensure();
-            result = PyObject_CallFunction(cb->py_cb, "i", chan_from_gpio(gpio));
-            if (result == NULL && PyErr_Occurred())
-            {
-               PyErr_Print();
-               PyErr_Clear();
-            }
-            Py_XDECREF(result);
-            PyGILState_Release(gstate);
-         }
-         cb->lastcall = timenow;
+      pthread_mutex_lock(&py_callback_lock);
+      for (cb = py_callbacks, i = 0; cb != NULL; cb = cb->next)
+         if (cb->gpio == ev->gpio && i++ == n)
+            break;
+      if (cb != NULL)
+         cb->refs++;
+      pthread_mutex_unlock(&py_callback_lock);
+      if (cb == NULL)
+         break;
+      n++;
+      func = cb->py_cb;
+      tstate = enter_interpreter(cb->interp, &gstate);
+
+      // run callback, switch bounce is handled by the event filter
+      if (pattern)
+         result = PyObject_CallFunction(func, "iOK", ev->gpio - PATTERN_GPIO,
+                                        ev->level ? Py_True : Py_False, ev->timestamp);
+      else if (cb->timestamped)
+         result = (event = build_event(ev)) == NULL ? NULL : PyObject_CallFunctionObjArgs(func, event, NULL);
+      else if (burst)
+         result = PyObject_CallFunction(func, "i(IKKi)", chan_from_gpio(ev->gpio),
+                                        ev->count, ev->first, ev->timestamp, ev->level);
+      else
+         result = PyObject_CallFunction(func, "i", chan_from_gpio(ev->gpio));
+      if (result == NULL && PyErr_Occurred())
+      {
+         PyErr_Print();
+         PyErr_Clear();
       }
-      cb = cb->next;
+      Py_XDECREF(result);
+      Py_CLEAR(event);
+      release_py_callback(cb);
+      leave_interpreter(tstate, gstate);
    }
 }
 
-static int add_py_callback(unsigned int gpio, unsigned int bouncetime, PyObject *cb_func)
+// sets the switch bounce lockout of the event filter for a gpio, bouncetime in ms
+static void set_bouncetime(unsigned int gpio, unsigned int bouncetime)
+{
+   struct event_filter filter;
+
+   get_event_filter(gpio, &filter);
+   filter.lockout = bouncetime * 1000;
+   set_event_filter(gpio, &filter);
+}
+
+// sets burst coalescing for a gpio, window in us
+static void set_burst(unsigned int gpio, unsigned int window, unsigned int count)
+{
+   struct event_burst burst;
+
+   burst.window = window;
+   burst.count = count;
+   set_event_burst(gpio, &burst);
+}
+
+static int add_py_callback(unsigned int gpio, PyObject *cb_func, int timestamped)
 {
    struct py_callback *new_py_cb;
-   struct py_callback *cb = py_callbacks;
+   struct py_callback *cb;
 
    // add callback to py_callbacks list
    new_py_cb = malloc(sizeof(struct py_callback));
@@ -290,17 +502,21 @@ static int add_py_callback(unsigned int gpio, unsigned int bouncetime, PyObject
    new_py_cb->py_cb = cb_func;
    Py_XINCREF(cb_func);         // Add a reference to new callback
    new_py_cb->gpio = gpio;
-   new_py_cb->lastcall = 0;
-   new_py_cb->bouncetime = bouncetime;
+   new_py_cb->interp = current_interpreter();
+   new_py_cb->timestamped = timestamped;
+   new_py_cb->refs = 1;
    new_py_cb->next = NULL;
+   pthread_mutex_lock(&py_callback_lock);
    if (py_callbacks == NULL) {
       py_callbacks = new_py_cb;
    } else {
       // add to end of list
+      cb = py_callbacks;
       while (cb->next != NULL)
          cb = cb->next;
       cb->next = new_py_cb;
    }
+   pthread_mutex_unlock(&py_callback_lock);
    add_edge_callback(gpio, run_py_callbacks);
    return 0;
 }
@@ -311,10 +527,11 @@ static PyObject *py_add_event_callback(PyObject *self, PyObject *args, PyObject
    unsigned int gpio;
    int channel;
    unsigned int bouncetime = 0;
+   int timestamped = 0;
    PyObject *cb_func;
-   char *kwlist[] = {"gpio", "callback", "bouncetime", NULL};
+   char *kwlist[] = {"gpio", "callback", "bouncetime", "timestamped", NULL};
 
-   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "iO|i", kwlist, &channel, &cb_func, &bouncetime))
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "iO|ii", kwlist, &channel, &cb_func, &bouncetime, &timestamped))
       return NULL;
 
    if (!PyCallable_Check(cb_func))
@@ -339,23 +556,42 @@ static PyObject *py_add_event_callback(PyObject *self, PyObject *args, PyObject
       return NULL;
    }
 
-   if (add_py_callback(gpio, bouncetime, cb_func) != 0)
+   if (event_counting(gpio))
+   {
+      PyErr_SetString(PyExc_RuntimeError, "Events of this GPIO channel are counted, callbacks can not be added");
+      return NULL;
+   }
+
+   if (add_py_callback(gpio, cb_func, timestamped) != 0)
       return NULL;
 
+   if (bouncetime > 0)
+      set_bouncetime(gpio, bouncetime);
+
    Py_RETURN_NONE;
 }
 
-// python function add_event_detect(gpio, edge, callback=None, bouncetime=0
+// python function add_event_detect(gpio, edge, callback=None, bouncetime=0, stabletime=0, minpulse=0, burstwindow=0, burstcount=0, counting=False, timestamped=False)
 static PyObject *py_add_event_detect(PyObject *self, PyObject *args, PyObject *kwargs)
 {
    unsigned int gpio;
    int channel, edge, result;
    unsigned int bouncetime = 0;
+   struct event_filter filter = {0, 0, 0};
    PyObject *cb_func = NULL;
-   char *kwlist[] = {"gpio", "edge", "callback", "bouncetime", NULL};
+   unsigned int burstwindow = 0, burstcount = 0;
+   int counting = 0, timestamped = 0;
+   char *kwlist[] = {"gpio", "edge", "callback", "bouncetime", "stabletime", "minpulse", "burstwindow", "burstcount", "counting", "timestamped", NULL};
+
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "ii|OiIIIIii", kwlist, &channel, &edge, &cb_func, &bouncetime,
+                                    &filter.stable, &filter.min_pulse, &burstwindow, &burstcount, &counting, &timestamped))
+      return NULL;
 
-   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "ii|Oi", kwlist, &channel, &edge, &cb_func, &bouncetime))
+   if (counting && cb_func != NULL && cb_func != Py_None)
+   {
+      PyErr_SetString(PyExc_ValueError, "A callback can not be used with counting");
       return NULL;
+   }
 
    if (cb_func != NULL && !PyCallable_Check(cb_func))
    {
@@ -393,57 +629,108 @@ static PyObject *py_add_event_detect(PyObject *self, PyObject *args, PyObject *k
       }
    }
 
+   filter.lockout = bouncetime * 1000;
+   set_event_filter(gpio, &filter);
+   set_burst(gpio, burstwindow, burstcount);
+   set_event_counting(gpio, counting);
+
    if (cb_func != NULL)
-      if (add_py_callback(gpio, bouncetime, cb_func) != 0)
+      if (add_py_callback(gpio, cb_func, timestamped) != 0)
          return NULL;
 
    Py_RETURN_NONE;
 }
 
-// python function remove_event_detect(gpio)
-static PyObject *py_remove_event_detect(PyObject *self, PyObject *args)
+// python function simulate_events(channel, edge, schedule=SYNTH_FIXED, interval=1000, burst=1, gap=0, jitter=0, count=0, callback=None, bouncetime=0, stabletime=0, minpulse=0, burstwindow=0, burstcount=0, counting=False, timestamped=False)
+static PyObject *py_simulate_events(PyObject *self, PyObject *args, PyObject *kwargs)
 {
    unsigned int gpio;
-   int channel;
-   struct py_callback *cb = py_callbacks;
-   struct py_callback *temp;
-   struct py_callback *prev = NULL;
+   int channel, edge, result;
+   unsigned int bouncetime = 0;
+   struct synth_schedule sched = {SYNTH_FIXED, 1000, 1, 0, 0, 0};
+   struct event_filter filter = {0, 0, 0};
+   PyObject *cb_func = NULL;
+   unsigned int burstwindow = 0, burstcount = 0;
+   int counting = 0, timestamped = 0;
+   char *kwlist[] = {"channel", "edge", "schedule", "interval", "burst", "gap", "jitter", "count", "callback", "bouncetime", "stabletime", "minpulse", "burstwindow", "burstcount", "counting", "timestamped", NULL};
 
-   if (!PyArg_ParseTuple(args, "i", &channel))
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "ii|iIIIIKOiIIIIii", kwlist, &channel, &edge, &sched.type, &sched.interval,
+                                    &sched.burst, &sched.gap, &sched.jitter, &sched.count, &cb_func, &bouncetime,
+                                    &filter.stable, &filter.min_pulse, &burstwindow, &burstcount, &counting, &timestamped))
+      return NULL;
+
+   if (counting && cb_func != NULL && cb_func != Py_None)
+   {
+      PyErr_SetString(PyExc_ValueError, "A callback can not be used with counting");
+      return NULL;
+   }
+
+   if (cb_func != NULL && !PyCallable_Check(cb_func))
+   {
+      PyErr_SetString(PyExc_TypeError, "Parameter must be callable");
       return NULL;
+   }
 
    if (get_gpio_number(channel, &gpio))
        return NULL;
 
-   // remove all python callbacks for gpio
-   while (cb != NULL)
+   // check channel is set up as an input
+   if (gpio_direction[gpio] != INPUT)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "You must setup() the GPIO channel as an input first");
+      return NULL;
+   }
+
+   // is edge valid value
+   edge -= PY_EVENT_CONST_OFFSET;
+   if (edge != RISING_EDGE && edge != FALLING_EDGE && edge != BOTH_EDGE)
+   {
+      PyErr_SetString(PyExc_ValueError, "The edge must be set to RISING, FALLING or BOTH");
+      return NULL;
+   }
+
+   if (sched.type < SYNTH_FIXED || sched.type > SYNTH_SQUARE)
    {
-      if (cb->gpio == gpio)
+      PyErr_SetString(PyExc_ValueError, "The schedule must be set to SYNTH_FIXED, SYNTH_BURST, SYNTH_POISSON or SYNTH_SQUARE");
+      return NULL;
+   }
+
+   if (sched.interval == 0)
+   {
+      PyErr_SetString(PyExc_ValueError, "interval must be greater than 0");
+      return NULL;
+   }
+
+   if ((result = synth_start(gpio, edge, &sched)) != 0)   // starts a thread
+   {
+      if (result == 1)
       {
-         Py_XDECREF(cb->py_cb);
-         if (prev == NULL)
-            py_callbacks = cb->next;
-         else
-            prev->next = cb->next;
-         temp = cb;
-         cb = cb->next;
-         free(temp);
+         PyErr_SetString(PyExc_RuntimeError, "Edge detection already enabled for this GPIO channel");
+         return NULL;
       } else {
-         prev = cb;
-         cb = cb->next;
+         PyErr_SetString(PyExc_RuntimeError, "Failed to start simulated events");
+         return NULL;
       }
    }
 
-   remove_edge_detect(gpio);
+   filter.lockout = bouncetime * 1000;
+   set_event_filter(gpio, &filter);
+   set_burst(gpio, burstwindow, burstcount);
+   set_event_counting(gpio, counting);
+
+   if (cb_func != NULL)
+      if (add_py_callback(gpio, cb_func, timestamped) != 0)
+         return NULL;
 
    Py_RETURN_NONE;
 }
 
-// python function value = event_detected(channel)
-static PyObject *py_event_detected(PyObject *self, PyObject *args)
+// python function (generated, dropped) = simulated_stats(channel)
+static PyObject *py_simulated_stats(PyObject *self, PyObject *args)
 {
    unsigned int gpio;
    int channel;
+   unsigned long long generated, dropped;
 
    if (!PyArg_ParseTuple(args, "i", &channel))
       return NULL;
@@ -451,119 +738,1755 @@ static PyObject *py_event_detected(PyObject *self, PyObject *args)
    if (get_gpio_number(channel, &gpio))
        return NULL;
 
-   if (event_detected(gpio))
-      Py_RETURN_TRUE;
-   else
-      Py_RETURN_FALSE;
+   if (synth_stats(gpio, &generated, &dropped) != 0)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "No simulated events running for this GPIO channel");
+      return NULL;
+   }
+
+   return Py_BuildValue("(KK)", generated, dropped);
 }
 
-// python function py_wait_for_edge(gpio, edge)
-static PyObject *py_wait_for_edge(PyObject *self, PyObject *args)
+// python function remove_event_detect(gpio)
+static PyObject *py_remove_event_detect(PyObject *self, PyObject *args)
 {
    unsigned int gpio;
-   int channel, edge, result;
-   char error[30];
+   int channel;
 
-   if (!PyArg_ParseTuple(args, "ii", &channel, &edge))
+   if (!PyArg_ParseTuple(args, "i", &channel))
+      return NULL;
+
+   if (get_gpio_number(channel, &gpio))
+       return NULL;
+
+   remove_py_callbacks(gpio);
+   remove_edge_detect(gpio);
+
+   Py_RETURN_NONE;
+}
+
+// python function count = rejected_events(channel)
+static PyObject *py_rejected_events(PyObject *self, PyObject *args)
+{
+   unsigned int gpio;
+   int channel;
+
+   if (!PyArg_ParseTuple(args, "i", &channel))
       return NULL;
 
    if (get_gpio_number(channel, &gpio))
+       return NULL;
+
+   return Py_BuildValue("K", event_filter_rejected(gpio));
+}
+
+// python function set_callback_executor(threads=1, queue_size=1024, overflow=DROP_OLDEST)
+static PyObject *py_set_callback_executor(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   int threads = EXECUTOR_THREADS;
+   int queue_size = QUEUE_SIZE;
+   int overflow = QUEUE_DROP_OLDEST;
+   int result;
+   static char *kwlist[] = {"threads", "queue_size", "overflow", NULL};
+
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|iii", kwlist, &threads, &queue_size, &overflow))
       return NULL;
 
-   // check channel is setup as an input
-   if (gpio_direction[gpio] != INPUT)
+   if (threads < 0)
    {
-      PyErr_SetString(PyExc_RuntimeError, "You must setup() the GPIO channel as an input first");
+      PyErr_SetString(PyExc_ValueError, "threads must be 0 or greater");
       return NULL;
    }
 
-   // is edge a valid value?
-   edge -= PY_EVENT_CONST_OFFSET;
-   if (edge != RISING_EDGE && edge != FALLING_EDGE && edge != BOTH_EDGE)
+   if (queue_size < 1)
    {
-      PyErr_SetString(PyExc_ValueError, "The edge must be set to RISING, FALLING or BOTH");
+      PyErr_SetString(PyExc_ValueError, "queue_size must be greater than 0");
       return NULL;
    }
 
-   Py_BEGIN_ALLOW_THREADS // disable GIL
-   result = blocking_wait_for_edge(gpio, edge);
-   Py_END_ALLOW_THREADS   // enable GIL
+   if (overflow != QUEUE_DROP_OLDEST && overflow != QUEUE_DROP_NEWEST && overflow != QUEUE_COALESCE)
+   {
+      PyErr_SetString(PyExc_ValueError, "overflow must be set to DROP_OLDEST, DROP_NEWEST or COALESCE");
+      return NULL;
+   }
 
-   if (result == 0) {
-      Py_INCREF(Py_None);
-      return Py_None;
-   } else if (result == 2) {
-      PyErr_SetString(PyExc_RuntimeError, "Edge detection events already enabled for this GPIO channel");
+   result = set_executor(threads, queue_size, overflow);
+   if (result == 1)
+   {
+      PyErr_NoMemory();
       return NULL;
-   } else {
-      sprintf(error, "Error #%d waiting for edge", result);
-      PyErr_SetString(PyExc_RuntimeError, error);
+   } else if (result == 2) {
+      PyErr_SetString(PyExc_RuntimeError, "Failed to start the callback executor threads");
       return NULL;
    }
 
    Py_RETURN_NONE;
 }
 
-// python function value = gpio_function(channel)
-static PyObject *py_gpio_function(PyObject *self, PyObject *args)
+// python function stats = callback_queue_stats()
+static PyObject *py_callback_queue_stats(PyObject *self, PyObject *args)
+{
+   struct queue_stats stats;
+
+   get_queue_stats(&stats);
+   return Py_BuildValue("{s:K,s:K,s:K,s:I,s:I}",
+                        "queued", stats.queued,
+                        "dropped", stats.dropped,
+                        "coalesced", stats.coalesced,
+                        "high_water", stats.high_water,
+                        "size", stats.size);
+}
+
+// gets the gpio of a counting channel, returns -1 with an exception set otherwise
+static int counting_gpio(int channel, unsigned int *gpio)
+{
+   if (get_gpio_number(channel, gpio))
+      return -1;
+
+   if (!event_counting(*gpio))
+   {
+      PyErr_SetString(PyExc_RuntimeError, "Add event detection with counting=True first");
+      return -1;
+   }
+   return 0;
+}
+
+// python function value = count(channel)
+static PyObject *py_count(PyObject *self, PyObject *args)
 {
    unsigned int gpio;
    int channel;
-   int f;
-   PyObject *func;
 
    if (!PyArg_ParseTuple(args, "i", &channel))
       return NULL;
 
-   // run init_module if module not set up
-   if (!module_setup && (init_module() != SETUP_OK))
+   if (counting_gpio(channel, &gpio))
       return NULL;
 
-   if (get_gpio_number(channel, &gpio))
-       return NULL;
+   return Py_BuildValue("K", event_count(gpio));
+}
 
-   f = gpio_function(gpio);
-   switch (f)
-   {
-      case 0 : f = INPUT;  break;
-      case 1 : f = OUTPUT; break;
-      case 4 : switch (gpio)
-               {
-                  case 0 :
-                  case 1 : if (revision == 1) f = I2C; else f = MODE_UNKNOWN;
-                           break;
+// python function value = count_and_reset(channel)
+static PyObject *py_count_and_reset(PyObject *self, PyObject *args)
+{
+   unsigned int gpio;
+   int channel;
 
-                  case 2 :
-                  case 3 : if (revision == 2) f = I2C; else f = MODE_UNKNOWN;
-                           break;
-                           
-                  case 7 :
-                  case 8 :
-                  case 9 :
-                  case 10 :
-                  case 11 : f = SPI; break;
+   if (!PyArg_ParseTuple(args, "i", &channel))
+      return NULL;
 
-                  case 14 :
-                  case 15 : f = SERIAL; break;
+   if (counting_gpio(channel, &gpio))
+      return NULL;
 
-                  default : f = MODE_UNKNOWN; break;
-               }
-               break;
+   return Py_BuildValue("K", event_count_reset(gpio));
+}
 
-      case 5 : if (gpio == 18) f = PWM; else f = MODE_UNKNOWN;
-               break;
+// python function values = counts(channels, reset=False)
+static PyObject *py_counts(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   unsigned int gpios[54];
+   int reset = 0, n, i, channel;
+   PyObject *channels, *seq, *list, *value;
+   static char *kwlist[] = {"channels", "reset", NULL};
 
-      default : f = MODE_UNKNOWN; break;
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|i", kwlist, &channels, &reset))
+      return NULL;
 
-   }
-   func = Py_BuildValue("i", f);
-   return func;
-}
+   if ((seq = PySequence_Fast(channels, "channels must be a list or tuple of channels")) == NULL)
+      return NULL;
+
+   // check all channels before reading, so a reset is all or nothing
+   n = PySequence_Fast_GET_SIZE(seq);
+   if (n > 54)
+   {
+      Py_DECREF(seq);
+      PyErr_SetString(PyExc_ValueError, "channels must hold at most 54 channels");
+      return NULL;
+   }
+   for (i = 0; i < n; i++)
+   {
+      if (!PyArg_Parse(PySequence_Fast_GET_ITEM(seq, i), "i", &channel) || counting_gpio(channel, &gpios[i]))
+      {
+         Py_DECREF(seq);
+         return NULL;
+      }
+   }
+   Py_DECREF(seq);
+
+   if ((list = PyList_New(n)) == NULL)
+      return NULL;
+   for (i = 0; i < n; i++)
+   {
+      if ((value = Py_BuildValue("K", reset ? event_count_reset(gpios[i]) : event_count(gpios[i]))) == NULL)
+      {
+         Py_DECREF(list);
+         return NULL;
+      }
+      PyList_SET_ITEM(list, i, value);
+   }
+   return list;
+}
+
+// python function values = measure(channel, reset=False)
+static PyObject *py_measure(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   unsigned int gpio;
+   int channel, reset = 0;
+   struct measure_result m;
+   static char *kwlist[] = {"channel", "reset", NULL};
+
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "i|i", kwlist, &channel, &reset))
+      return NULL;
+
+   if (get_gpio_number(channel, &gpio))
+      return NULL;
+
+   if (!gpio_event_added(gpio))
+   {
+      PyErr_SetString(PyExc_RuntimeError, "Add event detection using add_event_detect first");
+      return NULL;
+   }
+
+   read_measure(gpio, &m);
+   if (reset)
+      reset_measure(gpio);
+
+   return Py_BuildValue("{s:I,s:I,s:I,s:d,s:I,s:I,s:I,s:d,s:d,s:d,s:d,s:d,s:K,s:K}",
+                        "period", m.period.last, "period_min", m.period.min,
+                        "period_max", m.period.max, "period_avg", m.period.avg,
+                        "high", m.high.last, "high_min", m.high.min,
+                        "high_max", m.high.max, "high_avg", m.high.avg,
+                        "duty", m.duty, "duty_avg", m.duty_avg,
+                        "frequency", m.period.last ? 1000000.0 / m.period.last : 0.0,
+                        "frequency_avg", m.period.avg > 0.0 ? 1000000.0 / m.period.avg : 0.0,
+                        "periods", m.periods, "last_edge", m.last_edge);
+}
+
+// turns a list of output channels into a gpio bit mask, returns -1 with an exception set on error
+static int output_mask(PyObject *channels, unsigned long long *mask)
+{
+   unsigned int gpio;
+   int n, i, channel;
+   PyObject *seq;
+
+   *mask = 0;
+   if (channels == NULL)
+      return 0;
+   if ((seq = PySequence_Fast(channels, "set, clear and toggle must be lists or tuples of channels")) == NULL)
+      return -1;
+
+   n = PySequence_Fast_GET_SIZE(seq);
+   for (i = 0; i < n; i++)
+   {
+      if (!PyArg_Parse(PySequence_Fast_GET_ITEM(seq, i), "i", &channel) || get_gpio_number(channel, &gpio))
+      {
+         Py_DECREF(seq);
+         return -1;
+      }
+      if (gpio_direction[gpio] != OUTPUT)
+      {
+         Py_DECREF(seq);
+         PyErr_SetString(PyExc_RuntimeError, "The GPIO channel has not been set up as an OUTPUT");
+         return -1;
+      }
+      *mask |= 1ULL << gpio;
+   }
+   Py_DECREF(seq);
+   return 0;
+}
+
+// python function id = add_reflex(channel, edge, set=[], clear=[], toggle=[], pwm=None, delay=0, oneshot=False)
+static PyObject *py_add_reflex(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   unsigned int gpio, pwm_gpio;
+   int channel, edge, pwm_channel, id;
+   int oneshot = 0;
+   PyObject *set = NULL, *clear = NULL, *toggle = NULL, *pwm = Py_None;
+   struct reflex_rule rule;
+   static char *kwlist[] = {"channel", "edge", "set", "clear", "toggle", "pwm", "delay", "oneshot", NULL};
+
+   rule.delay = 0;
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "ii|OOOOIi", kwlist, &channel, &edge, &set, &clear, &toggle, &pwm, &rule.delay, &oneshot))
+      return NULL;
+
+   if (get_gpio_number(channel, &gpio))
+      return NULL;
+
+   if (!gpio_event_added(gpio))
+   {
+      PyErr_SetString(PyExc_RuntimeError, "Add event detection using add_event_detect first");
+      return NULL;
+   }
+
+   // is edge a valid value?
+   edge -= PY_EVENT_CONST_OFFSET;
+   if (edge != RISING_EDGE && edge != FALLING_EDGE && edge != BOTH_EDGE)
+   {
+      PyErr_SetString(PyExc_ValueError, "The edge must be set to RISING, FALLING or BOTH");
+      return NULL;
+   }
+
+   if (output_mask(set, &rule.set) || output_mask(clear, &rule.clear) || output_mask(toggle, &rule.toggle))
+      return NULL;
+
+   rule.pwm_gpio = -1;
+   if (pwm != Py_None)
+   {
+      if (!PyArg_ParseTuple(pwm, "iff", &pwm_channel, &rule.frequency, &rule.dutycycle))
+         return NULL;
+      if (get_gpio_number(pwm_channel, &pwm_gpio))
+         return NULL;
+      if (gpio_direction[pwm_gpio] != OUTPUT)
+      {
+         PyErr_SetString(PyExc_RuntimeError, "The PWM channel has not been set up as an OUTPUT");
+         return NULL;
+      }
+      if (rule.frequency <= 0.0 || rule.dutycycle < 0.0 || rule.dutycycle > 100.0)
+      {
+         PyErr_SetString(PyExc_ValueError, "pwm must be (channel, frequency > 0.0, 0.0 <= dutycycle <= 100.0)");
+         return NULL;
+      }
+      rule.pwm_gpio = pwm_gpio;
+   }
+
+   rule.gpio = gpio;
+   rule.edge = edge;
+   rule.oneshot = oneshot;
+   if ((id = add_reflex(&rule)) < 0)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "Too many reflex rules");
+      return NULL;
+   }
+   return Py_BuildValue("i", id);
+}
+
+// python function remove_reflex(id)
+static PyObject *py_remove_reflex(PyObject *self, PyObject *args)
+{
+   int id;
+
+   if (!PyArg_ParseTuple(args, "i", &id))
+      return NULL;
+
+   if (remove_reflex(id))
+   {
+      PyErr_SetString(PyExc_ValueError, "No reflex rule with this id");
+      return NULL;
+   }
+   Py_RETURN_NONE;
+}
+
+// turns a list of set up channels into a gpio bit mask, adding the inputs to *inputs
+// returns -1 with an exception set on error
+static int pattern_mask(PyObject *channels, unsigned long long *mask, unsigned long long *inputs)
+{
+   unsigned int gpio;
+   int n, i, channel;
+   PyObject *seq;
+
+   *mask = 0;
+   if (channels == NULL)
+      return 0;
+   if ((seq = PySequence_Fast(channels, "high and low must be lists or tuples of channels")) == NULL)
+      return -1;
+
+   n = PySequence_Fast_GET_SIZE(seq);
+   for (i = 0; i < n; i++)
+   {
+      if (!PyArg_Parse(PySequence_Fast_GET_ITEM(seq, i), "i", &channel) || get_gpio_number(channel, &gpio))
+      {
+         Py_DECREF(seq);
+         return -1;
+      }
+      if (gpio_direction[gpio] != INPUT && gpio_direction[gpio] != OUTPUT)
+      {
+         Py_DECREF(seq);
+         PyErr_SetString(PyExc_RuntimeError, "You must setup() the GPIO channel first");
+         return -1;
+      }
+      *mask |= 1ULL << gpio;
+      if (gpio_direction[gpio] == INPUT)
+         *inputs |= 1ULL << gpio;
+   }
+   Py_DECREF(seq);
+   return 0;
+}
+
+// python function id = add_pattern(high=[], low=[], callback=None, poll=0)
+static PyObject *py_add_pattern(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   unsigned long long high, low, inputs = 0;
+   unsigned int gpio, poll = 0;
+   int id;
+   PyObject *high_list = NULL, *low_list = NULL, *cb_func = NULL;
+   static char *kwlist[] = {"high", "low", "callback", "poll", NULL};
+
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|OOOI", kwlist, &high_list, &low_list, &cb_func, &poll))
+      return NULL;
+
+   if (cb_func != NULL && cb_func != Py_None && !PyCallable_Check(cb_func))
+   {
+      PyErr_SetString(PyExc_TypeError, "Parameter must be callable");
+      return NULL;
+   }
+
+   if (pattern_mask(high_list, &high, &inputs) || pattern_mask(low_list, &low, &inputs))
+      return NULL;
+
+   if (high & low)
+   {
+      PyErr_SetString(PyExc_ValueError, "A channel can not be in both high and low");
+      return NULL;
+   }
+   if (inputs == 0)
+   {
+      PyErr_SetString(PyExc_ValueError, "The pattern must hold at least one input channel");
+      return NULL;
+   }
+
+   // the pattern is checked on the edges of its inputs
+   for (gpio = 0; gpio < 54; gpio++)
+   {
+      if ((inputs & (1ULL << gpio)) && add_wait_edge_detect(gpio) != 0)
+      {
+         PyErr_SetString(PyExc_RuntimeError, "Failed to add edge detection");
+         return NULL;
+      }
+   }
+
+   if ((id = add_pattern(high | low, high, poll, cb_func != NULL && cb_func != Py_None)) < 0)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "Too many patterns");
+      return NULL;
+   }
+   if (cb_func != NULL && cb_func != Py_None && add_py_callback(PATTERN_GPIO + id, cb_func, 0) != 0)
+   {
+      remove_pattern(id);
+      return NULL;
+   }
+   return Py_BuildValue("i", id);
+}
+
+// python function (matched, entries, exits) = pattern_state(id)
+static PyObject *py_pattern_state(PyObject *self, PyObject *args)
+{
+   int id;
+   struct pattern_state state;
+
+   if (!PyArg_ParseTuple(args, "i", &id))
+      return NULL;
+
+   if (get_pattern_state(id, &state))
+   {
+      PyErr_SetString(PyExc_ValueError, "No pattern with this id");
+      return NULL;
+   }
+   return Py_BuildValue("(OKK)", state.matched ? Py_True : Py_False, state.entries, state.exits);
+}
+
+// python function remove_pattern(id)
+static PyObject *py_remove_pattern(PyObject *self, PyObject *args)
+{
+   int id;
+
+   if (!PyArg_ParseTuple(args, "i", &id))
+      return NULL;
+
+   if (remove_pattern(id))
+   {
+      PyErr_SetString(PyExc_ValueError, "No pattern with this id");
+      return NULL;
+   }
+   remove_py_callbacks(PATTERN_GPIO + id);
+   Py_RETURN_NONE;
+}
+
+// builds a list from the buckets of a histogram
+static PyObject *histogram_list(unsigned long long *buckets)
+{
+   PyObject *list, *value;
+   int i;
+
+   if ((list = PyList_New(STATS_BUCKETS)) == NULL)
+      return NULL;
+   for (i = 0; i < STATS_BUCKETS; i++)
+   {
+      if ((value = Py_BuildValue("K", buckets[i])) == NULL)
+      {
+         Py_DECREF(list);
+         return NULL;
+      }
+      PyList_SET_ITEM(list, i, value);
+   }
+   return list;
+}
+
+// builds the stats dict of a gpio
+static PyObject *stats_dict(unsigned int gpio)
+{
+   struct event_stats s;
+   PyObject *latency, *duration;
+
+   read_stats(gpio, &s);
+   if ((latency = histogram_list(s.latency)) == NULL)
+      return NULL;
+   if ((duration = histogram_list(s.duration)) == NULL)
+   {
+      Py_DECREF(latency);
+      return NULL;
+   }
+   return Py_BuildValue("{s:K,s:K,s:K,s:K,s:N,s:N}",
+                        "seen", s.seen, "bounced", s.bounced,
+                        "dropped", s.dropped, "delivered", s.delivered,
+                        "latency", latency, "duration", duration);
+}
+
+// python function values = stats(channel=None)
+static PyObject *py_stats(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   unsigned int gpio;
+   int channel = -1;
+   struct event_stats s;
+   PyObject *dict, *value, *key;
+   static char *kwlist[] = {"channel", NULL};
+
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|i", kwlist, &channel))
+      return NULL;
+
+   if (channel != -1)
+   {
+      if (get_gpio_number(channel, &gpio))
+         return NULL;
+      return stats_dict(gpio);
+   }
+
+   // all channels with event detection or something to report
+   if ((dict = PyDict_New()) == NULL)
+      return NULL;
+   for (gpio = 0; gpio < 54; gpio++)
+   {
+      read_stats(gpio, &s);
+      if ((!gpio_event_added(gpio) && s.seen == 0) || (int)chan_from_gpio(gpio) == -1)
+         continue;
+      if ((value = stats_dict(gpio)) == NULL || (key = Py_BuildValue("i", chan_from_gpio(gpio))) == NULL)
+      {
+         Py_XDECREF(value);
+         Py_DECREF(dict);
+         return NULL;
+      }
+      if (PyDict_SetItem(dict, key, value) != 0)
+      {
+         Py_DECREF(key);
+         Py_DECREF(value);
+         Py_DECREF(dict);
+         return NULL;
+      }
+      Py_DECREF(key);
+      Py_DECREF(value);
+   }
+   return dict;
+}
+
+// python function reset_stats(channel=None)
+static PyObject *py_reset_stats(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   unsigned int gpio;
+   int channel = -1;
+   static char *kwlist[] = {"channel", NULL};
+
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|i", kwlist, &channel))
+      return NULL;
+
+   if (channel != -1)
+   {
+      if (get_gpio_number(channel, &gpio))
+         return NULL;
+      reset_stats(gpio);
+   } else {
+      for (gpio = 0; gpio < 54; gpio++)
+         reset_stats(gpio);
+   }
+   Py_RETURN_NONE;
+}
+
+// python function trace_start()
+static PyObject *py_trace_start(PyObject *self, PyObject *args)
+{
+   trace_start();
+   Py_RETURN_NONE;
+}
+
+// python function trace_stop()
+static PyObject *py_trace_stop(PyObject *self, PyObject *args)
+{
+   trace_stop();
+   Py_RETURN_NONE;
+}
+
+// python function trace_dump(path)
+static PyObject *py_trace_dump(PyObject *self, PyObject *args)
+{
+   char *path;
+   int result;
+
+   if (!PyArg_ParseTuple(args, "s", &path))
+      return NULL;
+
+   Py_BEGIN_ALLOW_THREADS // disable GIL
+   result = trace_dump(path);
+   Py_END_ALLOW_THREADS   // enable GIL
+
+   if (result != 0)
+   {
+      PyErr_SetFromErrnoWithFilename(PyExc_IOError, path);
+      return NULL;
+   }
+   Py_RETURN_NONE;
+}
+
+// python function record_start(path, channels=None, segment_records=65536, segments=0)
+static PyObject *py_record_start(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   char *path;
+   unsigned int gpio, segment_records = RECORD_SEGMENT, segments = 0;
+   unsigned long long gpios = 0;
+   int n, i, channel, result;
+   PyObject *channels = Py_None, *seq;
+   static char *kwlist[] = {"path", "channels", "segment_records", "segments", NULL};
+
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|OII", kwlist, &path, &channels, &segment_records, &segments))
+      return NULL;
+
+   if (channels == Py_None)
+   {
+      gpios = ~0ULL;
+   } else {
+      if ((seq = PySequence_Fast(channels, "channels must be a list or tuple of channels")) == NULL)
+         return NULL;
+      n = PySequence_Fast_GET_SIZE(seq);
+      for (i = 0; i < n; i++)
+      {
+         if (!PyArg_Parse(PySequence_Fast_GET_ITEM(seq, i), "i", &channel) || get_gpio_number(channel, &gpio))
+         {
+            Py_DECREF(seq);
+            return NULL;
+         }
+         gpios |= 1ULL << gpio;
+      }
+      Py_DECREF(seq);
+   }
+
+   result = record_start(path, gpios, segment_records, segments);
+   if (result == 1)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "Already recording, use record_stop() first");
+      return NULL;
+   } else if (result == 2) {
+      PyErr_SetFromErrnoWithFilename(PyExc_IOError, path);
+      return NULL;
+   }
+   Py_RETURN_NONE;
+}
+
+// python function record_stop()
+static PyObject *py_record_stop(PyObject *self, PyObject *args)
+{
+   record_stop();
+   Py_RETURN_NONE;
+}
+
+// python function values = record_stats()
+static PyObject *py_record_stats(PyObject *self, PyObject *args)
+{
+   struct record_stats stats;
+
+   get_record_stats(&stats);
+   return Py_BuildValue("{s:K,s:K,s:K}",
+                        "records", stats.records,
+                        "segments", stats.segments,
+                        "failed", stats.failed);
+}
+
+static void stop_py_replay(void)
+{
+   unsigned long long gpios = replay_stop();
+   unsigned int gpio;
+
+   for (gpio = 0; gpio < 54; gpio++)
+      if ((gpios >> gpio) & 1)
+         remove_py_callbacks(gpio);
+}
+
+// python function replay_events(path, edge=BOTH, speed=1.0, channels=None, callback=None, bouncetime=0, timestamped=False)
+static PyObject *py_replay_events(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   char *path;
+   unsigned int gpio, bouncetime = 0;
+   unsigned long long gpios = 0;
+   int n, i, channel, result, timestamped = 0;
+   int edge = BOTH_EDGE + PY_EVENT_CONST_OFFSET;
+   double speed = 1.0;
+   PyObject *channels = Py_None, *cb_func = NULL, *seq;
+   struct event_filter filter = {0, 0, 0};
+   static char *kwlist[] = {"path", "edge", "speed", "channels", "callback", "bouncetime", "timestamped", NULL};
+
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|idOOIi", kwlist, &path, &edge, &speed, &channels, &cb_func, &bouncetime, &timestamped))
+      return NULL;
+
+   if (cb_func != NULL && cb_func != Py_None && !PyCallable_Check(cb_func))
+   {
+      PyErr_SetString(PyExc_TypeError, "Parameter must be callable");
+      return NULL;
+   }
+
+   // is edge valid value
+   edge -= PY_EVENT_CONST_OFFSET;
+   if (edge != RISING_EDGE && edge != FALLING_EDGE && edge != BOTH_EDGE)
+   {
+      PyErr_SetString(PyExc_ValueError, "The edge must be set to RISING, FALLING or BOTH");
+      return NULL;
+   }
+
+   if (speed < 0.0)
+   {
+      PyErr_SetString(PyExc_ValueError, "speed must be 0 (as fast as possible) or greater");
+      return NULL;
+   }
+
+   if (channels == Py_None)
+   {
+      gpios = ~0ULL;
+   } else {
+      if ((seq = PySequence_Fast(channels, "channels must be a list or tuple of channels")) == NULL)
+         return NULL;
+      n = PySequence_Fast_GET_SIZE(seq);
+      for (i = 0; i < n; i++)
+      {
+         if (!PyArg_Parse(PySequence_Fast_GET_ITEM(seq, i), "i", &channel) || get_gpio_number(channel, &gpio))
+         {
+            Py_DECREF(seq);
+            return NULL;
+         }
+         gpios |= 1ULL << gpio;
+      }
+      Py_DECREF(seq);
+   }
+
+   result = replay_open(path, &gpios, edge, speed);
+   if (result == 1)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "Already replaying, use replay_stop() first");
+      return NULL;
+   } else if (result == 2) {
+      PyErr_Format(PyExc_IOError, "No recording found at %s", path);
+      return NULL;
+   } else if (result == 3) {
+      PyErr_SetString(PyExc_RuntimeError, "Edge detection already enabled for a replayed GPIO channel");
+      return NULL;
+   } else if (result != 0) {
+      PyErr_SetString(PyExc_RuntimeError, "Failed to start the replay");
+      return NULL;
+   }
+
+   // filters and callbacks are in place before the first edge is replayed
+   filter.lockout = bouncetime * 1000;
+   for (gpio = 0; gpio < 54; gpio++)
+   {
+      if (!((gpios >> gpio) & 1))
+         continue;
+      set_event_filter(gpio, &filter);
+      if (cb_func != NULL && cb_func != Py_None && add_py_callback(gpio, cb_func, timestamped) != 0)
+      {
+         stop_py_replay();
+         return NULL;
+      }
+   }
+
+   if (replay_run() != 0)
+   {
+      stop_py_replay();
+      PyErr_SetString(PyExc_RuntimeError, "Failed to start the replay");
+      return NULL;
+   }
+   Py_RETURN_NONE;
+}
+
+// python function replay_stop()
+static PyObject *py_replay_stop(PyObject *self, PyObject *args)
+{
+   stop_py_replay();
+   Py_RETURN_NONE;
+}
+
+// python function values = replay_stats()
+static PyObject *py_replay_stats(PyObject *self, PyObject *args)
+{
+   struct replay_stats stats;
+
+   get_replay_stats(&stats);
+   return Py_BuildValue("{s:K,s:K,s:O}",
+                        "replayed", stats.replayed,
+                        "elapsed", stats.elapsed,
+                        "running", stats.running ? Py_True : Py_False);
+}
+
+// turns a list of channels into a mask of GPIO 0-31, the channels need not be set up as they are only sampled
+// returns -1 with an exception set on error
+static int sample_mask(PyObject *channels, const char *what, unsigned int *mask)
+{
+   unsigned int gpio;
+   int n, i, channel;
+   PyObject *seq;
+
+   *mask = 0;
+   if (channels == NULL || channels == Py_None)
+      return 0;
+   if ((seq = PySequence_Fast(channels, what)) == NULL)
+      return -1;
+
+   n = PySequence_Fast_GET_SIZE(seq);
+   for (i = 0; i < n; i++)
+   {
+      if (!PyArg_Parse(PySequence_Fast_GET_ITEM(seq, i), "i", &channel) || get_gpio_number(channel, &gpio))
+      {
+         Py_DECREF(seq);
+         return -1;
+      }
+      if (gpio >= 32)
+      {
+         Py_DECREF(seq);
+         PyErr_SetString(PyExc_ValueError, "Only GPIO 0-31 are sampled");
+         return -1;
+      }
+      *mask |= 1U << gpio;
+   }
+   Py_DECREF(seq);
+   return 0;
+}
+
+// python function sampler_start(rate, samples, high=None, low=None, pretrigger=0, cpu=-1, encoding=SAMPLER_RAW)
+static PyObject *py_sampler_start(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   unsigned int rate, samples, pretrigger = 0, high, low;
+   int cpu = -1, encoding = SAMPLER_RAW, result;
+   PyObject *high_list = NULL, *low_list = NULL;
+   static char *kwlist[] = {"rate", "samples", "high", "low", "pretrigger", "cpu", "encoding", NULL};
+
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "II|OOIii", kwlist, &rate, &samples, &high_list, &low_list, &pretrigger, &cpu, &encoding))
+      return NULL;
+
+   if (encoding != SAMPLER_RAW && encoding != SAMPLER_RLE)
+   {
+      PyErr_SetString(PyExc_ValueError, "encoding must be SAMPLER_RAW or SAMPLER_RLE");
+      return NULL;
+   }
+
+   if (high_list == Py_None)
+      high_list = NULL;
+   if (low_list == Py_None)
+      low_list = NULL;
+   if (sample_mask(high_list, "high and low must be lists or tuples of channels", &high) ||
+       sample_mask(low_list, "high and low must be lists or tuples of channels", &low))
+      return NULL;
+
+   if (high & low)
+   {
+      PyErr_SetString(PyExc_ValueError, "A channel can not be in both high and low");
+      return NULL;
+   }
+   if (rate == 0 || rate > SAMPLER_MAX_RATE)
+   {
+      PyErr_Format(PyExc_ValueError, "rate must be from 1 to %d samples per second", SAMPLER_MAX_RATE);
+      return NULL;
+   }
+   if (samples == 0)
+   {
+      PyErr_SetString(PyExc_ValueError, "samples must be greater than 0");
+      return NULL;
+   }
+   if (pretrigger >= samples)
+   {
+      PyErr_SetString(PyExc_ValueError, "pretrigger must be less than samples");
+      return NULL;
+   }
+
+   result = sampler_start(rate, samples, encoding, high_list != NULL || low_list != NULL, high | low, high,
+                          pretrigger, cpu);   // starts a thread
+   if (result == 1)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "Already sampling, use sampler_stop() first");
+      return NULL;
+   } else if (result != 0) {
+      PyErr_SetString(PyExc_RuntimeError, "Failed to start the sampler");
+      return NULL;
+   }
+   Py_RETURN_NONE;
+}
+
+// python function sampler_stop()
+static PyObject *py_sampler_stop(PyObject *self, PyObject *args)
+{
+   sampler_stop();
+   Py_RETURN_NONE;
+}
+
+// python function values = sampler_state()
+static PyObject *py_sampler_state(PyObject *self, PyObject *args)
+{
+   struct sampler_status status;
+
+   get_sampler_status(&status);
+   return Py_BuildValue("{s:i,s:K,s:K}",
+                        "state", status.state,
+                        "taken", status.taken,
+                        "missed", status.missed);
+}
+
+// python function buffer = sampler_data()
+static PyObject *py_sampler_data(PyObject *self, PyObject *args)
+{
+   struct sample_block *block;
+
+   if ((block = sampler_take()) == NULL)
+      Py_RETURN_NONE;
+   return sample_buffer_new(block);
+}
+
+// python function sampler_save_vcd(path, channels=None)
+static PyObject *py_sampler_save_vcd(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   char *path;
+   unsigned int gpio, gpios = 0;
+   int result;
+   PyObject *channels = Py_None;
+   struct sample_block *block;
+   static char *kwlist[] = {"path", "channels", NULL};
+
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|O", kwlist, &path, &channels))
+      return NULL;
+
+   if (channels != Py_None)
+   {
+      if (sample_mask(channels, "channels must be a list or tuple of channels", &gpios))
+         return NULL;
+   } else {
+      // the channels set up, or all of them if none are
+      for (gpio = 0; gpio < 32; gpio++)
+         if (gpio_direction[gpio] != -1)
+            gpios |= 1U << gpio;
+      if (gpios == 0)
+         gpios = 0xffffffffU;
+   }
+
+   if ((block = sampler_take()) == NULL)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "No capture to save, use sampler_start() and wait for it to finish");
+      return NULL;
+   }
+   result = sampler_write_vcd(block, path, gpios);
+   sampler_release(block);
+   if (result != 0)
+   {
+      PyErr_SetFromErrnoWithFilename(PyExc_IOError, path);
+      return NULL;
+   }
+   Py_RETURN_NONE;
+}
+
+// turns one channel into a GPIO 0-31 for the decoders, None gives -1 if allowed
+// returns -1 with an exception set on error
+static int sample_gpio(PyObject *channel, int optional, int *gpio)
+{
+   unsigned int g;
+   int ch;
+
+   if (channel == Py_None && optional)
+   {
+      *gpio = -1;
+      return 0;
+   }
+   if (!PyArg_Parse(channel, "i", &ch) || get_gpio_number(ch, &g))
+      return -1;
+   if (g >= 32)
+   {
+      PyErr_SetString(PyExc_ValueError, "Only GPIO 0-31 are sampled");
+      return -1;
+   }
+   *gpio = g;
+   return 0;
+}
+
+// the transitions of the gpios in a SampleBuffer or a recording file
+// returns -1 with an exception set on error
+static int decode_source(PyObject *capture, unsigned int gpios, struct transitions *tr)
+{
+   struct sample_block *block;
+   const char *path;
+   int result;
+
+   if ((block = sample_buffer_block(capture)) != NULL)
+   {
+      result = decode_block(block, gpios, tr);
+   } else {
+#if PY_MAJOR_VERSION > 2
+      if (!PyUnicode_Check(capture) || (path = PyUnicode_AsUTF8(capture)) == NULL)
+#else
+      if (!PyString_Check(capture) || (path = PyString_AsString(capture)) == NULL)
+#endif
+      {
+         PyErr_SetString(PyExc_TypeError, "capture must be a SampleBuffer from sampler_data() or the path of a recording");
+         return -1;
+      }
+      result = decode_recording(path, gpios, tr);
+      if (result == 1)
+      {
+         PyErr_SetFromErrnoWithFilename(PyExc_IOError, (char *)path);
+         return -1;
+      }
+   }
+   if (result != 0)
+   {
+      PyErr_NoMemory();
+      return -1;
+   }
+   return 0;
+}
+
+// decoded frames as a list of (start, end, type, value, value2, flags) tuples, frees the frames
+static PyObject *decode_result(struct decode_frames *out, int result)
+{
+   PyObject *list, *item;
+   unsigned int i;
+
+   if (result != 0)
+   {
+      free_frames(out);
+      return PyErr_NoMemory();
+   }
+   if ((list = PyList_New(out->count)) == NULL)
+   {
+      free_frames(out);
+      return NULL;
+   }
+   for (i = 0; i < out->count; i++)
+   {
+      item = Py_BuildValue("(KKiIII)", out->frames[i].start, out->frames[i].end, out->frames[i].type,
+                           out->frames[i].value, out->frames[i].value2, out->frames[i].flags);
+      if (item == NULL)
+      {
+         Py_DECREF(list);
+         free_frames(out);
+         return NULL;
+      }
+      PyList_SET_ITEM(list, i, item);
+   }
+   free_frames(out);
+   return list;
+}
+
+// python function frames = decode_uart(capture, channel, baud, bits=8, parity='N', stopbits=1)
+static PyObject *py_decode_uart(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   PyObject *capture, *channel;
+   struct uart_config cfg;
+   struct transitions tr;
+   struct decode_frames out;
+   int gpio, result;
+   char *parity = "N";
+   static char *kwlist[] = {"capture", "channel", "baud", "bits", "parity", "stopbits", NULL};
+
+   cfg.bits = 8;
+   cfg.stopbits = 1;
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOI|IsI", kwlist, &capture, &channel, &cfg.baud, &cfg.bits, &parity, &cfg.stopbits))
+      return NULL;
+
+   if (sample_gpio(channel, 0, &gpio))
+      return NULL;
+   if (cfg.baud == 0)
+   {
+      PyErr_SetString(PyExc_ValueError, "baud must be greater than 0");
+      return NULL;
+   }
+   if (cfg.bits < 5 || cfg.bits > 9 || cfg.stopbits < 1 || cfg.stopbits > 2)
+   {
+      PyErr_SetString(PyExc_ValueError, "bits must be from 5 to 9 and stopbits 1 or 2");
+      return NULL;
+   }
+   if (strcmp(parity, "N") != 0 && strcmp(parity, "E") != 0 && strcmp(parity, "O") != 0)
+   {
+      PyErr_SetString(PyExc_ValueError, "parity must be 'N', 'E' or 'O'");
+      return NULL;
+   }
+   cfg.gpio = gpio;
+   cfg.parity = parity[0];
+
+   if (decode_source(capture, 1U << gpio, &tr))
+      return NULL;
+   if (tr.rate < cfg.baud * 2)
+   {
+      free_transitions(&tr);
+      PyErr_SetString(PyExc_ValueError, "The capture must be sampled at least twice per bit");
+      return NULL;
+   }
+   result = decode_uart(&tr, &cfg, &out);
+   free_transitions(&tr);
+   return decode_result(&out, result);
+}
+
+// python function frames = decode_spi(capture, clk, mosi=None, miso=None, cs=None, mode=0, bits=8, lsb_first=False)
+static PyObject *py_decode_spi(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   PyObject *capture, *clk, *mosi = Py_None, *miso = Py_None, *cs = Py_None, *lsb_first = Py_False;
+   struct spi_config cfg;
+   struct transitions tr;
+   struct decode_frames out;
+   unsigned int gpios;
+   int clk_gpio, result;
+   static char *kwlist[] = {"capture", "clk", "mosi", "miso", "cs", "mode", "bits", "lsb_first", NULL};
+
+   cfg.mode = 0;
+   cfg.bits = 8;
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|OOOiIO", kwlist, &capture, &clk, &mosi, &miso, &cs, &cfg.mode, &cfg.bits, &lsb_first))
+      return NULL;
+
+   if (sample_gpio(clk, 0, &clk_gpio) || sample_gpio(mosi, 1, &cfg.mosi) ||
+       sample_gpio(miso, 1, &cfg.miso) || sample_gpio(cs, 1, &cfg.cs))
+      return NULL;
+   if (cfg.mode < 0 || cfg.mode > 3)
+   {
+      PyErr_SetString(PyExc_ValueError, "mode must be from 0 to 3");
+      return NULL;
+   }
+   if (cfg.bits < 1 || cfg.bits > 32)
+   {
+      PyErr_SetString(PyExc_ValueError, "bits must be from 1 to 32");
+      return NULL;
+   }
+   cfg.clk = clk_gpio;
+   cfg.lsb_first = PyObject_IsTrue(lsb_first);
+
+   gpios = 1U << cfg.clk;
+   if (cfg.mosi >= 0)
+      gpios |= 1U << cfg.mosi;
+   if (cfg.miso >= 0)
+      gpios |= 1U << cfg.miso;
+   if (cfg.cs >= 0)
+      gpios |= 1U << cfg.cs;
+   if (decode_source(capture, gpios, &tr))
+      return NULL;
+   result = decode_spi(&tr, &cfg, &out);
+   free_transitions(&tr);
+   return decode_result(&out, result);
+}
+
+// python function frames = decode_i2c(capture, scl, sda)
+static PyObject *py_decode_i2c(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   PyObject *capture, *scl_channel, *sda_channel;
+   struct transitions tr;
+   struct decode_frames out;
+   int scl, sda, result;
+   static char *kwlist[] = {"capture", "scl", "sda", NULL};
+
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOO", kwlist, &capture, &scl_channel, &sda_channel))
+      return NULL;
+
+   if (sample_gpio(scl_channel, 0, &scl) || sample_gpio(sda_channel, 0, &sda))
+      return NULL;
+   if (decode_source(capture, (1U << scl) | (1U << sda), &tr))
+      return NULL;
+   result = decode_i2c(&tr, scl, sda, &out);
+   free_transitions(&tr);
+   return decode_result(&out, result);
+}
+
+// python function frames = decode_onewire(capture, channel)
+static PyObject *py_decode_onewire(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   PyObject *capture, *channel;
+   struct transitions tr;
+   struct decode_frames out;
+   int gpio, result;
+   static char *kwlist[] = {"capture", "channel", NULL};
+
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO", kwlist, &capture, &channel))
+      return NULL;
+
+   if (sample_gpio(channel, 0, &gpio))
+      return NULL;
+   if (decode_source(capture, 1U << gpio, &tr))
+      return NULL;
+   result = decode_onewire(&tr, gpio, &out);
+   free_transitions(&tr);
+   return decode_result(&out, result);
+}
+
+// python function t = timestamp()
+static PyObject *py_timestamp(PyObject *self, PyObject *args)
+{
+   return Py_BuildValue("K", event_timestamp());
+}
+
+// python function output_at(t, channels, values)
+static PyObject *py_output_at(PyObject *self, PyObject *args)
+{
+   unsigned long long t, set = 0, clear = 0;
+   unsigned int gpio;
+   int n, i, channel, value, result;
+   PyObject *channels, *values, *chan_seq = NULL, *value_seq = NULL;
+
+   if (!PyArg_ParseTuple(args, "KOO", &t, &channels, &values))
+      return NULL;
+
+   // a channel or a list of them, with a value or a list of as many values
+   if (PySequence_Check(channels))
+   {
+      if ((chan_seq = PySequence_Fast(channels, "channels must be a channel or a list or tuple of channels")) == NULL)
+         return NULL;
+      n = PySequence_Fast_GET_SIZE(chan_seq);
+   } else {
+      n = 1;
+   }
+   if (PySequence_Check(values))
+   {
+      if ((value_seq = PySequence_Fast(values, "values must be a value or a list or tuple of values")) == NULL)
+         goto fail;
+      if (PySequence_Fast_GET_SIZE(value_seq) != n)
+      {
+         PyErr_SetString(PyExc_ValueError, "values must have one value for each channel");
+         goto fail;
+      }
+   }
+
+   for (i = 0; i < n; i++)
+   {
+      if (!PyArg_Parse(chan_seq ? PySequence_Fast_GET_ITEM(chan_seq, i) : channels, "i", &channel) ||
+          !PyArg_Parse(value_seq ? PySequence_Fast_GET_ITEM(value_seq, i) : values, "i", &value) ||
+          get_gpio_number(channel, &gpio))
+         goto fail;
+      if (gpio_direction[gpio] != OUTPUT)
+      {
+         PyErr_SetString(PyExc_RuntimeError, "The GPIO channel has not been set up as an OUTPUT");
+         goto fail;
+      }
+      if (value)
+         set |= 1ULL << gpio;
+      else
+         clear |= 1ULL << gpio;
+   }
+   Py_XDECREF(chan_seq);
+   Py_XDECREF(value_seq);
+
+   result = output_at(t, set, clear);
+   if (result == 1)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "Too many timed outputs queued");
+      return NULL;
+   } else if (result != 0) {
+      PyErr_SetString(PyExc_RuntimeError, "Failed to start the output thread");
+      return NULL;
+   }
+   Py_RETURN_NONE;
+
+fail:
+   Py_XDECREF(chan_seq);
+   Py_XDECREF(value_seq);
+   return NULL;
+}
+
+// python function n = output_at_cancel()
+static PyObject *py_output_at_cancel(PyObject *self, PyObject *args)
+{
+   return Py_BuildValue("I", output_sched_cancel());
+}
+
+// python function values = output_at_stats()
+static PyObject *py_output_at_stats(PyObject *self, PyObject *args)
+{
+   struct output_sched_stats stats;
+
+   get_output_sched_stats(&stats);
+   return Py_BuildValue("{s:K,s:K,s:I,s:d,s:d,s:d}",
+                        "scheduled", stats.scheduled,
+                        "executed", stats.executed,
+                        "pending", stats.pending,
+                        "late_last", stats.late_last,
+                        "late_avg", stats.late_avg,
+                        "late_max", stats.late_max);
+}
+
+// python function wave_stop()
+static PyObject *py_wave_stop(PyObject *self, PyObject *args)
+{
+   wave_stop();
+   waveform_reap();
+   Py_RETURN_NONE;
+}
+
+// python function values = wave_status()
+static PyObject *py_wave_status(PyObject *self, PyObject *args)
+{
+   struct wave_status status;
+
+   get_wave_status(&status);
+   waveform_reap();
+   return Py_BuildValue("{s:O,s:O,s:K,s:K,s:d}",
+                        "playing", status.playing ? Py_True : Py_False,
+                        "queued", status.queued ? Py_True : Py_False,
+                        "steps", status.steps,
+                        "loops", status.loops,
+                        "late_max", status.late_max);
+}
+
+// python function set_thread_config(threads, policy, priority=0, cpus=None)
+static PyObject *py_set_thread_config(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   struct rt_config cfg;
+   PyObject *cpus = Py_None, *seq;
+   int threads, cls, core, i, n, refused = 0;
+   static char *kwlist[] = {"threads", "policy", "priority", "cpus", NULL};
+
+   cfg.priority = 0;
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "ii|iO", kwlist, &threads, &cfg.policy, &cfg.priority, &cpus))
+      return NULL;
+
+   if (threads <= 0 || threads >= (1 << RT_CLASSES))
+   {
+      PyErr_SetString(PyExc_ValueError, "threads must be THREAD_POLL, THREAD_PWM, THREAD_EXECUTOR, THREAD_SERVICE or a combination of them");
+      return NULL;
+   }
+
+   cfg.cpus = 0;
+   if (cpus != Py_None)
+   {
+      if ((seq = PySequence_Fast(cpus, "cpus must be a list or tuple of cores")) == NULL)
+         return NULL;
+      n = PySequence_Fast_GET_SIZE(seq);
+      for (i = 0; i < n; i++)
+      {
+         if (!PyArg_Parse(PySequence_Fast_GET_ITEM(seq, i), "i", &core))
+         {
+            Py_DECREF(seq);
+            return NULL;
+         }
+         if (core < 0 || core > 63)
+         {
+            Py_DECREF(seq);
+            PyErr_SetString(PyExc_ValueError, "cores must be 0-63");
+            return NULL;
+         }
+         cfg.cpus |= 1ULL << core;
+      }
+      Py_DECREF(seq);
+   }
+
+   for (cls = 0; cls < RT_CLASSES; cls++)
+   {
+      if (!(threads & (1 << cls)))
+         continue;
+      n = rt_set_config(cls, &cfg);
+      if (n == 2)
+      {
+         PyErr_SetString(PyExc_ValueError, "policy must be SCHED_OTHER with priority 0, or SCHED_FIFO or SCHED_RR with priority 1-99");
+         return NULL;
+      }
+      refused |= n;
+   }
+
+   if (refused && WARNINGS(self) &&
+       PyErr_WarnEx(NULL, "The system refused the settings for a running thread, real time priority needs root or CAP_SYS_NICE", 1) == -1)
+      return NULL;
+
+   Py_RETURN_NONE;
+}
+
+// python function lock_memory(enable=True, prefault=0)
+static PyObject *py_lock_memory(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   int enable = 1;
+   unsigned int prefault = 0;
+   int result;
+   static char *kwlist[] = {"enable", "prefault", NULL};
+
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|iI", kwlist, &enable, &prefault))
+      return NULL;
+
+   result = rt_lock_memory(enable, prefault);
+   if (result == 1)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "Failed to lock memory, needs root, CAP_IPC_LOCK or a larger RLIMIT_MEMLOCK");
+      return NULL;
+   } else if (result == 2) {
+      PyErr_Format(PyExc_ValueError, "prefault must be at most %d bytes", RT_PREFAULT_MAX);
+      return NULL;
+   }
+
+   Py_RETURN_NONE;
+}
+
+// returns the dict thread_config() reports for a class of threads
+static PyObject *thread_status(int cls)
+{
+   struct rt_status status;
+   PyObject *cpus, *core;
+   int i;
+
+   rt_get_status(cls, &status);
+   if ((cpus = PyList_New(0)) == NULL)
+      return NULL;
+   for (i = 0; i < 64; i++)
+   {
+      if (!(status.effective.cpus & (1ULL << i)))
+         continue;
+      if ((core = Py_BuildValue("i", i)) == NULL || PyList_Append(cpus, core) != 0)
+      {
+         Py_XDECREF(core);
+         Py_DECREF(cpus);
+         return NULL;
+      }
+      Py_DECREF(core);
+   }
+   return Py_BuildValue("{s:i,s:i,s:N,s:I,s:K}",
+                        "policy", status.effective.policy,
+                        "priority", status.effective.priority,
+                        "cpus", cpus,
+                        "threads", status.threads,
+                        "failed", status.failed);
+}
+
+// python function values = thread_config()
+static PyObject *py_thread_config(PyObject *self, PyObject *args)
+{
+   unsigned int prefault;
+   int locked;
+
+   rt_get_memory(&locked, &prefault);
+   return Py_BuildValue("{s:N,s:N,s:N,s:N,s:O,s:I}",
+                        "poll", thread_status(RT_POLL),
+                        "pwm", thread_status(RT_PWM),
+                        "executor", thread_status(RT_EXECUTOR),
+                        "service", thread_status(RT_SERVICE),
+                        "memory_locked", locked ? Py_True : Py_False,
+                        "prefault", prefault);
+}
+
+// python function fd = event_fd(size=1024)
+static PyObject *py_event_fd(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   int size = STREAM_SIZE;
+   int fd;
+   static char *kwlist[] = {"size", NULL};
+
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|i", kwlist, &size))
+      return NULL;
+
+   if (size < 1)
+   {
+      PyErr_SetString(PyExc_ValueError, "size must be greater than 0");
+      return NULL;
+   }
+
+   if ((fd = stream_open(size)) == -1)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "Failed to open the event stream");
+      return NULL;
+   }
+   return Py_BuildValue("i", fd);
+}
+
+// python function events = read_events(max=64)
+static PyObject *py_read_events(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   struct gpio_event evs[64];
+   int max = 64;
+   int n, i;
+   PyObject *list, *item;
+   static char *kwlist[] = {"max", NULL};
+
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|i", kwlist, &max))
+      return NULL;
+
+   if ((list = PyList_New(0)) == NULL)
+      return NULL;
+
+   while (max > 0 && (n = stream_read(evs, max < 64 ? max : 64)) > 0)
+   {
+      for (i = 0; i < n; i++)
+      {
+         item = Py_BuildValue("(iiKI)", chan_from_gpio(evs[i].gpio), evs[i].level, evs[i].timestamp, evs[i].count);
+         if (item == NULL || PyList_Append(list, item) != 0)
+         {
+            Py_XDECREF(item);
+            Py_DECREF(list);
+            return NULL;
+         }
+         Py_DECREF(item);
+      }
+      max -= n;
+   }
+   return list;
+}
+
+// RPi._asyncio uses async def, so edge() and events() need Python 3.5 or later
+#if PY_VERSION_HEX >= 0x03050000
+// calls a function of the RPi._asyncio helper module, steals the reference to args
+static PyObject *call_asyncio(const char *name, PyObject *args)
+{
+   PyObject *module, *func, *result = NULL;
+
+   if (args == NULL)
+      return NULL;
+   if ((module = PyImport_ImportModule("RPi._asyncio")) != NULL)
+   {
+      if ((func = PyObject_GetAttrString(module, name)) != NULL)
+      {
+         result = PyObject_CallObject(func, args);
+         Py_DECREF(func);
+      }
+      Py_DECREF(module);
+   }
+   Py_DECREF(args);
+   return result;
+}
+
+// python function event = await edge(channel, timeout=None)
+static PyObject *py_edge(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   unsigned int gpio;
+   int channel;
+   PyObject *timeout = Py_None;
+   static char *kwlist[] = {"channel", "timeout", NULL};
+
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "i|O", kwlist, &channel, &timeout))
+      return NULL;
+
+   if (get_gpio_number(channel, &gpio))
+      return NULL;
+
+   if (!gpio_event_added(gpio))
+   {
+      PyErr_SetString(PyExc_RuntimeError, "Add event detection using add_event_detect first");
+      return NULL;
+   }
+
+   return call_asyncio("edge", Py_BuildValue("(iO)", channel, timeout));
+}
+
+// python function async for event in events(channel=None)
+static PyObject *py_events(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   unsigned int gpio;
+   int chan;
+   PyObject *channel = Py_None;
+   static char *kwlist[] = {"channel", NULL};
+
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", kwlist, &channel))
+      return NULL;
+
+   if (channel != Py_None)
+   {
+      if (!PyArg_Parse(channel, "i", &chan))
+         return NULL;
+      if (get_gpio_number(chan, &gpio))
+         return NULL;
+      if (!gpio_event_added(gpio))
+      {
+         PyErr_SetString(PyExc_RuntimeError, "Add event detection using add_event_detect first");
+         return NULL;
+      }
+   }
+
+   return call_asyncio("events", Py_BuildValue("(O)", channel));
+}
+#endif
+
+// python function value = event_detected(channel)
+static PyObject *py_event_detected(PyObject *self, PyObject *args)
+{
+   unsigned int gpio;
+   int channel;
+
+   if (!PyArg_ParseTuple(args, "i", &channel))
+      return NULL;
+
+   if (get_gpio_number(channel, &gpio))
+       return NULL;
+
+   if (event_detected(gpio))
+      Py_RETURN_TRUE;
+   else
+      Py_RETURN_FALSE;
+}
+
+// python function py_wait_for_edge(gpio, edge)
+static PyObject *py_wait_for_edge(PyObject *self, PyObject *args)
+{
+   unsigned int gpio;
+   int channel, edge, result;
+   char error[30];
+
+   if (!PyArg_ParseTuple(args, "ii", &channel, &edge))
+      return NULL;
+
+   if (get_gpio_number(channel, &gpio))
+      return NULL;
+
+   // check channel is setup as an input
+   if (gpio_direction[gpio] != INPUT)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "You must setup() the GPIO channel as an input first");
+      return NULL;
+   }
+
+   // is edge a valid value?
+   edge -= PY_EVENT_CONST_OFFSET;
+   if (edge != RISING_EDGE && edge != FALLING_EDGE && edge != BOTH_EDGE)
+   {
+      PyErr_SetString(PyExc_ValueError, "The edge must be set to RISING, FALLING or BOTH");
+      return NULL;
+   }
+
+   Py_BEGIN_ALLOW_THREADS // disable GIL
+   result = blocking_wait_for_edge(gpio, edge);
+   Py_END_ALLOW_THREADS   // enable GIL
+
+   if (result == 0) {
+      Py_INCREF(Py_None);
+      return Py_None;
+   } else if (result == 2) {
+      PyErr_SetString(PyExc_RuntimeError, "Edge detection events already enabled for this GPIO channel");
+      return NULL;
+   } else {
+      sprintf(error, "Error #%d waiting for edge", result);
+      PyErr_SetString(PyExc_RuntimeError, error);
+      return NULL;
+   }
+
+   Py_RETURN_NONE;
+}
+
+// python function (channel, timestamp) = wait_for_any(channels, edge, timeout=-1)
+static PyObject *py_wait_for_any(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+   unsigned int gpios[54];
+   int edge, timeout = -1, result, n, i, channel;
+   PyObject *channels, *seq;
+   struct gpio_event ev;
+   static char *kwlist[] = {"channels", "edge", "timeout", NULL};
+
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Oi|i", kwlist, &channels, &edge, &timeout))
+      return NULL;
+
+   if ((seq = PySequence_Fast(channels, "channels must be a list or tuple of channels")) == NULL)
+      return NULL;
+
+   n = PySequence_Fast_GET_SIZE(seq);
+   if (n < 1 || n > 54)
+   {
+      Py_DECREF(seq);
+      PyErr_SetString(PyExc_ValueError, "channels must hold 1 to 54 channels");
+      return NULL;
+   }
+   for (i = 0; i < n; i++)
+   {
+      if (!PyArg_Parse(PySequence_Fast_GET_ITEM(seq, i), "i", &channel) || get_gpio_number(channel, &gpios[i]))
+      {
+         Py_DECREF(seq);
+         return NULL;
+      }
+
+      // check channel is setup as an input
+      if (gpio_direction[gpios[i]] != INPUT)
+      {
+         Py_DECREF(seq);
+         PyErr_SetString(PyExc_RuntimeError, "You must setup() the GPIO channel as an input first");
+         return NULL;
+      }
+   }
+   Py_DECREF(seq);
+
+   // is edge a valid value?
+   edge -= PY_EVENT_CONST_OFFSET;
+   if (edge != RISING_EDGE && edge != FALLING_EDGE && edge != BOTH_EDGE)
+   {
+      PyErr_SetString(PyExc_ValueError, "The edge must be set to RISING, FALLING or BOTH");
+      return NULL;
+   }
+
+   Py_BEGIN_ALLOW_THREADS // disable GIL
+   result = wait_for_any(gpios, n, edge, timeout, &ev);
+   Py_END_ALLOW_THREADS   // enable GIL
+
+   if (result == 1)
+      Py_RETURN_NONE;
+   else if (result == 2)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "Failed to add edge detection");
+      return NULL;
+   }
+   return Py_BuildValue("(iK)", chan_from_gpio(ev.gpio), ev.timestamp);
+}
+
+// python function value = gpio_function(channel)
+static PyObject *py_gpio_function(PyObject *self, PyObject *args)
+{
+   unsigned int gpio;
+   int channel;
+   int f;
+   PyObject *func;
+
+   if (!PyArg_ParseTuple(args, "i", &channel))
+      return NULL;
+
+   // run init_module if module not set up
+   if (!module_setup && (init_module() != SETUP_OK))
+      return NULL;
+
+   if (get_gpio_number(channel, &gpio))
+       return NULL;
+
+   f = gpio_function(gpio);
+   switch (f)
+   {
+      case 0 : f = INPUT;  break;
+      case 1 : f = OUTPUT; break;
+      case 4 : switch (gpio)
+               {
+                  case 0 :
+                  case 1 : if (revision == 1) f = I2C; else f = MODE_UNKNOWN;
+                           break;
+
+                  case 2 :
+                  case 3 : if (revision == 2) f = I2C; else f = MODE_UNKNOWN;
+                           break;
+                           
+                  case 7 :
+                  case 8 :
+                  case 9 :
+                  case 10 :
+                  case 11 : f = SPI; break;
+
+                  case 14 :
+                  case 15 : f = SERIAL; break;
+
+                  default : f = MODE_UNKNOWN; break;
+               }
+               break;
+
+      case 5 : if (gpio == 18) f = PWM; else f = MODE_UNKNOWN;
+               break;
+
+      default : f = MODE_UNKNOWN; break;
+
+   }
+   func = Py_BuildValue("i", f);
+   return func;
+}
 
 // python function setwarnings(state)
 static PyObject *py_setwarnings(PyObject *self, PyObject *args)
 {
-   if (!PyArg_ParseTuple(args, "i", &gpio_warnings))
+   if (!PyArg_ParseTuple(args, "i", &WARNINGS(self)))
       return NULL;
 
    if (setup_error)
@@ -583,42 +2506,104 @@ PyMethodDef rpi_gpio_methods[] = {
    {"output", py_output_gpio, METH_VARARGS, "Output to a GPIO channel\nchannel - either board pin number or BCM number depending on which mode is set.\nvalue   - 0/1 or False/True or LOW/HIGH"},
    {"input", py_input_gpio, METH_VARARGS, "Input from a GPIO channel.  Returns HIGH=1=True or LOW=0=False\nchannel - either board pin number or BCM number depending on which mode is set."},
    {"setmode", py_setmode, METH_VARARGS, "Set up numbering mode to use for channels.\nBOARD - Use Raspberry Pi board numbers\nBCM   - Use Broadcom GPIO 00..nn numbers"},
-   {"add_event_detect", (PyCFunction)py_add_event_detect, METH_VARARGS | METH_KEYWORDS, "Enable edge detection events for a particular GPIO channel.\nchannel      - either board pin number or BCM number depending on which mode is set.\nedge         - RISING, FALLING or BOTH\n[callback]   - A callback function for the event (optional)\n[bouncetime] - Switch bounce timeout in ms for callback"},
+   {"add_event_detect", (PyCFunction)py_add_event_detect, METH_VARARGS | METH_KEYWORDS, "Enable edge detection events for a particular GPIO channel.\nchannel      - either board pin number or BCM number depending on which mode is set.\nedge         - RISING, FALLING or BOTH\n[callback]   - A callback function for the event (optional)\n[bouncetime] - Switch bounce timeout in ms, edges within this time after an accepted edge are ignored\n[stabletime] - Time in us the new level must hold before an edge is accepted\n[minpulse]   - Pulses shorter than this time in us are ignored, both of their edges, other edges are delayed by it\n[burstwindow] - Coalesce edges into one callback per window of this many us\n[burstcount]  - Coalesce edges into one callback per this many edges\nWith burstwindow or burstcount set the callback is called as callback(channel, (count, first, last, level)), timestamps in us\n[counting]    - Only count the edges, see count(), count_and_reset() and counts()\n[timestamped] - Call the callback as callback(event) with an Event of the channel, timestamp, level, edge, seq and count instead"},
    {"remove_event_detect", py_remove_event_detect, METH_VARARGS, "Remove edge detection for a particular GPIO channel\nchannel - either board pin number or BCM number depending on which mode is set."},
    {"event_detected", py_event_detected, METH_VARARGS, "Returns True if an edge has occured on a given GPIO.  You need to enable edge detection using add_event_detect() first.\nchannel - either board pin number or BCM number depending on which mode is set."},
-   {"add_event_callback", (PyCFunction)py_add_event_callback, METH_VARARGS | METH_KEYWORDS, "Add a callback for an event already defined using add_event_detect()\nchannel      - either board pin number or BCM number depending on which mode is set.\ncallback     - a callback function\n[bouncetime] - Switch bounce timeout in ms"},
+   {"add_event_callback", (PyCFunction)py_add_event_callback, METH_VARARGS | METH_KEYWORDS, "Add a callback for an event already defined using add_event_detect()\nchannel      - either board pin number or BCM number depending on which mode is set.\ncallback     - a callback function\n[bouncetime] - Switch bounce timeout in ms, applies to all events of the channel\n[timestamped] - Call the callback as callback(event) with an Event, see add_event_detect()"},
+   {"rejected_events", py_rejected_events, METH_VARARGS, "Returns the number of edges rejected by the switch bounce and glitch filter of a channel\nchannel - either board pin number or BCM number depending on which mode is set."},
+   {"simulate_events", (PyCFunction)py_simulate_events, METH_VARARGS | METH_KEYWORDS, "Enable edge detection events for a GPIO channel, fed by a synthetic edge generator instead of the pin.\nchannel      - either board pin number or BCM number depending on which mode is set.\nedge         - RISING, FALLING or BOTH\n[schedule]   - SYNTH_FIXED (default), SYNTH_BURST, SYNTH_POISSON or SYNTH_SQUARE\n[interval]   - Time between edges in us (mean time for SYNTH_POISSON, half period for SYNTH_SQUARE)\n[burst]      - Edges per burst for SYNTH_BURST\n[gap]        - Idle time between bursts in us for SYNTH_BURST\n[jitter]     - Maximum edge displacement in us for SYNTH_SQUARE\n[count]      - Number of edges to generate, 0 for unlimited\n[callback]   - A callback function for the event (optional)\n[bouncetime] - Switch bounce timeout in ms, see add_event_detect()\n[stabletime] - Time in us the new level must hold before an edge is accepted\n[minpulse]   - Pulses shorter than this time in us are ignored, both of their edges, other edges are delayed by it\n[burstwindow] - Coalesce edges into one callback per window of this many us\n[burstcount]  - Coalesce edges into one callback per this many edges\nWith burstwindow or burstcount set the callback is called as callback(channel, (count, first, last, level)), timestamps in us\n[counting]    - Only count the edges, see count(), count_and_reset() and counts()\n[timestamped] - Call the callback as callback(event) with an Event, see add_event_detect()"},
+   {"set_callback_executor", (PyCFunction)py_set_callback_executor, METH_VARARGS | METH_KEYWORDS, "Set how event callbacks are run, so slow callbacks do not hold up edge detection\n[threads]    - Number of threads running the callbacks (default 1), 0 runs them on the edge detection thread\n[queue_size] - Number of events that can wait for a callback thread (default 1024)\n[overflow]   - What to do when the queue is full: DROP_OLDEST (default), DROP_NEWEST or COALESCE"},
+   {"callback_queue_stats", py_callback_queue_stats, METH_NOARGS, "Returns a dict with the queued, dropped, coalesced, high_water and size figures of the callback queue"},
+   {"wait_for_any", (PyCFunction)py_wait_for_any, METH_VARARGS | METH_KEYWORDS, "Wait for an edge on any of several channels.\nchannels  - list or tuple of board pin numbers or BCM numbers depending on which mode is set.\nedge      - RISING, FALLING or BOTH\n[timeout] - Timeout in ms, -1 (default) waits forever\nReturns (channel, timestamp in us) of the first edge, or None on timeout"},
+   {"count", py_count, METH_VARARGS, "Returns the number of edges counted on a channel set up with add_event_detect(..., counting=True)\nchannel - either board pin number or BCM number depending on which mode is set."},
+   {"count_and_reset", py_count_and_reset, METH_VARARGS, "Returns the number of edges counted on a channel and sets the counter back to 0 in one step\nchannel - either board pin number or BCM number depending on which mode is set."},
+   {"counts", (PyCFunction)py_counts, METH_VARARGS | METH_KEYWORDS, "Returns a list with the edge counts of several channels\nchannels - list or tuple of board pin numbers or BCM numbers depending on which mode is set.\n[reset]  - Set the counters back to 0 in the same step"},
+   {"measure", (PyCFunction)py_measure, METH_VARARGS | METH_KEYWORDS, "Returns a dict with the period, high time (in us), duty cycle and frequency (in Hz) of the signal on a channel with event detection\nEach as the last value, and period and high time with _min, _max and _avg (moving average) values, plus the number of periods and the timestamp of the last edge\nchannel - either board pin number or BCM number depending on which mode is set.\n[reset] - Start the statistics over after reading them"},
+   {"add_reflex", (PyCFunction)py_add_reflex, METH_VARARGS | METH_KEYWORDS, "Add a rule that drives outputs from an edge on the edge detection thread, without calling into Python\nchannel   - input channel with event detection, either board pin number or BCM number depending on which mode is set.\nedge      - RISING, FALLING or BOTH, whatever edge type the channel's event detection was set up for\n[set]     - List of output channels to set HIGH\n[clear]   - List of output channels to set LOW\n[toggle]  - List of output channels to invert\n[pwm]     - (channel, frequency, dutycycle) of a software PWM output to start\n[delay]   - Time in us from the edge to the action (default 0), edges while an action is pending are ignored\n[oneshot] - Remove the rule after it has acted once\nReturns the id of the rule, rules are removed with their input's event detection"},
+   {"remove_reflex", py_remove_reflex, METH_VARARGS, "Remove a rule added with add_reflex()\nid - the id returned by add_reflex()"},
+   {"add_pattern", (PyCFunction)py_add_pattern, METH_VARARGS | METH_KEYWORDS, "Add a trigger on the levels of several channels, checked against one snapshot of all levels on every edge, both edges whatever edge type a channel was set up for\n[high]     - List of channels that must be HIGH\n[low]      - List of channels that must be LOW\n[callback] - Called as callback(id, matched, timestamp) when the levels start or stop matching, timestamp in us\n[poll]     - Also check every this many us, for changes on outputs or channels without edges (default 0, edges only)\nInput channels without event detection get it added. Returns the id of the pattern"},
+   {"pattern_state", py_pattern_state, METH_VARARGS, "Returns (matched, entries, exits) of a pattern, entries and exits count how often the levels started and stopped matching\nid - the id returned by add_pattern()"},
+   {"remove_pattern", py_remove_pattern, METH_VARARGS, "Remove a pattern added with add_pattern()\nid - the id returned by add_pattern()"},
+   {"stats", (PyCFunction)py_stats, METH_VARARGS | METH_KEYWORDS, "Returns a dict with the event telemetry of a channel: the seen, bounced, dropped and delivered counters,\nand latency (edge to callback) and duration (of the callbacks) histograms as lists of counts,\nitem 0 for 0 us and item n for 2**(n-1) to 2**n - 1 us, the last item holding anything longer\n[channel] - either board pin number or BCM number depending on which mode is set. Without it a dict of channel: stats for all channels with event detection"},
+   {"reset_stats", (PyCFunction)py_reset_stats, METH_VARARGS | METH_KEYWORDS, "Set the event telemetry counters back to 0\n[channel] - either board pin number or BCM number depending on which mode is set. Without it all channels are reset"},
+   {"trace_start", py_trace_start, METH_NOARGS, "Start recording a trace of output writes, captured edges, callbacks and PWM sleeps, the records of an earlier trace are dropped"},
+   {"trace_stop", py_trace_stop, METH_NOARGS, "Stop recording the trace"},
+   {"trace_dump", py_trace_dump, METH_VARARGS, "Stop recording and write the trace as Chrome trace JSON, for chrome://tracing or Perfetto\npath - name of the file to write"},
+   {"record_start", (PyCFunction)py_record_start, METH_VARARGS | METH_KEYWORDS, "Record every captured edge from the edge detection thread into memory mapped segment files path.000000, path.000001, ...\nRead them back with RPi.recording, or convert to CSV with python -m RPi.recording path\nThe segment files of an earlier recording to the same path are deleted\npath              - base name of the segment files\n[channels]        - List of channels to record (default all channels with event detection)\n[segment_records] - Records per segment file (default 65536, 16 bytes each)\n[segments]        - Number of segment files to keep, older ones are deleted (default 0, keep all)"},
+   {"record_stop", py_record_stop, METH_NOARGS, "Stop recording edges"},
+   {"record_stats", py_record_stats, METH_NOARGS, "Returns a dict with the records written, the segments started and the records lost because a segment file could not be made"},
+   {"replay_events", (PyCFunction)py_replay_events, METH_VARARGS | METH_KEYWORDS, "Replay a recording made with record_start() through edge detection, the filters and the callbacks as if the edges happened now\npath         - base name of the recording\n[edge]       - RISING, FALLING or BOTH (default)\n[speed]      - 1.0 (default) replays with the recorded timing, 2.0 twice as fast, 0 as fast as possible\n[channels]   - List of channels to replay (default all channels in the recording)\n[callback]   - A callback function for the events of every replayed channel (optional)\n[bouncetime] - Switch bounce timeout in ms, see add_event_detect()\n[timestamped] - Call the callback as callback(event) with an Event, see add_event_detect()\nEdge detection is enabled on the replayed channels until replay_stop()"},
+   {"replay_stop", py_replay_stop, METH_NOARGS, "Stop a replay and remove edge detection from the replayed channels"},
+   {"replay_stats", py_replay_stats, METH_NOARGS, "Returns a dict with the edges replayed, the time in us the replay took so far or in total, and whether it is running"},
+   {"sampler_start", (PyCFunction)py_sampler_start, METH_VARARGS | METH_KEYWORDS, "Start the logic analyser, sampling the levels of GPIO 0-31 in one register read at a fixed rate into a ring buffer\nrate         - Samples per second, up to 1000000 (busy waits between samples)\nsamples      - Size of the capture in samples\n[high]       - List of channels that must be high for the trigger\n[low]        - List of channels that must be low for the trigger\n[pretrigger] - Samples kept from before the trigger\n[cpu]        - Core to pin the sampling thread to, e.g. one kept free with isolcpus (default -1, any)\n[encoding]   - SAMPLER_RAW (default) stores every sample, SAMPLER_RLE only the changes as (samples since the change before, levels) pairs, and samples and pretrigger count those pairs\nWith a trigger the capture ends by itself when it is full, without one the ring keeps the latest samples until sampler_stop()"},
+   {"sampler_stop", py_sampler_stop, METH_NOARGS, "Stop the logic analyser, the samples taken so far are kept"},
+   {"sampler_state", py_sampler_state, METH_NOARGS, "Returns a dict with the state (SAMPLER_IDLE, SAMPLER_ARMED, SAMPLER_TRIGGERED or SAMPLER_DONE), the samples taken and the sample times missed"},
+   {"sampler_data", py_sampler_data, METH_NOARGS, "Returns the last capture as a SampleBuffer, oldest sample first, or None while sampling. Shares the samples without copying"},
+   {"sampler_save_vcd", (PyCFunction)py_sampler_save_vcd, METH_VARARGS | METH_KEYWORDS, "Write the last capture to a value change dump file, for GTKWave or sigrok\npath       - file to write\n[channels] - List of channels to include (default the channels set up, channels of GPIO 0-31 only)\nUse RPi.capture.to_sigrok() for a sigrok session file"},
+   {"decode_uart", (PyCFunction)py_decode_uart, METH_VARARGS | METH_KEYWORDS, "Decode serial characters from a capture, returns a list of (start, end, type, value, value2, flags) frames with times in microseconds\ncapture    - SampleBuffer from sampler_data() or the path of a recording\nchannel    - Channel of the TX or RX line (idle high)\nbaud       - Bits per second\n[bits]     - Data bits, 5 to 9 (default 8)\n[parity]   - 'N' (default), 'E' or 'O'\n[stopbits] - 1 (default) or 2\nflags has DECODE_PARITY_ERROR, DECODE_FRAMING_ERROR and DECODE_INCOMPLETE"},
+   {"decode_spi", (PyCFunction)py_decode_spi, METH_VARARGS | METH_KEYWORDS, "Decode SPI words from a capture, returns a list of (start, end, DECODE_DATA, mosi, miso, flags) frames with times in microseconds\ncapture     - SampleBuffer from sampler_data() or the path of a recording\nclk         - Channel of the clock\n[mosi]      - Channel of MOSI\n[miso]      - Channel of MISO\n[cs]        - Channel of the active low chip select, words are only read while it is low\n[mode]      - SPI mode 0 to 3 (default 0)\n[bits]      - Bits per word, 1 to 32 (default 8)\n[lsb_first] - True if the least significant bit comes first (default False)"},
+   {"decode_i2c", (PyCFunction)py_decode_i2c, METH_VARARGS | METH_KEYWORDS, "Decode I2C transfers from a capture, returns a list of (start, end, type, value, 0, flags) frames with times in microseconds\ncapture - SampleBuffer from sampler_data() or the path of a recording\nscl     - Channel of the clock\nsda     - Channel of the data\ntype is DECODE_START, DECODE_ADDRESS (value is the address byte with the read bit), DECODE_DATA or DECODE_STOP, and flags has DECODE_NACK"},
+   {"decode_onewire", (PyCFunction)py_decode_onewire, METH_VARARGS | METH_KEYWORDS, "Decode 1-Wire bytes at standard speed from a capture, returns a list of (start, end, type, value, 0, flags) frames with times in microseconds\ncapture - SampleBuffer from sampler_data() or the path of a recording\nchannel - Channel of the bus\ntype is DECODE_RESET, with DECODE_PRESENCE in flags when a device answered, or DECODE_DATA"},
+   {"timestamp", py_timestamp, METH_NOARGS, "Returns the current time in microseconds on the clock of the event timestamps and output_at()"},
+   {"output_at", py_output_at, METH_VARARGS, "Queue a change of outputs for an absolute time, made from a separate thread that spins the last 100us\nt        - Time in microseconds, see timestamp(), a time already past is made at once\nchannel  - Channel or list of channels set up as outputs\nvalue    - 0/1 or False/True or LOW/HIGH, or a list of as many values\nChanges for the same time are made in the order queued, see output_at_stats() for how late they were"},
+   {"output_at_cancel", py_output_at_cancel, METH_NOARGS, "Drop the timed outputs not made yet, returns how many"},
+   {"output_at_stats", py_output_at_stats, METH_NOARGS, "Returns a dict of scheduled, executed and pending timed outputs with late_last, late_avg and late_max, the lateness in microseconds"},
+   {"wave_stop", py_wave_stop, METH_NOARGS, "Stop the waveform playing and drop any queued, the outputs keep their last levels"},
+   {"wave_status", py_wave_status, METH_NOARGS, "Returns a dict of playing and queued (True when a Waveform is), steps and loops (steps made and passes played to the end) and late_max, the worst lateness of a step in microseconds"},
+   {"set_thread_config", (PyCFunction)py_set_thread_config, METH_VARARGS | METH_KEYWORDS, "Set the scheduling and cores of the module's threads, applied at once to those running and to those started later\nthreads    - THREAD_POLL (edge detection), THREAD_PWM (software PWM), THREAD_EXECUTOR (callbacks), THREAD_SERVICE (timed outputs, waveforms and timers), or several of them or-ed together, or THREAD_ALL\npolicy     - SCHED_OTHER, SCHED_FIFO or SCHED_RR\n[priority] - 1-99 for SCHED_FIFO and SCHED_RR, 0 for SCHED_OTHER (default)\n[cpus]     - List of cores the threads may run on, e.g. isolated ones (default the cores the process started with)\nReal time priority needs root or CAP_SYS_NICE, see thread_config() for what the threads run with"},
+   {"lock_memory", (PyCFunction)py_lock_memory, METH_VARARGS | METH_KEYWORDS, "Lock all current and future memory of the process so it is never paged out\n[enable]   - False unlocks it (default True)\n[prefault] - Bytes of stack each thread of the module touches as it starts (default 0)\nNeeds root, CAP_IPC_LOCK or a large enough RLIMIT_MEMLOCK"},
+   {"thread_config", py_thread_config, METH_NOARGS, "Returns a dict of the policy, priority and cpus the poll, pwm, executor and service threads run with, their number and the settings the system refused (failed), with memory_locked and prefault"},
+   {"event_fd", (PyCFunction)py_event_fd, METH_VARARGS | METH_KEYWORDS, "Returns an eventfd that is readable while detected events are waiting in the event stream, see read_events()\n[size] - Number of events held by the stream (default 1024), the oldest are dropped when it is full"},
+   {"read_events", (PyCFunction)py_read_events, METH_VARARGS | METH_KEYWORDS, "Returns a list of (channel, level, timestamp, count) tuples from the event stream without blocking, timestamps in us\n[max] - Maximum number of events to return (default 64)"},
+#if PY_VERSION_HEX >= 0x03050000
+   {"edge", (PyCFunction)py_edge, METH_VARARGS | METH_KEYWORDS, "Coroutine waiting for an edge on a channel with event detection, for use with asyncio (Python 3.5 and later)\nchannel   - either board pin number or BCM number depending on which mode is set.\n[timeout] - Timeout in seconds\nReturns a (channel, level, timestamp, count) tuple, or None on timeout"},
+   {"events", (PyCFunction)py_events, METH_VARARGS | METH_KEYWORDS, "Asynchronous iterator of (channel, level, timestamp, count) tuples, for use with asyncio (Python 3.5 and later)\n[channel] - Only report events of this channel (default all channels with event detection)"},
+#endif
+   {"simulated_stats", py_simulated_stats, METH_VARARGS, "Returns (generated, dropped) edge counts of the synthetic edge generator of a channel\nchannel - either board pin number or BCM number depending on which mode is set."},
    {"wait_for_edge", py_wait_for_edge, METH_VARARGS, "Wait for an edge.\nchannel - either board pin number or BCM number depending on which mode is set.\nedge    - RISING, FALLING or BOTH"},
    {"gpio_function", py_gpio_function, METH_VARARGS, "Return the current GPIO function (IN, OUT, PWM, SERIAL, I2C, SPI)\nchannel - either board pin number or BCM number depending on which mode is set."},
    {"setwarnings", py_setwarnings, METH_VARARGS, "Enable or disable warning messages"},
    {NULL, NULL, 0, NULL}
 };
 
-#if PY_MAJOR_VERSION > 2
-static struct PyModuleDef rpigpiomodule = {
-   PyModuleDef_HEAD_INIT,
-   "RPi.GPIO",       // name of module
-   moduledocstring,  // module documentation, may be NULL
-   -1,               // size of per-interpreter state of the module, or -1 if the module keeps state in global variables.
-   rpi_gpio_methods
-};
-#endif
+// registers the classes of the module, they are shared by all interpreters
+static int add_type(PyObject *module, const char *name, PyTypeObject *type)
+{
+   if (type == NULL)
+      return -1;
+   Py_INCREF(type);
+   if (PyModule_AddObject(module, name, (PyObject*)type) != 0)
+   {
+      Py_DECREF(type);
+      return -1;
+   }
+   return 0;
+}
 
-#if PY_MAJOR_VERSION > 2
-PyMODINIT_FUNC PyInit_GPIO(void)
-#else
-PyMODINIT_FUNC initGPIO(void)
-#endif
+// an ending subinterpreter takes its callbacks and timers with it, before it checks that no other thread is in it
+static PyObject *py_end_interpreter(PyObject *self, PyObject *args)
 {
-   PyObject *module = NULL;
+   PyInterpreterState *interp = current_interpreter();
 
-#if PY_MAJOR_VERSION > 2
-   if ((module = PyModule_Create(&rpigpiomodule)) == NULL)
-      return NULL;
-#else
-   if ((module = Py_InitModule3("RPi.GPIO", rpi_gpio_methods, moduledocstring)) == NULL)
-      return;
-#endif
+   remove_interpreter_callbacks(interp);
+   py_timers_remove_interpreter(interp);
+   Py_BEGIN_ALLOW_THREADS // disable GIL
+   wait_interpreter_calls();
+   Py_END_ALLOW_THREADS   // enable GIL
+   Py_RETURN_NONE;
+}
+
+static PyMethodDef end_interpreter_def = {"_end_interpreter", py_end_interpreter, METH_NOARGS, NULL};
+
+// runs for each interpreter importing the module
+static int gpio_exec(PyObject *module)
+{
+   PyObject *rpi_revision, *atexit, *func, *result;
+   int registered;
 
+#ifdef MULTI_PHASE_INIT
+   WARNINGS(module) = 1;
+#endif
    define_constants(module);
 
    // detect board revision and set up accordingly
@@ -627,11 +2612,7 @@ PyMODINIT_FUNC initGPIO(void)
    {
       PyErr_SetString(PyExc_RuntimeError, "This module can only be run on a Raspberry Pi!");
       setup_error = 1;
-#if PY_MAJOR_VERSION > 2
-      return NULL;
-#else
-      return;
-#endif
+      return -1;
    } else if (revision == 1) {
       pin_to_gpio = &pin_to_gpio_rev1;
    } else { // assume revision 2
@@ -639,47 +2620,126 @@ PyMODINIT_FUNC initGPIO(void)
    }
 
    rpi_revision = Py_BuildValue("i", revision);
-   PyModule_AddObject(module, "RPI_REVISION", rpi_revision);
+   if (PyModule_AddObject(module, "RPI_REVISION", rpi_revision) != 0)
+   {
+      Py_XDECREF(rpi_revision);
+      return -1;
+   }
 
-   // Add PWM class
-   if (PWM_init_PWMType() == NULL)
-#if PY_MAJOR_VERSION > 2
-      return NULL;
+   if (add_type(module, "PWM", PWM_init_PWMType()) != 0 ||
+       add_type(module, "SampleBuffer", SampleBuffer_init_type()) != 0 ||
+       add_type(module, "Waveform", Waveform_init_type()) != 0 ||
+       add_type(module, "Timer", Timer_init_type()) != 0 ||
+       add_type(module, "Pin", Pin_init_type()) != 0)
+      return -1;
+
+   // Add Event class, a struct sequence made once for all interpreters
+#if PY_VERSION_HEX >= 0x03040000
+   if (EventType.tp_name == NULL && PyStructSequence_InitType2(&EventType, &event_desc) != 0)
+      return -1;
 #else
-      return;
+   if (EventType.tp_name == NULL)
+      PyStructSequence_InitType(&EventType, &event_desc);
 #endif
-   Py_INCREF(&PWMType);
-   PyModule_AddObject(module, "PWM", (PyObject*)&PWMType);
+   if (add_type(module, "Event", &EventType) != 0)
+      return -1;
 
+#if PY_VERSION_HEX < 0x03070000
    if (!PyEval_ThreadsInitialized())
       PyEval_InitThreads();
+#endif
+
+   // real time settings of the module's threads from the environment
+   if (rt_config_from_env() > 0 &&
+       PyErr_WarnEx(NULL, "Invalid or refused entries in " RT_ENV " were ignored", 1) == -1)
+      return -1;
 
-   // register exit functions - last declared is called first
-   if (Py_AtExit(cleanup) != 0)
+   // the main interpreter cleans up at process exit, subinterpreters when they end
+   if (current_interpreter() != NULL)
    {
-      setup_error = 1;
-      cleanup();
-#if PY_MAJOR_VERSION > 2
-      return NULL;
-#else
-      return;
-#endif
+      if ((atexit = PyImport_ImportModule("atexit")) == NULL)
+         return -1;
+      func = PyCFunction_New(&end_interpreter_def, NULL);
+      result = func == NULL ? NULL : PyObject_CallMethod(atexit, "register", "O", func);
+      Py_XDECREF(func);
+      Py_DECREF(atexit);
+      if (result == NULL)
+         return -1;
+      Py_DECREF(result);
    }
 
-   if (Py_AtExit(event_cleanup) != 0)
+   // register exit functions once per process - last declared is called first
+   pthread_mutex_lock(&init_lock);
+   registered = exit_registered;
+   exit_registered = 1;
+   pthread_mutex_unlock(&init_lock);
+   if (registered)
+      return 0;
+
+   if (Py_AtExit(cleanup) != 0 || Py_AtExit(event_cleanup) != 0)
    {
       setup_error = 1;
       cleanup();
+      return -1;
+   }
+   return 0;
+}
+
+#ifdef MULTI_PHASE_INIT
+static PyModuleDef_Slot rpi_gpio_slots[] = {
+   {Py_mod_exec, (void *)gpio_exec},
+#ifdef Py_mod_multiple_interpreters
+   // the classes are static types, so subinterpreters share the GIL of the main one
+   {Py_mod_multiple_interpreters, Py_MOD_MULTIPLE_INTERPRETERS_SUPPORTED},
+#endif
+#ifdef Py_GIL_DISABLED
+   {Py_mod_gil, Py_MOD_GIL_NOT_USED},
+#endif
+   {0, NULL}
+};
+#endif
+
 #if PY_MAJOR_VERSION > 2
-      return NULL;
+static struct PyModuleDef rpigpiomodule = {
+   PyModuleDef_HEAD_INIT,
+   "RPi.GPIO",       // name of module
+   moduledocstring,  // module documentation, may be NULL
+#ifdef MULTI_PHASE_INIT
+   sizeof(struct module_state), // size of per-interpreter state of the module
+   rpi_gpio_methods,
+   rpi_gpio_slots
 #else
-      return;
+   -1,               // size of per-interpreter state of the module, or -1 if the module keeps state in global variables.
+   rpi_gpio_methods
+#endif
+};
 #endif
-   }
 
 #if PY_MAJOR_VERSION > 2
-   return module;
+PyMODINIT_FUNC PyInit_GPIO(void)
+{
+#ifdef MULTI_PHASE_INIT
+   return PyModuleDef_Init(&rpigpiomodule);
 #else
-   return;
+   PyObject *module;
+
+   if ((module = PyModule_Create(&rpigpiomodule)) == NULL)
+      return NULL;
+   if (gpio_exec(module) != 0)
+   {
+      Py_DECREF(module);
+      return NULL;
+   }
+   return module;
 #endif
 }
+#else
+PyMODINIT_FUNC initGPIO(void)
+{
+   PyObject *module;
+
+   if ((module = Py_InitModule3("RPi.GPIO", rpi_gpio_methods, moduledocstring)) == NULL)
+      return;
+   gpio_exec(module);
+}
+#endif
@@ -0,0 +1,204 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "Python.h"
+#include "structmember.h"
+#include "c_gpio.h"
+#include "py_pin.h"
+#include "common.h"
+
+typedef struct
+{
+   PyObject_HEAD
+   int channel;
+   struct gpio_pin pin;    // resolved once, the methods take no arguments to parse
+} PinObject;
+
+static PyObject *level_object(int value)
+{
+#if PY_MAJOR_VERSION > 2
+   return PyLong_FromLong(value);
+#else
+   return PyInt_FromLong(value);
+#endif
+}
+
+static int check_output(PinObject *self)
+{
+   if (gpio_direction[self->pin.gpio] != OUTPUT)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "The GPIO channel has not been set up as an OUTPUT");
+      return 1;
+   }
+   return 0;
+}
+
+// python method Pin.__init__(self, channel)
+static int Pin_init(PinObject *self, PyObject *args, PyObject *kwargs)
+{
+   unsigned int gpio;
+   int channel;
+   static char *kwlist[] = {"channel", NULL};
+
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "i", kwlist, &channel))
+      return -1;
+
+   if (get_gpio_number(channel, &gpio))
+      return -1;
+
+   self->channel = channel;
+   resolve_pin(gpio, &self->pin);
+   return 0;
+}
+
+// python method Pin.high(self)
+static PyObject *Pin_high(PinObject *self, PyObject *unused)
+{
+   if (check_output(self))
+      return NULL;
+   output_pin(&self->pin, HIGH);
+   Py_RETURN_NONE;
+}
+
+// python method Pin.low(self)
+static PyObject *Pin_low(PinObject *self, PyObject *unused)
+{
+   if (check_output(self))
+      return NULL;
+   output_pin(&self->pin, LOW);
+   Py_RETURN_NONE;
+}
+
+// python method value = Pin.toggle(self)
+static PyObject *Pin_toggle(PinObject *self, PyObject *unused)
+{
+   if (check_output(self))
+      return NULL;
+   return level_object(toggle_pin(&self->pin));
+}
+
+// python method Pin.write(self, value)
+static PyObject *Pin_write(PinObject *self, PyObject *value)
+{
+   int level;
+
+   if (check_output(self))
+      return NULL;
+   if ((level = PyObject_IsTrue(value)) == -1)
+      return NULL;
+   output_pin(&self->pin, level);
+   Py_RETURN_NONE;
+}
+
+// python method value = Pin.read(self)
+static PyObject *Pin_read(PinObject *self, PyObject *unused)
+{
+   // check channel is set up as an input or output
+   if (gpio_direction[self->pin.gpio] != INPUT && gpio_direction[self->pin.gpio] != OUTPUT)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "You must setup() the GPIO channel first");
+      return NULL;
+   }
+   return level_object(input_pin(&self->pin));
+}
+
+static PyObject *Pin_repr(PinObject *self)
+{
+#if PY_MAJOR_VERSION > 2
+   return PyUnicode_FromFormat("<RPi.GPIO.Pin channel=%d gpio=%d>", self->channel, self->pin.gpio);
+#else
+   return PyString_FromFormat("<RPi.GPIO.Pin channel=%d gpio=%d>", self->channel, self->pin.gpio);
+#endif
+}
+
+// deallocation method
+static void Pin_dealloc(PinObject *self)
+{
+   Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyMethodDef
+Pin_methods[] = {
+   { "high", (PyCFunction)Pin_high, METH_NOARGS, "Set the output HIGH" },
+   { "low", (PyCFunction)Pin_low, METH_NOARGS, "Set the output LOW" },
+   { "toggle", (PyCFunction)Pin_toggle, METH_NOARGS, "Invert the output, returns the new level" },
+   { "write", (PyCFunction)Pin_write, METH_O, "Set the output to value, any true value is HIGH" },
+   { "read", (PyCFunction)Pin_read, METH_NOARGS, "Returns the level of the channel, HIGH or LOW" },
+   { NULL }
+};
+
+static PyMemberDef
+Pin_members[] = {
+   { "channel", T_INT, offsetof(PinObject, channel), READONLY, "The channel in the numbering mode of the constructor" },
+   { "gpio", T_INT, offsetof(PinObject, pin.gpio), READONLY, "The BCM GPIO number" },
+   { NULL }
+};
+
+PyTypeObject PinType = {
+   PyVarObject_HEAD_INIT(NULL,0)
+   "RPi.GPIO.Pin",            // tp_name
+   sizeof(PinObject),         // tp_basicsize
+   0,                         // tp_itemsize
+   (destructor)Pin_dealloc,   // tp_dealloc
+   0,                         // tp_print
+   0,                         // tp_getattr
+   0,                         // tp_setattr
+   0,                         // tp_compare
+   (reprfunc)Pin_repr,        // tp_repr
+   0,                         // tp_as_number
+   0,                         // tp_as_sequence
+   0,                         // tp_as_mapping
+   0,                         // tp_hash
+   0,                         // tp_call
+   0,                         // tp_str
+   0,                         // tp_getattro
+   0,                         // tp_setattro
+   0,                         // tp_as_buffer
+   Py_TPFLAGS_DEFAULT,        // tp_flag
+   "Pin(channel), a channel resolved once to its GPIO number and register bits, for tight loops.\nThe methods take no arguments to parse, set the channel up with setup() first",    // tp_doc
+   0,                         // tp_traverse
+   0,                         // tp_clear
+   0,                         // tp_richcompare
+   0,                         // tp_weaklistoffset
+   0,                         // tp_iter
+   0,                         // tp_iternext
+   Pin_methods,               // tp_methods
+   Pin_members,               // tp_members
+   0,                         // tp_getset
+   0,                         // tp_base
+   0,                         // tp_dict
+   0,                         // tp_descr_get
+   0,                         // tp_descr_set
+   0,                         // tp_dictoffset
+   (initproc)Pin_init,        // tp_init
+   0,                         // tp_alloc
+   0,                         // tp_new
+};
+
+PyTypeObject *Pin_init_type(void)
+{
+   PinType.tp_new = PyType_GenericNew;
+   if (PyType_Ready(&PinType) < 0)
+      return NULL;
+
+   return &PinType;
+}
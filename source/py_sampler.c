@@ -0,0 +1,219 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "Python.h"
+#include "sampler.h"
+#include "py_sampler.h"
+
+// a capture of the logic analyser, its samples are shared through the buffer protocol without copying
+typedef struct
+{
+   PyObject_HEAD
+   struct sample_block *block;
+   int ndim;
+   Py_ssize_t shape[2];
+   Py_ssize_t strides[2];
+} SampleBufferObject;
+
+// deallocation method
+static void SampleBuffer_dealloc(SampleBufferObject *self)
+{
+   if (self->block != NULL)
+      sampler_release(self->block);
+   Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+// buffer protocol, a read only array of unsigned 32 bit samples, or of (delta, levels) rows with SAMPLER_RLE
+static int SampleBuffer_getbuffer(SampleBufferObject *self, Py_buffer *view, int flags)
+{
+   if (flags & PyBUF_WRITABLE)
+   {
+      PyErr_SetString(PyExc_BufferError, "Samples are read only");
+      return -1;
+   }
+   view->obj = (PyObject *)self;
+   Py_INCREF(self);
+   view->buf = self->block->samples;
+   view->len = self->shape[0] * self->strides[0];
+   view->readonly = 1;
+   if (flags & PyBUF_ND)
+   {
+      view->format = (flags & PyBUF_FORMAT) ? "I" : NULL;
+      view->itemsize = sizeof(unsigned int);
+      view->ndim = self->ndim;
+      view->shape = self->shape;
+   } else {
+      // plain bytes for consumers that do not ask for the shape
+      view->format = NULL;
+      view->itemsize = 1;
+      view->ndim = 1;
+      view->shape = NULL;
+   }
+   view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? self->strides : NULL;
+   view->suboffsets = NULL;
+   view->internal = NULL;
+   return 0;
+}
+
+static Py_ssize_t SampleBuffer_length(SampleBufferObject *self)
+{
+   return self->shape[0];
+}
+
+static PyObject *SampleBuffer_item(SampleBufferObject *self, Py_ssize_t i)
+{
+   if (i < 0 || i >= self->shape[0])
+   {
+      PyErr_SetString(PyExc_IndexError, "sample index out of range");
+      return NULL;
+   }
+   if (self->block->encoding == SAMPLER_RLE)
+      return Py_BuildValue("(II)", self->block->samples[2 * i], self->block->samples[2 * i + 1]);
+   return Py_BuildValue("I", self->block->samples[i]);
+}
+
+static PyObject *SampleBuffer_get_rate(SampleBufferObject *self, void *closure)
+{
+   return Py_BuildValue("I", self->block->rate);
+}
+
+static PyObject *SampleBuffer_get_encoding(SampleBufferObject *self, void *closure)
+{
+   return Py_BuildValue("i", self->block->encoding);
+}
+
+static PyObject *SampleBuffer_get_span(SampleBufferObject *self, void *closure)
+{
+   return Py_BuildValue("K", self->block->span);
+}
+
+static PyObject *SampleBuffer_get_trigger(SampleBufferObject *self, void *closure)
+{
+   if (self->block->trigger < 0)
+      Py_RETURN_NONE;
+   return Py_BuildValue("L", self->block->trigger);
+}
+
+static PySequenceMethods SampleBuffer_as_sequence = {
+   (lenfunc)SampleBuffer_length,      // sq_length
+   0,                                 // sq_concat
+   0,                                 // sq_repeat
+   (ssizeargfunc)SampleBuffer_item,   // sq_item
+};
+
+static PyBufferProcs SampleBuffer_as_buffer = {
+#if PY_MAJOR_VERSION < 3
+   0,                                 // bf_getreadbuffer
+   0,                                 // bf_getwritebuffer
+   0,                                 // bf_getsegcount
+   0,                                 // bf_getcharbuffer
+#endif
+   (getbufferproc)SampleBuffer_getbuffer,   // bf_getbuffer
+   0,                                 // bf_releasebuffer
+};
+
+static PyGetSetDef
+SampleBuffer_getset[] = {
+   { "rate", (getter)SampleBuffer_get_rate, NULL, "Samples per second", NULL },
+   { "trigger", (getter)SampleBuffer_get_trigger, NULL, "Index of the trigger sample (entry with SAMPLER_RLE), None if the capture did not trigger", NULL },
+   { "encoding", (getter)SampleBuffer_get_encoding, NULL, "SAMPLER_RAW or SAMPLER_RLE", NULL },
+   { "span", (getter)SampleBuffer_get_span, NULL, "Samples from the first one captured to the last", NULL },
+   { NULL }
+};
+
+PyTypeObject SampleBufferType = {
+   PyVarObject_HEAD_INIT(NULL,0)
+   "RPi.GPIO.SampleBuffer",   // tp_name
+   sizeof(SampleBufferObject),   // tp_basicsize
+   0,                         // tp_itemsize
+   (destructor)SampleBuffer_dealloc,   // tp_dealloc
+   0,                         // tp_print
+   0,                         // tp_getattr
+   0,                         // tp_setattr
+   0,                         // tp_compare
+   0,                         // tp_repr
+   0,                         // tp_as_number
+   &SampleBuffer_as_sequence, // tp_as_sequence
+   0,                         // tp_as_mapping
+   0,                         // tp_hash
+   0,                         // tp_call
+   0,                         // tp_str
+   0,                         // tp_getattro
+   0,                         // tp_setattro
+   &SampleBuffer_as_buffer,   // tp_as_buffer
+#if PY_MAJOR_VERSION < 3
+   Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER, // tp_flag
+#else
+   Py_TPFLAGS_DEFAULT,        // tp_flag
+#endif
+   "Logic analyser capture, one unsigned 32 bit sample of the levels of gpios 0-31 per item.\nWith SAMPLER_RLE each item is a (samples since the item before, levels) pair, and the buffer has two columns.\nSupports the buffer protocol, e.g. numpy.frombuffer(buf, numpy.uint32) or memoryview(buf) without copying",    // tp_doc
+   0,                         // tp_traverse
+   0,                         // tp_clear
+   0,                         // tp_richcompare
+   0,                         // tp_weaklistoffset
+   0,                         // tp_iter
+   0,                         // tp_iternext
+   0,                         // tp_methods
+   0,                         // tp_members
+   SampleBuffer_getset,       // tp_getset
+};
+
+PyTypeObject *SampleBuffer_init_type(void)
+{
+   if (PyType_Ready(&SampleBufferType) < 0)
+      return NULL;
+
+   return &SampleBufferType;
+}
+
+PyObject *sample_buffer_new(struct sample_block *block)
+// takes over the reference to block
+{
+   SampleBufferObject *self;
+
+   if ((self = PyObject_New(SampleBufferObject, &SampleBufferType)) == NULL)
+   {
+      sampler_release(block);
+      return NULL;
+   }
+   self->block = block;
+   self->shape[0] = block->length;
+   if (block->encoding == SAMPLER_RLE)
+   {
+      self->ndim = 2;
+      self->shape[1] = 2;
+      self->strides[0] = 2 * sizeof(unsigned int);
+      self->strides[1] = sizeof(unsigned int);
+   } else {
+      self->ndim = 1;
+      self->strides[0] = sizeof(unsigned int);
+   }
+   return (PyObject *)self;
+}
+
+struct sample_block *sample_buffer_block(PyObject *obj)
+// the capture behind a SampleBuffer, or NULL if obj is not one
+{
+   if (!PyObject_TypeCheck(obj, &SampleBufferType))
+      return NULL;
+   return ((SampleBufferObject *)obj)->block;
+}
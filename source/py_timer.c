@@ -0,0 +1,352 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <pthread.h>
+#include "Python.h"
+#include "c_gpio.h"
+#include "event_gpio.h"
+#include "event_timer.h"
+#include "py_timer.h"
+#include "common.h"
+
+typedef struct
+{
+   PyObject_HEAD
+   int id;                 // -1 once cancelled
+   PyObject *callback;
+} TimerObject;
+
+// the running timers by id with the interpreter they were made in, and the callbacks running for each
+static TimerObject *timer_objects[TIMER_MAX];
+static PyInterpreterState *timer_interp[TIMER_MAX];
+static int timer_calls[TIMER_MAX];
+static pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timer_call_done = PTHREAD_COND_INITIALIZER;
+
+static void run_py_timer(struct gpio_event *ev)
+{
+   PyObject *result;
+   PyObject *callback = NULL;
+   PyGILState_STATE gstate;
+   PyThreadState *tstate;
+   PyInterpreterState *interp;
+   int id = ev->gpio - TIMER_GPIO;
+
+   pthread_mutex_lock(&timer_lock);
+   interp = timer_interp[id];
+   if (timer_objects[id] == NULL)
+   {
+      pthread_mutex_unlock(&timer_lock);
+      return;
+   }
+   timer_calls[id]++;
+   pthread_mutex_unlock(&timer_lock);
+
+   tstate = enter_interpreter(interp, &gstate);
+   pthread_mutex_lock(&timer_lock);
+   if (timer_objects[id] != NULL && timer_interp[id] == interp && timer_objects[id]->callback != NULL)
+   {
+      callback = timer_objects[id]->callback;
+      Py_INCREF(callback);   // the callback may cancel its own timer
+   }
+   pthread_mutex_unlock(&timer_lock);
+   if (callback != NULL)
+   {
+      result = PyObject_CallFunction(callback, "K", ev->timestamp);
+      if (result == NULL && PyErr_Occurred())
+      {
+         PyErr_Print();
+         PyErr_Clear();
+      }
+      Py_XDECREF(result);
+      Py_DECREF(callback);
+   }
+   leave_interpreter(tstate, gstate);
+   pthread_mutex_lock(&timer_lock);
+   timer_calls[id]--;
+   pthread_cond_broadcast(&timer_call_done);
+   pthread_mutex_unlock(&timer_lock);
+}
+
+static void Timer_remove(TimerObject *self)
+{
+   if (self->id < 0)
+      return;
+   pthread_mutex_lock(&timer_lock);
+   timer_objects[self->id] = NULL;
+   pthread_mutex_unlock(&timer_lock);
+   remove_timer(self->id);
+   self->id = -1;
+}
+
+void py_timers_cleanup(void)
+// the timers have been removed by event_cleanup()
+{
+   int i;
+
+   pthread_mutex_lock(&timer_lock);
+   for (i = 0; i < TIMER_MAX; i++)
+   {
+      if (timer_objects[i] != NULL)
+      {
+         timer_objects[i]->id = -1;
+         timer_objects[i] = NULL;
+      }
+   }
+   pthread_mutex_unlock(&timer_lock);
+}
+
+void py_timers_remove_interpreter(PyInterpreterState *interp)
+// cancels the timers of an interpreter that is ending and waits for their running callbacks
+{
+   TimerObject *self;
+   int i;
+
+   for (i = 0; i < TIMER_MAX; i++)
+   {
+      pthread_mutex_lock(&timer_lock);
+      self = timer_interp[i] == interp ? timer_objects[i] : NULL;
+      pthread_mutex_unlock(&timer_lock);
+      if (self != NULL)
+         Timer_remove(self);
+   }
+   Py_BEGIN_ALLOW_THREADS // disable GIL
+   pthread_mutex_lock(&timer_lock);
+   for (i = 0; i < TIMER_MAX; i++)
+      while (timer_interp[i] == interp && timer_calls[i] > 0)
+         pthread_cond_wait(&timer_call_done, &timer_lock);
+   pthread_mutex_unlock(&timer_lock);
+   Py_END_ALLOW_THREADS   // enable GIL
+}
+
+static PyObject *Timer_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+   TimerObject *self;
+
+   if ((self = (TimerObject *)type->tp_alloc(type, 0)) != NULL)
+      self->id = -1;
+   return (PyObject *)self;
+}
+
+// python method Timer.__init__(self, period, callback=None, toggle=None, samples=0)
+static int Timer_init(TimerObject *self, PyObject *args, PyObject *kwargs)
+{
+   PyObject *callback = Py_None, *toggle = Py_None, *seq;
+   struct timer_config cfg;
+   unsigned int gpio;
+   int n, i, channel, id;
+   static char *kwlist[] = {"period", "callback", "toggle", "samples", NULL};
+
+   cfg.samples = 0;
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "K|OOI", kwlist, &cfg.period, &callback, &toggle, &cfg.samples))
+      return -1;
+
+   if (cfg.period == 0)
+   {
+      PyErr_SetString(PyExc_ValueError, "period must be greater than 0");
+      return -1;
+   }
+   if (callback != Py_None && !PyCallable_Check(callback))
+   {
+      PyErr_SetString(PyExc_TypeError, "Parameter must be callable");
+      return -1;
+   }
+
+   cfg.toggle = 0;
+   if (toggle != Py_None)
+   {
+      if ((seq = PySequence_Fast(toggle, "toggle must be a list or tuple of channels")) == NULL)
+         return -1;
+      n = PySequence_Fast_GET_SIZE(seq);
+      for (i = 0; i < n; i++)
+      {
+         if (!PyArg_Parse(PySequence_Fast_GET_ITEM(seq, i), "i", &channel) || get_gpio_number(channel, &gpio))
+         {
+            Py_DECREF(seq);
+            return -1;
+         }
+         if (gpio_direction[gpio] != OUTPUT)
+         {
+            Py_DECREF(seq);
+            PyErr_SetString(PyExc_RuntimeError, "The GPIO channel has not been set up as an OUTPUT");
+            return -1;
+         }
+         cfg.toggle |= 1ULL << gpio;
+      }
+      Py_DECREF(seq);
+   }
+
+   Timer_remove(self);
+   Py_CLEAR(self->callback);
+   cfg.callback = callback != Py_None;
+   if ((id = add_timer(&cfg)) == -1)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "Too many timers");
+      return -1;
+   } else if (id == -2) {
+      PyErr_NoMemory();
+      return -1;
+   } else if (id < 0) {
+      PyErr_SetString(PyExc_RuntimeError, "Failed to start the timer thread");
+      return -1;
+   }
+
+   if (cfg.callback)
+   {
+      Py_INCREF(callback);
+      self->callback = callback;
+      if (add_edge_callback(TIMER_GPIO + id, run_py_timer) != 0)
+      {
+         remove_timer(id);
+         PyErr_NoMemory();
+         return -1;
+      }
+   }
+   self->id = id;
+   pthread_mutex_lock(&timer_lock);
+   timer_objects[id] = self;
+   timer_interp[id] = current_interpreter();
+   pthread_mutex_unlock(&timer_lock);
+   return 0;
+}
+
+// python method Timer.cancel(self)
+static PyObject *Timer_cancel(TimerObject *self, PyObject *args)
+{
+   Timer_remove(self);
+   Py_RETURN_NONE;
+}
+
+// python method values = Timer.stats(self)
+static PyObject *Timer_stats(TimerObject *self, PyObject *args)
+{
+   struct timer_stats stats;
+
+   if (self->id < 0 || get_timer_stats(self->id, &stats) != 0)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "The timer has been cancelled");
+      return NULL;
+   }
+   return Py_BuildValue("{s:K,s:K,s:K,s:d,s:d,s:d}",
+                        "ticks", stats.ticks,
+                        "overruns", stats.overruns,
+                        "dropped", stats.dropped,
+                        "late_last", stats.late_last,
+                        "late_avg", stats.late_avg,
+                        "late_max", stats.late_max);
+}
+
+// python method samples = Timer.samples(self)
+static PyObject *Timer_samples(TimerObject *self, PyObject *args)
+{
+   struct timer_sample buf[256];
+   PyObject *list, *item;
+   unsigned int n, i;
+
+   if (self->id < 0)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "The timer has been cancelled");
+      return NULL;
+   }
+   if ((list = PyList_New(0)) == NULL)
+      return NULL;
+   while ((n = timer_samples(self->id, buf, 256)) > 0)
+   {
+      for (i = 0; i < n; i++)
+      {
+         if ((item = Py_BuildValue("(KI)", buf[i].timestamp, buf[i].levels)) == NULL || PyList_Append(list, item) != 0)
+         {
+            Py_XDECREF(item);
+            Py_DECREF(list);
+            return NULL;
+         }
+         Py_DECREF(item);
+      }
+   }
+   return list;
+}
+
+// deallocation method
+static void Timer_dealloc(TimerObject *self)
+{
+   Timer_remove(self);
+   Py_CLEAR(self->callback);
+   Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyMethodDef
+Timer_methods[] = {
+   { "cancel", (PyCFunction)Timer_cancel, METH_NOARGS, "Stop the timer" },
+   { "stats", (PyCFunction)Timer_stats, METH_NOARGS, "Returns a dict of ticks, overruns (ticks skipped because the timer thread was a period or more late), dropped (samples overwritten before they were read) and late_last, late_avg and late_max, the lateness of the ticks in microseconds" },
+   { "samples", (PyCFunction)Timer_samples, METH_NOARGS, "Returns and removes the samples taken so far as a list of (timestamp, levels) tuples, oldest first, bit n of levels is gpio n" },
+   { NULL }
+};
+
+PyTypeObject TimerType = {
+   PyVarObject_HEAD_INIT(NULL,0)
+   "RPi.GPIO.Timer",          // tp_name
+   sizeof(TimerObject),       // tp_basicsize
+   0,                         // tp_itemsize
+   (destructor)Timer_dealloc, // tp_dealloc
+   0,                         // tp_print
+   0,                         // tp_getattr
+   0,                         // tp_setattr
+   0,                         // tp_compare
+   0,                         // tp_repr
+   0,                         // tp_as_number
+   0,                         // tp_as_sequence
+   0,                         // tp_as_mapping
+   0,                         // tp_hash
+   0,                         // tp_call
+   0,                         // tp_str
+   0,                         // tp_getattro
+   0,                         // tp_setattro
+   0,                         // tp_as_buffer
+   Py_TPFLAGS_DEFAULT,        // tp_flag
+   "Timer(period, callback=None, toggle=None, samples=0), ticks at a fixed rate from absolute deadlines on one thread shared by all timers, until cancel() or the timer is deleted.\nperiod     - Time between ticks in microseconds, the first tick is a period from now\n[callback] - Function called with the timestamp the tick was due, on the callback executor\n[toggle]   - List of output channels inverted on each tick, in C\n[samples]  - Size of a ring of the levels of GPIO 0-31 read on each tick in C, see samples()\nTicks the thread is a period or more late for are skipped and counted as overruns",    // tp_doc
+   0,                         // tp_traverse
+   0,                         // tp_clear
+   0,                         // tp_richcompare
+   0,                         // tp_weaklistoffset
+   0,                         // tp_iter
+   0,                         // tp_iternext
+   Timer_methods,             // tp_methods
+   0,                         // tp_members
+   0,                         // tp_getset
+   0,                         // tp_base
+   0,                         // tp_dict
+   0,                         // tp_descr_get
+   0,                         // tp_descr_set
+   0,                         // tp_dictoffset
+   (initproc)Timer_init,      // tp_init
+   0,                         // tp_alloc
+   0,                         // tp_new
+};
+
+PyTypeObject *Timer_init_type(void)
+{
+   TimerType.tp_new = Timer_new;
+   if (PyType_Ready(&TimerType) < 0)
+      return NULL;
+
+   return &TimerType;
+}
@@ -0,0 +1,237 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <pthread.h>
+#include "Python.h"
+#include "waveform.h"
+#include "py_waveform.h"
+#include "c_gpio.h"
+#include "common.h"
+
+// steps compiled once and played from the buffer they were given in, without copying
+typedef struct
+{
+   PyObject_HEAD
+   Py_buffer view;
+   int has_view;
+   struct waveform w;
+} WaveformObject;
+
+// waveforms handed to the player, kept alive until it is done with them
+static WaveformObject *in_player[3] = {NULL, NULL, NULL};
+static pthread_mutex_t in_player_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void waveform_reap(void)
+{
+   WaveformObject *done[3];
+   int i, n = 0;
+
+   pthread_mutex_lock(&in_player_lock);
+   for (i = 0; i < 3; i++)
+   {
+      if (in_player[i] != NULL && !wave_in_use(&in_player[i]->w))
+      {
+         done[n++] = in_player[i];
+         in_player[i] = NULL;
+      }
+   }
+   pthread_mutex_unlock(&in_player_lock);
+   // released outside the lock, deallocating a waveform may reap again
+   for (i = 0; i < n; i++)
+      Py_DECREF(done[i]);
+}
+
+// python method Waveform.__init__(self, steps)
+static int Waveform_init(WaveformObject *self, PyObject *args, PyObject *kwds)
+{
+   PyObject *steps;
+   unsigned int gpio, outputs = 0;
+   int result;
+
+   if (!PyArg_ParseTuple(args, "O", &steps))
+      return -1;
+
+   if (self->has_view)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "Waveform already initialised");
+      return -1;
+   }
+   if (PyObject_GetBuffer(steps, &self->view, PyBUF_C_CONTIGUOUS) != 0)
+      return -1;
+   self->has_view = 1;
+   if (self->view.len == 0 || self->view.len % (WAVE_STEP_WORDS * sizeof(unsigned int)) != 0 ||
+       ((size_t)self->view.buf % sizeof(unsigned int)) != 0)
+   {
+      PyErr_SetString(PyExc_ValueError, "steps must be an aligned buffer of unsigned 32 bit (set, clear, hold) triplets");
+      return -1;
+   }
+
+   for (gpio = 0; gpio < 32; gpio++)
+      if (gpio_direction[gpio] == OUTPUT)
+         outputs |= 1U << gpio;
+   result = wave_compile(&self->w, self->view.buf, self->view.len / (WAVE_STEP_WORDS * sizeof(unsigned int)), outputs);
+   if (result == 1) {
+      PyErr_SetString(PyExc_ValueError, "Every step must hold for at least 1ns");
+   } else if (result == 2) {
+      PyErr_SetString(PyExc_RuntimeError, "The steps change GPIO channels not set up as an OUTPUT");
+   } else if (result == 3) {
+      PyErr_SetString(PyExc_ValueError, "A step can not both set and clear a GPIO");
+   } else if (result != 0) {
+      PyErr_NoMemory();
+   }
+   return result == 0 ? 0 : -1;
+}
+
+static PyObject *Waveform_start(WaveformObject *self, PyObject *args, PyObject *kwargs, int queue)
+{
+   unsigned int repeat = 1;
+   int i, result;
+   static char *kwlist[] = {"repeat", NULL};
+
+   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|I", kwlist, &repeat))
+      return NULL;
+
+   if (self->w.offsets == NULL)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "Waveform not initialised");
+      return NULL;
+   }
+
+   result = wave_play(&self->w, repeat, queue);
+   if (result == 1)
+   {
+      PyErr_SetString(PyExc_RuntimeError, "A waveform is queued already");
+      return NULL;
+   } else if (result != 0) {
+      PyErr_SetString(PyExc_RuntimeError, "Failed to start the waveform thread");
+      return NULL;
+   }
+
+   waveform_reap();
+   pthread_mutex_lock(&in_player_lock);
+   for (i = 0; i < 3; i++)
+   {
+      if (in_player[i] == NULL)
+      {
+         Py_INCREF(self);
+         in_player[i] = self;
+         break;
+      }
+   }
+   pthread_mutex_unlock(&in_player_lock);
+   Py_RETURN_NONE;
+}
+
+// python method Waveform.play(self, repeat=1)
+static PyObject *Waveform_play(WaveformObject *self, PyObject *args, PyObject *kwargs)
+{
+   return Waveform_start(self, args, kwargs, 0);
+}
+
+// python method Waveform.queue(self, repeat=1)
+static PyObject *Waveform_queue(WaveformObject *self, PyObject *args, PyObject *kwargs)
+{
+   return Waveform_start(self, args, kwargs, 1);
+}
+
+static PyObject *Waveform_get_steps(WaveformObject *self, void *closure)
+{
+   return Py_BuildValue("I", self->w.offsets ? self->w.count : 0);
+}
+
+static PyObject *Waveform_get_duration(WaveformObject *self, void *closure)
+{
+   return Py_BuildValue("K", self->w.offsets ? self->w.duration : 0ULL);
+}
+
+// deallocation method, the player holds a reference while it uses the steps
+static void Waveform_dealloc(WaveformObject *self)
+{
+   wave_free(&self->w);
+   if (self->has_view)
+      PyBuffer_Release(&self->view);
+   Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyMethodDef
+Waveform_methods[] = {
+   { "play", (PyCFunction)Waveform_play, METH_VARARGS | METH_KEYWORDS, "Play the waveform at once, replacing any playing or queued\n[repeat] - Times to play it, 0 until stopped or followed by a queued waveform (default 1)" },
+   { "queue", (PyCFunction)Waveform_queue, METH_VARARGS | METH_KEYWORDS, "Play the waveform right after the one playing, ending a repeating one at the end of its pass, or at once if none is\n[repeat] - Times to play it, 0 until stopped or followed by a queued waveform (default 1)" },
+   { NULL }
+};
+
+static PyGetSetDef
+Waveform_getset[] = {
+   { "steps", (getter)Waveform_get_steps, NULL, "Number of steps", NULL },
+   { "duration", (getter)Waveform_get_duration, NULL, "Time one pass takes in ns", NULL },
+   { NULL }
+};
+
+PyTypeObject WaveformType = {
+   PyVarObject_HEAD_INIT(NULL,0)
+   "RPi.GPIO.Waveform",       // tp_name
+   sizeof(WaveformObject),    // tp_basicsize
+   0,                         // tp_itemsize
+   (destructor)Waveform_dealloc,   // tp_dealloc
+   0,                         // tp_print
+   0,                         // tp_getattr
+   0,                         // tp_setattr
+   0,                         // tp_compare
+   0,                         // tp_repr
+   0,                         // tp_as_number
+   0,                         // tp_as_sequence
+   0,                         // tp_as_mapping
+   0,                         // tp_hash
+   0,                         // tp_call
+   0,                         // tp_str
+   0,                         // tp_getattro
+   0,                         // tp_setattro
+   0,                         // tp_as_buffer
+   Py_TPFLAGS_DEFAULT,        // tp_flag
+   "Waveform(steps), a pattern of outputs played from a real time thread at absolute deadlines.\nsteps is a buffer of unsigned 32 bit (set mask, clear mask, hold in ns) triplets for gpios 0-31, e.g. array.array('I') or a numpy uint32 array of shape (n, 3), used without copying, so it must not change while the waveform exists.\nThe gpios changed must be set up as outputs when the waveform is made",    // tp_doc
+   0,                         // tp_traverse
+   0,                         // tp_clear
+   0,                         // tp_richcompare
+   0,                         // tp_weaklistoffset
+   0,                         // tp_iter
+   0,                         // tp_iternext
+   Waveform_methods,          // tp_methods
+   0,                         // tp_members
+   Waveform_getset,           // tp_getset
+   0,                         // tp_base
+   0,                         // tp_dict
+   0,                         // tp_descr_get
+   0,                         // tp_descr_set
+   0,                         // tp_dictoffset
+   (initproc)Waveform_init,   // tp_init
+   0,                         // tp_alloc
+   0,                         // tp_new
+};
+
+PyTypeObject *Waveform_init_type(void)
+{
+   WaveformType.tp_new = PyType_GenericNew;
+   if (PyType_Ready(&WaveformType) < 0)
+      return NULL;
+
+   return &WaveformType;
+}
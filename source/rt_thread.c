@@ -0,0 +1,368 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#define _GNU_SOURCE     // for pthread_setaffinity_np()
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "rt_thread.h"
+
+#define RT_THREADS_MAX 128
+
+struct rt_thread
+{
+    pthread_t thread;
+    int cls;
+    int used;
+};
+
+// the service threads keep the real time priority they always had, the others inherit the scheduling of the
+// thread that started them until their class is configured
+struct rt_config rt_configs[RT_CLASSES] = {{SCHED_OTHER, 0, 0}, {SCHED_OTHER, 0, 0}, {SCHED_OTHER, 0, 0}, {SCHED_FIFO, 50, 0}};
+int rt_configured[RT_CLASSES] = {0, 0, 0, 1};
+unsigned long long rt_failed[RT_CLASSES];
+struct rt_thread rt_threads[RT_THREADS_MAX];     // running threads, so changes apply to them at once
+int rt_locked = 0;
+unsigned int rt_prefault = 0;
+cpu_set_t rt_process_cpus;                      // cores the process started with, for a cpus mask of 0
+pthread_mutex_t rt_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_key_t rt_key;
+pthread_once_t rt_once = PTHREAD_ONCE_INIT;
+
+static const char *rt_class_names[RT_CLASSES] = {"poll", "pwm", "executor", "service"};
+
+static void rt_thread_gone(void *slot)
+// runs as a thread of the library exits, before its pthread_t becomes invalid
+{
+    pthread_mutex_lock(&rt_lock);
+    ((struct rt_thread *)slot)->used = 0;
+    pthread_mutex_unlock(&rt_lock);
+}
+
+static void rt_init(void)
+{
+    int i;
+
+    pthread_key_create(&rt_key, rt_thread_gone);
+    if (sched_getaffinity(0, sizeof(rt_process_cpus), &rt_process_cpus) != 0)
+    {
+        CPU_ZERO(&rt_process_cpus);
+        for (i = 0; i < CPU_SETSIZE; i++)
+            CPU_SET(i, &rt_process_cpus);
+    }
+}
+
+static int apply_config(pthread_t thread, struct rt_config *cfg)
+// called with rt_lock held, returns the number of settings the system refused
+{
+    struct sched_param param;
+    cpu_set_t cpus;
+    int i, refused = 0;
+
+    param.sched_priority = cfg->priority;
+    if (pthread_setschedparam(thread, cfg->policy, &param) != 0)
+        refused++;
+
+    if (cfg->cpus == 0)
+    {
+        cpus = rt_process_cpus;
+    } else {
+        CPU_ZERO(&cpus);
+        for (i = 0; i < 64; i++)
+            if (cfg->cpus & (1ULL << i))
+                CPU_SET(i, &cpus);
+    }
+    if (pthread_setaffinity_np(thread, sizeof(cpus), &cpus) != 0)
+        refused++;
+    return refused;
+}
+
+static void __attribute__((noinline)) prefault_stack(unsigned int size)
+// touches the size bytes of stack below the caller, one write per page
+{
+    volatile unsigned char stack[RT_PREFAULT_MAX] __attribute__((unused));
+    unsigned int i, page = sysconf(_SC_PAGESIZE);
+
+    for (i = 0; i < size; i += page)
+        stack[RT_PREFAULT_MAX - 1 - i] = 0;
+}
+
+void rt_thread_enter(int cls)
+// called by each thread of the library as it starts, applies the configuration of its class
+{
+    struct rt_thread *slot = NULL;
+    unsigned int prefault;
+    int i;
+
+    pthread_once(&rt_once, rt_init);
+    pthread_mutex_lock(&rt_lock);
+    for (i = 0; i < RT_THREADS_MAX && slot == NULL; i++)
+        if (!rt_threads[i].used)
+            slot = &rt_threads[i];
+    if (slot != NULL)
+    {
+        slot->thread = pthread_self();
+        slot->cls = cls;
+        slot->used = 1;
+        pthread_setspecific(rt_key, slot);
+    }
+    if (rt_configured[cls])
+        rt_failed[cls] += apply_config(pthread_self(), &rt_configs[cls]);
+    prefault = rt_prefault;
+    pthread_mutex_unlock(&rt_lock);
+
+    if (prefault > 0)
+        prefault_stack(prefault);
+}
+
+int rt_set_config(int cls, struct rt_config *cfg)
+// applies at once to the running threads of the class and to those started later
+// return values:
+// 0 - Success
+// 1 - Refused by the system for a running thread, e.g. real time priority without root or CAP_SYS_NICE
+// 2 - Invalid configuration
+{
+    int i, refused = 0;
+
+    if (cls < 0 || cls >= RT_CLASSES)
+        return 2;
+    if (cfg->policy != SCHED_OTHER && cfg->policy != SCHED_FIFO && cfg->policy != SCHED_RR)
+        return 2;
+    if (cfg->priority < sched_get_priority_min(cfg->policy) || cfg->priority > sched_get_priority_max(cfg->policy))
+        return 2;
+
+    pthread_once(&rt_once, rt_init);
+    pthread_mutex_lock(&rt_lock);
+    rt_configs[cls] = *cfg;
+    rt_configured[cls] = 1;
+    for (i = 0; i < RT_THREADS_MAX; i++)
+        if (rt_threads[i].used && rt_threads[i].cls == cls)
+            refused += apply_config(rt_threads[i].thread, cfg);
+    rt_failed[cls] += refused;
+    pthread_mutex_unlock(&rt_lock);
+    return refused ? 1 : 0;
+}
+
+int rt_lock_memory(int lock, unsigned int prefault)
+// lock 1 locks all current and future pages of the process in memory, 0 unlocks them
+// threads started from now on touch prefault bytes of their stack first, so they do not fault on it later
+// return values:
+// 0 - Success
+// 1 - Locking refused, needs root, CAP_IPC_LOCK or a large enough RLIMIT_MEMLOCK
+// 2 - prefault larger than RT_PREFAULT_MAX
+{
+    if (prefault > RT_PREFAULT_MAX)
+        return 2;
+
+    pthread_mutex_lock(&rt_lock);
+    if (lock && !rt_locked)
+    {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+        {
+            pthread_mutex_unlock(&rt_lock);
+            return 1;
+        }
+        rt_locked = 1;
+    } else if (!lock && rt_locked) {
+        munlockall();
+        rt_locked = 0;
+    }
+    rt_prefault = prefault;
+    pthread_mutex_unlock(&rt_lock);
+    return 0;
+}
+
+static unsigned long long cpu_mask(cpu_set_t *cpus)
+{
+    unsigned long long mask = 0;
+    int i;
+
+    for (i = 0; i < 64; i++)
+        if (CPU_ISSET(i, cpus))
+            mask |= 1ULL << i;
+    return mask;
+}
+
+void rt_get_status(int cls, struct rt_status *status)
+{
+    struct sched_param param;
+    cpu_set_t cpus;
+    int i, policy;
+
+    pthread_once(&rt_once, rt_init);
+    pthread_mutex_lock(&rt_lock);
+    status->config = rt_configs[cls];
+    status->effective = rt_configs[cls];
+    if (status->effective.cpus == 0)
+        status->effective.cpus = cpu_mask(&rt_process_cpus);
+    status->threads = 0;
+    status->failed = rt_failed[cls];
+    for (i = 0; i < RT_THREADS_MAX; i++)
+    {
+        if (!rt_threads[i].used || rt_threads[i].cls != cls)
+            continue;
+
+        // what the first thread of the class really runs with
+        if (status->threads++ == 0 && pthread_getschedparam(rt_threads[i].thread, &policy, &param) == 0)
+        {
+            status->effective.policy = policy;
+            status->effective.priority = param.sched_priority;
+            if (pthread_getaffinity_np(rt_threads[i].thread, sizeof(cpus), &cpus) == 0)
+                status->effective.cpus = cpu_mask(&cpus);
+        }
+    }
+    pthread_mutex_unlock(&rt_lock);
+}
+
+void rt_get_memory(int *locked, unsigned int *prefault)
+{
+    pthread_mutex_lock(&rt_lock);
+    *locked = rt_locked;
+    *prefault = rt_prefault;
+    pthread_mutex_unlock(&rt_lock);
+}
+
+static int parse_cpus(char *s, unsigned long long *cpus)
+// parses cores such as 3, 1,3 or 2-3 into a mask, returns 0 on success
+{
+    unsigned long first, last;
+    char *end;
+
+    *cpus = 0;
+    while (*s != '\0')
+    {
+        first = last = strtoul(s, &end, 10);
+        if (end == s)
+            return 1;
+        if (*end == '-')
+        {
+            s = end + 1;
+            last = strtoul(s, &end, 10);
+            if (end == s)
+                return 1;
+        }
+        if (first > last || last > 63)
+            return 1;
+        while (first <= last)
+            *cpus |= 1ULL << first++;
+        if (*end == ',')
+            end++;
+        else if (*end != '\0')
+            return 1;
+        s = end;
+    }
+    return *cpus == 0;
+}
+
+static int parse_thread_entry(char *name, char *value)
+// applies <policy>[:<priority>][@<cores>] to the class name, returns 0 on success
+{
+    struct rt_config cfg;
+    char *cpus, *priority, *end;
+    int cls, matched = 0;
+
+    cfg.cpus = 0;
+    cfg.priority = 0;
+    if ((cpus = strchr(value, '@')) != NULL)
+    {
+        *cpus++ = '\0';
+        if (parse_cpus(cpus, &cfg.cpus) != 0)
+            return 1;
+    }
+    if ((priority = strchr(value, ':')) != NULL)
+    {
+        *priority++ = '\0';
+        cfg.priority = strtol(priority, &end, 10);
+        if (end == priority || *end != '\0')
+            return 1;
+    }
+    if (strcmp(value, "other") == 0)
+        cfg.policy = SCHED_OTHER;
+    else if (strcmp(value, "fifo") == 0)
+        cfg.policy = SCHED_FIFO;
+    else if (strcmp(value, "rr") == 0)
+        cfg.policy = SCHED_RR;
+    else
+        return 1;
+
+    for (cls = 0; cls < RT_CLASSES; cls++)
+    {
+        if (strcmp(name, "all") != 0 && strcmp(name, rt_class_names[cls]) != 0)
+            continue;
+        matched = 1;
+        if (rt_set_config(cls, &cfg) == 2)
+            return 1;
+    }
+    return !matched;
+}
+
+int rt_config_from_env(void)
+// applies the RPI_GPIO_RT environment variable, entries separated by spaces or semicolons:
+//   <threads>=<policy>[:<priority>][@<cores>]  threads poll, pwm, executor, service or all, policy other, fifo
+//                                              or rr, cores such as 3, 1,3 or 2-3, e.g. poll=fifo:80@3
+//   prefault=<bytes>                           stack each thread touches as it starts
+//   mlock                                      locks the memory of the process
+// returns the number of entries that were invalid or refused
+{
+    const char *env;
+    char *copy, *entry, *value, *end, *save = NULL;
+    unsigned long prefault;
+    unsigned int current;
+    int lock, memory = 0, errors = 0;
+
+    if ((env = getenv(RT_ENV)) == NULL || (copy = strdup(env)) == NULL)
+        return 0;
+
+    // without mlock memory locked earlier through rt_lock_memory() stays locked
+    rt_get_memory(&lock, &current);
+    prefault = current;
+    for (entry = strtok_r(copy, " ;", &save); entry != NULL; entry = strtok_r(NULL, " ;", &save))
+    {
+        if (strcmp(entry, "mlock") == 0)
+        {
+            lock = memory = 1;
+        } else if ((value = strchr(entry, '=')) == NULL) {
+            errors++;
+        } else {
+            *value++ = '\0';
+            if (strcmp(entry, "prefault") == 0)
+            {
+                prefault = strtoul(value, &end, 10);
+                memory = 1;
+                if (end == value || *end != '\0' || prefault > RT_PREFAULT_MAX)
+                {
+                    prefault = current;
+                    errors++;
+                }
+            } else if (parse_thread_entry(entry, value) != 0) {
+                errors++;
+            }
+        }
+    }
+    free(copy);
+
+    if (memory && rt_lock_memory(lock, prefault) != 0)
+        errors++;
+    return errors;
+}
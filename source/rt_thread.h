@@ -0,0 +1,56 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Real time configuration of the library's threads: scheduling policy and priority, CPU affinity and memory locking */
+
+#include <sched.h>
+
+#define RT_POLL 0           // edge detection poll thread
+#define RT_PWM 1            // software PWM threads
+#define RT_EXECUTOR 2       // callback executor threads
+#define RT_SERVICE 3        // timed output, waveform and timer threads
+#define RT_CLASSES 4
+
+#define RT_PREFAULT_MAX (1024 * 1024)   // most bytes of stack a thread can prefault
+#define RT_ENV "RPI_GPIO_RT"
+
+struct rt_config
+{
+    int policy;                     // SCHED_OTHER, SCHED_FIFO or SCHED_RR
+    int priority;                   // 1-99 for SCHED_FIFO and SCHED_RR, 0 for SCHED_OTHER
+    unsigned long long cpus;        // bit n allows core n, 0 for the cores the process started with
+};
+
+struct rt_status
+{
+    struct rt_config config;        // as configured
+    struct rt_config effective;     // of a running thread of the class, or as configured if none runs
+    unsigned int threads;           // running threads of the class
+    unsigned long long failed;      // settings the system refused, e.g. real time priority without CAP_SYS_NICE
+};
+
+void rt_thread_enter(int cls);
+int rt_set_config(int cls, struct rt_config *cfg);
+int rt_lock_memory(int lock, unsigned int prefault);
+void rt_get_status(int cls, struct rt_status *status);
+void rt_get_memory(int *locked, unsigned int *prefault);
+int rt_config_from_env(void);
@@ -0,0 +1,378 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#define _GNU_SOURCE     // for pthread_setaffinity_np()
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "c_gpio.h"
+#include "sampler.h"
+
+#define SPIN_NS 100000ULL    // the last stretch before a sample is spun, not slept
+
+struct sampler
+{
+    pthread_t thread;
+    int joined;
+    volatile int running;
+    unsigned long long period;   // in ns
+    int triggered;
+    unsigned int mask, value;    // trigger condition on the levels of gpios 0-31
+    unsigned int pretrigger;     // samples kept before the trigger
+    int cpu;                     // core the thread is pinned to, -1 for any
+    int state;
+    unsigned long long taken, missed;
+    struct sample_block *block;
+};
+struct sampler *sampler = NULL;  // the capture running or the last one, guarded by sampler_lock
+pthread_mutex_t sampler_lock = PTHREAD_MUTEX_INITIALIZER;
+
+unsigned long long sample_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void wait_until(unsigned long long t)
+// nanosleep alone is too coarse for rates of hundreds of kHz
+{
+    struct timespec ts;
+    unsigned long long now;
+
+    while ((now = sample_clock()) < t)
+    {
+        if (t - now > SPIN_NS)
+        {
+            ts.tv_sec = (t - SPIN_NS) / 1000000000ULL;
+            ts.tv_nsec = (t - SPIN_NS) % 1000000000ULL;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        }
+    }
+}
+
+void reverse_entries(unsigned int *samples, unsigned int width, unsigned int from, unsigned int to)
+{
+    unsigned int tmp, k;
+
+    while (from + 1 < to)
+    {
+        to--;
+        for (k = 0; k < width; k++)
+        {
+            tmp = samples[from * width + k];
+            samples[from * width + k] = samples[to * width + k];
+            samples[to * width + k] = tmp;
+        }
+        from++;
+    }
+}
+
+void *sampler_thread(void *threadarg)
+{
+    struct sampler *s = (struct sampler *)threadarg;
+    struct sample_block *b = s->block;
+    unsigned int width = (b->encoding == SAMPLER_RLE) ? 2 : 1;
+    unsigned long long next, now, skipped, taken = 0, stored = 0, trigger_at = 0, i;
+    unsigned int level, last = 0, since = 0, pos = 0, remaining = 0;
+    unsigned int *entry;
+    int state = SAMPLER_ARMED, fire;
+    cpu_set_t cpus;
+
+    if (s->cpu >= 0)
+    {
+        CPU_ZERO(&cpus);
+        CPU_SET(s->cpu, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+
+    next = sample_clock();
+    while (s->running)
+    {
+        wait_until(next);
+        level = input_gpio_bank(0);
+        fire = state == SAMPLER_ARMED && s->triggered && stored >= s->pretrigger && (level & s->mask) == s->value;
+        if (taken++ > 0)
+            since++;
+
+        // run length encoding only stores changes, a run too long for the delta and the trigger sample
+        if (width == 1 || taken == 1 || level != last || since == 0xffffffffU || fire)
+        {
+            entry = b->samples + pos * width;
+            if (width == 2)
+            {
+                entry[0] = since;
+                entry[1] = level;
+                since = 0;
+            } else {
+                entry[0] = level;
+            }
+            pos = (pos + 1 == b->size) ? 0 : pos + 1;
+            stored++;
+
+            if (fire)
+            {
+                state = SAMPLER_TRIGGERED;
+                trigger_at = stored - 1;
+                remaining = b->size - s->pretrigger - 1;
+                __atomic_store_n(&s->state, state, __ATOMIC_RELAXED);
+            } else if (state == SAMPLER_TRIGGERED && remaining > 0) {
+                remaining--;
+            }
+        }
+        last = level;
+        __atomic_store_n(&s->taken, taken, __ATOMIC_RELAXED);
+        if (state == SAMPLER_TRIGGERED && remaining == 0)
+        {
+            state = SAMPLER_DONE;
+            break;
+        }
+
+        // sample times that passed while we were preempted are skipped, not made up
+        next += s->period;
+        now = sample_clock();
+        if (now > next + s->period)
+        {
+            skipped = (now - next) / s->period;
+            next += skipped * s->period;
+            __atomic_add_fetch(&s->missed, skipped, __ATOMIC_RELAXED);
+            if (width == 2)   // the levels are taken to have held meanwhile
+                since = (since + skipped > 0xfffffffeULL) ? 0xfffffffeU : since + (unsigned int)skipped;
+        }
+    }
+
+    // put the ring in order, oldest entry first
+    if (stored >= b->size)
+    {
+        b->length = b->size;
+        reverse_entries(b->samples, width, 0, pos);
+        reverse_entries(b->samples, width, pos, b->size);
+        reverse_entries(b->samples, width, 0, b->size);
+    } else {
+        b->length = (unsigned int)stored;
+    }
+    if (state != SAMPLER_ARMED)
+        b->trigger = (long long)(trigger_at - (stored - b->length));
+    if (width == 2 && b->length > 0)
+    {
+        b->samples[0] = 0;  // the entry it counted from was overwritten
+        b->span = since + 1;
+        for (i = 1; i < b->length; i++)
+            b->span += b->samples[2 * i];
+    } else {
+        b->span = b->length;
+    }
+    __atomic_store_n(&s->state, state == SAMPLER_DONE ? SAMPLER_DONE : SAMPLER_IDLE, __ATOMIC_RELEASE);
+    pthread_exit(NULL);
+}
+
+void release_block(struct sample_block *block)
+// call with sampler_lock held
+{
+    if (--block->refs == 0)
+    {
+        free(block->samples);
+        free(block);
+    }
+}
+
+void join_sampler(struct sampler *s)
+// call with sampler_lock held
+{
+    if (!s->joined)
+    {
+        s->running = 0;
+        pthread_join(s->thread, NULL);
+        s->joined = 1;
+    }
+}
+
+int sampler_start(unsigned int rate, unsigned int size, int encoding, int triggered, unsigned int mask,
+                  unsigned int value, unsigned int pretrigger, int cpu)
+// return values:
+// 0 - Success
+// 1 - Already sampling
+// 2 - Other error
+{
+    struct sampler *s;
+    struct sample_block *b;
+
+    if (rate == 0 || rate > SAMPLER_MAX_RATE || size == 0 || (triggered && pretrigger >= size) ||
+        (encoding != SAMPLER_RAW && encoding != SAMPLER_RLE))
+        return 2;
+
+    pthread_mutex_lock(&sampler_lock);
+    if (sampler != NULL && !sampler->joined && __atomic_load_n(&sampler->state, __ATOMIC_ACQUIRE) != SAMPLER_DONE)
+    {
+        pthread_mutex_unlock(&sampler_lock);
+        return 1;
+    }
+
+    s = calloc(1, sizeof(struct sampler));
+    b = calloc(1, sizeof(struct sample_block));
+    if (s == NULL || b == NULL ||
+        (b->samples = malloc((size_t)size * (encoding == SAMPLER_RLE ? 2 : 1) * sizeof(unsigned int))) == NULL)
+    {
+        free(b);
+        free(s);
+        pthread_mutex_unlock(&sampler_lock);
+        return 2;   // out of memory
+    }
+    b->refs = 1;
+    b->encoding = encoding;
+    b->size = size;
+    b->rate = rate;
+    b->trigger = -1;
+    s->block = b;
+    s->period = 1000000000ULL / rate;
+    s->triggered = triggered;
+    s->mask = mask;
+    s->value = value & mask;
+    s->pretrigger = pretrigger;
+    s->cpu = cpu;
+    s->state = SAMPLER_ARMED;
+    s->running = 1;
+
+    if (pthread_create(&s->thread, NULL, sampler_thread, (void *)s) != 0)
+    {
+        release_block(b);
+        free(s);
+        pthread_mutex_unlock(&sampler_lock);
+        return 2;
+    }
+
+    // the capture before is only kept by the buffers handed out for it
+    if (sampler != NULL)
+    {
+        join_sampler(sampler);
+        release_block(sampler->block);
+        free(sampler);
+    }
+    sampler = s;
+    pthread_mutex_unlock(&sampler_lock);
+    return 0;
+}
+
+void sampler_stop(void)
+// ends a capture early, the samples taken so far stay available through sampler_take()
+{
+    pthread_mutex_lock(&sampler_lock);
+    if (sampler != NULL)
+        join_sampler(sampler);
+    pthread_mutex_unlock(&sampler_lock);
+}
+
+void get_sampler_status(struct sampler_status *status)
+{
+    pthread_mutex_lock(&sampler_lock);
+    if (sampler == NULL)
+    {
+        status->state = SAMPLER_IDLE;
+        status->taken = status->missed = 0;
+    } else {
+        status->state = __atomic_load_n(&sampler->state, __ATOMIC_ACQUIRE);
+        status->taken = __atomic_load_n(&sampler->taken, __ATOMIC_RELAXED);
+        status->missed = __atomic_load_n(&sampler->missed, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&sampler_lock);
+}
+
+struct sample_block *sampler_take(void)
+// returns the last capture with a reference for the caller, NULL while sampling or if there is none
+{
+    struct sample_block *block = NULL;
+    int state;
+
+    pthread_mutex_lock(&sampler_lock);
+    if (sampler != NULL)
+    {
+        state = __atomic_load_n(&sampler->state, __ATOMIC_ACQUIRE);
+        if (state == SAMPLER_DONE || state == SAMPLER_IDLE)
+        {
+            block = sampler->block;
+            block->refs++;
+        }
+    }
+    pthread_mutex_unlock(&sampler_lock);
+    return block;
+}
+
+void sampler_release(struct sample_block *block)
+{
+    pthread_mutex_lock(&sampler_lock);
+    release_block(block);
+    pthread_mutex_unlock(&sampler_lock);
+}
+
+int sampler_write_vcd(struct sample_block *block, const char *path, unsigned int gpios)
+// writes a capture as a value change dump with a wire for each gpio in the bit mask gpios
+// returns 0 on success, 2 if the file could not be written (errno is set)
+{
+    FILE *f;
+    unsigned long long t = 0;
+    unsigned int i, gpio, level, prev = 0, changed;
+    int result;
+
+    if ((f = fopen(path, "w")) == NULL)
+        return 2;
+    fprintf(f, "$comment RPi.GPIO logic analyser, %u samples per second $end\n", block->rate);
+    fprintf(f, "$timescale 1 ns $end\n$scope module gpio $end\n");
+    for (gpio = 0; gpio < 32; gpio++)
+        if ((gpios >> gpio) & 1)
+            fprintf(f, "$var wire 1 %c gpio%u $end\n", '!' + gpio, gpio);
+    fprintf(f, "$upscope $end\n$enddefinitions $end\n");
+
+    for (i = 0; i < block->length; i++)
+    {
+        if (block->encoding == SAMPLER_RLE)
+        {
+            t += block->samples[2 * i];
+            level = block->samples[2 * i + 1];
+        } else {
+            t = i;
+            level = block->samples[i];
+        }
+        changed = (i == 0) ? gpios : (level ^ prev) & gpios;
+        prev = level;
+        if (changed == 0)
+            continue;
+
+        fprintf(f, "#%llu\n", t * 1000000000ULL / block->rate);
+        if (i == 0)
+            fprintf(f, "$dumpvars\n");
+        for (gpio = 0; gpio < 32; gpio++)
+            if ((changed >> gpio) & 1)
+                fprintf(f, "%u%c\n", (level >> gpio) & 1, '!' + gpio);
+        if (i == 0)
+            fprintf(f, "$end\n");
+    }
+    if (block->span > 0)
+        fprintf(f, "#%llu\n", block->span * 1000000000ULL / block->rate);
+
+    result = ferror(f);
+    if (fclose(f) != 0 || result)
+        return 2;
+    return 0;
+}
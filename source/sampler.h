@@ -0,0 +1,61 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Logic analyser, samples the level register of gpios 0-31 at a fixed rate into a ring buffer */
+
+#define SAMPLER_IDLE      0   // not started, or stopped
+#define SAMPLER_ARMED     1   // sampling, waiting for the trigger
+#define SAMPLER_TRIGGERED 2   // sampling the samples after the trigger
+#define SAMPLER_DONE      3   // capture complete
+
+#define SAMPLER_RAW 0   // one level word per sample
+#define SAMPLER_RLE 1   // (samples since the entry before, level word) pairs, stored when the levels change
+
+#define SAMPLER_MAX_RATE 1000000
+
+// a capture, shared with the buffer objects of the language bindings by reference counting
+struct sample_block
+{
+    unsigned int refs;
+    int encoding;               // SAMPLER_RAW or SAMPLER_RLE
+    unsigned int size;          // samples (entries with SAMPLER_RLE) the block holds
+    unsigned int length;        // samples (entries) captured, oldest first
+    long long trigger;          // index of the trigger sample (entry), -1 if not triggered
+    unsigned int rate;          // samples per second
+    unsigned long long span;    // samples from the first one captured to the last
+    unsigned int *samples;      // bit n is the level of gpio n
+};
+
+struct sampler_status
+{
+    int state;
+    unsigned long long taken;   // samples taken since the start
+    unsigned long long missed;  // sample times passed while the thread was not running
+};
+
+int sampler_start(unsigned int rate, unsigned int size, int encoding, int triggered, unsigned int mask,
+                  unsigned int value, unsigned int pretrigger, int cpu);
+void sampler_stop(void);
+void get_sampler_status(struct sampler_status *status);
+struct sample_block *sampler_take(void);
+void sampler_release(struct sample_block *block);
+int sampler_write_vcd(struct sample_block *block, const char *path, unsigned int gpios);
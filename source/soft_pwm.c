@@ -25,7 +25,8 @@ SOFTWARE.
 #include <time.h>
 #include "c_gpio.h"
 #include "soft_pwm.h"
-pthread_t threads;
+#include "trace.h"
+#include "rt_thread.h"
 
 struct pwm
 {
@@ -36,30 +37,24 @@ struct pwm
     float slicetime;
     struct timespec req_on, req_off;
     int running;
+    int has_thread;     // a thread runs on the pwm, it frees the pwm once stopped
     struct pwm *next;
 };
 struct pwm *pwm_list = NULL;
+pthread_mutex_t pwm_lock = PTHREAD_MUTEX_INITIALIZER;  // guards pwm_list and the settings of each pwm
 
-void remove_pwm(unsigned int gpio)
+void remove_pwm(struct pwm *old)
+// called with pwm_lock held
 {
-    struct pwm *p = pwm_list;
-    struct pwm *prev = NULL;
-    struct pwm *temp;
+    struct pwm **p;
 
-    while (p != NULL)
+    for (p = &pwm_list; *p != NULL; p = &(*p)->next)
     {
-        if (p->gpio == gpio)
+        if (*p == old)
         {
-            if (prev == NULL)
-                pwm_list = p->next;
-            else
-                prev->next = p->next;
-            temp = p;
-            p = p->next;
-            free(temp);
-        } else {
-            prev = p;
-            p = p->next;
+            *p = old->next;
+            free(old);
+            return;
         }
     }
 }
@@ -83,43 +78,59 @@ void full_sleep(struct timespec *req)
 {
     struct timespec rem = {0};
 
+    TRACE(TRACE_SLEEP_BEGIN, 0, req->tv_sec * 1000000ULL + req->tv_nsec / 1000);
     if (nanosleep(req,&rem) == -1)
         full_sleep(&rem);
+    TRACE(TRACE_SLEEP_END, 0, 0);
 }
 
 void *pwm_thread(void *threadarg)
 {
     struct pwm *p = (struct pwm *)threadarg;
+    struct timespec req_on, req_off;
+    float dutycycle;
 
+    trace_thread_name("pwm");
+    rt_thread_enter(RT_PWM);
+    pthread_mutex_lock(&pwm_lock);
     while (p->running)
     {
+        // one period from a copy of the settings, callers may change them meanwhile
+        dutycycle = p->dutycycle;
+        req_on = p->req_on;
+        req_off = p->req_off;
+        pthread_mutex_unlock(&pwm_lock);
 
-        if (p->dutycycle > 0.0)
+        if (dutycycle > 0.0)
         {
             output_gpio(p->gpio, 1);
-            full_sleep(&p->req_on);
+            full_sleep(&req_on);
         }
 
-        if (p->dutycycle < 100.0)
+        if (dutycycle < 100.0)
         {
             output_gpio(p->gpio, 0);
-            full_sleep(&p->req_off);
+            full_sleep(&req_off);
         }
+        pthread_mutex_lock(&pwm_lock);
     }
 
-    // clean up
+    // clean up, a pwm_start() before this point kept the loop running instead
     output_gpio(p->gpio, 0);
-    remove_pwm(p->gpio);
-    pthread_exit(NULL);
+    remove_pwm(p);
+    pthread_mutex_unlock(&pwm_lock);
+    return NULL;
 }
 
 struct pwm *add_new_pwm(unsigned int gpio)
 {
     struct pwm *new_pwm;
 
-    new_pwm = malloc(sizeof(struct pwm));
+    if ((new_pwm = malloc(sizeof(struct pwm))) == NULL)
+        return NULL;
     new_pwm->gpio = gpio;
     new_pwm->running = 0;
+    new_pwm->has_thread = 0;
     new_pwm->next = NULL;
     // default to 1 kHz frequency, dutycycle 0.0
     new_pwm->freq = 1000.0;
@@ -131,6 +142,7 @@ struct pwm *add_new_pwm(unsigned int gpio)
 }
 
 struct pwm *find_pwm(unsigned int gpio)
+// called with pwm_lock held, adds a pwm for gpio if there is none
 {
     struct pwm *p = pwm_list;
 
@@ -164,11 +176,13 @@ void pwm_set_duty_cycle(unsigned int gpio, float dutycycle)
         return;
     }
 
+    pthread_mutex_lock(&pwm_lock);
     if ((p = find_pwm(gpio)) != NULL)
     {
         p->dutycycle = dutycycle;
         calculate_times(p);
     }
+    pthread_mutex_unlock(&pwm_lock);
 }
 
 void pwm_set_frequency(unsigned int gpio, float freq)
@@ -181,34 +195,53 @@ void pwm_set_frequency(unsigned int gpio, float freq)
         return;
     }
 
+    pthread_mutex_lock(&pwm_lock);
     if ((p = find_pwm(gpio)) != NULL)
     {
         p->basetime = 1000.0 / freq;    // calculated in ms
         p->slicetime = p->basetime / 100.0;
         calculate_times(p);
     }
+    pthread_mutex_unlock(&pwm_lock);
 }
 
 void pwm_start(unsigned int gpio)
 {
     struct pwm *p;
+    pthread_t thread;
+    pthread_attr_t attr;
 
+    pthread_mutex_lock(&pwm_lock);
     if (((p = find_pwm(gpio)) == NULL) || p->running)
+    {
+        pthread_mutex_unlock(&pwm_lock);
         return;
+    }
 
+    // a thread still winding down after pwm_stop() picks up again
     p->running = 1;
-    if (pthread_create(&threads, NULL, pwm_thread, (void *)p) != 0)
+    if (!p->has_thread)
     {
-        // btc fixme - error
-        p->running = 0;
-        return;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&thread, &attr, pwm_thread, (void *)p) != 0)
+        {
+            // btc fixme - error
+            p->running = 0;
+        } else {
+            p->has_thread = 1;
+        }
+        pthread_attr_destroy(&attr);
     }
+    pthread_mutex_unlock(&pwm_lock);
 }
 
 void pwm_stop(unsigned int gpio)
 {
     struct pwm *p;
 
+    pthread_mutex_lock(&pwm_lock);
     if ((p = find_pwm(gpio)) != NULL)
         p->running = 0;
+    pthread_mutex_unlock(&pwm_lock);
 }
@@ -0,0 +1,200 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "trace.h"
+
+struct trace_rec
+{
+    unsigned long long ts;      // CLOCK_MONOTONIC in ns
+    unsigned long long value;
+    unsigned int type;
+    unsigned int gpio;
+};
+
+// one ring per thread, only written by its thread; rings of threads that have ended are reused
+struct trace_ring
+{
+    struct trace_rec recs[TRACE_RING_SIZE];
+    unsigned long long head;    // records written since the trace started
+    unsigned int generation;    // trace the records belong to
+    int owned;                  // a running thread writes to the ring
+    long tid;
+    char name[32];
+    struct trace_ring *next;
+};
+
+int trace_enabled = 0;
+unsigned int trace_generation = 0;
+struct trace_ring *trace_rings = NULL;
+pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_key_t trace_key;
+pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static __thread struct trace_ring *ring = NULL;
+static __thread const char *thread_name = NULL;
+
+void release_ring(void *r)
+{
+    pthread_mutex_lock(&trace_lock);
+    ((struct trace_ring *)r)->owned = 0;
+    pthread_mutex_unlock(&trace_lock);
+}
+
+void make_trace_key(void)
+{
+    pthread_key_create(&trace_key, release_ring);
+}
+
+struct trace_ring *claim_ring(void)
+// returns the ring of the calling thread, NULL if out of memory
+{
+    struct trace_ring *r;
+
+    pthread_once(&trace_once, make_trace_key);
+    pthread_mutex_lock(&trace_lock);
+    for (r = trace_rings; r != NULL; r = r->next)
+        if (!r->owned)
+            break;
+    if (r == NULL)
+    {
+        if ((r = malloc(sizeof(struct trace_ring))) == NULL)
+        {
+            pthread_mutex_unlock(&trace_lock);
+            return NULL;
+        }
+        r->next = trace_rings;
+        trace_rings = r;
+    }
+    r->owned = 1;
+    r->head = 0;
+    r->generation = trace_generation;
+    r->tid = syscall(SYS_gettid);
+    r->name[0] = '\0';
+    if (thread_name != NULL)
+        strncpy(r->name, thread_name, sizeof(r->name) - 1);
+    r->name[sizeof(r->name) - 1] = '\0';
+    pthread_mutex_unlock(&trace_lock);
+    pthread_setspecific(trace_key, r);
+    return r;
+}
+
+void trace_record(unsigned int type, unsigned int gpio, unsigned long long value)
+{
+    struct timespec ts;
+    struct trace_rec *rec;
+    unsigned int generation = __atomic_load_n(&trace_generation, __ATOMIC_ACQUIRE);
+
+    if (ring == NULL && (ring = claim_ring()) == NULL)
+        return;
+    if (ring->generation != generation)
+    {
+        // first record of a new trace, the old records are dropped
+        __atomic_store_n(&ring->head, 0, __ATOMIC_RELAXED);
+        ring->generation = generation;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    rec = &ring->recs[ring->head % TRACE_RING_SIZE];
+    rec->ts = (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    rec->value = value;
+    rec->type = type;
+    rec->gpio = gpio;
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+void trace_thread_name(const char *name)
+// names the calling thread in traces, name must stay valid while the thread runs
+{
+    thread_name = name;
+}
+
+void trace_start(void)
+{
+    __atomic_add_fetch(&trace_generation, 1, __ATOMIC_RELEASE);
+    trace_enabled = 1;
+}
+
+void trace_stop(void)
+{
+    trace_enabled = 0;
+}
+
+static const char *trace_names[] = {"output", "set", "clear", "edge", "callback", "callback", "sleep", "sleep"};
+static const char trace_phases[] = {'i', 'i', 'i', 'i', 'B', 'E', 'B', 'E'};
+
+int trace_dump(const char *path)
+// stops tracing and writes the records as Chrome trace JSON, returns 0 on success, 1 if the file can not be written
+{
+    FILE *f;
+    struct trace_ring *r;
+    struct trace_rec *rec;
+    unsigned long long head, i;
+    int pid = getpid();
+    const char *sep = "";
+
+    trace_stop();
+    if ((f = fopen(path, "w")) == NULL)
+        return 1;
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    pthread_mutex_lock(&trace_lock);
+    for (r = trace_rings; r != NULL; r = r->next)
+    {
+        if (r->generation != trace_generation)
+            continue;
+        if (r->name[0])
+        {
+            fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%ld,\"args\":{\"name\":\"%s\"}}",
+                    sep, pid, r->tid, r->name);
+            sep = ",\n";
+        }
+        head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        for (i = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0; i < head; i++)
+        {
+            rec = &r->recs[i % TRACE_RING_SIZE];
+            if (rec->type > TRACE_SLEEP_END)
+                continue;
+            fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03llu,\"pid\":%d,\"tid\":%ld",
+                    sep, trace_names[rec->type], trace_phases[rec->type], rec->ts / 1000, rec->ts % 1000, pid, r->tid);
+            if (trace_phases[rec->type] == 'i')
+                fprintf(f, ",\"s\":\"t\"");
+            if (rec->type == TRACE_SET_MASK || rec->type == TRACE_CLEAR_MASK)
+                fprintf(f, ",\"args\":{\"mask\":\"0x%llx\"}}", rec->value);
+            else if (rec->type == TRACE_SLEEP_BEGIN)
+                fprintf(f, ",\"args\":{\"us\":%llu}}", rec->value);
+            else if (rec->type == TRACE_SLEEP_END)
+                fprintf(f, "}");
+            else
+                fprintf(f, ",\"args\":{\"gpio\":%u,\"value\":%llu}}", rec->gpio, rec->value);
+            sep = ",\n";
+        }
+    }
+    pthread_mutex_unlock(&trace_lock);
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0 ? 0 : 1;
+}
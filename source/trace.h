@@ -0,0 +1,50 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Tracing into a ring of records per thread, written out as Chrome trace JSON (chrome://tracing, Perfetto).
+   Build with -DNO_TRACE to leave the trace points out, otherwise a trace point costs one predicted branch
+   while tracing is stopped. */
+
+#define TRACE_RING_SIZE 16384   // records kept per thread, older ones are overwritten
+
+#define TRACE_OUTPUT          0   // output register write, value is the level
+#define TRACE_SET_MASK        1   // several outputs set, value is the gpio mask
+#define TRACE_CLEAR_MASK      2   // several outputs cleared
+#define TRACE_EDGE            3   // edge captured by the poll thread, value is the level
+#define TRACE_CALLBACK_BEGIN  4
+#define TRACE_CALLBACK_END    5
+#define TRACE_SLEEP_BEGIN     6   // value is the requested time in us
+#define TRACE_SLEEP_END       7
+
+extern int trace_enabled;
+
+void trace_record(unsigned int type, unsigned int gpio, unsigned long long value);
+void trace_thread_name(const char *name);
+void trace_start(void);
+void trace_stop(void);
+int trace_dump(const char *path);
+
+#ifdef NO_TRACE
+#define TRACE(type, gpio, value) do { } while (0)
+#else
+#define TRACE(type, gpio, value) do { if (__builtin_expect(trace_enabled, 0)) trace_record(type, gpio, value); } while (0)
+#endif
@@ -0,0 +1,288 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+#include "c_gpio.h"
+#include "waveform.h"
+#include "rt_thread.h"
+
+#define SPIN_NS 100000ULL       // the last stretch before a step is spun, not slept
+
+// one waveform playing and one queued behind it, guarded by wave_lock
+struct wave_slot
+{
+    struct waveform *w;
+    unsigned int repeat;        // times to play, 0 until replaced or stopped
+};
+struct wave_slot wave_current = {NULL, 0};
+struct wave_slot wave_next = {NULL, 0};
+unsigned int wave_pos = 0;              // next step of the current waveform, count for its end
+unsigned long long wave_base = 0;       // start time of the current pass in ns
+struct wave_status wave_stats = {0, 0, 0, 0, 0.0};
+int wave_spinning = 0;                  // the thread is making a step without the lock
+pthread_t wave_thread;
+int wave_running = 0;
+pthread_mutex_t wave_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t wave_cond;
+
+unsigned long long wave_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int wave_compile(struct waveform *w, const unsigned int *steps, unsigned int count, unsigned int outputs)
+// checks the steps and works out when each starts, the steps must outlive the waveform
+// return values:
+// 0 - Success
+// 1 - No steps, or a step with no hold time
+// 2 - A step changes a gpio not in outputs
+// 3 - A step both sets and clears a gpio
+// 4 - Out of memory
+{
+    unsigned long long t = 0;
+    unsigned int i;
+    const unsigned int *s;
+
+    w->steps = steps;
+    w->count = count;
+    w->offsets = NULL;
+    if (count == 0)
+        return 1;
+    for (i = 0; i < count; i++)
+    {
+        s = steps + i * WAVE_STEP_WORDS;
+        if (s[2] == 0)
+            return 1;
+        if ((s[0] | s[1]) & ~outputs)
+            return 2;
+        if (s[0] & s[1])
+            return 3;
+    }
+
+    if ((w->offsets = malloc(count * sizeof(unsigned long long))) == NULL)
+        return 4;
+    for (i = 0; i < count; i++)
+    {
+        w->offsets[i] = t;
+        t += steps[i * WAVE_STEP_WORDS + 2];
+    }
+    w->duration = t;
+    return 0;
+}
+
+void wave_free(struct waveform *w)
+{
+    free(w->offsets);
+    w->offsets = NULL;
+}
+
+void wave_end_pass(void)
+// called with wave_lock held at the end of the current waveform, moves on to the next pass or waveform
+{
+    wave_stats.loops++;
+    wave_base += wave_current.w->duration;
+    wave_pos = 0;
+    if (wave_next.w != NULL)
+    {
+        wave_current = wave_next;
+        wave_next.w = NULL;
+    } else if (wave_current.repeat != 1) {
+        if (wave_current.repeat > 1)
+            wave_current.repeat--;
+    } else {
+        wave_current.w = NULL;
+    }
+}
+
+void *wave_loop(void *threadarg)
+{
+    struct timespec ts;
+    unsigned long long due, now;
+    unsigned int set, clear;
+    const unsigned int *s;
+    double late;
+
+    rt_thread_enter(RT_SERVICE);
+    pthread_mutex_lock(&wave_lock);
+    while (wave_running)
+    {
+        if (wave_current.w == NULL)
+        {
+            pthread_cond_wait(&wave_cond, &wave_lock);
+            continue;
+        }
+
+        // the end of a waveform is due after the hold of its last step
+        if (wave_pos == wave_current.w->count)
+            due = wave_base + wave_current.w->duration;
+        else
+            due = wave_base + wave_current.w->offsets[wave_pos];
+        now = wave_clock();
+        if (due > now + SPIN_NS)
+        {
+            ts.tv_sec = (due - SPIN_NS) / 1000000000ULL;
+            ts.tv_nsec = (due - SPIN_NS) % 1000000000ULL;
+            pthread_cond_timedwait(&wave_cond, &wave_lock, &ts);
+            continue;
+        }
+        if (wave_pos == wave_current.w->count)
+        {
+            wave_end_pass();
+            continue;
+        }
+
+        // the step is copied so the waveform can be replaced while the thread spins
+        s = wave_current.w->steps + wave_pos * WAVE_STEP_WORDS;
+        set = s[0];
+        clear = s[1];
+        wave_pos++;
+        wave_spinning = 1;
+        pthread_mutex_unlock(&wave_lock);
+        while ((now = wave_clock()) < due)
+            ;
+        output_gpio_mask(set, clear);
+        late = (now - due) / 1000.0;
+
+        pthread_mutex_lock(&wave_lock);
+        wave_spinning = 0;
+        pthread_cond_broadcast(&wave_cond);
+        wave_stats.steps++;
+        if (late > wave_stats.late_max)
+            wave_stats.late_max = late;
+    }
+    pthread_mutex_unlock(&wave_lock);
+    return NULL;
+}
+
+int start_wave_thread(void)
+// called with wave_lock held, returns 0 on success
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&wave_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    wave_running = 1;
+    if (pthread_create(&wave_thread, NULL, wave_loop, NULL) != 0)
+    {
+        wave_running = 0;
+        pthread_cond_destroy(&wave_cond);
+        return 2;
+    }
+    return 0;
+}
+
+int wave_play(struct waveform *w, unsigned int repeat, int queue)
+// plays w repeat times (0 until stopped or followed by a queued waveform) at once, or with queue after the
+// waveform playing, ending a repeating one at the end of its pass
+// return values:
+// 0 - Success
+// 1 - A waveform is queued already
+// 2 - Thread could not be started
+{
+    pthread_mutex_lock(&wave_lock);
+    if (!wave_running && start_wave_thread() != 0)
+    {
+        pthread_mutex_unlock(&wave_lock);
+        return 2;
+    }
+
+    if (queue && wave_current.w != NULL)
+    {
+        if (wave_next.w != NULL)
+        {
+            pthread_mutex_unlock(&wave_lock);
+            return 1;
+        }
+        wave_next.w = w;
+        wave_next.repeat = repeat;
+    } else {
+        wave_current.w = w;
+        wave_current.repeat = repeat;
+        wave_next.w = NULL;
+        wave_pos = 0;
+        // starting after the spin time lets the first step be as punctual as the rest
+        wave_base = wave_clock() + SPIN_NS;
+        pthread_cond_broadcast(&wave_cond);
+    }
+    pthread_mutex_unlock(&wave_lock);
+    return 0;
+}
+
+void wave_stop(void)
+// returns once no step of a waveform can be made any more
+{
+    pthread_mutex_lock(&wave_lock);
+    wave_current.w = NULL;
+    wave_next.w = NULL;
+    if (wave_running)
+        pthread_cond_broadcast(&wave_cond);
+    while (wave_spinning)
+        pthread_cond_wait(&wave_cond, &wave_lock);
+    pthread_mutex_unlock(&wave_lock);
+}
+
+int wave_in_use(struct waveform *w)
+// 1 while w is playing or queued, the bindings keep its steps alive until then
+{
+    int result;
+
+    pthread_mutex_lock(&wave_lock);
+    result = wave_current.w == w || wave_next.w == w;
+    pthread_mutex_unlock(&wave_lock);
+    return result;
+}
+
+void get_wave_status(struct wave_status *status)
+{
+    pthread_mutex_lock(&wave_lock);
+    *status = wave_stats;
+    status->playing = wave_current.w != NULL;
+    status->queued = wave_next.w != NULL;
+    pthread_mutex_unlock(&wave_lock);
+}
+
+void wave_cleanup(void)
+{
+    wave_stop();
+    pthread_mutex_lock(&wave_lock);
+    if (!wave_running)
+    {
+        pthread_mutex_unlock(&wave_lock);
+        return;
+    }
+    wave_running = 0;
+    wave_stats = (struct wave_status){0, 0, 0, 0, 0.0};
+    pthread_cond_broadcast(&wave_cond);
+    pthread_mutex_unlock(&wave_lock);
+
+    pthread_join(wave_thread, NULL);
+    pthread_cond_destroy(&wave_cond);
+}
@@ -0,0 +1,51 @@
+/*
+Copyright (c) 2013 Ben Croston
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* Waveform playback, precomputed steps of gpios 0-31 played from a thread at absolute deadlines */
+
+#define WAVE_STEP_WORDS 3   // a step is (set mask, clear mask, hold in ns), 32 bits each
+
+// compiled once from steps that stay owned by the caller, the player only reads them
+struct waveform
+{
+    const unsigned int *steps;
+    unsigned int count;
+    unsigned long long *offsets;    // ns from the start of the waveform to the start of each step
+    unsigned long long duration;    // ns
+};
+
+struct wave_status
+{
+    int playing;
+    int queued;                     // a waveform waits to follow the one playing
+    unsigned long long steps;       // steps made since the player started
+    unsigned long long loops;       // waveforms played to the end
+    double late_max;                // worst lateness of a step in microseconds
+};
+
+int wave_compile(struct waveform *w, const unsigned int *steps, unsigned int count, unsigned int outputs);
+void wave_free(struct waveform *w);
+int wave_play(struct waveform *w, unsigned int repeat, int queue);
+void wave_stop(void);
+int wave_in_use(struct waveform *w);
+void get_wave_status(struct wave_status *status);
+void wave_cleanup(void);
@@ -1,8 +1,13 @@
+import os
 import time
+import array
+import threading
 import RPi.GPIO as GPIO
+from RPi import recording
 
 GND_PIN = 6    # not used by program but needs to be connected!
 LED_PIN = 12
+LED_GPIO = 18  # BCM number of LED_PIN
 SWITCH_PIN = 18
 
 def test_output():
@@ -115,6 +120,424 @@ def test_switchbounce():
         pass
     GPIO.remove_event_detect(SWITCH_PIN);
 
+def test_simulated_events():
+    global count
+    count = 0
+
+    def cb(chan):
+        global count
+        count += 1
+
+    print('Simulated event throughput test (10 seconds)...')
+    GPIO.simulate_events(SWITCH_PIN, GPIO.BOTH, schedule=GPIO.SYNTH_FIXED, interval=50, callback=cb)
+    time.sleep(10)
+    generated, dropped = GPIO.simulated_stats(SWITCH_PIN)
+    GPIO.remove_event_detect(SWITCH_PIN)
+    print('Generated %s edges, dropped %s, %s callbacks (%s/sec)'%(generated, dropped, count, count/10))
+
+    try:
+        GPIO.simulate_events(SWITCH_PIN, GPIO.RISING, schedule=99)
+        print('Fail - managed to set an invalid schedule')
+    except ValueError:
+        pass
+
+    count = 0
+    GPIO.simulate_events(SWITCH_PIN, GPIO.RISING, schedule=GPIO.SYNTH_BURST, interval=100, burst=10, gap=100000, count=100, callback=cb)
+    time.sleep(2)
+    GPIO.remove_event_detect(SWITCH_PIN)
+    if count != 50:
+        print('Fail - expected 50 rising edges, got %s'%count)
+
+    print('Simulated glitch filter test...')
+    count = 0
+    GPIO.simulate_events(SWITCH_PIN, GPIO.BOTH, interval=2000, count=100, stabletime=3000, callback=cb)
+    time.sleep(1)
+    rejected = GPIO.rejected_events(SWITCH_PIN)
+    GPIO.remove_event_detect(SWITCH_PIN)
+    if count != 0 or rejected != 100:
+        print('Fail - pulses shorter than stabletime accepted (%s callbacks, %s rejected)'%(count, rejected))
+
+    count = 0
+    GPIO.simulate_events(SWITCH_PIN, GPIO.BOTH, interval=100, count=100, minpulse=1000, callback=cb)
+    time.sleep(0.2)
+    rejected = GPIO.rejected_events(SWITCH_PIN)
+    GPIO.remove_event_detect(SWITCH_PIN)
+    if count != 0 or rejected != 100:
+        print('Fail - edges of pulses shorter than minpulse accepted (%s callbacks, %s rejected)'%(count, rejected))
+
+    count = 0
+    GPIO.simulate_events(SWITCH_PIN, GPIO.BOTH, interval=5000, count=20, minpulse=1000, callback=cb)
+    time.sleep(0.3)
+    GPIO.remove_event_detect(SWITCH_PIN)
+    if count != 20:
+        print('Fail - expected 20 edges of pulses longer than minpulse, got %s'%count)
+
+    count = 0
+    GPIO.simulate_events(SWITCH_PIN, GPIO.BOTH, interval=100, count=10000, bouncetime=1, callback=cb)
+    time.sleep(2)
+    GPIO.remove_event_detect(SWITCH_PIN)
+    if count != 1000:
+        print('Fail - expected 1000 edges outside of the bouncetime, got %s'%count)
+
+    print('Burst coalescing test...')
+    bursts = []
+    def burst_cb(chan, burst):
+        bursts.append(burst)
+
+    GPIO.simulate_events(SWITCH_PIN, GPIO.BOTH, interval=100, count=10000, burstcount=100, callback=burst_cb)
+    time.sleep(2)
+    GPIO.remove_event_detect(SWITCH_PIN)
+    if len(bursts) != 100 or sum(b[0] for b in bursts) != 10000:
+        print('Fail - expected 100 bursts of 10000 edges, got %s bursts of %s edges'%(len(bursts), sum(b[0] for b in bursts)))
+
+    print('Edge counter test...')
+    GPIO.simulate_events(SWITCH_PIN, GPIO.RISING, interval=100, count=10000, counting=True)
+    time.sleep(0.5)
+    counted = GPIO.count_and_reset(SWITCH_PIN)
+    time.sleep(1.5)
+    counted += GPIO.count(SWITCH_PIN)
+    GPIO.remove_event_detect(SWITCH_PIN)
+    if counted != 5000:
+        print('Fail - expected 5000 rising edges counted, got %s'%counted)
+
+    print('Input capture test...')
+    GPIO.simulate_events(SWITCH_PIN, GPIO.BOTH, schedule=GPIO.SYNTH_SQUARE, interval=500, count=400, counting=True)
+    time.sleep(1)
+    m = GPIO.measure(SWITCH_PIN)
+    GPIO.remove_event_detect(SWITCH_PIN)
+    if m['period'] != 1000 or m['high'] != 500 or m['frequency'] != 1000:
+        print('Fail - expected a 1000us period with 500us high time, got %s'%m)
+
+    print('wait_for_any test...')
+    GPIO.simulate_events(SWITCH_PIN, GPIO.RISING, interval=100000, count=1)
+    if GPIO.wait_for_any([SWITCH_PIN], GPIO.RISING, 1000) is None:
+        print('Fail - wait_for_any() missed a simulated edge')
+    if GPIO.wait_for_any([SWITCH_PIN], GPIO.RISING, 100) is not None:
+        print('Fail - wait_for_any() did not time out')
+    GPIO.remove_event_detect(SWITCH_PIN)
+    GPIO.simulate_events(SWITCH_PIN, GPIO.RISING, interval=100000, count=1, counting=True)
+    if GPIO.wait_for_any([SWITCH_PIN], GPIO.RISING, 1000) is None:
+        print('Fail - wait_for_any() missed an edge of a counted channel')
+    GPIO.remove_event_detect(SWITCH_PIN)
+    GPIO.simulate_events(SWITCH_PIN, GPIO.RISING, interval=100000, count=1, burstcount=10)
+    if GPIO.wait_for_any([SWITCH_PIN], GPIO.RISING, 1000) is None:
+        print('Fail - wait_for_any() missed an edge held for a burst')
+    GPIO.remove_event_detect(SWITCH_PIN)
+
+    print('Reflex rule test...')
+    GPIO.output(LED_PIN, GPIO.LOW)
+    GPIO.simulate_events(SWITCH_PIN, GPIO.RISING, interval=100000, count=3)
+    GPIO.add_reflex(SWITCH_PIN, GPIO.RISING, toggle=[LED_PIN], oneshot=True)
+    GPIO.add_reflex(SWITCH_PIN, GPIO.RISING, clear=[LED_PIN], delay=400000)
+    time.sleep(0.2)
+    if GPIO.input(LED_PIN) != GPIO.HIGH:
+        print('Fail - reflex rule did not set the output')
+    time.sleep(0.4)
+    GPIO.remove_event_detect(SWITCH_PIN)
+    if GPIO.input(LED_PIN) != GPIO.LOW:
+        print('Fail - delayed reflex rule did not clear the output')
+    # rules have their own edge type, whatever edge type the channel was set up for
+    GPIO.simulate_events(SWITCH_PIN, GPIO.RISING, interval=100000, count=2)
+    GPIO.add_reflex(SWITCH_PIN, GPIO.FALLING, set=[LED_PIN])
+    time.sleep(0.3)
+    GPIO.remove_event_detect(SWITCH_PIN)
+    if GPIO.input(LED_PIN) != GPIO.HIGH:
+        print('Fail - FALLING reflex rule did not act on a channel set up for RISING edges')
+    GPIO.output(LED_PIN, GPIO.LOW)
+
+    print('Pattern trigger test...')
+    entered = []
+    def pattern_cb(id, matched, timestamp):
+        if matched:
+            entered.append(timestamp)
+
+    GPIO.output(LED_PIN, GPIO.LOW)
+    GPIO.simulate_events(SWITCH_PIN, GPIO.BOTH, schedule=GPIO.SYNTH_SQUARE, interval=10000, count=20)
+    pattern = GPIO.add_pattern(high=[SWITCH_PIN], low=[LED_PIN], callback=pattern_cb)
+    time.sleep(0.5)
+    matched, entries, exits = GPIO.pattern_state(pattern)
+    GPIO.remove_pattern(pattern)
+    GPIO.remove_event_detect(SWITCH_PIN)
+    if entries != 10 or exits != 10 or len(entered) != 10:
+        print('Fail - expected 10 pattern entries and exits, got %s, %s and %s callbacks'%(entries, exits, len(entered)))
+
+    # the levels follow both edges, whatever edge type the channel was set up for
+    GPIO.simulate_events(SWITCH_PIN, GPIO.RISING, schedule=GPIO.SYNTH_SQUARE, interval=10000, count=20)
+    pattern = GPIO.add_pattern(high=[SWITCH_PIN], low=[LED_PIN])
+    time.sleep(0.5)
+    matched, entries, exits = GPIO.pattern_state(pattern)
+    GPIO.remove_pattern(pattern)
+    GPIO.remove_event_detect(SWITCH_PIN)
+    if entries != 10 or exits != 10:
+        print('Fail - expected 10 pattern entries and exits on a channel set up for RISING edges, got %s and %s'%(entries, exits))
+
+    try:
+        import asyncio
+    except ImportError:
+        asyncio = None
+    if asyncio is not None and hasattr(GPIO, 'edge'):
+        print('asyncio edge test...')
+        loop = asyncio.new_event_loop()
+        asyncio.set_event_loop(loop)
+        GPIO.simulate_events(SWITCH_PIN, GPIO.RISING, interval=100000, count=2)
+        if loop.run_until_complete(GPIO.edge(SWITCH_PIN, timeout=0.05)) is not None:
+            print('Fail - edge() did not time out')
+        if loop.run_until_complete(GPIO.edge(SWITCH_PIN, timeout=1)) is None:
+            print('Fail - edge() missed a simulated edge')
+        GPIO.remove_event_detect(SWITCH_PIN)
+        loop.close()
+
+    print('Slow callback test...')
+    def slow_cb(chan):
+        time.sleep(0.01)
+
+    GPIO.set_callback_executor(threads=1, queue_size=16, overflow=GPIO.DROP_NEWEST)
+    GPIO.simulate_events(SWITCH_PIN, GPIO.BOTH, interval=200, count=2000, callback=slow_cb)
+    time.sleep(1)
+    generated, dropped = GPIO.simulated_stats(SWITCH_PIN)
+    stats = GPIO.callback_queue_stats()
+    GPIO.remove_event_detect(SWITCH_PIN)
+    GPIO.set_callback_executor()
+    if dropped != 0:
+        print('Fail - slow callback stalled edge capture, %s edges dropped by the generator'%dropped)
+    if stats['dropped'] == 0:
+        print('Fail - expected the callback queue to overflow, got %s'%stats)
+
+    print('Event telemetry test...')
+    GPIO.reset_stats()
+    GPIO.simulate_events(SWITCH_PIN, GPIO.BOTH, interval=100, count=1000, bouncetime=1, callback=cb)
+    time.sleep(0.5)
+    stats = GPIO.stats(SWITCH_PIN)
+    GPIO.remove_event_detect(SWITCH_PIN)
+    if stats['seen'] != 1000 or stats['bounced'] != 900 or stats['delivered'] != 100 or sum(stats['latency']) != 100:
+        print('Fail - expected 1000 edges seen, 900 bounced and 100 delivered, got %s'%stats)
+
+    print('Trace test...')
+    GPIO.trace_start()
+    GPIO.simulate_events(SWITCH_PIN, GPIO.BOTH, interval=1000, count=100, callback=cb)
+    time.sleep(0.5)
+    GPIO.remove_event_detect(SWITCH_PIN)
+    GPIO.trace_dump('/tmp/rpi_gpio_trace.json')
+    with open('/tmp/rpi_gpio_trace.json') as f:
+        trace = f.read()
+    if trace.count('"name":"edge"') != 100 or trace.count('"name":"callback"') != 200:
+        print('Fail - expected 100 edges and 100 callbacks in the trace')
+
+    print('Recorder test...')
+    GPIO.record_start('/tmp/rpi_gpio_record', channels=[SWITCH_PIN], segment_records=64)
+    GPIO.simulate_events(SWITCH_PIN, GPIO.BOTH, interval=1000, count=100)
+    time.sleep(0.5)
+    GPIO.remove_event_detect(SWITCH_PIN)
+    GPIO.record_stop()
+    events = list(recording.read('/tmp/rpi_gpio_record'))
+    if len(events) != 100 or GPIO.record_stats()['segments'] != 2:
+        print('Fail - expected 100 edges recorded in 2 segments, got %s'%len(events))
+    # a shorter recording to the same path replaces the earlier one, segments and all
+    GPIO.record_start('/tmp/rpi_gpio_record2', channels=[SWITCH_PIN], segment_records=16)
+    GPIO.simulate_events(SWITCH_PIN, GPIO.BOTH, interval=1000, count=50)
+    time.sleep(0.3)
+    GPIO.remove_event_detect(SWITCH_PIN)
+    GPIO.record_stop()
+    GPIO.record_start('/tmp/rpi_gpio_record2', channels=[SWITCH_PIN], segment_records=16)
+    GPIO.simulate_events(SWITCH_PIN, GPIO.BOTH, interval=1000, count=10)
+    time.sleep(0.1)
+    GPIO.remove_event_detect(SWITCH_PIN)
+    GPIO.record_stop()
+    events = list(recording.read('/tmp/rpi_gpio_record2'))
+    if len(events) != 10 or len(recording.segments('/tmp/rpi_gpio_record2')) != 1:
+        print('Fail - expected only the 10 edges of the second recording, got %s'%len(events))
+
+    print('Replay test...')
+    replayed = []
+    GPIO.replay_events('/tmp/rpi_gpio_record', speed=0, callback=lambda channel: replayed.append(channel))
+    time.sleep(0.5)
+    stats = GPIO.replay_stats()
+    GPIO.replay_stop()
+    if stats['replayed'] != 100 or stats['running'] or len(replayed) != 100:
+        print('Fail - expected 100 edges replayed into 100 callbacks, got %s and %s callbacks'%(stats, len(replayed)))
+
+    print('Logic analyser test...')
+    GPIO.output(LED_PIN, GPIO.LOW)
+    GPIO.sampler_start(100000, 1000, high=[LED_PIN], pretrigger=100)
+    time.sleep(0.01)
+    GPIO.output(LED_PIN, GPIO.HIGH)
+    time.sleep(0.1)
+    samples = GPIO.sampler_data()
+    if samples is None or len(samples) != 1000 or samples.trigger != 100 or samples[99] == samples[100]:
+        print('Fail - expected a capture of 1000 samples triggered by the LED at sample 100')
+    GPIO.output(LED_PIN, GPIO.LOW)
+
+    print('Run length encoded capture test...')
+    GPIO.sampler_start(100000, 100, encoding=GPIO.SAMPLER_RLE)
+    time.sleep(0.01)   # let the first sample see the LED off
+    for i in range(10):
+        GPIO.output(LED_PIN, i % 2 == 0)
+        time.sleep(0.01)
+    GPIO.sampler_stop()
+    samples = GPIO.sampler_data()
+    if len(samples) != 11 or samples.span < 9000:
+        print('Fail - expected 11 changes over 0.1s, got %s over %s samples'%(len(samples), samples.span))
+    GPIO.sampler_save_vcd('/tmp/rpi_gpio_capture.vcd', channels=[LED_PIN])
+
+    print('Protocol decoder test...')
+    frames = GPIO.decode_uart(samples, LED_PIN, 100)   # the toggles above are a start bit and 0x55 at 100 baud
+    if len(frames) != 1 or frames[0][3] != 0x55:
+        print('Fail - expected 0x55 decoded from the capture, got %s'%frames)
+
+    print('Timed output test...')
+    GPIO.output(LED_PIN, GPIO.LOW)
+    now = GPIO.timestamp()
+    GPIO.output_at(now + 20000, LED_PIN, GPIO.HIGH)
+    GPIO.output_at(now + 10000, LED_PIN, GPIO.LOW)
+    time.sleep(0.015)
+    if GPIO.input(LED_PIN) != GPIO.LOW:
+        print('Fail - the LED changed before its time')
+    time.sleep(0.015)
+    stats = GPIO.output_at_stats()
+    if GPIO.input(LED_PIN) != GPIO.HIGH or stats['executed'] != 2 or stats['pending'] != 0:
+        print('Fail - expected the LED on after two timed outputs, got %s'%stats)
+    print('Timed outputs late by %.1fus on average, %.1fus at most'%(stats['late_avg'], stats['late_max']))
+    GPIO.output(LED_PIN, GPIO.LOW)
+
+    print('Waveform test...')
+    led = 1 << LED_GPIO   # the steps are masks of BCM gpio numbers
+    wave = GPIO.Waveform(array.array('I', [led, 0, 1000000, 0, led, 1000000]))
+    wave.play(repeat=20)
+    time.sleep(0.1)
+    status = GPIO.wave_status()
+    if status['playing'] or status['loops'] != 20 or status['steps'] != 40:
+        print('Fail - expected 20 passes of 2 steps, got %s'%status)
+
+    print('Timer test...')
+    ticks = []
+    timer = GPIO.Timer(1000, ticks.append, toggle=[LED_PIN], samples=8)
+    time.sleep(0.05)
+    timer.cancel()
+    if len(ticks) < 25 or any(b - a < 1000 for a, b in zip(ticks, ticks[1:])):
+        print('Fail - expected ticks at least 1000us apart, got %s'%len(ticks))
+
+    print('Thread configuration test...')
+    pwm = GPIO.PWM(LED_PIN, 50)
+    pwm.start(50)
+    time.sleep(0.05)
+    GPIO.set_thread_config(GPIO.THREAD_PWM, GPIO.SCHED_OTHER, cpus=[0])
+    config = GPIO.thread_config()['pwm']
+    pwm.stop()
+    if config['threads'] != 1 or config['cpus'] != [0] or config['failed'] != 0:
+        print('Fail - expected the PWM thread pinned to core 0, got %s'%config)
+    GPIO.set_thread_config(GPIO.THREAD_PWM, GPIO.SCHED_OTHER)
+    try:
+        GPIO.lock_memory(True)
+        locked = True
+    except RuntimeError:
+        locked = False
+    try:
+        import _xxsubinterpreters as interpreters
+    except ImportError:
+        interpreters = None
+    if locked and interpreters is not None:
+        # a prefault entry without mlock in RPI_GPIO_RT, applied as the module is imported again, keeps the lock
+        os.environ['RPI_GPIO_RT'] = 'prefault=8192'
+        interp = interpreters.create()
+        interpreters.run_string(interp, 'import RPi.GPIO')
+        interpreters.destroy(interp)
+        del os.environ['RPI_GPIO_RT']
+        config = GPIO.thread_config()
+        if not config['memory_locked'] or config['prefault'] != 8192:
+            print('Fail - RPI_GPIO_RT prefault entry unlocked the memory, got %s'%config)
+    if locked:
+        GPIO.lock_memory(False)
+
+    print('Pin object test...')
+    pin = GPIO.Pin(LED_PIN)
+    pin.high()
+    if pin.read() != GPIO.HIGH or GPIO.input(LED_PIN) != GPIO.HIGH:
+        print('Fail - Pin.high() did not set the output')
+    if pin.toggle() != GPIO.LOW or pin.read() != GPIO.LOW:
+        print('Fail - Pin.toggle() did not invert the output')
+    pin.write(True)
+    if GPIO.input(LED_PIN) != GPIO.HIGH:
+        print('Fail - Pin.write() did not set the output')
+    pin.low()
+    start = time.time()
+    for i in range(10000):
+        pin.toggle()
+    print('Pin toggles at %.0f per second'%(10000 / (time.time() - start)))
+
+    print('Subinterpreter test...')
+    try:
+        import _xxsubinterpreters as interpreters
+    except ImportError:
+        interpreters = None
+    if interpreters is not None:
+        interp = interpreters.create()
+        try:
+            interpreters.run_string(interp, """if True:
+                import time, RPi.GPIO as GPIO
+                GPIO.setmode(GPIO.BOARD)
+                GPIO.setwarnings(False)
+                calls = []
+                GPIO.simulate_events(%d, GPIO.BOTH, interval=200, count=50, callback=calls.append)
+                time.sleep(0.1)
+                assert len(calls) == 50, 'got %%s callbacks in the subinterpreter'%%len(calls)
+                """ % SWITCH_PIN)
+        except interpreters.RunFailedError as e:
+            print('Fail - %s'%e)
+        # the subinterpreter removes its callbacks as it ends
+        interpreters.destroy(interp)
+        GPIO.remove_event_detect(SWITCH_PIN)
+
+    print('Timestamped event test...')
+    events = []
+    GPIO.simulate_events(SWITCH_PIN, GPIO.BOTH, interval=500, count=20, callback=events.append, timestamped=True)
+    time.sleep(0.1)
+    GPIO.remove_event_detect(SWITCH_PIN)
+    if [ev.seq for ev in events] != list(range(1, 21)):
+        print('Fail - sequence numbers %s'%[ev.seq for ev in events])
+    for ev in events:
+        if ev.channel != SWITCH_PIN or ev.count != 1:
+            print('Fail - %s'%(ev,))
+        if ev.edge != (GPIO.RISING if ev.level else GPIO.FALLING):
+            print('Fail - edge does not match the level in %s'%(ev,))
+    if any(b.timestamp <= a.timestamp for a, b in zip(events, events[1:])):
+        print('Fail - timestamps are not increasing')
+
+    print('Concurrency stress test...')
+    errors = []
+    stop = time.time() + 1
+    def churn(action):
+        try:
+            while time.time() < stop:
+                action()
+        except Exception as e:
+            errors.append(e)
+    def pwm_restart():
+        pwm = GPIO.PWM(LED_PIN, 2000)
+        pwm.start(30)
+        pwm.ChangeDutyCycle(60)
+        pwm.stop()
+    def events_restart():
+        GPIO.simulate_events(SWITCH_PIN, GPIO.BOTH, interval=100, count=20, callback=lambda channel: None)
+        time.sleep(0.002)
+        GPIO.remove_event_detect(SWITCH_PIN)
+    actions = [pwm_restart, events_restart]
+    # only flip unconnected pins against the simulated register block
+    stress_pins = [13, 15, 16, 22] if os.environ.get('RPI_GPIO_SIMULATE') else []
+    for pin in stress_pins:
+        actions.append(lambda pin=pin: (GPIO.setup(pin, GPIO.OUT), GPIO.setup(pin, GPIO.IN)))
+    threads = [threading.Thread(target=churn, args=(action,)) for action in actions]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    for pin in stress_pins:
+        GPIO.setup(pin, GPIO.OUT if pin % 2 else GPIO.IN)
+        if GPIO.gpio_function(pin) != (GPIO.OUT if pin % 2 else GPIO.IN):
+            print('Fail - function of pin %s lost by a concurrent setup'%pin)
+    if errors:
+        print('Fail - concurrent calls raised %s'%errors)
+    GPIO.setup(LED_PIN, GPIO.OUT)
+
 def test_gpio_function():
     GPIO.setmode(GPIO.BCM)
     for chan in range(54):
@@ -204,6 +627,7 @@ while 1:
     print('P - Software PWM')
     print('H - Hardware PWM')
     print('S - Switchbounce')
+    print('T - Throughput (simulated events)')
     print('G - gpio_function')
     print('B - Board revision')
     print('W - Test warnings')
@@ -227,6 +651,8 @@ while 1:
         test_hard_pwm()
     elif command.startswith('S'):
         test_switchbounce()
+    elif command.startswith('T'):
+        test_simulated_events()
     elif command.startswith('G'):
         test_gpio_function()
     elif command.startswith('W'):